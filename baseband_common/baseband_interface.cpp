@@ -1,4 +1,10 @@
 #include "baseband_interface.h"
+#include <utils/flog.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace dsp
 {
@@ -21,4 +27,821 @@ namespace dsp
         else
             throw std::runtime_error("Unknown baseband type " + type);
     }
-}
\ No newline at end of file
+}
+namespace dsp
+{
+    void BasebandReader::set_file(std::string file_path, BasebandType format)
+    {
+        stopThreads();
+
+        // The workers are stopped, but the GUI may still be reading the stats
+        std::unique_lock<std::mutex> lck(main_mtx);
+
+        if (std::filesystem::is_fifo(file_path))
+        {
+            filesize = 1;
+            progress = 0;
+        }
+        else
+        {
+            filesize = getFilesize(file_path);
+            progress = 0;
+
+            is_wav |= wav::isValidWav(wav::parseHeaderFromFileWav(file_path));
+            is_wav |= wav::isValidRF64(wav::parseHeaderFromFileWav(file_path));
+        }
+
+        this->format = format;
+        input_file = std::ifstream(file_path, std::ios::binary);
+
+        ziqSeekable = false;
+        ziqFrameIdx = 0;
+        if (format == ZIQ)
+        {
+            ziqReader = std::make_shared<ziq::ziq_reader>(input_file);
+            ziqSeekable = ziqReader->is_seekable();
+        }
+
+        if (format == ZIQ2)
+            input_file.seekg(4);
+
+        // Find out the exact length when possible
+        index.clear();
+        total_samples = 0;
+        if (format == ZIQ2 && filesize > 1)
+        {
+            if (ziq2::ziq2_read_index(file_path, index))
+                total_samples = index.back().sample + index.back().nsamples;
+        }
+        else if (ziqSeekable)
+        {
+            total_samples = ziqReader->get_sample_count();
+        }
+        else if (format != ZIQ && filesize > 1)
+        {
+            total_samples = filesize / getSampleSize();
+        }
+        reader_sample = 0;
+        sample_position = 0;
+        seekSkip = 0;
+
+        // Reset the queue and start reading ahead
+        for (auto &blk : blocks)
+            blk.state = Block::FREE;
+        readIdx = 0;
+        writeIdx = 0;
+        decodeIdx = 0;
+        stopWorkers = false;
+        reachedEOF = false;
+        seekPending = false;
+        lastDecodedSamples = decodedSamples;
+        lastStatsTime = std::chrono::steady_clock::now();
+        lck.unlock();
+
+        readerThread = std::thread(&BasebandReader::readerWorker, this);
+        if (format == ZIQ2 || ziqSeekable)
+        {
+            int decoders = std::clamp<int>(std::thread::hardware_concurrency(), 1, BASEBAND_READER_MAX_DECODERS);
+            for (int i = 0; i < decoders; i++)
+                decoderThreads.emplace_back(&BasebandReader::decoderWorker, this);
+        }
+    }
+
+    BasebandReaderStats BasebandReader::get_stats()
+    {
+        std::lock_guard<std::mutex> lck(main_mtx);
+
+        // Average the rate over a second so it's readable
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastStatsTime).count();
+        if (elapsed >= 1.0)
+        {
+            uint64_t decoded = decodedSamples;
+            decodeRate = (double)(decoded - lastDecodedSamples) / (elapsed * 1e6);
+            lastDecodedSamples = decoded;
+            lastStatsTime = now;
+        }
+
+        BasebandReaderStats stats;
+        stats.decodeRate = decodeRate;
+        stats.queueFill = 0;
+        stats.queueSize = BASEBAND_READER_QUEUE_SIZE;
+        for (auto &blk : blocks)
+        {
+            if (blk.state == Block::READY && blk.generation == generation)
+                stats.queueFill++;
+        }
+        return stats;
+    }
+
+    void BasebandReader::stopThreads()
+    {
+        {
+            std::lock_guard<std::mutex> lck(main_mtx);
+            stopWorkers = true;
+        }
+        freeCnd.notify_all();
+        rawCnd.notify_all();
+        readyCnd.notify_all();
+        if (readerThread.joinable())
+            readerThread.join();
+        for (auto &thread : decoderThreads)
+            thread.join();
+        decoderThreads.clear();
+    }
+
+    void BasebandReader::readerWorker()
+    {
+        bool rewound = false;
+        std::unique_lock<std::mutex> lck(main_mtx);
+        while (true)
+        {
+            freeCnd.wait(lck, [this]()
+                         { return (blocks[writeIdx].state == Block::FREE && !reachedEOF) || seekPending || stopWorkers; });
+            if (stopWorkers)
+                return;
+
+            // Only this thread touches the file, so seeks requested by the UI are done here
+            if (seekPending)
+            {
+                bool bySample = seekBySample;
+                float targetProgress = seekProgress;
+                uint64_t targetSample = seekSample;
+                seekPending = false;
+                lck.unlock();
+                if (bySample)
+                    seekToSample(targetSample);
+                else
+                    seekToProgress(targetProgress);
+                lck.lock();
+                reachedEOF = false;
+                continue;
+            }
+
+            // Free blocks belong to the reader, no need to hold the lock while filling one
+            Block &blk = blocks[writeIdx];
+            uint64_t gen = generation;
+            lck.unlock();
+            bool ok = readBlock(blk);
+            lck.lock();
+
+            if (!ok)
+            {
+                // Loop back unless the file is empty
+                if (should_repeat && !rewound)
+                {
+                    lck.unlock();
+                    rewind();
+                    lck.lock();
+                    rewound = true;
+                    continue;
+                }
+                reachedEOF = true;
+                readyCnd.notify_all();
+                continue;
+            }
+            rewound = false;
+
+            blk.generation = gen;
+            blk.offset = std::min<int>(seekSkip, blk.count);
+            blk.firstSample = reader_sample;
+            reader_sample += blk.count;
+            seekSkip = 0;
+            writeIdx = (writeIdx + 1) % BASEBAND_READER_QUEUE_SIZE;
+            if (format == ZIQ2 || ziqSeekable)
+            {
+                blk.state = Block::RAW;
+                rawCnd.notify_one();
+            }
+            else
+            {
+                blk.state = Block::READY;
+                readyCnd.notify_all();
+            }
+        }
+    }
+
+    void BasebandReader::decoderWorker()
+    {
+        std::unique_lock<std::mutex> lck(main_mtx);
+        while (true)
+        {
+            rawCnd.wait(lck, [this]()
+                        { return blocks[decodeIdx].state == Block::RAW || stopWorkers; });
+            if (stopWorkers)
+                return;
+
+            // Claim the next packet in order, the following one can go to another decoder right away
+            Block &blk = blocks[decodeIdx];
+            blk.state = Block::DECODING;
+            decodeIdx = (decodeIdx + 1) % BASEBAND_READER_QUEUE_SIZE;
+            rawCnd.notify_one();
+            lck.unlock();
+
+            if (blk.samples.size() < (size_t)blk.count)
+                blk.samples.resize(blk.count);
+            int count = blk.count;
+            if (format == ZIQ)
+                count = ziqReader->decode_frame(blk.raw.data(), blk.raw.size(), blk.samples.data(), blk.count);
+            else
+                ziq2::ziq2_read_iq_pkt(blk.raw.data(), blk.samples.data(), &count);
+            blk.count = std::clamp<int>(count, 0, blk.count);
+            decodedSamples += blk.count;
+
+            lck.lock();
+            blk.state = Block::READY;
+            readyCnd.notify_all();
+        }
+    }
+
+    bool BasebandReader::readBlock(Block &blk)
+    {
+        int count = 0;
+        switch (format)
+        {
+        case CF_32:
+            if (blk.samples.size() < BASEBAND_READER_BLOCK_SIZE)
+                blk.samples.resize(BASEBAND_READER_BLOCK_SIZE);
+            input_file.read((char *)blk.samples.data(), BASEBAND_READER_BLOCK_SIZE * sizeof(complex_t));
+            count = input_file.gcount() / sizeof(complex_t);
+            break;
+
+        case WAV_16:
+        case IS_16:
+            if (blk.samples.size() < BASEBAND_READER_BLOCK_SIZE)
+                blk.samples.resize(BASEBAND_READER_BLOCK_SIZE);
+            input_file.read((char *)buffer_i16, BASEBAND_READER_BLOCK_SIZE * sizeof(int16_t) * 2);
+            count = input_file.gcount() / (sizeof(int16_t) * 2);
+            volk_16i_s32f_convert_32f_u((float *)blk.samples.data(), (const int16_t *)buffer_i16, 65535, count * 2);
+            break;
+
+        case IS_8:
+            if (blk.samples.size() < BASEBAND_READER_BLOCK_SIZE)
+                blk.samples.resize(BASEBAND_READER_BLOCK_SIZE);
+            input_file.read((char *)buffer_i8, BASEBAND_READER_BLOCK_SIZE * sizeof(int8_t) * 2);
+            count = input_file.gcount() / (sizeof(int8_t) * 2);
+            volk_8i_s32f_convert_32f_u((float *)blk.samples.data(), (const int8_t *)buffer_i8, 127, count * 2);
+            break;
+
+        case IU_8:
+            if (blk.samples.size() < BASEBAND_READER_BLOCK_SIZE)
+                blk.samples.resize(BASEBAND_READER_BLOCK_SIZE);
+            input_file.read((char *)buffer_u8, BASEBAND_READER_BLOCK_SIZE * sizeof(uint8_t) * 2);
+            count = input_file.gcount() / (sizeof(uint8_t) * 2);
+            getU8LUT().convert(buffer_u8, blk.samples.data(), count);
+            break;
+
+        case ZIQ:
+            // Seekable files are read frame by frame and decompressed by the decoder threads
+            if (ziqSeekable)
+            {
+                auto &frames = ziqReader->get_frames();
+                if (ziqFrameIdx >= frames.size())
+                    return false;
+                const ziq::ziq_frame &frame = frames[ziqFrameIdx++];
+                blk.raw.resize(frame.c_size);
+                input_file.seekg(ziqReader->get_data_start() + frame.c_offset);
+                input_file.read((char *)blk.raw.data(), frame.c_size);
+                if (input_file.gcount() < (std::streamsize)frame.c_size)
+                    return false;
+                count = frame.d_size / ziqReader->bytes_per_sample();
+                break;
+            }
+            if (blk.samples.size() < BASEBAND_READER_BLOCK_SIZE)
+                blk.samples.resize(BASEBAND_READER_BLOCK_SIZE);
+            if (input_file.eof())
+                return false;
+            ziqReader->read(blk.samples.data(), BASEBAND_READER_BLOCK_SIZE);
+            count = BASEBAND_READER_BLOCK_SIZE;
+            break;
+
+        case ZIQ2:
+            // Find the next IQ packet, only the framing is handled here, decoding is left to the decoder threads
+            while (true)
+            {
+                uint8_t sync[4];
+                input_file.read((char *)sync, 4);
+                if (input_file.gcount() < 4)
+                    return false;
+                while (!(sync[0] == 0x1a && sync[1] == 0xcf && sync[2] == 0xfc && sync[3] == 0x1d))
+                {
+                    memmove(&sync[0], &sync[1], 3);
+                    input_file.read((char *)&sync[3], 1);
+                    if (input_file.gcount() < 1)
+                        return false;
+                }
+
+                ziq2::ziq2_pkt_hdr_t mdr;
+                input_file.read((char *)&mdr, sizeof(ziq2::ziq2_pkt_hdr_t));
+                if (input_file.gcount() < (std::streamsize)sizeof(ziq2::ziq2_pkt_hdr_t))
+                    return false;
+                if (mdr.pkt_size > (size_t)STREAM_BUFFER_SIZE * sizeof(complex_t) * 2)
+                    continue;
+
+                blk.raw.resize(sizeof(ziq2::ziq2_pkt_hdr_t) + mdr.pkt_size);
+                memcpy(blk.raw.data(), &mdr, sizeof(ziq2::ziq2_pkt_hdr_t));
+                input_file.read((char *)&blk.raw[sizeof(ziq2::ziq2_pkt_hdr_t)], mdr.pkt_size);
+                if (input_file.gcount() < (std::streamsize)mdr.pkt_size)
+                    return false;
+
+                if (mdr.pkt_type != ziq2::ZIQ2_PKT_IQ)
+                    continue;
+                count = ziq2::ziq2_get_iq_pkt_count(blk.raw.data());
+                if (count > 0 && count <= STREAM_BUFFER_SIZE)
+                    break;
+            }
+            break;
+
+        default:
+            return false;
+        }
+
+        if (count <= 0)
+            return false;
+        blk.count = count;
+        if (format != ZIQ2 && !ziqSeekable)
+            decodedSamples += count;
+
+        std::streamoff pos = input_file.tellg();
+        blk.filePos = (pos < 0) ? filesize : pos;
+        return true;
+    }
+
+    void BasebandReader::rewind()
+    {
+        reader_sample = 0;
+        ziqFrameIdx = 0;
+        input_file.clear();
+        input_file.seekg(0);
+
+        if (format == ZIQ2)
+            input_file.seekg(4);
+    }
+
+    int BasebandReader::getSampleSize()
+    {
+        switch (format)
+        {
+        case WAV_16:
+        case IS_16:
+            return sizeof(int16_t) * 2;
+
+        case IS_8:
+            return sizeof(int8_t) * 2;
+
+        case IU_8:
+            return sizeof(uint8_t) * 2;
+
+        default:
+            return sizeof(complex_t);
+        }
+    }
+
+    void BasebandReader::seekToSample(uint64_t sample)
+    {
+        input_file.clear();
+
+        if (format == ZIQ2)
+        {
+            // Find the packet holding the sample, the samples before it are skipped once it's read
+            auto it = std::upper_bound(index.begin(), index.end(), sample, [](uint64_t s, const ziq2::ziq2_index_entry_t &e)
+                                       { return s < e.sample; });
+            if (it != index.begin())
+                it--;
+            input_file.seekg(it->offset);
+            reader_sample = it->sample;
+            seekSkip = sample - it->sample;
+            return;
+        }
+
+        if (ziqSeekable)
+        {
+            uint64_t bps = ziqReader->bytes_per_sample();
+            auto &frames = ziqReader->get_frames();
+            auto it = std::upper_bound(frames.begin(), frames.end(), sample * bps, [](uint64_t b, const ziq::ziq_frame &f)
+                                       { return b < f.d_offset; });
+            if (it != frames.begin())
+                it--;
+            ziqFrameIdx = it - frames.begin();
+            reader_sample = it->d_offset / bps;
+            seekSkip = sample - reader_sample;
+            return;
+        }
+
+        input_file.seekg(sample * getSampleSize());
+        reader_sample = sample;
+    }
+
+    void BasebandReader::seekToProgress(float progress)
+    {
+        input_file.clear();
+
+        if (format == ZIQ2)
+        {
+            // No index, look for the next sync word after the position
+            uint64_t pos = filesize * (progress / 100.0f);
+            std::vector<uint8_t> buf(65536 + 3);
+            input_file.seekg(pos);
+            while (true)
+            {
+                input_file.read((char *)buf.data(), buf.size());
+                int len = input_file.gcount();
+                int i;
+                for (i = 0; i + 3 < len; i++)
+                {
+                    if (buf[i] == 0x1a && buf[i + 1] == 0xcf && buf[i + 2] == 0xfc && buf[i + 3] == 0x1d)
+                        break;
+                }
+                if (i + 3 < len)
+                {
+                    pos += i;
+                    break;
+                }
+                if (len < (int)buf.size())
+                {
+                    pos = filesize;
+                    break;
+                }
+
+                // Overlap chunks so that a sync word across the boundary isn't missed
+                pos += len - 3;
+                input_file.seekg(pos);
+            }
+            input_file.clear();
+            input_file.seekg(pos);
+            return;
+        }
+
+        int samplesize = getSampleSize();
+        uint64_t position = double(filesize / samplesize - 1) * (progress / 100.0f);
+        input_file.seekg(position * samplesize);
+        reader_sample = position;
+    }
+
+    std::string BasebandWriter::start_recording(std::string path_without_ext, uint64_t samplerate, int depth, bool override_filename)
+    {
+        std::lock_guard<std::mutex> lck(rec_mutex);
+
+        bit_depth = depth;
+
+        std::string finalt;
+        if (d_sample_format == CF_32)
+            finalt = path_without_ext + ".f32";
+        else if (d_sample_format == IS_16)
+            finalt = path_without_ext + ".s16";
+        else if (d_sample_format == IS_8)
+            finalt = path_without_ext + ".s8";
+        else if (d_sample_format == WAV_16)
+            finalt = path_without_ext + ".wav";
+        // #ifdef BUILD_ZIQ
+        else if (d_sample_format == ZIQ)
+            finalt = path_without_ext + ".ziq";
+        // #endif
+        else if (d_sample_format == ZIQ2)
+            finalt = path_without_ext + ".ziq";
+
+        if (write_sigmf && is_raw())
+            finalt = path_without_ext + ".sigmf-data";
+
+        if (override_filename)
+            finalt = path_without_ext;
+
+        current_size_out = 0;
+        current_size_out_raw = 0;
+        index_path.clear();
+
+        // The buffer has to be set before opening, everything then reaches the disk in large writes
+        output_file = std::ofstream();
+        output_file.rdbuf()->pubsetbuf((char *)write_buffer, BASEBAND_WRITER_WRITE_SIZE);
+        output_file.open(finalt, std::ios::binary);
+        output_path = finalt;
+        if (!output_file.is_open())
+        {
+            flog::error("Failed to open file for recording: {0}", finalt);
+            return "";
+        }
+
+#ifdef __linux__
+        // Reserve the space without changing the file size, what isn't used is given back when stopping
+        if (preallocate_size)
+        {
+            int fd = open(finalt.c_str(), O_WRONLY);
+            if (fd < 0 || fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, preallocate_size))
+                flog::warn("Could not preallocate {0} bytes for {1}", preallocate_size, finalt);
+            if (fd >= 0)
+                close(fd);
+        }
+#endif
+
+        if (d_sample_format == WAV_16)
+        {
+            wav_writer = std::make_unique<WavWriter>(output_file);
+            wav_writer->write_header(samplerate, 2);
+        }
+
+        if (write_sigmf && is_raw())
+        {
+            std::string datatype = (d_sample_format == CF_32) ? "cf32_le" : ((d_sample_format == IS_16) ? "ci16_le" : "ci8");
+            if (!sigmf_meta.open(path_without_ext + ".sigmf-meta", datatype, samplerate, 1, frequency))
+            {
+                output_file.close();
+                return "";
+            }
+        }
+
+        // #ifdef BUILD_ZIQ
+        if (d_sample_format == ZIQ)
+        {
+            ziqcfg.is_compressed = true;
+            ziqcfg.bits_per_sample = depth;
+            ziqcfg.samplerate = samplerate;
+            ziqcfg.annotation = "";
+            ziqcfg.frame_samples = ZIQ_DEFAULT_FRAME_SAMPLES;
+
+            ziqWriter = std::make_shared<ziq::ziq_writer>(ziqcfg, output_file);
+        }
+        // #endif
+        // #ifdef BUILD_ZIQ2
+        if (d_sample_format == ZIQ2)
+        {
+            uint8_t hdr[64];
+            int sz = ziq2::ziq2_write_file_hdr(hdr, samplerate);
+            output_file.write((char *)hdr, sz);
+            ziq2_offset = sz;
+            ziq2_sample = 0;
+
+            if (write_index)
+            {
+                index_path = ziq2::ziq2_index_path(finalt);
+                index_file = std::ofstream(index_path, std::ios::binary);
+                ziq2::ziq2_write_index_hdr(index_file);
+            }
+        }
+        // #endif
+
+        // Reset the queue and start the workers
+        for (auto &blk : blocks)
+            blk.state = Block::FREE;
+        write_idx = 0;
+        encode_idx = 0;
+        read_idx = 0;
+        queued_blocks = 0;
+        queued_samples = 0;
+        queued_total = 0;
+        max_queued_blocks = 0;
+        dropped_blocks = 0;
+        dropped_samples = 0;
+        stop_workers = false;
+
+        writer_thread = std::thread(&BasebandWriter::writerWorker, this);
+        if (needs_encoding())
+        {
+            int encoders = std::clamp<int>(std::thread::hardware_concurrency(), 1, BASEBAND_WRITER_MAX_ENCODERS);
+            for (int i = 0; i < encoders; i++)
+                encoder_threads.emplace_back(&BasebandWriter::encoderWorker, this);
+        }
+
+        should_work = true;
+
+        return finalt;
+    }
+
+    void BasebandWriter::stop_recording()
+    {
+        std::lock_guard<std::mutex> lck(rec_mutex);
+        if (!should_work)
+            return;
+
+        // Stop taking samples, then let the workers drain the queue
+        {
+            std::unique_lock<std::mutex> qlck(queue_mtx);
+            should_work = false;
+            free_cnd.wait(qlck, [this]()
+                          { return queued_blocks == 0; });
+        }
+        stopThreads();
+
+        if (d_sample_format == ZIQ && ziqWriter)
+            ziqWriter->finish();
+        if (d_sample_format == WAV_16)
+            wav_writer->finish_header(get_written());
+
+        if (dropped_blocks)
+            flog::warn("Recording dropped {0} blocks ({1} samples), the disk couldn't keep up", dropped_blocks, dropped_samples);
+
+        output_file.close();
+        if (index_file.is_open())
+            index_file.close();
+        sigmf_meta.close();
+
+#ifdef __linux__
+        // Give back the preallocated space that wasn't used
+        if (preallocate_size)
+        {
+            std::error_code ec;
+            uintmax_t size = std::filesystem::file_size(output_path, ec);
+            if (!ec)
+                std::filesystem::resize_file(output_path, size, ec);
+        }
+#endif
+
+        current_size_out = 0;
+        current_size_out_raw = 0;
+    }
+
+    void BasebandWriter::discard_recording()
+    {
+        if (!should_work)
+            return;
+
+        // The metadata is deleted before it gets its final write
+        sigmf_meta.discard();
+        stop_recording();
+
+        std::error_code ec;
+        std::filesystem::remove(output_path, ec);
+        if (!index_path.empty())
+            std::filesystem::remove(index_path, ec);
+    }
+
+    void BasebandWriter::feed_samples(complex_t *samples, int nsamples)
+    {
+        if (nsamples <= 0 || !should_work)
+            return;
+
+        // Only this thread fills blocks, so the lock is never held for long
+        std::unique_lock<std::mutex> lck(queue_mtx);
+        Block &blk = blocks[write_idx];
+        if (blk.state != Block::FREE || queued_samples + nsamples > BASEBAND_WRITER_MAX_QUEUED)
+        {
+            dropped_blocks++;
+            dropped_samples += nsamples;
+            return;
+        }
+        lck.unlock();
+
+        if (blk.samples.size() < (size_t)nsamples)
+            blk.samples.resize(nsamples);
+        memcpy(blk.samples.data(), samples, nsamples * sizeof(complex_t));
+        blk.count = nsamples;
+
+        lck.lock();
+        if (!should_work)
+            return;
+        write_idx = (write_idx + 1) % BASEBAND_WRITER_QUEUE_SIZE;
+        queued_blocks++;
+        queued_samples += nsamples;
+        queued_total += nsamples;
+        max_queued_blocks = std::max<int>(max_queued_blocks, queued_blocks);
+        if (needs_encoding())
+        {
+            blk.state = Block::RAW;
+            raw_cnd.notify_one();
+        }
+        else
+        {
+            blk.state = Block::ENCODED;
+            encoded_cnd.notify_one();
+        }
+    }
+
+    BasebandWriterStats BasebandWriter::get_stats()
+    {
+        std::lock_guard<std::mutex> lck(queue_mtx);
+        BasebandWriterStats stats;
+        stats.queueFill = queued_blocks;
+        stats.maxQueueFill = max_queued_blocks;
+        stats.queueSize = BASEBAND_WRITER_QUEUE_SIZE;
+        stats.droppedBlocks = dropped_blocks;
+        stats.droppedSamples = dropped_samples;
+        return stats;
+    }
+
+    void BasebandWriter::stopThreads()
+    {
+        {
+            std::lock_guard<std::mutex> lck(queue_mtx);
+            stop_workers = true;
+        }
+        raw_cnd.notify_all();
+        encoded_cnd.notify_all();
+        if (writer_thread.joinable())
+            writer_thread.join();
+        for (auto &thread : encoder_threads)
+            thread.join();
+        encoder_threads.clear();
+    }
+
+    void BasebandWriter::encoderWorker()
+    {
+        std::vector<float> mag_buffer;
+        std::unique_lock<std::mutex> lck(queue_mtx);
+        while (true)
+        {
+            raw_cnd.wait(lck, [this]()
+                         { return blocks[encode_idx].state == Block::RAW || stop_workers; });
+            if (stop_workers)
+                return;
+
+            // Claim the next block in order, the following one can go to another encoder right away
+            Block &blk = blocks[encode_idx];
+            blk.state = Block::ENCODING;
+            encode_idx = (encode_idx + 1) % BASEBAND_WRITER_QUEUE_SIZE;
+            raw_cnd.notify_one();
+            lck.unlock();
+
+            if (mag_buffer.size() < (size_t)blk.count)
+                mag_buffer.resize(blk.count);
+            encodeBlock(blk, mag_buffer.data());
+
+            lck.lock();
+            blk.state = Block::ENCODED;
+            encoded_cnd.notify_all();
+        }
+    }
+
+    void BasebandWriter::writerWorker()
+    {
+        std::unique_lock<std::mutex> lck(queue_mtx);
+        while (true)
+        {
+            encoded_cnd.wait(lck, [this]()
+                             { return blocks[read_idx].state == Block::ENCODED || stop_workers; });
+            if (stop_workers)
+                return;
+
+            // Encoded blocks belong to the writer until freed
+            Block &blk = blocks[read_idx];
+            lck.unlock();
+            writeBlock(blk);
+            lck.lock();
+
+            blk.state = Block::FREE;
+            read_idx = (read_idx + 1) % BASEBAND_WRITER_QUEUE_SIZE;
+            queued_blocks--;
+            queued_samples -= blk.count;
+            free_cnd.notify_all();
+        }
+    }
+
+    void BasebandWriter::encodeBlock(Block &blk, float *mag_buffer)
+    {
+        int nsamples = blk.count;
+        if (d_sample_format == IS_16 || d_sample_format == WAV_16)
+        {
+            blk.size = nsamples * sizeof(int16_t) * 2;
+            if (blk.data.size() < (size_t)blk.size)
+                blk.data.resize(blk.size);
+            volk_32f_s32f_convert_16i((int16_t *)blk.data.data(), (float *)blk.samples.data(), 65535, nsamples * 2);
+        }
+        else if (d_sample_format == IS_8)
+        {
+            blk.size = nsamples * sizeof(int8_t) * 2;
+            if (blk.data.size() < (size_t)blk.size)
+                blk.data.resize(blk.size);
+            volk_32f_s32f_convert_8i((int8_t *)blk.data.data(), (float *)blk.samples.data(), 127, nsamples * 2);
+        }
+        // #ifdef BUILD_ZIQ2
+        else if (d_sample_format == ZIQ2)
+        {
+            // Packets are never bigger than the float samples, whatever the bit depth or codec
+            size_t max_size = nsamples * sizeof(complex_t) + 64;
+            if (blk.data.size() < max_size)
+                blk.data.resize(max_size);
+            blk.size = ziq2::ziq2_write_iq_pkt(blk.data.data(), blk.samples.data(), mag_buffer, nsamples, bit_depth);
+        }
+        // #endif
+    }
+
+    void BasebandWriter::writeBlock(Block &blk)
+    {
+        if (d_sample_format == CF_32)
+        {
+            output_file.write((char *)blk.samples.data(), blk.count * sizeof(complex_t));
+            current_size_out += blk.count * sizeof(complex_t);
+        }
+        // #ifdef BUILD_ZIQ
+        else if (d_sample_format == ZIQ)
+        {
+            // The stream is sequential, zstd spreads the compression over its own workers
+            current_size_out += ziqWriter->write(blk.samples.data(), blk.count);
+            current_size_out_raw += (ziqcfg.bits_per_sample / 4) * blk.count;
+        }
+        // #endif
+        else
+        {
+            output_file.write((char *)blk.data.data(), blk.size);
+            current_size_out += blk.size;
+
+            // #ifdef BUILD_ZIQ2
+            if (d_sample_format == ZIQ2)
+            {
+                if (index_file.is_open())
+                    ziq2::ziq2_write_index_entry(index_file, ziq2_offset, ziq2_sample, blk.count);
+                ziq2_offset += blk.size;
+                ziq2_sample += blk.count;
+            }
+            // #endif
+        }
+    }
+}
@@ -3,15 +3,43 @@
 #include <fstream>
 #include <filesystem>
 #include <dsp/types.h>
+#include <dsp/convert/int_to_complex.h>
 #include "wav.h"
 #include "ziq.h"
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <vector>
 #include <signal_path/signal_path.h>
+#include <utils/sigmf.h>
 
 #include "ziq2.h"
 
 #include "wav_writer.h"
 
+// Number of blocks the reader keeps ahead of the DSP
+#define BASEBAND_READER_QUEUE_SIZE      16
+
+// Samples per block for formats that aren't packetized
+#define BASEBAND_READER_BLOCK_SIZE      65536
+
+// Upper limit of threads decoding ZIQ2 packets in parallel
+#define BASEBAND_READER_MAX_DECODERS    4
+
+// Number of blocks the writer can hold between the DSP and the disk
+#define BASEBAND_WRITER_QUEUE_SIZE      64
+
+// Upper limit of samples waiting to be written, new blocks are dropped past that
+#define BASEBAND_WRITER_MAX_QUEUED      (16 * 1024 * 1024)
+
+// Upper limit of threads quantizing and compressing blocks in parallel
+#define BASEBAND_WRITER_MAX_ENCODERS    4
+
+// Size of the file buffer, the disk only sees writes this big
+#define BASEBAND_WRITER_WRITE_SIZE      (4 * 1024 * 1024)
+
 typedef dsp::complex_t complex_t;
 
 inline size_t getFilesize(std::string filepath) {
@@ -35,7 +63,14 @@ namespace dsp {
 
     BasebandType basebandTypeFromString(std::string type);
 
-    // "Simple" class to wrap all the baseband reading stuff, including sample scaling. All inline for performance
+    struct BasebandReaderStats {
+        double decodeRate; // In MS/s
+        int queueFill;
+        int queueSize;
+    };
+
+    // "Simple" class to wrap all the baseband reading stuff, including sample scaling.
+    // A background thread reads and decodes ahead of the DSP, ZIQ2 packets being decoded in parallel.
     class BasebandReader {
     public:
         // File stuff
@@ -43,28 +78,93 @@ namespace dsp {
         size_t progress;
         std::ifstream input_file;
 
-        // Control
-        bool should_repeat = false;
+        // Control, set before set_file()
+        std::atomic<bool> should_repeat = false;
 
     private:
+        struct Block {
+            enum State {
+                FREE,
+                RAW,
+                DECODING,
+                READY
+            };
+            State state = FREE;
+            std::vector<uint8_t> raw;
+            std::vector<complex_t> samples;
+            int count = 0;
+            int offset = 0;
+            size_t filePos = 0;
+            uint64_t firstSample = 0;
+            uint64_t generation = 0;
+        };
+
         // Main mutex
         std::mutex main_mtx;
 
         // Format
-        BasebandType format;
+        BasebandType format = NONE;
 
         // Buffers
         int16_t* buffer_i16;
         int8_t* buffer_i8;
         uint8_t* buffer_u8;
 
+        // Shared by every reader, only built the first time an U8 file is read
+        static dsp::convert::int_to_complex::U8LUT& getU8LUT() {
+            static dsp::convert::int_to_complex::U8LUT lut(127.0f, 127.0f);
+            return lut;
+        }
+
 
         std::shared_ptr<ziq::ziq_reader> ziqReader;
+        bool ziqSeekable = false;
+        size_t ziqFrameIdx = 0;
 
 
         // Wav handling
         bool is_wav = false;
 
+        // Read-ahead queue, blocks are filled, decoded and consumed in file order
+        Block blocks[BASEBAND_READER_QUEUE_SIZE];
+        int readIdx = 0;
+        int writeIdx = 0;
+        int decodeIdx = 0;
+        std::condition_variable freeCnd;
+        std::condition_variable rawCnd;
+        std::condition_variable readyCnd;
+        bool stopWorkers = false;
+        bool reachedEOF = false;
+        uint64_t generation = 0;
+        bool seekPending = false;
+        bool seekBySample = false;
+        float seekProgress = 0;
+        uint64_t seekSample = 0;
+        int seekSkip = 0;
+
+        // Sample positions, exact for raw formats, seekable ZIQ and indexed ZIQ2 files
+        std::vector<ziq2::ziq2_index_entry_t> index;
+        uint64_t total_samples = 0;
+        uint64_t reader_sample = 0;
+        uint64_t sample_position = 0;
+        std::thread readerThread;
+        std::vector<std::thread> decoderThreads;
+
+        // Stats
+        std::atomic<uint64_t> decodedSamples = 0;
+        uint64_t lastDecodedSamples = 0;
+        std::chrono::steady_clock::time_point lastStatsTime;
+        double decodeRate = 0;
+
+        void readerWorker();
+        void decoderWorker();
+        bool readBlock(Block& blk);
+        int getSampleSize();
+        void seekToProgress(float progress);
+        void seekToSample(uint64_t sample);
+        void rewind();
+        void stopThreads();
+
     public:
         BasebandReader() {
             buffer_i16 = dsp::buffer::alloc<int16_t>(STREAM_BUFFER_SIZE * 2);
@@ -73,180 +173,141 @@ namespace dsp {
         }
 
         ~BasebandReader() {
+            stopThreads();
             volk_free(buffer_i16);
             volk_free(buffer_i8);
             volk_free(buffer_u8);
         }
 
-        // Set the file you want to work on
-        inline void set_file(std::string file_path, BasebandType format) {
-            main_mtx.lock();
-            if (std::filesystem::is_fifo(file_path)) {
-                filesize = 1;
-                progress = 0;
-            }
-            else {
-                filesize = getFilesize(file_path);
-                progress = 0;
-
-                is_wav |= wav::isValidWav(wav::parseHeaderFromFileWav(file_path));
-                is_wav |= wav::isValidRF64(wav::parseHeaderFromFileWav(file_path));
-            }
-
-            this->format = format;
-            input_file = std::ifstream(file_path, std::ios::binary);
-
-            if (format == ZIQ)
-                ziqReader = std::make_shared<ziq::ziq_reader>(input_file);
-
-            if (format == ZIQ2)
-                input_file.seekg(4);
-
-            main_mtx.unlock();
-        }
+        // Set the file you want to work on, this starts reading ahead
+        void set_file(std::string file_path, BasebandType format);
 
+        // Get at most buffer_size samples, waits for the reader if it is behind
         inline int read_samples(complex_t* output_buffer, int buffer_size) {
-            main_mtx.lock();
-            if (should_repeat && input_file.eof()) {
-                input_file.clear();
-                input_file.seekg(0);
-
-                if (format == ZIQ2)
-                    input_file.seekg(4);
-            }
-
-            switch (format) {
-            case CF_32:
-                input_file.read((char*)output_buffer, buffer_size * sizeof(complex_t));
-                break;
-
-            case WAV_16:
-            case IS_16:
-                input_file.read((char*)buffer_i16, buffer_size * sizeof(int16_t) * 2);
-                volk_16i_s32f_convert_32f_u((float*)output_buffer, (const int16_t*)buffer_i16, 65535, buffer_size * 2);
-                break;
-
-            case IS_8:
-                input_file.read((char*)buffer_i8, buffer_size * sizeof(int8_t) * 2);
-                volk_8i_s32f_convert_32f_u((float*)output_buffer, (const int8_t*)buffer_i8, 127, buffer_size * 2);
-                break;
-
-            case IU_8:
-                input_file.read((char*)buffer_u8, buffer_size * sizeof(uint8_t) * 2);
-                for (int i = 0; i < buffer_size; i++) {
-                    float imag = (buffer_u8[i * 2 + 1] - 127) * (1.0 / 127.0);
-                    float real = (buffer_u8[i * 2 + 0] - 127) * (1.0 / 127.0);
-                    output_buffer[i].re = real;
-                    output_buffer[i].im = imag;
+            std::unique_lock<std::mutex> lck(main_mtx);
+            while (true) {
+                readyCnd.wait(lck, [this]() { return blocks[readIdx].state == Block::READY || (reachedEOF && blocks[readIdx].state == Block::FREE) || stopWorkers; });
+                if (blocks[readIdx].state != Block::READY) { return 0; }
+
+                // Drop anything read before a seek as well as empty blocks
+                Block& blk = blocks[readIdx];
+                if (blk.generation != generation || blk.offset >= blk.count) {
+                    blk.state = Block::FREE;
+                    readIdx = (readIdx + 1) % BASEBAND_READER_QUEUE_SIZE;
+                    freeCnd.notify_all();
+                    continue;
                 }
-                break;
-
-            case ZIQ:
-                ziqReader->read(output_buffer, buffer_size);
-                break;
-
-            case ZIQ2: {
-                input_file.read((char*)buffer_u8, 4 + sizeof(ziq2::ziq2_pkt_hdr_t));
-                ziq2::ziq2_pkt_hdr_t* mdr = (ziq2::ziq2_pkt_hdr_t*)&buffer_u8[4];
-                input_file.read((char*)&buffer_u8[4 + sizeof(ziq2::ziq2_pkt_hdr_t)], mdr->pkt_size);
-
-                if (mdr->pkt_type == ziq2::ZIQ2_PKT_IQ)
-                    ziq2::ziq2_read_iq_pkt(&buffer_u8[4], output_buffer, &buffer_size);
-                else
-                    buffer_size = 0;
-            } break;
 
-            default:
-                break;
+                int count = std::min<int>(buffer_size, blk.count - blk.offset);
+                memcpy(output_buffer, &blk.samples[blk.offset], count * sizeof(complex_t));
+                blk.offset += count;
+                progress = blk.filePos;
+                sample_position = blk.firstSample + blk.offset;
+                if (blk.offset >= blk.count) {
+                    blk.state = Block::FREE;
+                    readIdx = (readIdx + 1) % BASEBAND_READER_QUEUE_SIZE;
+                    freeCnd.notify_all();
+                }
+                return count;
             }
-
-            // if (is_wav)
-            //     for (int i = 0; i < buffer_size; i++)
-            //         output_buffer[i] = complex_t(output_buffer[i].imag, output_buffer[i].real);
-
-            progress = input_file.tellg();
-
-            main_mtx.unlock();
-
-            return buffer_size;
         }
 
-        inline void set_progress(size_t progress) {
-            if (format == ZIQ)
+        // Seek to a percentage of the file, done asynchronously by the reader
+        inline void set_progress(float progress) {
+            if (format == ZIQ && !ziqSeekable)
                 return;
 
-            if (format == ZIQ2) {
-                main_mtx.lock();
-                size_t pos = filesize * (progress / 100.0f);
-                uint8_t sync[4];
-                while (pos < filesize) {
-                    input_file.seekg(pos);
-                    input_file.read((char*)sync, 4);
-                    if (sync[0] == 0x1a && sync[1] == 0xcf && sync[2] == 0xfc && sync[3] == 0x1d)
-                        break;
-                    pos++;
-                }
-                input_file.seekg(pos);
-                main_mtx.unlock();
+            // Go through the exact sample position when possible
+            if (total_samples) {
+                seek_samples(double(total_samples) * (progress / 100.0));
                 return;
             }
 
-            main_mtx.lock();
-
-            int samplesize = sizeof(complex_t);
-
-            switch (format) {
-            case CF_32:
-                samplesize = sizeof(complex_t);
-                break;
+            std::lock_guard<std::mutex> lck(main_mtx);
+            seekPending = true;
+            seekBySample = false;
+            seekProgress = progress;
+            generation++;
+            freeCnd.notify_all();
+        }
 
-            case WAV_16:
-            case IS_16:
-                samplesize = sizeof(int16_t) * 2;
-                break;
+        // Seek to an exact sample, only for raw formats, seekable ZIQ and indexed ZIQ2 files
+        inline void seek_samples(uint64_t sample) {
+            if (!total_samples)
+                return;
 
-            case IS_8:
-                samplesize = sizeof(int8_t) * 2;
-                break;
+            std::lock_guard<std::mutex> lck(main_mtx);
+            seekPending = true;
+            seekBySample = true;
+            seekSample = std::min<uint64_t>(sample, total_samples - 1);
+            generation++;
+            freeCnd.notify_all();
+        }
 
-            case IU_8:
-                samplesize = sizeof(uint8_t) * 2;
-                break;
+        // Total length in samples, 0 if unknown
+        inline uint64_t get_sample_count() {
+            return total_samples;
+        }
 
-            default:
-                break;
-            }
+        inline uint64_t get_sample_position() {
+            return sample_position;
+        }
 
-            uint64_t position = double(filesize / samplesize - 1) * (progress / 100.0f);
-            input_file.seekg(position * samplesize);
-            main_mtx.unlock();
+        inline bool has_index() {
+            return !index.empty();
         }
 
+        BasebandReaderStats get_stats();
+
         inline void close() {
+            stopThreads();
             input_file.close();
         }
 
         inline bool is_eof() {
-            if (input_file.is_open())
-                return input_file.eof();
-            else
-                return false;
+            std::lock_guard<std::mutex> lck(main_mtx);
+            return reachedEOF && blocks[readIdx].state == Block::FREE;
         }
     };
 
+    struct BasebandWriterStats {
+        int queueFill;
+        int maxQueueFill; // High-water mark since the start of the recording
+        int queueSize;
+        uint64_t droppedBlocks;
+        uint64_t droppedSamples;
+    };
+
+    // Records the samples to a file. The DSP only queues blocks, a pool of threads quantizes
+    // or compresses them in parallel and a writer thread puts them to disk in order.
+    // If the disk can't keep up, blocks are dropped instead of stalling the DSP.
     class BasebandWriter {
     private:
+        struct Block {
+            enum State {
+                FREE,
+                RAW,
+                ENCODING,
+                ENCODED
+            };
+            State state = FREE;
+            std::vector<complex_t> samples;
+            int count = 0;
+            std::vector<uint8_t> data;
+            int size = 0;
+        };
+
         std::mutex rec_mutex;
 
         BasebandType d_sample_format;
 
         std::ofstream output_file;
+        std::string output_path;
+        uint8_t* write_buffer;
+        uint64_t preallocate_size = 0;
 
-        size_t current_size_out = 0;
-        size_t current_size_out_raw = 0;
-
-        int8_t* buffer_s8;
-        int16_t* buffer_s16;
+        std::atomic<size_t> current_size_out = 0;
+        std::atomic<size_t> current_size_out_raw = 0;
 
         int bit_depth = 0;
 
@@ -255,90 +316,104 @@ namespace dsp {
         std::shared_ptr<ziq::ziq_writer> ziqWriter;
         // #endif
 
-        float* mag_buffer = nullptr;
-
         std::unique_ptr<WavWriter> wav_writer;
 
-        bool should_work = false;
+        // ZIQ2 packet index
+        bool write_index = false;
+        std::ofstream index_file;
+        std::string index_path;
+        uint64_t ziq2_offset = 0;
+        uint64_t ziq2_sample = 0;
+
+        // SigMF metadata, the samples are counted as they are queued to know where a retune happened
+        bool write_sigmf = false;
+        sigmf::MetaWriter sigmf_meta;
+        std::atomic<double> frequency = 0.0;
+        std::atomic<uint64_t> queued_total = 0;
+
+        // Write queue, blocks are encoded out of order but always written in order
+        std::mutex queue_mtx;
+        Block blocks[BASEBAND_WRITER_QUEUE_SIZE];
+        int write_idx = 0;
+        int encode_idx = 0;
+        int read_idx = 0;
+        int queued_blocks = 0;
+        int queued_samples = 0;
+        std::condition_variable raw_cnd;
+        std::condition_variable encoded_cnd;
+        std::condition_variable free_cnd;
+        bool stop_workers = false;
+        std::thread writer_thread;
+        std::vector<std::thread> encoder_threads;
+
+        // Stats
+        int max_queued_blocks = 0;
+        uint64_t dropped_blocks = 0;
+        uint64_t dropped_samples = 0;
+
+        std::atomic<bool> should_work = false;
+
+        bool is_raw() {
+            return d_sample_format == CF_32 || d_sample_format == IS_16 || d_sample_format == IS_8;
+        }
+
+        bool needs_encoding() {
+            return d_sample_format == IS_16 || d_sample_format == WAV_16 || d_sample_format == IS_8 || d_sample_format == ZIQ2;
+        }
+
+        void encoderWorker();
+        void writerWorker();
+        void encodeBlock(Block& blk, float* mag_buffer);
+        void writeBlock(Block& blk);
+        void stopThreads();
 
     public:
         BasebandWriter() {
-            buffer_s8 = dsp::buffer::alloc<int8_t>(STREAM_BUFFER_SIZE * 2);
-            buffer_s16 = dsp::buffer::alloc<int16_t>(STREAM_BUFFER_SIZE * 2);
+            write_buffer = dsp::buffer::alloc<uint8_t>(BASEBAND_WRITER_WRITE_SIZE);
         }
 
         ~BasebandWriter() {
-            volk_free(buffer_s8);
-            volk_free(buffer_s16);
-            if (mag_buffer != nullptr)
-                volk_free(mag_buffer);
+            if (should_work)
+                stop_recording();
+            volk_free(write_buffer);
         }
 
         void set_output_sample_type(BasebandType sample_format) {
             d_sample_format = sample_format;
         }
 
-        std::string start_recording(std::string path_without_ext, uint64_t samplerate, int depth = 0, bool override_filename = false) // Depth is only for compressed non-raw formats
-        {
-            rec_mutex.lock();
-
-            bit_depth = depth;
-
-            std::string finalt;
-            if (d_sample_format == CF_32)
-                finalt = path_without_ext + ".f32";
-            else if (d_sample_format == IS_16)
-                finalt = path_without_ext + ".s16";
-            else if (d_sample_format == IS_8)
-                finalt = path_without_ext + ".s8";
-            else if (d_sample_format == WAV_16)
-                finalt = path_without_ext + ".wav";
-            // #ifdef BUILD_ZIQ
-            else if (d_sample_format == ZIQ)
-                finalt = path_without_ext + ".ziq";
-            // #endif
-            else if (d_sample_format == ZIQ2)
-                finalt = path_without_ext + ".ziq";
-
-            if (override_filename)
-                finalt = path_without_ext;
-
-            current_size_out = 0;
-            current_size_out_raw = 0;
-
-            output_file = std::ofstream(finalt, std::ios::binary);
-
-            if (d_sample_format == WAV_16) {
-                wav_writer = std::make_unique<WavWriter>(output_file);
-                wav_writer->write_header(samplerate, 2);
-            }
+        // Write a packet index next to ZIQ2 recordings for fast seeking
+        void set_write_index(bool enabled) {
+            write_index = enabled;
+        }
 
-            // #ifdef BUILD_ZIQ
-            if (d_sample_format == ZIQ) {
-                ziqcfg.is_compressed = true;
-                ziqcfg.bits_per_sample = depth;
-                ziqcfg.samplerate = samplerate;
-                ziqcfg.annotation = "";
+        // Write the raw formats as a SigMF recording, the other formats ignore it
+        void set_sigmf(bool enabled) {
+            write_sigmf = enabled;
+        }
 
-                ziqWriter = std::make_shared<ziq::ziq_writer>(ziqcfg, output_file);
-            }
-            // #endif
-            // #ifdef BUILD_ZIQ2
-            if (d_sample_format == ZIQ2) {
-                int sz = ziq2::ziq2_write_file_hdr((uint8_t*)buffer_s8, samplerate);
-                output_file.write((char*)buffer_s8, sz);
-
-                if (mag_buffer == nullptr)
-                    mag_buffer = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
-            }
-            // #endif
+        // Frequency of the samples, a change while recording SigMF starts a new capture segment
+        void set_frequency(double freq) {
+            frequency = freq;
+            if (should_work && write_sigmf && is_raw())
+                sigmf_meta.addCapture(queued_total, freq);
+        }
 
-            should_work = true;
-            rec_mutex.unlock();
+        // Time of the first sample in ns since the epoch and its frequency, for a file that was opened before it started recording
+        void set_start(int64_t time, double freq) {
+            frequency = freq;
+            if (should_work && write_sigmf && is_raw())
+                sigmf_meta.setStart(time, freq);
+        }
 
-            return finalt;
+        // Reserve that many bytes on the disk when starting a recording, 0 to disable. Only done on Linux.
+        void set_preallocate(uint64_t bytes) {
+            preallocate_size = bytes;
         }
 
+        // Returns the path of the file, empty if it couldn't be created
+        std::string start_recording(std::string path_without_ext, uint64_t samplerate, int depth = 0, bool override_filename = false); // Depth is only for compressed non-raw formats
+
         size_t get_written() {
             return current_size_out;
         }
@@ -347,56 +422,15 @@ namespace dsp {
             return current_size_out_raw;
         }
 
-        void stop_recording() {
-            if (d_sample_format == WAV_16)
-                wav_writer->finish_header(get_written());
+        BasebandWriterStats get_stats();
 
-            rec_mutex.lock();
-            should_work = false;
-            current_size_out = 0;
-            current_size_out_raw = 0;
-            output_file.close();
-            rec_mutex.unlock();
-        }
+        // Writes out everything still queued before closing the file
+        void stop_recording();
 
-        void feed_samples(complex_t* samples, int nsamples) {
-            if (nsamples <= 0 || !should_work)
-                return;
+        // Stops the recording and deletes every file it created, for a recording that ended up not being used
+        void discard_recording();
 
-            rec_mutex.lock();
-            if (should_work) {
-                if (d_sample_format == CF_32) {
-                    output_file.write((char*)samples, nsamples * sizeof(complex_t));
-                    current_size_out += nsamples * sizeof(complex_t);
-                }
-                else if (d_sample_format == IS_16 || d_sample_format == WAV_16) {
-                    volk_32f_s32f_convert_16i(buffer_s16, (float*)samples, 65535, nsamples * 2);
-                    output_file.write((char*)buffer_s16, nsamples * sizeof(int16_t) * 2);
-                    current_size_out += nsamples * sizeof(int16_t) * 2;
-                }
-                else if (d_sample_format == IS_8) {
-                    volk_32f_s32f_convert_8i(buffer_s8, (float*)samples, 127, nsamples * 2);
-                    output_file.write((char*)buffer_s8, nsamples * sizeof(int8_t) * 2);
-                    current_size_out += nsamples * sizeof(int8_t) * 2;
-                }
-                // #ifdef BUILD_ZIQ
-                else if (d_sample_format == ZIQ) {
-                    current_size_out += ziqWriter->write(samples, nsamples);
-                    current_size_out_raw += (ziqcfg.bits_per_sample / 4) * nsamples;
-                }
-                // #endif
-                // #ifdef BUILD_ZIQ2
-                else if (d_sample_format == ZIQ2) {
-                    int sz = ziq2::ziq2_write_iq_pkt((uint8_t*)buffer_s8, samples, mag_buffer, nsamples, bit_depth);
-                    output_file.write((char*)buffer_s8, sz);
-                    current_size_out += sz;
-                }
-                // #endif
-
-                output_file.flush();
-            }
-
-            rec_mutex.unlock();
-        }
+        // Queue samples to be written, never blocks on the disk
+        void feed_samples(complex_t* samples, int nsamples);
     };
 }
\ No newline at end of file
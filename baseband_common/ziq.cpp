@@ -2,6 +2,7 @@
 #include <volk/volk.h>
 #include <cstring>
 #include <signal_path/signal_path.h>
+#include <utils/flog.h>
 
 #define ZIQ_DECOMPRESS_BUFSIZE 8192
 
@@ -17,7 +18,10 @@ namespace ziq {
         stream.write((char*)&string_size, 8);
         stream.write((char*)cfg.annotation.c_str(), string_size);
 
+        frames.clear();
+
         // If compresssed, init compression
+        max_buffer_size = STREAM_BUFFER_SIZE; // Abolute max size. Show never be reached
         if (cfg.is_compressed) {
             zstd_ctx = ZSTD_createCCtx();
             ZSTD_CCtx_setParameter(zstd_ctx, ZSTD_c_compressionLevel, zst_level);
@@ -25,7 +29,6 @@ namespace ziq {
             ZSTD_CCtx_setParameter(zstd_ctx, ZSTD_c_nbWorkers, zst_workers);
 
             // Init buffer
-            max_buffer_size = STREAM_BUFFER_SIZE; // Abolute max size. Show never be reached
             output_compressed = new uint8_t[max_buffer_size * sizeof(complex_t)];
         }
 
@@ -47,23 +50,97 @@ namespace ziq {
             delete[] buffer_i16;
     }
 
-    int ziq_writer::compress_and_write(uint8_t* input, size_t size) {
+    int ziq_writer::compress_and_write(uint8_t* input, size_t size, ZSTD_EndDirective mode) {
         zstd_input = { input, size, 0 };
-        zstd_output = { output_compressed, max_buffer_size, 0 };
+        int written = 0;
+
+        // Flush the output whenever it fills up, and when ending a frame until zstd has nothing left
+        while (true) {
+            zstd_output = { output_compressed, max_buffer_size * sizeof(complex_t), 0 };
+            size_t remaining = ZSTD_compressStream2(zstd_ctx, &zstd_output, &zstd_input, mode);
+            if (ZSTD_isError(remaining)) {
+                flog::error("ZIQ compression error: {0}", ZSTD_getErrorName(remaining));
+                break;
+            }
 
-        while (zstd_input.pos < zstd_input.size)
-            ZSTD_compressStream2(zstd_ctx, &zstd_output, &zstd_input, ZSTD_e_continue);
+            stream.write((char*)output_compressed, zstd_output.pos);
+            written += zstd_output.pos;
 
-        stream.write((char*)output_compressed, zstd_output.pos);
+            if (mode == ZSTD_e_continue ? (zstd_input.pos == zstd_input.size) : (remaining == 0))
+                break;
+        }
 
-        return zstd_output.pos;
+        frame_c_size += written;
+        return written;
+    }
+
+    int ziq_writer::end_frame() {
+        if (frame_d_size == 0)
+            return 0;
+
+        int written = compress_and_write(NULL, 0, ZSTD_e_end);
+
+        ziq_frame frame;
+        frame.c_offset = frames.empty() ? 0 : frames.back().c_offset + frames.back().c_size;
+        frame.d_offset = frames.empty() ? 0 : frames.back().d_offset + frames.back().d_size;
+        frame.c_size = frame_c_size;
+        frame.d_size = frame_d_size;
+        frames.push_back(frame);
+
+        frame_c_size = 0;
+        frame_d_size = 0;
+        frame_samples = 0;
+        return written;
+    }
+
+    int ziq_writer::finish() {
+        if (finished || !cfg.is_compressed)
+            return 0;
+        finished = true;
+
+        if (!cfg.frame_samples)
+            return compress_and_write(NULL, 0, ZSTD_e_end);
+
+        int written = end_frame();
+
+        // Seek table as a skippable frame, entries without checksums
+        uint32_t magic = ZIQ_SKIPPABLE_MAGIC;
+        uint32_t table_size = frames.size() * 8 + 9;
+        stream.write((char*)&magic, 4);
+        stream.write((char*)&table_size, 4);
+        for (auto& frame : frames) {
+            stream.write((char*)&frame.c_size, 4);
+            stream.write((char*)&frame.d_size, 4);
+        }
+        uint32_t num_frames = frames.size();
+        uint8_t descriptor = 0;
+        magic = ZIQ_SEEKABLE_MAGIC;
+        stream.write((char*)&num_frames, 4);
+        stream.write((char*)&descriptor, 1);
+        stream.write((char*)&magic, 4);
+
+        return written + 8 + table_size;
     }
 
     int ziq_writer::write(complex_t* input, int size) {
+        int written = write_samples(input, size);
+
+        // Close the frame once it's big enough so that it can be decoded on its own
+        if (cfg.is_compressed && cfg.frame_samples) {
+            frame_samples += size;
+            if (frame_samples >= cfg.frame_samples)
+                written += end_frame();
+        }
+
+        return written;
+    }
+
+    int ziq_writer::write_samples(complex_t* input, int size) {
         if (cfg.bits_per_sample == 8) {
             volk_32f_s32f_convert_8i(buffer_i8, (float*)input, 127, size * 2);
 
             if (cfg.is_compressed) {
+                frame_d_size += size * 2 * sizeof(int8_t);
                 return compress_and_write((uint8_t*)buffer_i8, size * 2 * sizeof(int8_t));
             }
             else {
@@ -75,6 +152,7 @@ namespace ziq {
             volk_32f_s32f_convert_16i(buffer_i16, (float*)input, 65535, size * 2);
 
             if (cfg.is_compressed) {
+                frame_d_size += size * 2 * sizeof(int16_t);
                 return compress_and_write((uint8_t*)buffer_i16, size * 2 * sizeof(int16_t));
             }
             else {
@@ -84,6 +162,7 @@ namespace ziq {
         }
         else if (cfg.bits_per_sample == 32) {
             if (cfg.is_compressed) {
+                frame_d_size += size * sizeof(complex_t);
                 return compress_and_write((uint8_t*)input, size * sizeof(complex_t));
             }
             else {
@@ -112,15 +191,19 @@ namespace ziq {
             flog::error("This file is not a valid ZIQ file!");
             isValid = false;
         }
+        data_start = stream.tellg();
 
         // If compresssed, init compression
+        max_buffer_size = STREAM_BUFFER_SIZE; // Abolute max size. Show never be reached
         if (cfg.is_compressed) {
             zstd_ctx = ZSTD_createDCtx();
 
             // Init buffer
-            max_buffer_size = STREAM_BUFFER_SIZE; // Abolute max size. Show never be reached
             output_decompressed = new uint8_t[max_buffer_size * sizeof(complex_t)];
             compressed_buffer = new uint8_t[ZIQ_DECOMPRESS_BUFSIZE];
+            zstd_input = { compressed_buffer, 0, 0 };
+
+            load_seek_table();
         }
 
         if (cfg.bits_per_sample == 8)
@@ -148,18 +231,23 @@ namespace ziq {
     }
 
     int ziq_reader::decompress_at_least(int size) {
-        while (decompressed_cnt <= size && !stream.eof()) {
-            stream.read((char*)compressed_buffer, ZIQ_DECOMPRESS_BUFSIZE);
-
-            zstd_input = { compressed_buffer, (unsigned long)ZIQ_DECOMPRESS_BUFSIZE, 0 };
-            zstd_output = { &output_decompressed[decompressed_cnt], (unsigned long)(max_buffer_size - decompressed_cnt), 0 };
-
-            while (zstd_input.pos < zstd_input.size) {
-                size_t err = ZSTD_decompressStream(zstd_ctx, &zstd_output, &zstd_input);
-                if (ZSTD_isError(err)) {
-                    ZSTD_DCtx_reset(zstd_ctx, ZSTD_reset_session_only);
+        size_t capacity = max_buffer_size * sizeof(complex_t);
+        while (decompressed_cnt <= size && decompressed_cnt < capacity) {
+            // Only read more once zstd took everything, it may stop early when the output is full
+            if (zstd_input.pos >= zstd_input.size) {
+                if (stream.eof())
                     break;
-                }
+                stream.read((char*)compressed_buffer, ZIQ_DECOMPRESS_BUFSIZE);
+                zstd_input = { compressed_buffer, (size_t)stream.gcount(), 0 };
+                if (zstd_input.size == 0)
+                    break;
+            }
+
+            zstd_output = { &output_decompressed[decompressed_cnt], capacity - decompressed_cnt, 0 };
+            size_t err = ZSTD_decompressStream(zstd_ctx, &zstd_output, &zstd_input);
+            if (ZSTD_isError(err)) {
+                ZSTD_DCtx_reset(zstd_ctx, ZSTD_reset_session_only);
+                zstd_input.pos = zstd_input.size;
             }
 
             decompressed_cnt += zstd_output.pos;
@@ -229,6 +317,97 @@ namespace ziq {
         return 0;
     }
 
+    void ziq_reader::load_seek_table() {
+        stream.seekg(0, std::ios::end);
+        uint64_t file_size = stream.tellg();
+
+        // Footer: frame count, descriptor, magic
+        uint32_t num_frames = 0;
+        uint8_t descriptor = 0;
+        uint32_t magic = 0;
+        if (file_size >= data_start + 17) {
+            stream.seekg(file_size - 9);
+            stream.read((char*)&num_frames, 4);
+            stream.read((char*)&descriptor, 1);
+            stream.read((char*)&magic, 4);
+        }
+
+        uint64_t entry_size = (descriptor & 0x80) ? 12 : 8;
+        uint64_t table_size = num_frames * entry_size + 9;
+        if (magic == ZIQ_SEEKABLE_MAGIC && num_frames && file_size >= data_start + table_size + 8) {
+            uint32_t skippable_magic = 0, frame_size = 0;
+            uint64_t table_start = file_size - table_size - 8;
+            stream.seekg(table_start);
+            stream.read((char*)&skippable_magic, 4);
+            stream.read((char*)&frame_size, 4);
+
+            if (skippable_magic == ZIQ_SKIPPABLE_MAGIC && frame_size == table_size) {
+                std::vector<uint8_t> table(num_frames * entry_size);
+                stream.read((char*)table.data(), table.size());
+
+                uint64_t c_offset = 0, d_offset = 0;
+                for (uint32_t i = 0; i < num_frames; i++) {
+                    ziq_frame frame;
+                    memcpy(&frame.c_size, &table[i * entry_size], 4);
+                    memcpy(&frame.d_size, &table[i * entry_size + 4], 4);
+                    frame.c_offset = c_offset;
+                    frame.d_offset = d_offset;
+                    c_offset += frame.c_size;
+                    d_offset += frame.d_size;
+                    frames.push_back(frame);
+                }
+
+                // The frames must cover exactly the data, otherwise don't trust the table
+                if (data_start + c_offset != table_start) {
+                    flog::warn("ZIQ seek table doesn't match the data, ignoring it");
+                    frames.clear();
+                }
+            }
+        }
+
+        stream.clear();
+        stream.seekg(data_start);
+    }
+
+    uint64_t ziq_reader::get_sample_count() {
+        if (frames.empty())
+            return 0;
+        return (frames.back().d_offset + frames.back().d_size) / bytes_per_sample();
+    }
+
+    void ziq_reader::convert(const uint8_t* input, complex_t* output, int size) {
+        if (cfg.bits_per_sample == 8)
+            volk_8i_s32f_convert_32f_u((float*)output, (const int8_t*)input, 127, size * 2);
+        else if (cfg.bits_per_sample == 16)
+            volk_16i_s32f_convert_32f_u((float*)output, (const int16_t*)input, 65535, size * 2);
+        else if (cfg.bits_per_sample == 32)
+            memcpy(output, input, size * sizeof(complex_t));
+    }
+
+    int ziq_reader::decode_frame(const uint8_t* input, size_t size, complex_t* output, int max_samples) {
+        // Every thread gets its own context and scratch buffer
+        struct dctx_holder {
+            ZSTD_DCtx* ctx = ZSTD_createDCtx();
+            ~dctx_holder() { ZSTD_freeDCtx(ctx); }
+        };
+        thread_local dctx_holder dctx;
+        thread_local std::vector<uint8_t> buffer;
+
+        size_t capacity = (size_t)max_samples * bytes_per_sample();
+        if (buffer.size() < capacity)
+            buffer.resize(capacity);
+
+        size_t out = ZSTD_decompressDCtx(dctx.ctx, buffer.data(), capacity, input, size);
+        if (ZSTD_isError(out)) {
+            flog::error("ZIQ frame decompression error: {0}", ZSTD_getErrorName(out));
+            return -1;
+        }
+
+        int count = out / bytes_per_sample();
+        convert(buffer.data(), output, count);
+        return count;
+    }
+
     // Util functions
     bool isValidZIQ(std::string file) {
         std::ifstream stream(file, std::ios::binary);
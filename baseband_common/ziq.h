@@ -4,6 +4,7 @@
 #include <string>
 #include <cstdint>
 #include <fstream>
+#include <vector>
 #include <zstd.h>
 #include <dsp/types.h>
 
@@ -26,11 +27,22 @@ Supported sample formats are :
 - int8_t
 - int16_t
 - float (32)
+
+Seekable files close the zstd frame every few samples and end with
+a seek table in the zstd seekable format. That is still a valid
+zstd stream, so readers that don't know about it read them just fine.
 */
 
 // File signature of a ZIQ File
 #define ZIQ_SIGNATURE "ZIQ_"
 
+// Default number of samples per frame of seekable files
+#define ZIQ_DEFAULT_FRAME_SAMPLES (256 * 1024)
+
+// zstd seekable format
+#define ZIQ_SKIPPABLE_MAGIC 0x184D2A5E
+#define ZIQ_SEEKABLE_MAGIC  0x8F92EAB1
+
 namespace ziq {
     // Struct holding the parameters of a ZIQ Baseband (header)
     struct ziq_cfg {
@@ -38,6 +50,15 @@ namespace ziq {
         char bits_per_sample;   // Bits per sample
         uint64_t samplerate;    // Samplerate of the contained IQ data
         std::string annotation; // Annotation field. This should be JSON and can used to store frequency and other informations
+        uint64_t frame_samples = 0; // Samples per independent zstd frame, 0 for a single continuous stream
+    };
+
+    // Frame of a seekable file, offsets are relative to the start of the data
+    struct ziq_frame {
+        uint64_t c_offset;
+        uint64_t d_offset;
+        uint32_t c_size;
+        uint32_t d_size;
     };
 
     class ziq_writer {
@@ -50,7 +71,7 @@ namespace ziq {
     private:
         const int zst_level = 1;
         const int zst_workers = 8;
-        ZSTD_CCtx* zstd_ctx;
+        ZSTD_CCtx* zstd_ctx = nullptr;
         ZSTD_inBuffer zstd_input;
         ZSTD_outBuffer zstd_output;
         int zst_outc;
@@ -58,13 +79,26 @@ namespace ziq {
         uint8_t* output_compressed;
 
     private:
-        int compress_and_write(uint8_t* input, size_t size);
+        // Seek table
+        std::vector<ziq_frame> frames;
+        uint64_t frame_c_size = 0;
+        uint64_t frame_d_size = 0;
+        uint64_t frame_samples = 0;
+        bool finished = false;
+
+    private:
+        int compress_and_write(uint8_t* input, size_t size, ZSTD_EndDirective mode = ZSTD_e_continue);
+        int write_samples(complex_t* input, int size);
+        int end_frame();
 
     public:
         ziq_writer(ziq_cfg cfg, std::ofstream& stream);
         ~ziq_writer();
 
         int write(complex_t* input, int size);
+
+        // Flush everything and write the seek table, must be called before closing the file
+        int finish();
     };
 
     class ziq_reader {
@@ -76,7 +110,7 @@ namespace ziq {
         int16_t* buffer_i16;
 
     private:
-        ZSTD_DCtx* zstd_ctx;
+        ZSTD_DCtx* zstd_ctx = nullptr;
         ZSTD_inBuffer zstd_input;
         ZSTD_outBuffer zstd_output;
         int zst_outc;
@@ -85,15 +119,30 @@ namespace ziq {
         int decompressed_cnt;
         uint8_t* output_decompressed;
 
+        // Seek table
+        std::vector<ziq_frame> frames;
+        uint64_t data_start = 0;
+
     private:
         int decompress_at_least(int size);
         int read_decompressed(uint8_t* buffer, int size);
+        void load_seek_table();
+        void convert(const uint8_t* input, complex_t* output, int size);
 
     public:
         ziq_reader(std::ifstream& stream);
         ~ziq_reader();
 
         int read(complex_t* output, int size);
+
+        bool is_seekable() { return !frames.empty(); }
+        int bytes_per_sample() { return (cfg.bits_per_sample / 8) * 2; }
+        uint64_t get_sample_count();
+
+        // Frame access for seekable files, decode_frame can be called from several threads at once
+        const std::vector<ziq_frame>& get_frames() { return frames; }
+        uint64_t get_data_start() { return data_start; }
+        int decode_frame(const uint8_t* input, size_t size, complex_t* output, int max_samples);
     };
 
     bool isValidZIQ(std::string file);
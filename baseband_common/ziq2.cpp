@@ -1,6 +1,7 @@
 #include "ziq2.h"
 #include <utils/flog.h>
 #include <volk/volk.h>
+#include <string.h>
 
 namespace ziq2
 {
@@ -129,6 +130,21 @@ namespace ziq2
             volk_16i_s32f_convert_32f((float *)output, (int16_t *)&input[final_size], hdr->scale, *nsamples * 2);
     }
 
+    int ziq2_get_iq_pkt_count(uint8_t *input)
+    {
+        ziq2_pkt_hdr_t *mdr = (ziq2_pkt_hdr_t *)&input[0];
+        ziq2_iq_pkt_hdr_t *hdr = (ziq2_iq_pkt_hdr_t *)&input[sizeof(ziq2_pkt_hdr_t)];
+        if (mdr->pkt_size < sizeof(ziq2_iq_pkt_hdr_t))
+            return -1;
+
+        if (hdr->bit_depth == 8 || hdr->bit_depth == 16)
+        {
+            return ((mdr->pkt_size - sizeof(ziq2_iq_pkt_hdr_t)) * 8) / (hdr->bit_depth * 2);
+        }
+
+        return -1;
+    }
+
     bool ziq2_is_valid_ziq2(std::string file)
     {
         std::ifstream stream(file, std::ios::binary);
@@ -156,4 +172,136 @@ namespace ziq2
 
         return 0;
     }
+    std::string ziq2_index_path(std::string file)
+    {
+        return file + ZIQ2_INDEX_EXTENSION;
+    }
+
+    void ziq2_write_index_hdr(std::ofstream &stream)
+    {
+        uint32_t version = ZIQ2_INDEX_VERSION;
+        stream.write(ZIQ2_INDEX_SIGNATURE, 4);
+        stream.write((char *)&version, sizeof(uint32_t));
+    }
+
+    void ziq2_write_index_entry(std::ofstream &stream, uint64_t offset, uint64_t sample, uint32_t nsamples)
+    {
+        ziq2_index_entry_t entry;
+        entry.offset = offset;
+        entry.sample = sample;
+        entry.nsamples = nsamples;
+        stream.write((char *)&entry, sizeof(ziq2_index_entry_t));
+    }
+
+    static bool ziq2_has_sync_at(std::ifstream &stream, uint64_t offset)
+    {
+        uint8_t sync[4];
+        stream.clear();
+        stream.seekg(offset);
+        stream.read((char *)sync, 4);
+        return stream.gcount() == 4 && sync[0] == 0x1a && sync[1] == 0xcf && sync[2] == 0xfc && sync[3] == 0x1d;
+    }
+
+    bool ziq2_read_index(std::string file, std::vector<ziq2_index_entry_t> &index)
+    {
+        index.clear();
+        std::ifstream stream(ziq2_index_path(file), std::ios::binary | std::ios::ate);
+        if (!stream.is_open())
+            return false;
+        size_t size = stream.tellg();
+        stream.seekg(0);
+
+        char signature[4];
+        uint32_t version = 0;
+        stream.read(signature, 4);
+        stream.read((char *)&version, sizeof(uint32_t));
+        if (!stream || memcmp(signature, ZIQ2_INDEX_SIGNATURE, 4) || version != ZIQ2_INDEX_VERSION)
+            return false;
+
+        // An index of a recording that was cut short may end with a partial entry
+        size_t count = (size - 8) / sizeof(ziq2_index_entry_t);
+        index.resize(count);
+        stream.read((char *)index.data(), count * sizeof(ziq2_index_entry_t));
+        if (!stream || index.empty())
+        {
+            index.clear();
+            return false;
+        }
+
+        // Make sure the index belongs to this recording, checking both ends is enough to catch a stale one
+        std::ifstream rec(file, std::ios::binary);
+        if (!ziq2_has_sync_at(rec, index.front().offset) || !ziq2_has_sync_at(rec, index.back().offset))
+        {
+            flog::warn("ZIQ2 index of '{0}' doesn't match the recording, ignoring it", file);
+            index.clear();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ziq2_build_index(std::string file, std::atomic<float> *progress)
+    {
+        std::ifstream stream(file, std::ios::binary | std::ios::ate);
+        if (!stream.is_open())
+            return false;
+        uint64_t filesize = stream.tellg();
+        stream.seekg(4);
+
+        std::ofstream index(ziq2_index_path(file), std::ios::binary);
+        if (!index.is_open())
+            return false;
+        ziq2_write_index_hdr(index);
+
+        // Only the headers are needed, packet contents are skipped over
+        uint8_t buf[sizeof(ziq2_pkt_hdr_t) + sizeof(ziq2_iq_pkt_hdr_t)];
+        uint64_t sample = 0;
+        uint8_t sync[4];
+        while (true)
+        {
+            stream.read((char *)sync, 4);
+            if (stream.gcount() < 4)
+                break;
+
+            // Resync on corrupted data
+            while (!(sync[0] == 0x1a && sync[1] == 0xcf && sync[2] == 0xfc && sync[3] == 0x1d))
+            {
+                memmove(&sync[0], &sync[1], 3);
+                stream.read((char *)&sync[3], 1);
+                if (stream.gcount() < 1)
+                    break;
+            }
+            if (!stream)
+                break;
+            uint64_t offset = (uint64_t)stream.tellg() - 4;
+
+            ziq2_pkt_hdr_t *mdr = (ziq2_pkt_hdr_t *)buf;
+            stream.read((char *)buf, sizeof(ziq2_pkt_hdr_t));
+            if (!stream)
+                break;
+            if (offset + 4 + sizeof(ziq2_pkt_hdr_t) + mdr->pkt_size > filesize)
+                break;
+
+            int hdrlen = std::min<int>(mdr->pkt_size, sizeof(buf) - sizeof(ziq2_pkt_hdr_t));
+            stream.read((char *)&buf[sizeof(ziq2_pkt_hdr_t)], hdrlen);
+            stream.seekg(mdr->pkt_size - hdrlen, std::ios::cur);
+
+            if (mdr->pkt_type != ZIQ2_PKT_IQ)
+                continue;
+            int count = ziq2_get_iq_pkt_count(buf);
+            if (count <= 0)
+                continue;
+
+            ziq2_write_index_entry(index, offset, sample, count);
+            sample += count;
+
+            if (progress)
+                *progress = (float)offset / (float)filesize;
+        }
+
+        if (progress)
+            *progress = 1.0f;
+        flog::info("Built ZIQ2 index of '{0}', {1} samples", file, sample);
+        return true;
+    }
 };
@@ -4,6 +4,8 @@
 #include <string>
 #include <cstdint>
 #include <fstream>
+#include <vector>
+#include <atomic>
 #include <zstd.h>
 #include <dsp/types.h>
 
@@ -12,6 +14,11 @@ typedef dsp::complex_t complex_t;
 // File signature of a ZIQ2 File
 #define ZIQ2_SIGNATURE "ZIQ2"
 
+// Packet index written next to a recording, named after it with this appended
+#define ZIQ2_INDEX_EXTENSION ".idx"
+#define ZIQ2_INDEX_SIGNATURE "ZQ2I"
+#define ZIQ2_INDEX_VERSION   1
+
 namespace ziq2 {
     enum ziq2_pkt_type_t {
         ZIQ2_PKT_INFO = 0,
@@ -28,6 +35,18 @@ namespace ziq2 {
     } __attribute__((packed));
 #ifdef _WIN32
 #pragma pack(pop)
+#endif
+
+#ifdef _WIN32
+#pragma pack(push, 1)
+#endif
+    struct ziq2_index_entry_t {
+        uint64_t offset;   // Offset of the packet's sync word in the recording
+        uint64_t sample;   // Index of the first sample of the packet
+        uint32_t nsamples;
+    } __attribute__((packed));
+#ifdef _WIN32
+#pragma pack(pop)
 #endif
 
     int ziq2_write_info_pkt(uint8_t* output, uint64_t samplerate, bool sync = true);
@@ -36,7 +55,15 @@ namespace ziq2 {
 
     void ziq2_read_info_pkt(uint8_t* input, uint64_t* samplerate);
     void ziq2_read_iq_pkt(uint8_t* input, complex_t* output, int* nsamples);
+    int ziq2_get_iq_pkt_count(uint8_t* input);
 
     bool ziq2_is_valid_ziq2(std::string file);
     uint64_t ziq2_try_parse_header(std::string file);
+
+    // Packet index
+    std::string ziq2_index_path(std::string file);
+    void ziq2_write_index_hdr(std::ofstream& stream);
+    void ziq2_write_index_entry(std::ofstream& stream, uint64_t offset, uint64_t sample, uint32_t nsamples);
+    bool ziq2_read_index(std::string file, std::vector<ziq2_index_entry_t>& index);
+    bool ziq2_build_index(std::string file, std::atomic<float>* progress = nullptr);
 }
@@ -15,7 +15,11 @@ void CommandArgsParser::defineAll() {
 
         define('a', "addr", "Server mode address", "0.0.0.0");
         define('h', "help", "Show help");
+        define('\0', "netbench", "Run the loopback network benchmark on the server mode port and exit");
         define('p', "port", "Server mode port", 5259);
+        define('\0', "maxclients", "Server mode maximum number of simultaneous clients", 4);
+        define('\0', "udploss", "Server mode simulated UDP datagram loss rate (0 to 1, for testing)", 0.0);
+        define('\0', "udpreorder", "Server mode simulated UDP datagram reordering rate (0 to 1, for testing)", 0.0);
         define('r', "root", "Root directory, where all config files are stored", std::filesystem::absolute(root).string());
         define('s', "server", "Run in server mode");
         define('\0', "autostart", "Automatically start the SDR after loading");
@@ -7,6 +7,7 @@
 #include <gui/icons.h>
 #include <version.h>
 #include <utils/flog.h>
+#include <utils/net_bench.h>
 #include <gui/widgets/bandplan.h>
 #include <stb_image.h>
 #include <config.h>
@@ -77,6 +78,12 @@ int sdrpp_main(int argc, char* argv[]) {
         return 0;
     }
 
+    // Run the network benchmark and exit if requested
+    if (core::args["netbench"].b()) {
+        net::bench::run((int)core::args["port"]);
+        return 0;
+    }
+
     bool serverMode = (bool)core::args["server"];
 
 #ifdef _WIN32
@@ -227,6 +234,9 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["iqCorrection"] = false;
     defConfig["invertIQ"] = false;
 
+    defConfig["lowLatencyAudio"] = false;
+    defConfig["audioLatencyTarget"] = 40;
+
     defConfig["streams"]["Radio"]["muted"] = false;
     defConfig["streams"]["Radio"]["sink"] = "Audio";
     defConfig["streams"]["Radio"]["volume"] = 1.0f;
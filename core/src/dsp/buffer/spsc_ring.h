@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <algorithm>
+#include <string.h>
+#include <stddef.h>
+#include "buffer.h"
+
+namespace dsp::buffer {
+    // Wait-free ring for exactly one writer thread and one reader thread. Neither side ever
+    // blocks or takes a lock, so it can be used from a real-time audio callback.
+    template <class T>
+    class SPSCRing {
+    public:
+        SPSCRing() {}
+
+        SPSCRing(int capacity) { init(capacity); }
+
+        ~SPSCRing() {
+            if (!_buffer) { return; }
+            buffer::free(_buffer);
+        }
+
+        // The capacity is rounded up to a power of two. Not thread safe, call before use.
+        void init(int capacity) {
+            if (_buffer) { buffer::free(_buffer); }
+            size_t cap = 1;
+            while (cap < (size_t)capacity) { cap <<= 1; }
+            _capacity = cap;
+            mask = cap - 1;
+            _buffer = buffer::alloc<T>(cap);
+            buffer::clear(_buffer, cap);
+            writePos = 0;
+            readPos = 0;
+        }
+
+        int getCapacity() {
+            return _capacity;
+        }
+
+        // Number of items that can be read, exact from the reader and a lower bound from the writer
+        int getReadable() {
+            return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+        }
+
+        // Number of items that can be written, exact from the writer and a lower bound from the reader
+        int getWritable() {
+            return _capacity - getReadable();
+        }
+
+        // Writer side, returns the number of items written which is less than count if the ring is full
+        int write(const T* data, int count) {
+            size_t w = writePos.load(std::memory_order_relaxed);
+            size_t r = readPos.load(std::memory_order_acquire);
+            int n = std::min<size_t>(count, _capacity - (w - r));
+            copyIn(w, data, n);
+            writePos.store(w + n, std::memory_order_release);
+            return n;
+        }
+
+        // Reader side, returns the number of items read which is less than count if the ring runs empty
+        int read(T* data, int count) {
+            size_t r = readPos.load(std::memory_order_relaxed);
+            size_t w = writePos.load(std::memory_order_acquire);
+            int n = std::min<size_t>(count, w - r);
+            copyOut(r, data, n);
+            readPos.store(r + n, std::memory_order_release);
+            return n;
+        }
+
+        // Reader side, drop up to count items without reading them
+        int skip(int count) {
+            size_t r = readPos.load(std::memory_order_relaxed);
+            size_t w = writePos.load(std::memory_order_acquire);
+            int n = std::min<size_t>(count, w - r);
+            readPos.store(r + n, std::memory_order_release);
+            return n;
+        }
+
+    private:
+        void copyIn(size_t pos, const T* data, int count) {
+            size_t start = pos & mask;
+            size_t first = std::min<size_t>(count, _capacity - start);
+            memcpy(&_buffer[start], data, first * sizeof(T));
+            memcpy(_buffer, &data[first], (count - first) * sizeof(T));
+        }
+
+        void copyOut(size_t pos, T* data, int count) {
+            size_t start = pos & mask;
+            size_t first = std::min<size_t>(count, _capacity - start);
+            memcpy(data, &_buffer[start], first * sizeof(T));
+            memcpy(&data[first], _buffer, (count - first) * sizeof(T));
+        }
+
+        T* _buffer = NULL;
+        size_t _capacity = 0;
+        size_t mask = 0;
+
+        // Kept on separate cache lines so that the two sides don't slow each other down
+        alignas(64) std::atomic<size_t> writePos = 0;
+        alignas(64) std::atomic<size_t> readPos = 0;
+    };
+}
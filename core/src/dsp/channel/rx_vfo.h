@@ -1,6 +1,8 @@
 #pragma once
 #include "frequency_xlator.h"
 #include "../multirate/rational_resampler.h"
+#include <atomic>
+#include <chrono>
 
 namespace dsp::channel {
     class RxVFO : public Processor<complex_t, complex_t> {
@@ -102,6 +104,7 @@ namespace dsp::channel {
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
+            inputTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 
             int outCount = process(count, base_type::_in->readBuf, out.writeBuf);
 
@@ -113,6 +116,9 @@ namespace dsp::channel {
             return outCount;
         }
 
+        // Steady clock time in nanoseconds at which the last block entered the VFO, used to measure the latency downstream
+        std::atomic<int64_t> inputTime = 0;
+
     protected:
         void generateTaps() {
             taps::free(ftaps);
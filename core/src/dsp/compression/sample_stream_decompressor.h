@@ -10,6 +10,22 @@ namespace dsp::compression {
 
         SampleStreamDecompressor(stream<uint8_t>* in) { base_type::init(in); }
 
+        // Number of samples in a compressed block without decoding it
+        inline static int getSampleCount(int count, const uint8_t* in) {
+            if (count < 8) { return 0; }
+            uint16_t sampleType = *(uint16_t*)&in[2];
+            switch (sampleType) {
+            case PCMType::PCM_TYPE_F32:
+                return (count - 8) / sizeof(complex_t);
+            case PCMType::PCM_TYPE_I16:
+                return (count - 8) / (sizeof(int16_t) * 2);
+            case PCMType::PCM_TYPE_I8:
+                return (count - 8) / (sizeof(int8_t) * 2);
+            default:
+                return 0;
+            }
+        }
+
         inline int process(int count, const uint8_t* in, complex_t* out) {
             uint16_t sampleType = *(uint16_t*)&in[2];
             float scaler = *(float*)&in[4];
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <volk/volk.h>
+#include "../types.h"
+
+// Number of samples converted per step when an intermediate buffer is needed
+#define INT_TO_COMPLEX_CHUNK    4096
+
+/*
+    Conversion of interleaved integer IQ to complex_t, output = (input - offset) / scale.
+
+    The SIMD work is done by VOLK, which selects the best kernel (SSE/AVX2/NEON) at runtime.
+    Offset binary 8bit with the usual 128 offset is turned into signed 8bit first, other offsets
+    go through a lookup table of every possible IQ byte pair.
+*/
+
+namespace dsp::convert::int_to_complex {
+    inline void s8(const int8_t* in, complex_t* out, int count, float scale = 128.0f) {
+        volk_8i_s32f_convert_32f((float*)out, in, scale, count * 2);
+    }
+
+    inline void s16(const int16_t* in, complex_t* out, int count, float scale = 32768.0f) {
+        volk_16i_s32f_convert_32f((float*)out, in, scale, count * 2);
+    }
+
+    // Packed 24bit, little endian unless specified otherwise
+    inline void s24(const uint8_t* in, complex_t* out, int count, float scale = 8388608.0f, bool bigEndian = false) {
+        // Place the samples in the upper bits of 32bit integers so that no sign extension is needed,
+        // written straight into the output since it has the same size
+        int32_t* tmp = (int32_t*)out;
+        int n = count * 2;
+        if (bigEndian) {
+            for (int i = 0; i < n; i++) {
+                tmp[i] = (int32_t)(((uint32_t)in[i*3] << 24) | ((uint32_t)in[i*3 + 1] << 16) | ((uint32_t)in[i*3 + 2] << 8));
+            }
+        }
+        else {
+            for (int i = 0; i < n; i++) {
+                tmp[i] = (int32_t)(((uint32_t)in[i*3 + 2] << 24) | ((uint32_t)in[i*3 + 1] << 16) | ((uint32_t)in[i*3] << 8));
+            }
+        }
+        volk_32i_s32f_convert_32f((float*)out, tmp, scale * 256.0f, n);
+    }
+
+    // Offset binary 8bit with an offset of 128
+    inline void u8(const uint8_t* in, complex_t* out, int count, float scale = 128.0f) {
+        alignas(32) int8_t tmp[INT_TO_COMPLEX_CHUNK * 2];
+        for (int i = 0; i < count; i += INT_TO_COMPLEX_CHUNK) {
+            int n = std::min<int>(INT_TO_COMPLEX_CHUNK, count - i) * 2;
+            const uint8_t* src = &in[i * 2];
+            for (int j = 0; j < n; j++) { tmp[j] = (int8_t)(src[j] ^ 0x80); }
+            volk_8i_s32f_convert_32f((float*)&out[i], tmp, scale, n);
+        }
+    }
+
+    // Offset binary 8bit with any offset, one table lookup per IQ pair
+    class U8LUT {
+    public:
+        U8LUT() {}
+
+        U8LUT(float offset, float scale) { init(offset, scale); }
+
+        void init(float offset, float scale) {
+            if (!lut.empty() && offset == _offset && scale == _scale) { return; }
+            _offset = offset;
+            _scale = scale;
+            lut.resize(65536);
+            for (int i = 0; i < 65536; i++) {
+                // Index the table the way the pair is laid out in memory, regardless of endianness
+                uint16_t idx = i;
+                uint8_t pair[2];
+                memcpy(pair, &idx, 2);
+                lut[i].re = ((float)pair[0] - offset) / scale;
+                lut[i].im = ((float)pair[1] - offset) / scale;
+            }
+        }
+
+        inline void convert(const uint8_t* in, complex_t* out, int count) {
+            const complex_t* table = lut.data();
+            for (int i = 0; i < count; i++) {
+                uint16_t idx;
+                memcpy(&idx, &in[i * 2], 2);
+                out[i] = table[idx];
+            }
+        }
+
+    private:
+        std::vector<complex_t> lut;
+        float _offset = 0.0f;
+        float _scale = 1.0f;
+    };
+}
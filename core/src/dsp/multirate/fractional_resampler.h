@@ -0,0 +1,128 @@
+#pragma once
+#include "../processor.h"
+#include "../taps/windowed_sinc.h"
+#include "../window/nuttall.h"
+#include "polyphase_bank.h"
+
+// Number of filter phases, the delay between two phases is linearly interpolated
+#define FRACTIONAL_RESAMPLER_PHASES     128
+#define FRACTIONAL_RESAMPLER_TAPS       32
+
+namespace dsp::multirate {
+    // Resampler for an arbitrary ratio that can be changed between two blocks without any glitch,
+    // meant for small corrections around 1 such as compensating the drift between two clocks.
+    // The passband goes up to 0.45 times the input samplerate, so it doesn't filter when downsampling.
+    template<class T>
+    class FractionalResampler : public Processor<T, T> {
+        using base_type = Processor<T, T>;
+    public:
+        FractionalResampler() {}
+
+        FractionalResampler(stream<T>* in, double ratio) { init(in, ratio); }
+
+        ~FractionalResampler() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(buffer);
+            freePolyphaseBank(phases);
+        }
+
+        void init(stream<T>* in, double ratio) {
+            // Prototype lowpass at the rate of all phases interleaved, with a gain of the phase count
+            tap<float> proto = taps::windowedSinc<float>(FRACTIONAL_RESAMPLER_PHASES * FRACTIONAL_RESAMPLER_TAPS, 0.45, FRACTIONAL_RESAMPLER_PHASES, window::nuttall, FRACTIONAL_RESAMPLER_PHASES);
+            phases = buildPolyphaseBank(FRACTIONAL_RESAMPLER_PHASES, proto);
+            taps::free(proto);
+
+            // One more sample of history than the filter length so that the next phase can wrap to the next sample
+            buffer = buffer::alloc<T>(STREAM_BUFFER_SIZE + phases.tapsPerPhase);
+            bufStart = &buffer[phases.tapsPerPhase];
+            buffer::clear<T>(buffer, phases.tapsPerPhase);
+
+            setRatio(ratio);
+            base_type::init(in);
+        }
+
+        // Output samplerate divided by the input samplerate, takes effect at the next block.
+        // The output of a block is at most count * ratio + 1 samples.
+        void setRatio(double ratio) {
+            step = 1.0 / ratio;
+        }
+
+        double getRatio() {
+            return 1.0 / step;
+        }
+
+        void reset() {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            buffer::clear<T>(buffer, phases.tapsPerPhase);
+            offset = 0;
+            mu = 0.0;
+            base_type::tempStart();
+        }
+
+        inline int process(int count, const T* in, T* out) {
+            int outCount = 0;
+            int tapCount = phases.tapsPerPhase;
+
+            // Copy input to buffer
+            memcpy(bufStart, in, count * sizeof(T));
+
+            while (offset < count) {
+                // Pick the two phases around the fractional delay
+                double fphase = mu * (double)FRACTIONAL_RESAMPLER_PHASES;
+                int phase = (int)fphase;
+                float frac = fphase - (double)phase;
+                const float* nextTaps = (phase + 1 < FRACTIONAL_RESAMPLER_PHASES) ? phases.phases[phase + 1] : phases.phases[0];
+                const T* nextIn = (phase + 1 < FRACTIONAL_RESAMPLER_PHASES) ? &buffer[offset] : &buffer[offset + 1];
+
+                // Do both convolutions and interpolate between them
+                T a, b;
+                if constexpr (std::is_same_v<T, float>) {
+                    volk_32f_x2_dot_prod_32f(&a, &buffer[offset], phases.phases[phase], tapCount);
+                    volk_32f_x2_dot_prod_32f(&b, nextIn, nextTaps, tapCount);
+                }
+                if constexpr (std::is_same_v<T, complex_t> || std::is_same_v<T, stereo_t>) {
+                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&a, (lv_32fc_t*)&buffer[offset], phases.phases[phase], tapCount);
+                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&b, (lv_32fc_t*)nextIn, nextTaps, tapCount);
+                }
+                out[outCount++] = a + ((b - a) * frac);
+
+                // Advance by one output sample
+                mu += step;
+                int adv = (int)mu;
+                offset += adv;
+                mu -= (double)adv;
+            }
+            offset -= count;
+
+            // Move delay
+            memmove(buffer, &buffer[count], tapCount * sizeof(T));
+
+            return outCount;
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+
+            // Swap if some data was generated
+            base_type::_in->flush();
+            if (outCount) {
+                if (!base_type::out.swap(outCount)) { return -1; }
+            }
+            return outCount;
+        }
+
+    protected:
+        PolyphaseBank<float> phases;
+        double step = 1.0;
+        double mu = 0.0;
+        int offset = 0;
+        T* buffer;
+        T* bufStart;
+    };
+}
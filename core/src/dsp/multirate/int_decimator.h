@@ -0,0 +1,227 @@
+#pragma once
+#include <vector>
+#include "../processor.h"
+#include "../convert/int_to_complex.h"
+#include "decim/plans.h"
+
+// Outputs computed per pass over the taps, small enough for the accumulators to stay in L1
+#define INT_DECIMATOR_CHUNK 256
+
+namespace dsp::multirate {
+    // First decimation by two of the front-end done on the native integer samples, converting
+    // to complex_t only at the output. The taps are those of the float decimation plans quantized
+    // to fixed point, with as many fractional bits as 32bit accumulation allows without any input
+    // being able to overflow.
+    //
+    // The input is split into I and Q and into even and odd samples, so that every tap reads
+    // consecutive samples for consecutive outputs and the inner loop vectorizes. Symmetric taps are
+    // summed once per pair and taps that quantize to zero are skipped.
+    template <class T>
+    class IntDecimator : public Processor<T, complex_t> {
+        using base_type = Processor<T, complex_t>;
+    public:
+        IntDecimator() {}
+
+        IntDecimator(stream<T>* in, unsigned int ratio) { init(in, ratio); }
+
+        ~IntDecimator() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+        }
+
+        void init(stream<T>* in, unsigned int ratio) {
+            configure(ratio);
+            base_type::init(in);
+        }
+
+        // The ratio is the total decimation of the front-end, this block decimates by two of it
+        void setRatio(unsigned int ratio) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            configure(ratio);
+            base_type::tempStart();
+        }
+
+        void reset() {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            clearHistory();
+            base_type::tempStart();
+        }
+
+        // Decimation done by this block, 1 if it only converts
+        unsigned int getDecimation() {
+            return _decim;
+        }
+
+        inline int process(int count, const T* in, complex_t* out) {
+            // Without decimation, just convert
+            if (_decim == 1) {
+                if constexpr (std::is_same_v<T, complex16_t>) {
+                    convert::int_to_complex::s16((const int16_t*)in, out, count);
+                }
+                if constexpr (std::is_same_v<T, complex8_t>) {
+                    convert::int_to_complex::s8((const int8_t*)in, out, count);
+                }
+                return count;
+            }
+
+            // Append the new samples to the history, sample i goes to phase i & 1 at index i >> 1
+            int j = 0;
+            int pos = kept;
+            if (pos & 1) {
+                re[1][pos >> 1] = in[0].re;
+                im[1][pos >> 1] = in[0].im;
+                j++;
+                pos++;
+            }
+            int base = pos >> 1;
+            for (; j + 1 < count; j += 2, base++) {
+                re[0][base] = in[j].re;
+                im[0][base] = in[j].im;
+                re[1][base] = in[j + 1].re;
+                im[1][base] = in[j + 1].im;
+            }
+            if (j < count) {
+                re[0][base] = in[j].re;
+                im[0][base] = in[j].im;
+            }
+            int len = kept + count;
+
+            // Outputs are at offset, offset + 2, ... as long as the whole filter fits
+            int tapCount = _tapCount;
+            int outCount = (len - tapCount - offset >= 0) ? ((len - tapCount - offset) / 2 + 1) : 0;
+            for (int n0 = 0; n0 < outCount; n0 += INT_DECIMATOR_CHUNK) {
+                int n = std::min<int>(INT_DECIMATOR_CHUNK, outCount - n0);
+                int first = offset + 2 * n0;
+                for (int i = 0; i < n; i++) {
+                    accRe[i] = 0;
+                    accIm[i] = 0;
+                }
+                for (const auto& p : pairs) {
+                    const int16_t* ar = &re[(first + p.a) & 1][(first + p.a) >> 1];
+                    const int16_t* ai = &im[(first + p.a) & 1][(first + p.a) >> 1];
+                    const int16_t* br = &re[(first + p.b) & 1][(first + p.b) >> 1];
+                    const int16_t* bi = &im[(first + p.b) & 1][(first + p.b) >> 1];
+                    int32_t t = p.tap;
+                    for (int i = 0; i < n; i++) {
+                        accRe[i] += t * ((int32_t)ar[i] + (int32_t)br[i]);
+                        accIm[i] += t * ((int32_t)ai[i] + (int32_t)bi[i]);
+                    }
+                }
+                for (const auto& s : singles) {
+                    const int16_t* ar = &re[(first + s.a) & 1][(first + s.a) >> 1];
+                    const int16_t* ai = &im[(first + s.a) & 1][(first + s.a) >> 1];
+                    int32_t t = s.tap;
+                    for (int i = 0; i < n; i++) {
+                        accRe[i] += t * (int32_t)ar[i];
+                        accIm[i] += t * (int32_t)ai[i];
+                    }
+                }
+                complex_t* o = &out[n0];
+                for (int i = 0; i < n; i++) {
+                    o[i].re = (float)accRe[i] * outScale;
+                    o[i].im = (float)accIm[i] * outScale;
+                }
+            }
+
+            // Drop what no future output needs, always an even number of samples to keep the phases
+            int next = offset + 2 * outCount;
+            int drop = next & ~1;
+            offset = next - drop;
+            kept = len - drop;
+            int keptPairs = (kept + 1) / 2;
+            for (int c = 0; c < 2; c++) {
+                memmove(re[c].data(), &re[c][drop / 2], keptPairs * sizeof(int16_t));
+                memmove(im[c].data(), &im[c][drop / 2], keptPairs * sizeof(int16_t));
+            }
+
+            return outCount;
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            int outCount = process(count, base_type::_in->readBuf, base_type::out.writeBuf);
+
+            // Swap if some data was generated
+            base_type::_in->flush();
+            if (outCount) {
+                if (!base_type::out.swap(outCount)) { return -1; }
+            }
+            return outCount;
+        }
+
+    private:
+        // Taps at positions a and b of the filter, a == b for a tap that is applied alone
+        struct Tap {
+            int a;
+            int b;
+            int32_t tap;
+        };
+
+        void configure(unsigned int ratio) {
+            _decim = (ratio > 1) ? 2 : 1;
+
+            // When it's the only stage it needs the sharp filter of the last stage, otherwise the first stage of the ratio 4 plan is enough
+            const decim::stage& stage = (ratio > 2) ? decim::plan_4[0] : decim::plan_2[0];
+            _tapCount = stage.tapcount;
+
+            // Use the most fractional bits for which full scale input on every tap still fits in 32bit
+            float fullScale = std::is_same_v<T, complex16_t> ? 32768.0f : 128.0f;
+            double absSum = 0.0;
+            for (int i = 0; i < stage.tapcount; i++) { absSum += fabs(stage.taps[i]); }
+            float tapScale = 32768.0f;
+            while ((absSum * tapScale + stage.tapcount) * fullScale >= 2147483647.0) { tapScale *= 0.5f; }
+            outScale = 1.0f / (tapScale * fullScale);
+
+            std::vector<int32_t> q(stage.tapcount);
+            for (int i = 0; i < stage.tapcount; i++) { q[i] = lrintf(stage.taps[i] * tapScale); }
+            pairs.clear();
+            singles.clear();
+            for (int i = 0, j = stage.tapcount - 1; i <= j; i++, j--) {
+                if (i != j && q[i] == q[j]) {
+                    if (q[i]) { pairs.push_back({ i, j, q[i] }); }
+                    continue;
+                }
+                if (q[i]) { singles.push_back({ i, i, q[i] }); }
+                if (i != j && q[j]) { singles.push_back({ j, j, q[j] }); }
+            }
+
+            // Never more than a full stream buffer and the filter length of history
+            int maxPairs = (STREAM_BUFFER_SIZE + _tapCount + 2) / 2;
+            for (int c = 0; c < 2; c++) {
+                re[c].resize(maxPairs);
+                im[c].resize(maxPairs);
+            }
+            clearHistory();
+        }
+
+        void clearHistory() {
+            for (int c = 0; c < 2; c++) {
+                std::fill(re[c].begin(), re[c].end(), 0);
+                std::fill(im[c].begin(), im[c].end(), 0);
+            }
+            kept = _tapCount - 1;
+            offset = 0;
+        }
+
+        unsigned int _decim = 1;
+        int _tapCount = 0;
+        std::vector<Tap> pairs;
+        std::vector<Tap> singles;
+        float outScale;
+
+        // Even and odd samples of I and Q, history first
+        std::vector<int16_t> re[2];
+        std::vector<int16_t> im[2];
+        int kept = 0;
+        int offset = 0;
+
+        alignas(32) int32_t accRe[INT_DECIMATOR_CHUNK];
+        alignas(32) int32_t accIm[INT_DECIMATOR_CHUNK];
+    };
+}
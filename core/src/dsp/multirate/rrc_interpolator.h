@@ -15,6 +15,7 @@ namespace dsp::multirate {
         void init(stream<T>* in, double symbolrate, double samplerate, double rrcBeta, int rrcTapCount) {
             _symbolrate = symbolrate;
             _samplerate = samplerate;
+            _rrcBeta = rrcBeta;
             _rrcTapCount = rrcTapCount;
 
             rrcTaps = taps::rootRaisedCosine<float>(_rrcTapCount, rrcBeta, _symbolrate, _samplerate);
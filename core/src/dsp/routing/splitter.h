@@ -43,10 +43,36 @@ namespace dsp::routing {
             base_type::tempStart();
         }
 
+        // Handlers called from the splitter thread with every block. Much lighter than a stream
+        // when many consumers only need to copy the data, but they must never block.
+        void bindTap(void (*handler)(const T* data, int count, void* ctx), void* ctx) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            taps.push_back({ handler, ctx });
+            base_type::tempStart();
+        }
+
+        void unbindTap(void (*handler)(const T* data, int count, void* ctx), void* ctx) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            auto tit = std::find_if(taps.begin(), taps.end(), [=](const Tap& t) { return t.handler == handler && t.ctx == ctx; });
+            if (tit == taps.end()) {
+                throw std::runtime_error("[Splitter] Tried to unbind tap that isn't bound");
+            }
+            base_type::tempStop();
+            taps.erase(tit);
+            base_type::tempStart();
+        }
+
         int run() {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
 
+            for (const auto& tap : taps) {
+                tap.handler(base_type::_in->readBuf, count, tap.ctx);
+            }
+
             for (const auto& stream : streams) {
                 memcpy(stream->writeBuf, base_type::_in->readBuf, count * sizeof(T));
                 if (!stream->swap(count)) {
@@ -61,7 +87,13 @@ namespace dsp::routing {
         }
 
     protected:
+        struct Tap {
+            void (*handler)(const T* data, int count, void* ctx);
+            void* ctx;
+        };
+
         std::vector<stream<T>*> streams;
+        std::vector<Tap> taps;
 
     };
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include <math.h>
+#include <stdint.h>
 #include "math/constants.h"
 
 namespace dsp {
@@ -125,4 +126,15 @@ namespace dsp {
         float l;
         float r;
     };
-}
\ No newline at end of file
+
+    // Native integer IQ as delivered by most hardware, converted to complex_t after the first decimation
+    struct complex16_t {
+        int16_t re;
+        int16_t im;
+    };
+
+    struct complex8_t {
+        int8_t re;
+        int8_t im;
+    };
+}
@@ -181,6 +181,22 @@ namespace sourcemenu {
 
         sigpath::sourceManager.showSelectedMenu();
 
+        // Delivery health of the source, if it reports it
+        SourceHealth* health = sigpath::sourceManager.getHealth();
+        if (health) {
+            SourceHealth::Stats stats = health->getStats();
+            if (stats.running) {
+                ImGui::Text("Rate: %.3f/%.3f MS/s", stats.actualRate / 1e6, stats.expectedRate / 1e6);
+                ImGui::Text("Jitter: %.1fms (max interval %.1fms)", stats.jitter * 1e3, stats.maxInterval * 1e3);
+                if (stats.gaps) {
+                    ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Gaps: %llu (%llu samples lost)", (unsigned long long)stats.gaps, (unsigned long long)stats.lostSamples);
+                }
+                else {
+                    ImGui::Text("Gaps: 0");
+                }
+            }
+        }
+
         if (ImGui::Checkbox("IQ Correction##_sdrpp_iq_corr", &iqCorrection)) {
             sigpath::iqFrontEnd.setDCBlocking(iqCorrection);
             core::configManager.acquire();
@@ -1,4 +1,5 @@
 #include "server.h"
+#include "server_session.h"
 #include "core.h"
 #include <utils/flog.h>
 #include <version.h>
@@ -8,73 +9,46 @@
 #include <signal_path/signal_path.h>
 #include <gui/smgui.h>
 #include <utils/optionlist.h>
-#include "dsp/compression/sample_stream_compressor.h"
 #include "dsp/sink/handler_sink.h"
-#include <zstd.h>
+#include "dsp/routing/splitter.h"
+
+// Interval at which client statistics are logged
+#define SERVER_STATS_INTERVAL_MS    10000
 
 namespace server {
     dsp::stream<dsp::complex_t> dummyInput;
-    dsp::compression::SampleStreamCompressor comp;
-    dsp::sink::Handler<uint8_t> hnd;
-    net::Conn client;
-    uint8_t* rbuf = NULL;
-    uint8_t* sbuf = NULL;
-    uint8_t* bbuf = NULL;
-
-    PacketHeader* r_pkt_hdr = NULL;
-    uint8_t* r_pkt_data = NULL;
-    CommandHeader* r_cmd_hdr = NULL;
-    uint8_t* r_cmd_data = NULL;
-
-    PacketHeader* s_pkt_hdr = NULL;
-    uint8_t* s_pkt_data = NULL;
-    CommandHeader* s_cmd_hdr = NULL;
-    uint8_t* s_cmd_data = NULL;
-
-    PacketHeader* bb_pkt_hdr = NULL;
-    uint8_t* bb_pkt_data = NULL;
+    dsp::routing::Splitter<dsp::complex_t> split;
+    dsp::stream<dsp::complex_t> fullIQStream;
+    dsp::sink::Handler<dsp::complex_t> hnd;
 
-    SmGui::DrawListElem dummyElem;
+    std::vector<ClientSession*> sessions;
+    std::mutex sessionsMtx;
+    int nextClientId = 0;
+    int maxClients = 4;
 
-    ZSTD_CCtx* cctx;
+    SmGui::DrawListElem dummyElem;
+    std::recursive_mutex uiMtx;
 
     net::Listener listener;
+    net::Conn udpConn;
+    std::thread udpThread;
+    int udpPort = -1;
 
     OptionList<std::string, std::string> sourceList;
     int sourceId = 0;
     bool running = false;
-    bool compression = false;
     double sampleRate = 1000000.0;
 
     int main() {
         flog::info("=====| SERVER MODE |=====");
 
         // Init DSP
-        comp.init(&dummyInput, dsp::compression::PCM_TYPE_I8);
-        hnd.init(&comp.out, _testServerHandler, NULL);
-        rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        sbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        bbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        comp.start();
+        split.init(&dummyInput);
+        split.bindStream(&fullIQStream);
+        hnd.init(&fullIQStream, _basebandHandler, NULL);
+        split.start();
         hnd.start();
 
-        // Initialize headers
-        r_pkt_hdr = (PacketHeader*)rbuf;
-        r_pkt_data = &rbuf[sizeof(PacketHeader)];
-        r_cmd_hdr = (CommandHeader*)r_pkt_data;
-        r_cmd_data = &rbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
-
-        s_pkt_hdr = (PacketHeader*)sbuf;
-        s_pkt_data = &sbuf[sizeof(PacketHeader)];
-        s_cmd_hdr = (CommandHeader*)s_pkt_data;
-        s_cmd_data = &sbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
-
-        bb_pkt_hdr = (PacketHeader*)bbuf;
-        bb_pkt_data = &bbuf[sizeof(PacketHeader)];
-
-        // Initialize compressor
-        cctx = ZSTD_createCCtx();
-
         // Load config
         core::configManager.acquire();
         std::string modulesDir = core::configManager.conf["modulesDirectory"];
@@ -151,20 +125,48 @@ namespace server {
         // TODO: Use command line option
         std::string host = (std::string)core::args["addr"];
         int port = (int)core::args["port"];
+        maxClients = std::max<int>((int)core::args["maxclients"], 1);
         listener = net::listen(host, port);
         listener->acceptAsync(_clientHandler, NULL);
 
-        flog::info("Ready, listening on {0}:{1}", host, port);
-        while(1) { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }
+        // Open the UDP data channel on the same port, clients fall back to TCP if this fails
+        try {
+            udpConn = net::openUDP(host, port, "0.0.0.0", 0, true);
+            udpPort = port;
+            udpThread = std::thread(udpWorker);
+        }
+        catch (const std::exception& e) {
+            flog::warn("Could not open the UDP data channel: {0}", e.what());
+        }
+
+        flog::info("Ready, listening on {0}:{1} (up to {2} clients)", host, port, maxClients);
+        auto lastStats = std::chrono::steady_clock::now();
+        while(1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            reapSessions();
+
+            // Periodically log client statistics
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastStats < std::chrono::milliseconds(SERVER_STATS_INTERVAL_MS)) { continue; }
+            lastStats = now;
+            for (auto& stats : getClientStats()) {
+                flog::info("Client {0}: {1:.3f} Mbit/s, {2} blocks sent, {3} dropped, queue {4}/{5}, compression {6:.2f}:1 in {7:.3f}ms (level {8}, sample type {9})",
+                            stats.id, stats.bitrate / 1e6, stats.blocksSent, stats.blocksDropped, stats.queueDepth, SERVER_CLIENT_QUEUE_DEPTH,
+                            stats.compressionRatio, stats.compressionTimeMs, stats.compressionLevel, (int)stats.pcmType);
+            }
+        }
 
         return 0;
     }
 
     void _clientHandler(net::Conn conn, void* ctx) {
-        // Reject if someone else is already connected
-        if (client && client->isOpen()) {
-            flog::info("REJECTED Connection from {0}:{1}, another client is already connected.", "TODO", "TODO");
-            
+        std::unique_lock<std::mutex> lck(sessionsMtx);
+
+        // Reject if the server is full
+        if (sessions.size() >= maxClients) {
+            lck.unlock();
+            flog::info("REJECTED Connection, {0} clients are already connected.", maxClients);
+
             // Issue a disconnect command to the client
             uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader)];
             PacketHeader* tmp_phdr = (PacketHeader*)buf;
@@ -178,130 +180,116 @@ namespace server {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
             conn->close();
-            
+
             // Start another async accept
             listener->acceptAsync(_clientHandler, NULL);
             return;
         }
 
-        flog::info("Connection from {0}:{1}", "TODO", "TODO");
-        client = std::move(conn);
-        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
-
-        // Perform settings reset
-        sigpath::sourceManager.stop();
-        comp.setPCMType(dsp::compression::PCM_TYPE_I16);
-        compression = false;
-
-        sendSampleRate(sampleRate);
-
-        // TODO: Wait otherwise someone else could connect
+        // Create the session
+        ClientSession* session = new ClientSession(nextClientId++, std::move(conn));
+        sessions.push_back(session);
+        flog::info("Client {0} connected ({1}/{2})", session->id, sessions.size(), maxClients);
+        session->sendSampleRate(sampleRate);
+        lck.unlock();
 
         listener->acceptAsync(_clientHandler, NULL);
     }
 
-    void _packetHandler(int count, uint8_t* buf, void* ctx) {
-        PacketHeader* hdr = (PacketHeader*)buf;
-
-        // Read the rest of the data (TODO: CHECK SIZE OR SHIT WILL BE FUCKED + ADD TIMEOUT)
-        int len = 0;
-        int read = 0;
-        int goal = hdr->size - sizeof(PacketHeader);
-        while (len < goal) {
-            read = client->read(goal - len, &buf[sizeof(PacketHeader) + len]);
-            if (read < 0) { return; };
-            len += read;
-        }
-
-        // Parse and process
-        if (hdr->type == PACKET_TYPE_COMMAND && hdr->size >= sizeof(PacketHeader) + sizeof(CommandHeader)) {
-            CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
-            commandHandler((Command)chdr->cmd, &buf[sizeof(PacketHeader) + sizeof(CommandHeader)], hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
-        }
-        else {
-            sendError(ERROR_INVALID_PACKET);
+    void _basebandHandler(dsp::complex_t* data, int count, void* ctx) {
+        // Hand the block to every client, slow ones will drop it instead of stalling the DSP
+        std::lock_guard<std::mutex> lck(sessionsMtx);
+        for (auto& session : sessions) {
+            session->pushBaseband(data, count);
         }
-
-        // Start another async read
-        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
     }
 
-    void _testServerHandler(uint8_t* data, int count, void* ctx) {
-        // Compress data if needed and fill out header fields
-        if (compression) {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND_COMPRESSED;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + (uint32_t)ZSTD_compressCCtx(cctx, &bbuf[sizeof(PacketHeader)], SERVER_MAX_PACKET_SIZE, data, count, 1);
-        }
-        else {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + count;
-            memcpy(&bbuf[sizeof(PacketHeader)], data, count);
+    void udpWorker() {
+        uint8_t buf[SERVER_UDP_DATAGRAM_SIZE];
+        while (true) {
+            struct sockaddr_in addr;
+            int len = udpConn->readFrom(sizeof(buf), buf, &addr);
+            if (len < 0) { return; }
+
+            // The only thing clients send on UDP is their hello
+            if (len != sizeof(UDPHello) || buf[0] != UDP_PACKET_TYPE_HELLO) { continue; }
+            UDPHello* hello = (UDPHello*)buf;
+            std::lock_guard<std::mutex> lck(sessionsMtx);
+            for (auto& session : sessions) {
+                session->udpHello(hello->token, addr);
+            }
         }
+    }
 
-        // Write to network
-        if (client && client->isOpen()) { client->write(bb_pkt_hdr->size, bbuf); }
+    int getUDPPort() {
+        return udpPort;
     }
 
-    void setInput(dsp::stream<dsp::complex_t>* stream) {
-        comp.setInput(stream);
+    bool sendUDPDatagram(int size, uint8_t* data, const struct sockaddr_in* addr) {
+        return udpConn->writeTo(size, data, addr);
     }
 
-    void commandHandler(Command cmd, uint8_t* data, int len) {
-        if (cmd == COMMAND_GET_UI) {
-            sendUI(COMMAND_GET_UI, "", dummyElem);
-        }
-        else if (cmd == COMMAND_UI_ACTION && len >= 3) {
-            // Check if sending back data is needed
-            int i = 0;
-            bool sendback = data[i++];
-            len--;
-            
-            // Load id
-            SmGui::DrawListElem diffId;
-            int count = SmGui::DrawList::loadItem(diffId, &data[i], len);
-            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
-            if (diffId.type != SmGui::DRAW_LIST_ELEM_TYPE_STRING) { sendError(ERROR_INVALID_ARGUMENT); return; } 
-            i += count;
-            len -= count;
-
-            // Load value
-            SmGui::DrawListElem diffValue;
-            count = SmGui::DrawList::loadItem(diffValue, &data[i], len);
-            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
-            i += count;
-            len -= count;
-
-            // Render and send back
-            if (sendback) {
-                sendUI(COMMAND_UI_ACTION, diffId.str, diffValue);
+    void reapSessions() {
+        // Remove closed sessions from the list
+        std::vector<ClientSession*> closed;
+        {
+            std::lock_guard<std::mutex> lck(sessionsMtx);
+            for (auto it = sessions.begin(); it != sessions.end();) {
+                if ((*it)->isOpen()) { it++; continue; }
+                closed.push_back(*it);
+                it = sessions.erase(it);
             }
-            else {
-                renderUI(NULL, diffId.str, diffValue);
+        }
+        if (closed.empty()) { return; }
+
+        // Destroy them outside of the lock since stopping their VFOs pauses the DSP
+        for (auto& session : closed) {
+            flog::info("Client {0} disconnected", session->id);
+            delete session;
+        }
+        updateRunning();
+    }
+
+    void updateRunning() {
+        // The source runs as long as at least one client wants it to
+        bool anyRunning = false;
+        {
+            std::lock_guard<std::mutex> lck(sessionsMtx);
+            for (auto& session : sessions) {
+                anyRunning |= session->running;
             }
         }
-        else if (cmd == COMMAND_START) {
+
+        std::lock_guard<std::recursive_mutex> lck(uiMtx);
+        if (anyRunning == running) { return; }
+        if (anyRunning) {
             sigpath::sourceManager.start();
-            running = true;
         }
-        else if (cmd == COMMAND_STOP) {
+        else {
             sigpath::sourceManager.stop();
-            running = false;
-        }
-        else if (cmd == COMMAND_SET_FREQUENCY && len == 8) {
-            sigpath::sourceManager.tune(*(double*)data);
-            sendCommandAck(COMMAND_SET_FREQUENCY, 0);
-        }
-        else if (cmd == COMMAND_SET_SAMPLE_TYPE && len == 1) {
-            dsp::compression::PCMType type = (dsp::compression::PCMType)*(uint8_t*)data;
-            comp.setPCMType(type);
-        }
-        else if (cmd == COMMAND_SET_COMPRESSION && len == 1) {
-            compression = *(uint8_t*)data;
         }
-        else {
-            flog::error("Invalid Command: {0} (len = {1})", (int)cmd, len);
-            sendError(ERROR_INVALID_COMMAND);
+        running = anyRunning;
+    }
+
+    std::vector<ClientStats> getClientStats() {
+        std::vector<ClientStats> stats;
+        std::lock_guard<std::mutex> lck(sessionsMtx);
+        for (auto& session : sessions) {
+            stats.push_back(session->getStats());
         }
+        return stats;
+    }
+
+    void setInput(dsp::stream<dsp::complex_t>* stream) {
+        split.setInput(stream);
+    }
+
+    void bindVFOStream(dsp::stream<dsp::complex_t>* stream) {
+        split.bindStream(stream);
+    }
+
+    void unbindVFOStream(dsp::stream<dsp::complex_t>* stream) {
+        split.unbindStream(stream);
     }
 
     void drawMenu() {
@@ -320,6 +308,9 @@ namespace server {
     }
 
     void renderUI(SmGui::DrawList* dl, std::string diffId, SmGui::DrawListElem diffValue) {
+        // Clients share the same source menu, only one can render it at a time
+        std::lock_guard<std::recursive_mutex> lck(uiMtx);
+
         // If we're recording and there's an action, render once with the action and record without
 
         if (dl && !diffId.empty()) {
@@ -339,49 +330,15 @@ namespace server {
         }
     }
 
-    void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue) {
-        // Render UI
-        SmGui::DrawList dl;
-        renderUI(&dl, diffId, diffValue);
-
-        // Create response
-        int size = dl.getSize();
-        dl.store(s_cmd_data, size);
-
-        // Send to network
-        sendCommandAck(originCmd, size);
-    }
-
-    void sendError(Error err) {
-        PacketHeader* hdr = (PacketHeader*)sbuf;
-        s_pkt_data[0] = err;
-        sendPacket(PACKET_TYPE_ERROR, 1);
-    }
-
-    void sendSampleRate(double sampleRate) {
-        *(double*)s_cmd_data = sampleRate;
-        sendCommand(COMMAND_SET_SAMPLERATE, sizeof(double));
+    double getInputSampleRate() {
+        return sampleRate;
     }
 
     void setInputSampleRate(double samplerate) {
         sampleRate = samplerate;
-        if (!client || !client->isOpen()) { return; }
-        sendSampleRate(sampleRate);
-    }
-
-    void sendPacket(PacketType type, int len) {
-        s_pkt_hdr->type = type;
-        s_pkt_hdr->size = sizeof(PacketHeader) + len;
-        client->write(s_pkt_hdr->size, sbuf);
-    }
-
-    void sendCommand(Command cmd, int len) {
-        s_cmd_hdr->cmd = cmd;
-        sendPacket(PACKET_TYPE_COMMAND, sizeof(CommandHeader) + len);
-    }
-
-    void sendCommandAck(Command cmd, int len) {
-        s_cmd_hdr->cmd = cmd;
-        sendPacket(PACKET_TYPE_COMMAND_ACK, sizeof(CommandHeader) + len);
+        std::lock_guard<std::mutex> lck(sessionsMtx);
+        for (auto& session : sessions) {
+            session->setInputSampleRate(sampleRate);
+        }
     }
 }
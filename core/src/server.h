@@ -5,23 +5,28 @@
 #include <server_protocol.h>
 
 namespace server {
+    struct ClientStats;
+
     void setInput(dsp::stream<dsp::complex_t>* stream);
     int main();
 
     void _clientHandler(net::Conn conn, void* ctx);
-    void _packetHandler(int count, uint8_t* buf, void* ctx);
-    void _testServerHandler(uint8_t* data, int count, void* ctx);
+    void _basebandHandler(dsp::complex_t* data, int count, void* ctx);
 
-    void drawMenu();
+    void reapSessions();
+    void updateRunning();
+    std::vector<ClientStats> getClientStats();
+
+    void udpWorker();
+    int getUDPPort();
+    bool sendUDPDatagram(int size, uint8_t* data, const struct sockaddr_in* addr);
+
+    void bindVFOStream(dsp::stream<dsp::complex_t>* stream);
+    void unbindVFOStream(dsp::stream<dsp::complex_t>* stream);
 
-    void commandHandler(Command cmd, uint8_t* data, int len);
+    void drawMenu();
     void renderUI(SmGui::DrawList* dl, std::string diffId, SmGui::DrawListElem diffValue);
-    void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
-    void sendError(Error err);
-    void sendSampleRate(double sampleRate);
-    void setInputSampleRate(double samplerate);
 
-    void sendPacket(PacketType type, int len);
-    void sendCommand(Command cmd, int len);
-    void sendCommandAck(Command cmd, int len);
+    double getInputSampleRate();
+    void setInputSampleRate(double samplerate);
 }
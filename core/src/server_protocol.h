@@ -4,6 +4,12 @@
 #include <dsp/types.h>
 
 #define SERVER_MAX_PACKET_SIZE  (STREAM_BUFFER_SIZE * sizeof(dsp::complex_t) * 2)
+#define SERVER_MAX_VFO_COUNT    32
+
+// UDP data channel
+#define SERVER_UDP_DATAGRAM_SIZE        1400
+#define SERVER_UDP_MAX_PAYLOAD          (SERVER_UDP_DATAGRAM_SIZE - sizeof(server::UDPHeader))
+#define SERVER_UDP_HELLO_INTERVAL_MS    1000
 
 namespace server {
     enum PacketType {
@@ -27,12 +33,28 @@ namespace server {
         COMMAND_GET_SAMPLERATE,
         COMMAND_SET_SAMPLE_TYPE,
         COMMAND_SET_COMPRESSION,
+        COMMAND_SET_FULL_IQ,
+        COMMAND_ADD_VFO,
+        COMMAND_REMOVE_VFO,
+        COMMAND_SET_VFO_PARAMS,
+        COMMAND_SET_UDP,
 
         // Server to client
         COMMAND_SET_SAMPLERATE = 0x80,
         COMMAND_DISCONNECT
     };
 
+    enum CompressionMode {
+        COMPRESSION_MODE_NONE,
+        COMPRESSION_MODE_ZSTD,
+        COMPRESSION_MODE_ADAPTIVE
+    };
+
+    enum UDPPacketType {
+        UDP_PACKET_TYPE_HELLO,
+        UDP_PACKET_TYPE_DATA
+    };
+
     enum Error {
         ERROR_NONE = 0x00,
         ERROR_INVALID_PACKET,
@@ -49,5 +71,45 @@ namespace server {
     struct CommandHeader {
         uint32_t cmd;
     };
+
+    struct VFOHeader {
+        uint32_t id;
+        uint8_t compressed;
+    };
+
+    struct VFOParams {
+        uint32_t id;
+        double offset;
+        double bandwidth;
+        double sampleRate;
+    };
+
+    struct UDPParams {
+        uint8_t enabled;
+        uint32_t bitrate;   // Pacing rate in bit/s, 0 to send as fast as possible
+    };
+
+    struct UDPInfo {
+        uint8_t error;
+        uint16_t port;
+        uint32_t token;
+    };
+
+    // Sent by the client to the server's UDP port until data arrives, identifies the session and opens NAT mappings
+    struct UDPHello {
+        uint8_t type;
+        uint32_t token;
+    };
+
+    // Packets are split into datagrams that each carry this header
+    struct UDPHeader {
+        uint8_t type;
+        uint32_t seq;
+        uint32_t packetSeq;
+        uint64_t timestamp;     // Index of the first sample of the packet within its stream
+        uint32_t sampleCount;
+        uint16_t fragment;
+        uint16_t fragmentCount;
+    };
 #pragma pack(pop)
 }
\ No newline at end of file
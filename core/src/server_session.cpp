@@ -0,0 +1,682 @@
+#include "server_session.h"
+#include "server.h"
+#include <utils/flog.h>
+#include <signal_path/signal_path.h>
+#include <core.h>
+
+namespace server {
+    ClientSession::ClientSession(int id, net::Conn conn) : id(id) {
+        this->conn = std::move(conn);
+
+        // Allocate control buffers
+        rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+        sbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+
+        // Initialize headers
+        r_pkt_hdr = (PacketHeader*)rbuf;
+        r_pkt_data = &rbuf[sizeof(PacketHeader)];
+
+        s_pkt_hdr = (PacketHeader*)sbuf;
+        s_pkt_data = &sbuf[sizeof(PacketHeader)];
+        s_cmd_hdr = (CommandHeader*)s_pkt_data;
+        s_cmd_data = &sbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
+
+        // Initialize compressor, zstd splits large blocks across its own workers when built with threading support
+        cctx = ZSTD_createCCtx();
+        int workers = std::clamp<int>(std::thread::hardware_concurrency() / 2, 1, SERVER_MAX_COMPRESSION_WORKERS);
+        if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, workers))) {
+            flog::warn("Zstd was built without multithreading, client {0} will compress on a single thread", id);
+        }
+        setCompressionLevel(1);
+
+        // Prepare the UDP data channel
+        udpBuf.resize(SERVER_UDP_DATAGRAM_SIZE);
+        udpHeldBuf.resize(SERVER_UDP_DATAGRAM_SIZE);
+        udpLoss = std::clamp<double>(core::args["udploss"], 0.0, 1.0);
+        udpReorder = std::clamp<double>(core::args["udpreorder"], 0.0, 1.0);
+        udpRng.seed(std::random_device()());
+
+        // Start the send pipeline and the command reader
+        lastStatsTime = std::chrono::steady_clock::now();
+        lastAdaptTime = lastStatsTime;
+        compressThread = std::thread(&ClientSession::compressWorker, this);
+        workerThread = std::thread(&ClientSession::sendWorker, this);
+        this->conn->readAsync(sizeof(PacketHeader), rbuf, packetHandler, this);
+    }
+
+    ClientSession::~ClientSession() {
+        close();
+        removeAllVFOs();
+        for (auto& blk : queue) { delete blk; }
+        for (auto& blk : sendQueue) { delete blk; }
+        for (auto& blk : pool) { delete blk; }
+        ZSTD_freeCCtx(cctx);
+        delete[] rbuf;
+        delete[] sbuf;
+    }
+
+    void ClientSession::pushBaseband(const dsp::complex_t* data, int count) {
+        if (!fullIQ || !running) { return; }
+
+        // Dropped blocks still advance the timestamp so the client can tell how much is missing
+        push(PACKET_TYPE_BASEBAND, 0, (const uint8_t*)data, count * sizeof(dsp::complex_t), basebandTimestamp, count);
+        basebandTimestamp += count;
+    }
+
+    void ClientSession::pushVFO(VFOChannel* ch, const uint8_t* data, int size) {
+        int count = dsp::compression::SampleStreamDecompressor::getSampleCount(size, data);
+        push(PACKET_TYPE_VFO, ch->id, data, size, ch->timestamp, count);
+        ch->timestamp += count;
+    }
+
+    void ClientSession::udpHello(uint32_t token, const struct sockaddr_in& addr) {
+        std::lock_guard<std::mutex> lck(udpMtx);
+        if (!udpEnabled || token != udpToken) { return; }
+        if (!udpReady) { flog::info("Client {0}: UDP data channel established", id); }
+
+        // Follow the client if its NAT mapping changes
+        udpAddr = addr;
+        udpReady = true;
+    }
+
+    void ClientSession::setInputSampleRate(double sampleRate) {
+        {
+            std::lock_guard<std::mutex> lck(vfoMtx);
+            for (auto& [id, ch] : vfos) {
+                ch->vfo.setInSamplerate(sampleRate);
+            }
+        }
+        sendSampleRate(sampleRate);
+    }
+
+    void ClientSession::sendSampleRate(double sampleRate) {
+        std::lock_guard<std::mutex> lck(sendMtx);
+        *(double*)s_cmd_data = sampleRate;
+        sendCommand(COMMAND_SET_SAMPLERATE, sizeof(double));
+    }
+
+    void ClientSession::close() {
+        // Stop the send pipeline
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            stopWorker = true;
+        }
+        queueCnd.notify_all();
+        sendQueueCnd.notify_all();
+        if (compressThread.joinable()) { compressThread.join(); }
+        if (workerThread.joinable()) { workerThread.join(); }
+
+        // Close the connection
+        if (conn) { conn->close(); }
+    }
+
+    bool ClientSession::isOpen() {
+        return conn && conn->isOpen();
+    }
+
+    ClientStats ClientSession::getStats() {
+        std::lock_guard<std::mutex> slck(statsMtx);
+        ClientStats stats;
+        stats.id = id;
+        stats.bytesSent = bytesSent;
+        stats.blocksSent = blocksSent;
+        stats.blocksDropped = blocksDropped;
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            stats.queueDepth = inFlight;
+            stats.compressionLevel = compressionLevel;
+            stats.pcmType = adaptPCMType;
+        }
+        uint64_t outBytes = compressOutBytes;
+        uint64_t blocks = compressedBlocks;
+        stats.compressionRatio = outBytes ? ((double)compressInBytes / (double)outBytes) : 1.0;
+        stats.compressionTimeMs = blocks ? ((double)compressTimeNs / (double)blocks / 1e6) : 0.0;
+
+        // Compute the bitrate since the last call
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastStatsTime).count();
+        stats.bitrate = (elapsed > 0) ? ((double)(stats.bytesSent - lastBytesSent) * 8.0 / elapsed) : 0.0;
+        lastBytesSent = stats.bytesSent;
+        lastStatsTime = now;
+
+        return stats;
+    }
+
+    void ClientSession::packetHandler(int count, uint8_t* buf, void* ctx) {
+        ClientSession* _this = (ClientSession*)ctx;
+        PacketHeader* hdr = (PacketHeader*)buf;
+
+        // Refuse packets that wouldn't fit in the buffer
+        if (hdr->size < sizeof(PacketHeader) || hdr->size > SERVER_MAX_PACKET_SIZE) {
+            flog::error("Client {0} sent an invalid packet size, disconnecting", _this->id);
+            _this->conn->close();
+            return;
+        }
+
+        // Read the rest of the data
+        int len = 0;
+        int read = 0;
+        int goal = hdr->size - sizeof(PacketHeader);
+        while (len < goal) {
+            read = _this->conn->read(goal - len, &buf[sizeof(PacketHeader) + len]);
+            if (read < 0) { return; };
+            len += read;
+        }
+
+        // Parse and process
+        if (hdr->type == PACKET_TYPE_COMMAND && hdr->size >= sizeof(PacketHeader) + sizeof(CommandHeader)) {
+            CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+            _this->commandHandler((Command)chdr->cmd, &buf[sizeof(PacketHeader) + sizeof(CommandHeader)], hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
+        }
+        else {
+            _this->sendError(ERROR_INVALID_PACKET);
+        }
+
+        // Start another async read
+        _this->conn->readAsync(sizeof(PacketHeader), _this->rbuf, packetHandler, _this);
+    }
+
+    void ClientSession::vfoHandler(uint8_t* data, int count, void* ctx) {
+        VFOChannel* ch = (VFOChannel*)ctx;
+        ch->session->pushVFO(ch, data, count);
+    }
+
+    void ClientSession::commandHandler(Command cmd, uint8_t* data, int len) {
+        if (cmd == COMMAND_GET_UI) {
+            sendUI(COMMAND_GET_UI, "", SmGui::DrawListElem());
+        }
+        else if (cmd == COMMAND_UI_ACTION && len >= 3) {
+            // Check if sending back data is needed
+            int i = 0;
+            bool sendback = data[i++];
+            len--;
+
+            // Load id
+            SmGui::DrawListElem diffId;
+            int count = SmGui::DrawList::loadItem(diffId, &data[i], len);
+            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
+            if (diffId.type != SmGui::DRAW_LIST_ELEM_TYPE_STRING) { sendError(ERROR_INVALID_ARGUMENT); return; }
+            i += count;
+            len -= count;
+
+            // Load value
+            SmGui::DrawListElem diffValue;
+            count = SmGui::DrawList::loadItem(diffValue, &data[i], len);
+            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
+            i += count;
+            len -= count;
+
+            // Render and send back
+            if (sendback) {
+                sendUI(COMMAND_UI_ACTION, diffId.str, diffValue);
+            }
+            else {
+                renderUI(NULL, diffId.str, diffValue);
+            }
+        }
+        else if (cmd == COMMAND_START) {
+            running = true;
+            updateRunning();
+        }
+        else if (cmd == COMMAND_STOP) {
+            running = false;
+            updateRunning();
+        }
+        else if (cmd == COMMAND_SET_FREQUENCY && len == 8) {
+            sigpath::sourceManager.tune(*(double*)data);
+            std::lock_guard<std::mutex> lck(sendMtx);
+            sendCommandAck(COMMAND_SET_FREQUENCY, 0);
+        }
+        else if (cmd == COMMAND_SET_SAMPLE_TYPE && len == 1 && data[0] <= dsp::compression::PCM_TYPE_F32) {
+            setPCMType((dsp::compression::PCMType)*(uint8_t*)data);
+        }
+        else if (cmd == COMMAND_SET_COMPRESSION && len == 1 && data[0] <= COMPRESSION_MODE_ADAPTIVE) {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            compression = (CompressionMode)data[0];
+            adaptPCMType = pcmType.load();
+            if (compression != COMPRESSION_MODE_ADAPTIVE) { setCompressionLevel(1); }
+        }
+        else if (cmd == COMMAND_SET_UDP && len == sizeof(UDPParams)) {
+            UDPInfo info = {};
+            setUDP(*(UDPParams*)data, info);
+            std::lock_guard<std::mutex> lck(sendMtx);
+            memcpy(s_cmd_data, &info, sizeof(UDPInfo));
+            sendCommandAck(COMMAND_SET_UDP, sizeof(UDPInfo));
+        }
+        else if (cmd == COMMAND_SET_FULL_IQ && len == 1) {
+            fullIQ = (*(uint8_t*)data != 0);
+        }
+        else if (cmd == COMMAND_ADD_VFO && len == sizeof(VFOParams)) {
+            Error err = addVFO(*(VFOParams*)data);
+            std::lock_guard<std::mutex> lck(sendMtx);
+            s_cmd_data[0] = err;
+            sendCommandAck(COMMAND_ADD_VFO, 1);
+        }
+        else if (cmd == COMMAND_SET_VFO_PARAMS && len == sizeof(VFOParams)) {
+            Error err = setVFOParams(*(VFOParams*)data);
+            std::lock_guard<std::mutex> lck(sendMtx);
+            s_cmd_data[0] = err;
+            sendCommandAck(COMMAND_SET_VFO_PARAMS, 1);
+        }
+        else if (cmd == COMMAND_REMOVE_VFO && len == sizeof(uint32_t)) {
+            Error err = removeVFO(*(uint32_t*)data);
+            std::lock_guard<std::mutex> lck(sendMtx);
+            s_cmd_data[0] = err;
+            sendCommandAck(COMMAND_REMOVE_VFO, 1);
+        }
+        else {
+            flog::error("Invalid Command from client {0}: {1} (len = {2})", id, (int)cmd, len);
+            sendError(ERROR_INVALID_COMMAND);
+        }
+    }
+
+    void ClientSession::sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue) {
+        // Render UI
+        SmGui::DrawList dl;
+        renderUI(&dl, diffId, diffValue);
+
+        // Create response and send it
+        std::lock_guard<std::mutex> lck(sendMtx);
+        int size = dl.getSize();
+        dl.store(s_cmd_data, size);
+        sendCommandAck(originCmd, size);
+    }
+
+    void ClientSession::sendError(Error err) {
+        std::lock_guard<std::mutex> lck(sendMtx);
+        s_pkt_data[0] = err;
+        sendPacket(PACKET_TYPE_ERROR, 1);
+    }
+
+    void ClientSession::sendPacket(PacketType type, int len) {
+        s_pkt_hdr->type = type;
+        s_pkt_hdr->size = sizeof(PacketHeader) + len;
+        conn->write(s_pkt_hdr->size, sbuf);
+    }
+
+    void ClientSession::sendCommand(Command cmd, int len) {
+        s_cmd_hdr->cmd = cmd;
+        sendPacket(PACKET_TYPE_COMMAND, sizeof(CommandHeader) + len);
+    }
+
+    void ClientSession::sendCommandAck(Command cmd, int len) {
+        s_cmd_hdr->cmd = cmd;
+        sendPacket(PACKET_TYPE_COMMAND_ACK, sizeof(CommandHeader) + len);
+    }
+
+    void ClientSession::setPCMType(dsp::compression::PCMType type) {
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            pcmType = type;
+            adaptPCMType = type;
+        }
+        std::lock_guard<std::mutex> lck(vfoMtx);
+        for (auto& [id, ch] : vfos) {
+            ch->comp.setPCMType(type);
+        }
+    }
+
+    bool checkVFOParams(const VFOParams& params) {
+        double sampleRate = getInputSampleRate();
+        if (params.sampleRate <= 0 || params.sampleRate > sampleRate) { return false; }
+        if (params.bandwidth <= 0 || params.bandwidth > params.sampleRate) { return false; }
+        if (std::abs(params.offset) > sampleRate / 2.0) { return false; }
+        return true;
+    }
+
+    Error ClientSession::addVFO(const VFOParams& params) {
+        std::lock_guard<std::mutex> lck(vfoMtx);
+        if (vfos.size() >= SERVER_MAX_VFO_COUNT || vfos.find(params.id) != vfos.end()) { return ERROR_INVALID_ARGUMENT; }
+        if (!checkVFOParams(params)) { return ERROR_INVALID_ARGUMENT; }
+
+        // Create the channel's DSP chain
+        VFOChannel* ch = new VFOChannel;
+        ch->session = this;
+        ch->id = params.id;
+        ch->vfo.init(&ch->input, getInputSampleRate(), params.sampleRate, params.bandwidth, params.offset);
+        ch->comp.init(&ch->vfo.out, pcmType);
+        ch->hnd.init(&ch->comp.out, vfoHandler, ch);
+        ch->vfo.start();
+        ch->comp.start();
+        ch->hnd.start();
+
+        // Feed it from the baseband
+        bindVFOStream(&ch->input);
+        vfos[params.id] = ch;
+
+        flog::info("Client {0} added VFO {1} (offset: {2}, bandwidth: {3}, samplerate: {4})", id, params.id, params.offset, params.bandwidth, params.sampleRate);
+        return ERROR_NONE;
+    }
+
+    Error ClientSession::setVFOParams(const VFOParams& params) {
+        std::lock_guard<std::mutex> lck(vfoMtx);
+        auto it = vfos.find(params.id);
+        if (it == vfos.end() || !checkVFOParams(params)) { return ERROR_INVALID_ARGUMENT; }
+        VFOChannel* ch = it->second;
+        ch->vfo.setOffset(params.offset);
+        ch->vfo.setOutSamplerate(params.sampleRate, params.bandwidth);
+        return ERROR_NONE;
+    }
+
+    Error ClientSession::removeVFO(uint32_t vfoId) {
+        std::lock_guard<std::mutex> lck(vfoMtx);
+        auto it = vfos.find(vfoId);
+        if (it == vfos.end()) { return ERROR_INVALID_ARGUMENT; }
+        destroyVFO(it->second);
+        vfos.erase(it);
+        flog::info("Client {0} removed VFO {1}", id, vfoId);
+        return ERROR_NONE;
+    }
+
+    void ClientSession::removeAllVFOs() {
+        std::lock_guard<std::mutex> lck(vfoMtx);
+        for (auto& [vfoId, ch] : vfos) {
+            destroyVFO(ch);
+        }
+        vfos.clear();
+    }
+
+    void ClientSession::destroyVFO(VFOChannel* ch) {
+        unbindVFOStream(&ch->input);
+        ch->vfo.stop();
+        ch->comp.stop();
+        ch->hnd.stop();
+        delete ch;
+    }
+
+    bool ClientSession::push(PacketType type, uint32_t vfoId, const uint8_t* data, int size, uint64_t timestamp, int sampleCount) {
+        // Grab a free block, dropping the data if the client is too far behind
+        SendBlock* blk;
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            if (stopWorker) { return false; }
+            if (inFlight >= SERVER_CLIENT_QUEUE_DEPTH) {
+                blocksDropped++;
+                return false;
+            }
+            if (pool.empty()) {
+                blk = new SendBlock;
+            }
+            else {
+                blk = pool.back();
+                pool.pop_back();
+            }
+            inFlight++;
+        }
+
+        // Copy the data outside of the lock
+        blk->type = type;
+        blk->vfoId = vfoId;
+        blk->size = size;
+        blk->timestamp = timestamp;
+        blk->sampleCount = sampleCount;
+        if (blk->data.size() < size) { blk->data.resize(size); }
+        memcpy(blk->data.data(), data, size);
+
+        // Queue it for compression
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            queue.push_back(blk);
+        }
+        queueCnd.notify_one();
+        return true;
+    }
+
+    void ClientSession::releaseBlock(SendBlock* blk) {
+        std::lock_guard<std::mutex> lck(queueMtx);
+        pool.push_back(blk);
+        inFlight--;
+    }
+
+    void ClientSession::compressWorker() {
+        while (true) {
+            // Wait for a block or exit if the session is closing
+            SendBlock* blk;
+            {
+                std::unique_lock<std::mutex> lck(queueMtx);
+                queueCnd.wait(lck, [this]() { return (!queue.empty() || stopWorker); });
+                if (stopWorker) { return; }
+                blk = queue.front();
+                queue.pop_front();
+            }
+
+            // Compress while the previous block is still being sent
+            auto start = std::chrono::steady_clock::now();
+            buildPacket(blk);
+            compressBusyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+            // Hand it over to the sender
+            {
+                std::lock_guard<std::mutex> lck(queueMtx);
+                sendQueue.push_back(blk);
+            }
+            sendQueueCnd.notify_one();
+
+            if (compression == COMPRESSION_MODE_ADAPTIVE) { adapt(); }
+        }
+    }
+
+    void ClientSession::sendWorker() {
+        while (true) {
+            // Wait for a packet or exit if the session is closing
+            SendBlock* blk;
+            {
+                std::unique_lock<std::mutex> lck(queueMtx);
+                sendQueueCnd.wait(lck, [this]() { return (!sendQueue.empty() || stopWorker); });
+                if (stopWorker) { return; }
+                blk = sendQueue.front();
+                sendQueue.pop_front();
+            }
+
+            // Check if the packet should go over UDP
+            bool useUDP;
+            struct sockaddr_in addr;
+            {
+                std::lock_guard<std::mutex> lck(udpMtx);
+                useUDP = (udpEnabled && udpReady);
+                addr = udpAddr;
+            }
+
+            // Write to network, UDP is best effort so it never fails the session
+            auto start = std::chrono::steady_clock::now();
+            bool ok = true;
+            if (useUDP) {
+                sendUDP(blk, addr);
+            }
+            else {
+                ok = conn->write(blk->packetSize, blk->packet.data());
+            }
+            writeBusyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            if (ok) {
+                bytesSent += blk->packetSize;
+                blocksSent++;
+            }
+
+            releaseBlock(blk);
+            if (!ok) { return; }
+        }
+    }
+
+    void ClientSession::setUDP(const UDPParams& params, UDPInfo& info) {
+        int port = getUDPPort();
+        if (params.enabled && port < 0) {
+            info.error = ERROR_INVALID_COMMAND;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lck(udpMtx);
+        udpEnabled = params.enabled;
+        udpReady = false;
+        udpBitrate = params.bitrate;
+        udpToken = std::random_device()();
+        info.error = ERROR_NONE;
+        info.port = std::max<int>(port, 0);
+        info.token = udpToken;
+        flog::info("Client {0}: UDP data channel {1} (pacing: {2} bit/s)", id, udpEnabled ? "requested" : "disabled", udpBitrate);
+    }
+
+    void ClientSession::sendUDP(SendBlock* blk, const struct sockaddr_in& addr) {
+        // Split the packet into datagrams sharing the packet's sequence number and timestamp
+        int fragmentCount = (blk->packetSize + SERVER_UDP_MAX_PAYLOAD - 1) / SERVER_UDP_MAX_PAYLOAD;
+        UDPHeader* hdr = (UDPHeader*)udpBuf.data();
+        hdr->type = UDP_PACKET_TYPE_DATA;
+        hdr->packetSeq = udpPacketSeq++;
+        hdr->timestamp = blk->timestamp;
+        hdr->sampleCount = blk->sampleCount;
+        hdr->fragmentCount = fragmentCount;
+
+        for (int i = 0; i < fragmentCount; i++) {
+            int offset = i * SERVER_UDP_MAX_PAYLOAD;
+            int len = std::min<int>(SERVER_UDP_MAX_PAYLOAD, blk->packetSize - offset);
+            hdr->seq = udpSeq++;
+            hdr->fragment = i;
+            memcpy(&udpBuf[sizeof(UDPHeader)], &blk->packet[offset], len);
+            int size = sizeof(UDPHeader) + len;
+
+            // Pace to the requested bitrate
+            if (udpBitrate) {
+                auto now = std::chrono::steady_clock::now();
+                auto maxCredit = std::chrono::microseconds(SERVER_UDP_PACING_BURST_US);
+                if (udpNextSend > now) {
+                    std::this_thread::sleep_until(udpNextSend);
+                }
+                else if (now - udpNextSend > maxCredit) {
+                    udpNextSend = now - maxCredit;
+                }
+                udpNextSend += std::chrono::nanoseconds((uint64_t)size * 8000000000ull / udpBitrate);
+            }
+
+            sendDatagram(size, addr);
+        }
+    }
+
+    void ClientSession::sendDatagram(int size, const struct sockaddr_in& addr) {
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        if (udpLoss > 0.0 && dist(udpRng) < udpLoss) { return; }
+
+        // Hold back a datagram so that it goes out after the next one
+        if (udpReorder > 0.0 && !udpHeldSize && dist(udpRng) < udpReorder) {
+            memcpy(udpHeldBuf.data(), udpBuf.data(), size);
+            udpHeldSize = size;
+            return;
+        }
+
+        sendUDPDatagram(size, udpBuf.data(), &addr);
+        if (udpHeldSize) {
+            sendUDPDatagram(udpHeldSize, udpHeldBuf.data(), &addr);
+            udpHeldSize = 0;
+        }
+    }
+
+    void ClientSession::buildPacket(SendBlock* blk) {
+        const uint8_t* payload = blk->data.data();
+        int payloadSize = blk->size;
+        CompressionMode mode = compression;
+        dsp::compression::PCMType basebandPCMType = adaptPCMType;
+
+        // Quantize baseband to the client's sample type
+        if (blk->type == PACKET_TYPE_BASEBAND) {
+            int count = blk->size / sizeof(dsp::complex_t);
+            size_t maxSize = 8 + blk->size;
+            if (pcmBuf.size() < maxSize) { pcmBuf.resize(maxSize); }
+            payloadSize = dsp::compression::SampleStreamCompressor::process(count, basebandPCMType, (const dsp::complex_t*)payload, pcmBuf.data());
+            payload = pcmBuf.data();
+        }
+
+        // Work out the header size and make sure the packet buffer is big enough for the worst case
+        int hdrSize = sizeof(PacketHeader) + ((blk->type == PACKET_TYPE_VFO) ? sizeof(VFOHeader) : 0);
+        size_t maxSize = hdrSize + (mode ? ZSTD_compressBound(payloadSize) : payloadSize);
+        if (blk->packet.size() < maxSize) { blk->packet.resize(maxSize); }
+        PacketHeader* hdr = (PacketHeader*)blk->packet.data();
+        uint8_t* data = &blk->packet[hdrSize];
+
+        // Compress data if needed and fill out header fields
+        int dataSize;
+        if (mode) {
+            // The level can only be changed between frames, cctx is never touched by any other thread
+            int level = compressionLevel;
+            if (level != appliedLevel) {
+                ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+                appliedLevel = level;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            size_t ret = ZSTD_compress2(cctx, data, blk->packet.size() - hdrSize, payload, payloadSize);
+            compressTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+            // Fall back to sending uncompressed data if zstd failed
+            if (ZSTD_isError(ret)) {
+                flog::error("Client {0}: compression failed: {1}", id, ZSTD_getErrorName(ret));
+                mode = COMPRESSION_MODE_NONE;
+                dataSize = payloadSize;
+                memcpy(data, payload, payloadSize);
+            }
+            else {
+                dataSize = ret;
+                compressInBytes += payloadSize;
+                compressOutBytes += dataSize;
+                compressedBlocks++;
+            }
+        }
+        else {
+            dataSize = payloadSize;
+            memcpy(data, payload, payloadSize);
+        }
+        if (blk->type == PACKET_TYPE_VFO) {
+            VFOHeader* vhdr = (VFOHeader*)&blk->packet[sizeof(PacketHeader)];
+            vhdr->id = blk->vfoId;
+            vhdr->compressed = (mode != COMPRESSION_MODE_NONE);
+            hdr->type = PACKET_TYPE_VFO;
+        }
+        else {
+            hdr->type = mode ? PACKET_TYPE_BASEBAND_COMPRESSED : PACKET_TYPE_BASEBAND;
+        }
+        hdr->size = hdrSize + dataSize;
+        blk->packetSize = hdr->size;
+    }
+
+    void ClientSession::setCompressionLevel(int level) {
+        compressionLevel = level;
+    }
+
+    void ClientSession::adapt() {
+        // Only re-evaluate once per interval
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastAdaptTime).count();
+        if (elapsed < SERVER_ADAPT_INTERVAL_MS / 1000.0) { return; }
+        lastAdaptTime = now;
+
+        // Measure how busy the compressor and the link were
+        double compressBusy = (double)compressBusyNs.exchange(0) / (elapsed * 1e9);
+        double writeBusy = (double)writeBusyNs.exchange(0) / (elapsed * 1e9);
+        uint64_t dropped = blocksDropped;
+        bool dropping = (dropped != lastDropped);
+        lastDropped = dropped;
+
+        std::lock_guard<std::mutex> lck(queueMtx);
+        if (compressBusy > SERVER_ADAPT_BUSY_HIGH && compressionLevel > SERVER_ADAPT_MIN_LEVEL) {
+            // The compressor can't keep up, trade ratio for speed
+            setCompressionLevel(compressionLevel - 1);
+        }
+        else if (writeBusy > SERVER_ADAPT_BUSY_HIGH || dropping) {
+            // The link is the bottleneck, compress harder if there's CPU left or else reduce the sample depth
+            if (compressBusy < SERVER_ADAPT_BUSY_LOW && compressionLevel < SERVER_ADAPT_MAX_LEVEL) {
+                setCompressionLevel(compressionLevel + 1);
+            }
+            else if (adaptPCMType == dsp::compression::PCM_TYPE_F32) {
+                adaptPCMType = dsp::compression::PCM_TYPE_I16;
+            }
+            else if (adaptPCMType == dsp::compression::PCM_TYPE_I16) {
+                adaptPCMType = dsp::compression::PCM_TYPE_I8;
+            }
+        }
+        else if (writeBusy < SERVER_ADAPT_BUSY_LOW && adaptPCMType != pcmType) {
+            // The link has room again, go back towards the requested sample depth
+            adaptPCMType = (adaptPCMType == dsp::compression::PCM_TYPE_I8) ? dsp::compression::PCM_TYPE_I16 : pcmType.load();
+        }
+        else if (compressBusy < SERVER_ADAPT_BUSY_LOW && writeBusy > SERVER_ADAPT_BUSY_LOW && compressionLevel < SERVER_ADAPT_MAX_LEVEL) {
+            // Use spare CPU to save bandwidth
+            setCompressionLevel(compressionLevel + 1);
+        }
+    }
+}
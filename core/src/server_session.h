@@ -0,0 +1,197 @@
+#pragma once
+#include <utils/networking.h>
+#include <dsp/types.h>
+#include <dsp/channel/rx_vfo.h>
+#include <dsp/compression/sample_stream_compressor.h>
+#include <dsp/compression/sample_stream_decompressor.h>
+#include <dsp/sink/handler_sink.h>
+#include <server_protocol.h>
+#include <zstd.h>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+// Number of blocks a client can lag behind before frames get dropped
+#define SERVER_CLIENT_QUEUE_DEPTH           8
+
+// Adaptive compression settings
+#define SERVER_ADAPT_INTERVAL_MS            1000
+#define SERVER_ADAPT_MIN_LEVEL              -5
+#define SERVER_ADAPT_MAX_LEVEL              9
+#define SERVER_ADAPT_BUSY_HIGH              0.8
+#define SERVER_ADAPT_BUSY_LOW               0.4
+#define SERVER_MAX_COMPRESSION_WORKERS      4
+
+// UDP pacing credit that can be accumulated, absorbs late wakeups without allowing large bursts
+#define SERVER_UDP_PACING_BURST_US          2000
+
+namespace server {
+    class ClientSession;
+
+    struct SendBlock {
+        PacketType type;
+        uint32_t vfoId;
+        int size;
+        uint64_t timestamp;
+        int sampleCount;
+        std::vector<uint8_t> data;
+        int packetSize;
+        std::vector<uint8_t> packet;
+    };
+
+    struct VFOChannel {
+        ClientSession* session;
+        uint32_t id;
+        dsp::stream<dsp::complex_t> input;
+        dsp::channel::RxVFO vfo;
+        dsp::compression::SampleStreamCompressor comp;
+        dsp::sink::Handler<uint8_t> hnd;
+        uint64_t timestamp = 0;
+    };
+
+    struct ClientStats {
+        int id;
+        uint64_t bytesSent;
+        uint64_t blocksSent;
+        uint64_t blocksDropped;
+        int queueDepth;
+        double bitrate;
+
+        // Compression
+        double compressionRatio;
+        double compressionTimeMs;
+        int compressionLevel;
+        dsp::compression::PCMType pcmType;
+    };
+
+    class ClientSession {
+    public:
+        ClientSession(int id, net::Conn conn);
+        ~ClientSession();
+
+        void pushBaseband(const dsp::complex_t* data, int count);
+        void pushVFO(VFOChannel* ch, const uint8_t* data, int size);
+        void udpHello(uint32_t token, const struct sockaddr_in& addr);
+
+        void setInputSampleRate(double sampleRate);
+        void sendSampleRate(double sampleRate);
+
+        void close();
+        bool isOpen();
+
+        ClientStats getStats();
+
+        const int id;
+        std::atomic<bool> running = false;
+
+    private:
+        static void packetHandler(int count, uint8_t* buf, void* ctx);
+        static void vfoHandler(uint8_t* data, int count, void* ctx);
+
+        void commandHandler(Command cmd, uint8_t* data, int len);
+        void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
+        void sendError(Error err);
+        void sendPacket(PacketType type, int len);
+        void sendCommand(Command cmd, int len);
+        void sendCommandAck(Command cmd, int len);
+
+        void setPCMType(dsp::compression::PCMType type);
+        Error addVFO(const VFOParams& params);
+        Error setVFOParams(const VFOParams& params);
+        Error removeVFO(uint32_t id);
+        void removeAllVFOs();
+        void destroyVFO(VFOChannel* ch);
+
+        bool push(PacketType type, uint32_t vfoId, const uint8_t* data, int size, uint64_t timestamp, int sampleCount);
+        void compressWorker();
+        void sendWorker();
+        void buildPacket(SendBlock* blk);
+        void releaseBlock(SendBlock* blk);
+        void setUDP(const UDPParams& params, UDPInfo& info);
+        void sendUDP(SendBlock* blk, const struct sockaddr_in& addr);
+        void sendDatagram(int size, const struct sockaddr_in& addr);
+        void setCompressionLevel(int level);
+        void adapt();
+
+        net::Conn conn;
+
+        // Control path
+        uint8_t* rbuf = NULL;
+        uint8_t* sbuf = NULL;
+        PacketHeader* r_pkt_hdr = NULL;
+        uint8_t* r_pkt_data = NULL;
+        PacketHeader* s_pkt_hdr = NULL;
+        uint8_t* s_pkt_data = NULL;
+        CommandHeader* s_cmd_hdr = NULL;
+        uint8_t* s_cmd_data = NULL;
+        std::mutex sendMtx;
+
+        // Client settings, also read by the compressor thread
+        std::atomic<dsp::compression::PCMType> pcmType = dsp::compression::PCM_TYPE_I16;
+        std::atomic<CompressionMode> compression = COMPRESSION_MODE_NONE;
+        std::atomic<bool> fullIQ = true;
+        uint64_t basebandTimestamp = 0;
+
+        // VFOs
+        std::map<uint32_t, VFOChannel*> vfos;
+        std::mutex vfoMtx;
+
+        // Send pipeline, blocks go from the compression queue to the send queue
+        std::deque<SendBlock*> queue;
+        std::deque<SendBlock*> sendQueue;
+        std::vector<SendBlock*> pool;
+        int inFlight = 0;
+        std::mutex queueMtx;
+        std::condition_variable queueCnd;
+        std::condition_variable sendQueueCnd;
+        bool stopWorker = false;
+        std::thread compressThread;
+        std::thread workerThread;
+
+        // UDP data channel, data goes over TCP until the client's hello arrives
+        bool udpEnabled = false;
+        bool udpReady = false;
+        uint32_t udpToken = 0;
+        uint32_t udpBitrate = 0;
+        struct sockaddr_in udpAddr = {};
+        std::mutex udpMtx;
+        uint32_t udpSeq = 0;
+        uint32_t udpPacketSeq = 0;
+        std::vector<uint8_t> udpBuf;
+        std::chrono::steady_clock::time_point udpNextSend;
+
+        // Simulated impairments, used to test loss concealment over loopback
+        double udpLoss = 0.0;
+        double udpReorder = 0.0;
+        std::vector<uint8_t> udpHeldBuf;
+        int udpHeldSize = 0;
+        std::mt19937 udpRng;
+
+        // Compressor state
+        ZSTD_CCtx* cctx;
+        std::vector<uint8_t> pcmBuf;
+        std::atomic<int> compressionLevel = 1;     // Requested level, applied to cctx by the compressor thread between frames
+        int appliedLevel = 0;
+        std::atomic<dsp::compression::PCMType> adaptPCMType = dsp::compression::PCM_TYPE_I16;
+
+        // Adaptation state
+        std::atomic<uint64_t> compressBusyNs = 0;
+        std::atomic<uint64_t> writeBusyNs = 0;
+        uint64_t lastDropped = 0;
+        std::chrono::steady_clock::time_point lastAdaptTime;
+
+        // Statistics
+        std::atomic<uint64_t> bytesSent = 0;
+        std::atomic<uint64_t> blocksSent = 0;
+        std::atomic<uint64_t> blocksDropped = 0;
+        std::atomic<uint64_t> compressInBytes = 0;
+        std::atomic<uint64_t> compressOutBytes = 0;
+        std::atomic<uint64_t> compressTimeNs = 0;
+        std::atomic<uint64_t> compressedBlocks = 0;
+        std::mutex statsMtx;                       // Held by getStats(), protects the bitrate reference below
+        uint64_t lastBytesSent = 0;
+        std::chrono::steady_clock::time_point lastStatsTime;
+    };
+}
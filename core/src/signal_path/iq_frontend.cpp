@@ -26,8 +26,12 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
 
     effectiveSr = _sampleRate / _decimRatio;
 
+    intDecim16.init(NULL, _decimRatio);
+    intDecim8.init(NULL, _decimRatio);
+
     inBuf.init(in);
-    inBuf.bypass = !buffering;
+    sourceBuffering = buffering;
+    inBuf.bypass = !sourceBuffering || lowLatency;
 
     decim.init(NULL, _decimRatio);
     dcBlock.init(NULL, genDCBlockRate(effectiveSr));
@@ -70,7 +74,59 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
 }
 
 void IQFrontEnd::setInput(dsp::stream<dsp::complex_t>* in) {
+    stopIntInput();
     inBuf.setInput(in);
+    updateDecimation();
+}
+
+void IQFrontEnd::setInput(dsp::stream<dsp::complex16_t>* in) {
+    stopIntInput();
+    intDecim16.setInput(in);
+    inBuf.setInput(&intDecim16.out);
+    inputType = INPUT_INT16;
+    updateDecimation();
+    if (running) { intDecim16.start(); }
+}
+
+void IQFrontEnd::setInput(dsp::stream<dsp::complex8_t>* in) {
+    stopIntInput();
+    intDecim8.setInput(in);
+    inBuf.setInput(&intDecim8.out);
+    inputType = INPUT_INT8;
+    updateDecimation();
+    if (running) { intDecim8.start(); }
+}
+
+void IQFrontEnd::stopIntInput() {
+    if (inputType == INPUT_INT16) { intDecim16.stop(); }
+    if (inputType == INPUT_INT8) { intDecim8.stop(); }
+    inputType = INPUT_COMPLEX;
+}
+
+void IQFrontEnd::updateDecimation() {
+    // With an integer input, the first decimation by two was already done before the buffer
+    unsigned int firstStage = 1;
+    if (inputType == INPUT_INT16) {
+        intDecim16.setRatio(_decimRatio);
+        firstStage = intDecim16.getDecimation();
+    }
+    else if (inputType == INPUT_INT8) {
+        intDecim8.setRatio(_decimRatio);
+        firstStage = intDecim8.getDecimation();
+    }
+    int ratio = _decimRatio / firstStage;
+
+    // Temp stop the decimator
+    decim.tempStop();
+
+    // Update the decimation ratio
+    if (ratio > 1) { decim.setRatio(ratio); }
+
+    // Restart the decimator if it was running
+    decim.tempStart();
+
+    // Enable or disable in the chain
+    preproc.setBlockEnabled(&decim, ratio > 1, [=](dsp::stream<dsp::complex_t>* out){ split.setInput(out); });
 }
 
 void IQFrontEnd::setSampleRate(double sampleRate) {
@@ -96,26 +152,36 @@ void IQFrontEnd::setSampleRate(double sampleRate) {
     for (auto& [name, vfo] : vfos) {
         vfo->tempStart();
     }
+
+    onSampleRateChanged.emit(getSampleRate());
 }
 
 void IQFrontEnd::setBuffering(bool enabled) {
-    inBuf.bypass = !enabled;
+    sourceBuffering = enabled;
+    updateBuffering();
 }
 
-void IQFrontEnd::setDecimation(int ratio) {
-    // Temp stop the decimator
-    decim.tempStop();
+void IQFrontEnd::setLowLatency(bool enabled) {
+    lowLatency = enabled;
+    updateBuffering();
+}
+
+void IQFrontEnd::updateBuffering() {
+    bool bypass = !sourceBuffering || lowLatency;
+    if (inBuf.bypass == bypass) { return; }
+
+    // Stop the buffer so that the worker isn't writing queued frames while the bypass starts writing directly
+    inBuf.tempStop();
+    inBuf.flush();
+    inBuf.bypass = bypass;
+    inBuf.tempStart();
+}
 
+void IQFrontEnd::setDecimation(int ratio) {
     // Update the decimation ratio
     _decimRatio = ratio;
-    if (_decimRatio > 1) { decim.setRatio(_decimRatio); }
     setSampleRate(_sampleRate);
-
-    // Restart the decimator if it was running
-    decim.tempStart();
-
-    // Enable or disable in the chain
-    preproc.setBlockEnabled(&decim, _decimRatio > 1, [=](dsp::stream<dsp::complex_t>* out){ split.setInput(out); });
+    updateDecimation();
 
     // Update the DSP sample rate (TODO: Find a way to get rid of this)
     core::setInputSampleRate(_sampleRate);
@@ -202,6 +268,12 @@ void IQFrontEnd::flushInputBuffer() {
 }
 
 void IQFrontEnd::start() {
+    running = true;
+
+    // Start the integer input decimator
+    if (inputType == INPUT_INT16) { intDecim16.start(); }
+    if (inputType == INPUT_INT8) { intDecim8.start(); }
+
     // Start input buffer
     inBuf.start();
 
@@ -222,6 +294,12 @@ void IQFrontEnd::start() {
 }
 
 void IQFrontEnd::stop() {
+    running = false;
+
+    // Stop the integer input decimator
+    if (inputType == INPUT_INT16) { intDecim16.stop(); }
+    if (inputType == INPUT_INT8) { intDecim8.stop(); }
+
     // Stop input buffer
     inBuf.stop();
 
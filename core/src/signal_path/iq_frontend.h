@@ -2,12 +2,14 @@
 #include "../dsp/buffer/frame_buffer.h"
 #include "../dsp/buffer/reshaper.h"
 #include "../dsp/multirate/power_decimator.h"
+#include "../dsp/multirate/int_decimator.h"
 #include "../dsp/correction/dc_blocker.h"
 #include "../dsp/chain.h"
 #include "../dsp/routing/splitter.h"
 #include "../dsp/channel/rx_vfo.h"
 #include "../dsp/sink/handler_sink.h"
 #include "../dsp/math/conjugate.h"
+#include "../utils/event.h"
 #include <fftw3.h>
 
 class IQFrontEnd {
@@ -23,11 +25,18 @@ public:
     void init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool buffering, int decimRatio, bool dcBlocking, int fftSize, double fftRate, FFTWindow fftWindow, float* (*acquireFFTBuffer)(void* ctx), void (*releaseFFTBuffer)(void* ctx), void* fftCtx);
 
     void setInput(dsp::stream<dsp::complex_t>* in);
+
+    // Native integer input, the first decimation by two is done before converting to float
+    void setInput(dsp::stream<dsp::complex16_t>* in);
+    void setInput(dsp::stream<dsp::complex8_t>* in);
     void setSampleRate(double sampleRate);
     inline double getSampleRate() { return _sampleRate / _decimRatio; }
 
+    // The input is buffered unless the source asks for it not to be or the low latency profile is on
     void setBuffering(bool enabled);
+    void setLowLatency(bool enabled);
     void setDecimation(int ratio);
+    inline int getDecimation() { return _decimRatio; }
     void setInvertIQ(bool enabled);
     void setDCBlocking(bool enabled);
 
@@ -48,9 +57,15 @@ public:
 
     double getEffectiveSamplerate();
 
+    // Emitted with the new output sample rate, after the input sample rate or the decimation changed
+    Event<double> onSampleRateChanged;
+
 protected:
     static void handler(dsp::complex_t* data, int count, void* ctx);
     void updateFFTPath(bool updateWaterfall = false);
+    void stopIntInput();
+    void updateDecimation();
+    void updateBuffering();
 
     static inline double genDCBlockRate(double sampleRate) {
         return 50.0 / sampleRate;
@@ -62,6 +77,17 @@ protected:
         skip = fftInterval - nzSampCount;
     }
 
+    enum InputType {
+        INPUT_COMPLEX,
+        INPUT_INT16,
+        INPUT_INT8
+    };
+
+    // Integer input
+    InputType inputType = INPUT_COMPLEX;
+    dsp::multirate::IntDecimator<dsp::complex16_t> intDecim16;
+    dsp::multirate::IntDecimator<dsp::complex8_t> intDecim8;
+
     // Input buffer
     dsp::buffer::SampleFrameBuffer<dsp::complex_t> inBuf;
 
@@ -92,6 +118,8 @@ protected:
     float* (*_acquireFFTBuffer)(void* ctx);
     void (*_releaseFFTBuffer)(void* ctx);
     void* _fftCtx;
+    bool sourceBuffering = true;
+    bool lowLatency = false;
 
     // Processing data
     int _nzFFTSize;
@@ -103,5 +131,6 @@ protected:
     double effectiveSr;
 
     bool _init = false;
+    bool running = false;
 
 };
\ No newline at end of file
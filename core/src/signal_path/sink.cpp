@@ -1,4 +1,5 @@
 #include <signal_path/sink.h>
+#include <signal_path/signal_path.h>
 #include <utils/flog.h>
 #include <imgui/imgui.h>
 #include <gui/style.h>
@@ -79,6 +80,23 @@ void SinkManager::Stream::unbindStream(dsp::stream<dsp::stereo_t>* stream) {
     delete stream;
 }
 
+void SinkManager::Stream::bindTap(void (*handler)(const dsp::stereo_t* data, int count, void* ctx), void* ctx) {
+    splitter.bindTap(handler, ctx);
+}
+
+void SinkManager::Stream::unbindTap(void (*handler)(const dsp::stereo_t* data, int count, void* ctx), void* ctx) {
+    splitter.unbindTap(handler, ctx);
+}
+
+void SinkManager::Stream::setInputClock(const std::atomic<int64_t>* clock) {
+    inputClock = clock;
+}
+
+int64_t SinkManager::Stream::getInputTime() {
+    const std::atomic<int64_t>* clock = inputClock;
+    return clock ? clock->load() : 0;
+}
+
 void SinkManager::Stream::setSampleRate(float sampleRate) {
     std::lock_guard<std::mutex> lck(ctrlMtx);
     _sampleRate = sampleRate;
@@ -215,6 +233,40 @@ void SinkManager::unbindStream(std::string name, dsp::stream<dsp::stereo_t>* str
     streams[name]->unbindStream(stream);
 }
 
+bool SinkManager::bindSampleRateHandler(std::string name, EventHandler<float>* handler) {
+    if (streams.find(name) == streams.end()) {
+        flog::error("Cannot bind sample rate handler to stream '{0}'. Stream doesn't exist", name);
+        return false;
+    }
+    streams[name]->srChange.bindHandler(handler);
+    return true;
+}
+
+void SinkManager::unbindSampleRateHandler(std::string name, EventHandler<float>* handler) {
+    if (streams.find(name) == streams.end()) {
+        flog::error("Cannot unbind sample rate handler from stream '{0}'. Stream doesn't exist", name);
+        return;
+    }
+    streams[name]->srChange.unbindHandler(handler);
+}
+
+bool SinkManager::bindTap(std::string name, void (*handler)(const dsp::stereo_t* data, int count, void* ctx), void* ctx) {
+    if (streams.find(name) == streams.end()) {
+        flog::error("Cannot bind tap to stream '{0}'. Stream doesn't exist", name);
+        return false;
+    }
+    streams[name]->bindTap(handler, ctx);
+    return true;
+}
+
+void SinkManager::unbindTap(std::string name, void (*handler)(const dsp::stereo_t* data, int count, void* ctx), void* ctx) {
+    if (streams.find(name) == streams.end()) {
+        flog::error("Cannot unbind tap from stream '{0}'. Stream doesn't exist", name);
+        return;
+    }
+    streams[name]->unbindTap(handler, ctx);
+}
+
 void SinkManager::setStreamSink(std::string name, std::string providerName) {
     if (streams.find(name) == streams.end()) {
         flog::error("Cannot set sink for stream '{0}'. Stream doesn't exist", name);
@@ -339,6 +391,9 @@ void SinkManager::loadSinksFromConfig() {
         if (!core::configManager.conf["streams"].contains(name)) { continue; }
         loadStreamConfig(name);
     }
+    if (core::configManager.conf.contains("lowLatencyAudio") && core::configManager.conf.contains("audioLatencyTarget")) {
+        setLowLatency(core::configManager.conf["lowLatencyAudio"], core::configManager.conf["audioLatencyTarget"]);
+    }
 }
 
 void SinkManager::showMenu() {
@@ -352,6 +407,29 @@ void SinkManager::showMenu() {
         provStr += '\0';
     }
 
+    if (ImGui::Checkbox("Low latency##_sdrpp_sink_low_latency", &lowLatency)) {
+        setLowLatency(lowLatency, latencyTarget);
+        core::configManager.acquire();
+        core::configManager.conf["lowLatencyAudio"] = lowLatency;
+        core::configManager.release(true);
+    }
+    if (lowLatency) {
+        ImGui::LeftLabel("Target");
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        ImGui::SliderInt("##_sdrpp_sink_latency_target", &latencyTarget, 10, 200, "%d ms");
+        // Resizing restarts the sinks, so only apply once the slider is released
+        if (ImGui::IsItemDeactivatedAfterEdit()) {
+            setLowLatency(lowLatency, latencyTarget);
+            core::configManager.acquire();
+            core::configManager.conf["audioLatencyTarget"] = latencyTarget;
+            core::configManager.release(true);
+        }
+    }
+    if (!streams.empty()) {
+        ImGui::Separator();
+        ImGui::Spacing();
+    }
+
     for (auto const& [name, stream] : streams) {
         ImGui::SetCursorPosX((menuWidth / 2.0f) - (ImGui::CalcTextSize(name.c_str()).x / 2.0f));
         ImGui::Text("%s", name.c_str());
@@ -381,6 +459,21 @@ std::vector<std::string> SinkManager::getStreamNames() {
     return streamNames;
 }
 
+int SinkManager::getLatencyTarget() {
+    return lowLatency ? latencyTarget : 0;
+}
+
+void SinkManager::setLowLatency(bool enabled, int targetMs) {
+    lowLatency = enabled;
+    latencyTarget = targetMs;
+
+    // The frame buffer of the front end queues up to a few dozen blocks when the DSP falls behind,
+    // in the low latency profile it's better to hold the source back than to let latency build up.
+    sigpath::iqFrontEnd.setLowLatency(lowLatency);
+
+    onLatencyTargetChanged.emit(getLatencyTarget());
+}
+
 void SinkManager::refreshProviders() {
     providerNamesTxt.clear();
     for (auto& provName : providerNames) {
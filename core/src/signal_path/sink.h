@@ -9,6 +9,7 @@
 #include <mutex>
 #include <utils/event.h>
 #include <vector>
+#include <atomic>
 
 class SinkManager {
 public:
@@ -40,9 +41,18 @@ public:
 
         void setInput(dsp::stream<dsp::stereo_t>* in);
 
+        // Clock of the block that produced the audio, see dsp::channel::RxVFO::inputTime.
+        // Lets the sink measure the latency from the VFO input, NULL when unknown.
+        void setInputClock(const std::atomic<int64_t>* clock);
+        int64_t getInputTime();
+
         dsp::stream<dsp::stereo_t>* bindStream();
         void unbindStream(dsp::stream<dsp::stereo_t>* stream);
 
+        // Get the audio through a callback from the stream's thread instead of a new stream, see dsp::routing::Splitter::bindTap
+        void bindTap(void (*handler)(const dsp::stereo_t* data, int count, void* ctx), void* ctx);
+        void unbindTap(void (*handler)(const dsp::stereo_t* data, int count, void* ctx), void* ctx);
+
         friend SinkManager;
         friend SinkManager::Sink;
 
@@ -61,6 +71,7 @@ public:
         int providerId = 0;
         std::string providerName = "";
         bool running = false;
+        std::atomic<const std::atomic<int64_t>*> inputClock = NULL;
 
         float guiVolume = 1.0f;
     };
@@ -106,11 +117,25 @@ public:
     dsp::stream<dsp::stereo_t>* bindStream(std::string name);
     void unbindStream(std::string name, dsp::stream<dsp::stereo_t>* stream);
 
+    // Called with the new sample rate whenever the producer of the stream changes it
+    bool bindSampleRateHandler(std::string name, EventHandler<float>* handler);
+    void unbindSampleRateHandler(std::string name, EventHandler<float>* handler);
+
+    bool bindTap(std::string name, void (*handler)(const dsp::stereo_t* data, int count, void* ctx), void* ctx);
+    void unbindTap(std::string name, void (*handler)(const dsp::stereo_t* data, int count, void* ctx), void* ctx);
+
     void loadSinksFromConfig();
     void showMenu();
 
     std::vector<std::string> getStreamNames();
 
+    // In the low latency profile the sinks size all their buffering from a single end to end target
+    // instead of their own settings. Returns the target in milliseconds, or 0 in the normal profile.
+    int getLatencyTarget();
+    void setLowLatency(bool enabled, int targetMs);
+
+    Event<int> onLatencyTargetChanged;
+
     Event<std::string> onSinkProviderRegistered;
     Event<std::string> onSinkProviderUnregister;
     Event<std::string> onSinkProviderUnregistered;
@@ -129,4 +154,7 @@ private:
     std::vector<std::string> providerNames;
     std::string providerNamesTxt;
     std::vector<std::string> streamNames;
+
+    bool lowLatency = false;
+    int latencyTarget = 40;
 };
\ No newline at end of file
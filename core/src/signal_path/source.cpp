@@ -5,6 +5,9 @@
 #include <core.h>
 
 SourceManager::SourceManager() {
+    decimationChangeHandlerObj.handler = decimationChangeHandler;
+    decimationChangeHandlerObj.ctx = this;
+    sigpath::iqFrontEnd.onSampleRateChanged.bindHandler(&decimationChangeHandlerObj);
 }
 
 void SourceManager::registerSource(std::string name, SourceHandler* handler) {
@@ -26,7 +29,10 @@ void SourceManager::unregisterSource(std::string name) {
         if (selectedHandler != NULL) {
             sources[selectedName]->deselectHandler(sources[selectedName]->ctx);
         }
-        sigpath::iqFrontEnd.setInput(&nullSource);
+        if (!core::args["server"].b()) {
+            sigpath::iqFrontEnd.setInput(&nullSource);
+        }
+        currentInput = NULL;
         selectedHandler = NULL;
     }
     sources.erase(name);
@@ -50,13 +56,50 @@ void SourceManager::selectSource(std::string name) {
     selectedHandler = sources[name];
     selectedHandler->selectHandler(selectedHandler->ctx);
     selectedName = name;
+    if (core::args["server"].b() && selectedHandler->health) { selectedHandler->health->setLogging(true, name); }
+    currentInput = NULL;
+    updateInput();
+}
+
+void SourceManager::updateInput() {
+    // Without decimation the integer path would only add a block between the source and the front-end,
+    // the source then converts to complex_t itself. The server only takes complex_t.
+    bool native = !core::args["server"].b() && sigpath::iqFrontEnd.getDecimation() > 1;
+    dsp::untyped_stream* input = selectedHandler->stream;
+    if (native && selectedHandler->stream16) { input = selectedHandler->stream16; }
+    else if (native && selectedHandler->stream8) { input = selectedHandler->stream8; }
+    if (input == currentInput) { return; }
+    selectedHandler->nativeOutput = (input != selectedHandler->stream);
+
     if (core::args["server"].b()) {
         server::setInput(selectedHandler->stream);
     }
+    else if (input == selectedHandler->stream16) {
+        sigpath::iqFrontEnd.setInput(selectedHandler->stream16);
+    }
+    else if (input == selectedHandler->stream8) {
+        sigpath::iqFrontEnd.setInput(selectedHandler->stream8);
+    }
     else {
         sigpath::iqFrontEnd.setInput(selectedHandler->stream);
     }
-    // Set server input here
+
+    // The source may be waiting for the stream that isn't read anymore to be flushed before it switches
+    if (currentInput) { currentInput->flush(); }
+    currentInput = input;
+}
+
+void SourceManager::decimationChangeHandler(double sampleRate, void* ctx) {
+    SourceManager* _this = (SourceManager*)ctx;
+    if (_this->selectedHandler == NULL) { return; }
+    _this->updateInput();
+}
+
+SourceHealth* SourceManager::getHealth() {
+    if (selectedHandler == NULL) {
+        return NULL;
+    }
+    return selectedHandler->health;
 }
 
 void SourceManager::showSelectedMenu() {
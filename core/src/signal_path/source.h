@@ -2,9 +2,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <atomic>
 #include <dsp/stream.h>
 #include <dsp/types.h>
 #include <utils/event.h>
+#include <signal_path/source_health.h>
 
 class SourceManager {
 public:
@@ -19,6 +21,15 @@ public:
         void (*stopHandler)(void* ctx);
         void (*tuneHandler)(double freq, void* ctx);
         void* ctx;
+
+        // Optional native integer output, stream must still be provided. The source writes to it instead of stream
+        // while nativeOutput is set, which is only the case when the front-end decimates.
+        dsp::stream<dsp::complex16_t>* stream16 = NULL;
+        dsp::stream<dsp::complex8_t>* stream8 = NULL;
+        std::atomic<bool> nativeOutput = false;
+
+        // Optional delivery counters filled in by the source
+        SourceHealth* health = NULL;
     };
 
     enum TuningMode {
@@ -39,6 +50,9 @@ public:
 
     std::vector<std::string> getSourceNames();
 
+    // Health of the selected source, NULL if it doesn't report any
+    SourceHealth* getHealth();
+
     Event<std::string> onSourceRegistered;
     Event<std::string> onSourceUnregister;
     Event<std::string> onSourceUnregistered;
@@ -53,4 +67,10 @@ private:
     double ifFreq = 0.0;
     TuningMode tuneMode = TuningMode::NORMAL;
     dsp::stream<dsp::complex_t> nullSource;
+
+    // Give the front-end the integer output of the source if it has one and it's worth it
+    void updateInput();
+    static void decimationChangeHandler(double sampleRate, void* ctx);
+    EventHandler<double> decimationChangeHandlerObj;
+    dsp::untyped_stream* currentInput = NULL;
 };
\ No newline at end of file
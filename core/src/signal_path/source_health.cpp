@@ -0,0 +1,151 @@
+#include <signal_path/source_health.h>
+#include <utils/flog.h>
+#include <math.h>
+#include <algorithm>
+
+// A lag must last this long to be a gap, shorter ones are the driver catching up after a stall
+#define SOURCE_HEALTH_GAP_CONFIRM_TIME  1.0
+
+void SourceHealth::start(double expectedRate) {
+    std::lock_guard<std::mutex> lck(mtx);
+    stats = Stats();
+    stats.running = true;
+    stats.expectedRate = expectedRate;
+    accountedSamples = 0;
+    resetTiming(std::chrono::steady_clock::now());
+}
+
+void SourceHealth::stop() {
+    std::lock_guard<std::mutex> lck(mtx);
+    if (!stats.running) { return; }
+    stats.running = false;
+    if (logging && stats.gaps) {
+        flog::warn("Source '{0}': {1} gaps with {2} samples lost out of {3}", logName, stats.gaps, stats.lostSamples, stats.samples);
+    }
+}
+
+void SourceHealth::setExpectedRate(double expectedRate) {
+    std::lock_guard<std::mutex> lck(mtx);
+    stats.expectedRate = expectedRate;
+    resetTiming(std::chrono::steady_clock::now());
+}
+
+void SourceHealth::delivered(uint64_t count) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lck(mtx);
+    stats.samples += count;
+    accountedSamples += count;
+    windowSamples += count;
+
+    // Time between blocks
+    if (haveLastBlock) {
+        double interval = std::chrono::duration<double>(now - lastBlock).count();
+        intervalCount++;
+        intervalSum += interval;
+        intervalSqSum += interval * interval;
+        intervalMax = std::max<double>(intervalMax, interval);
+    }
+    lastBlock = now;
+
+    // The first block only sets the reference
+    if (!haveLastBlock) {
+        haveLastBlock = true;
+        anchorTime = now;
+        anchorSamples = accountedSamples;
+    }
+    else if (stats.expectedRate > 0.0) {
+        // Lag of the samples behind the wall clock, always allowing the device clock to be a bit slow
+        double elapsed = std::chrono::duration<double>(now - anchorTime).count();
+        double expected = elapsed * stats.expectedRate * (1.0 - (SOURCE_HEALTH_CLOCK_TOLERANCE / 1e6));
+        double lag = expected - (double)(accountedSamples - anchorSamples);
+
+        if (lag <= 0.0) {
+            // Ahead of the clock, the samples of this block were just captured
+            anchorTime = now;
+            anchorSamples = accountedSamples;
+            lagging = false;
+        }
+        else if (lag > SOURCE_HEALTH_GAP_THRESHOLD * stats.expectedRate) {
+            if (!lagging) {
+                lagging = true;
+                lagStart = now;
+                minLag = lag;
+            }
+            minLag = std::min<double>(minLag, lag);
+
+            // The lag didn't go away, the samples are lost
+            if (std::chrono::duration<double>(now - lagStart).count() >= SOURCE_HEALTH_GAP_CONFIRM_TIME) {
+                addGap((uint64_t)minLag);
+                anchorTime = now;
+                anchorSamples = accountedSamples;
+                lagging = false;
+            }
+        }
+        else {
+            lagging = false;
+        }
+    }
+
+    if (std::chrono::duration<double>(now - windowStart).count() >= 1.0) { endWindow(now); }
+}
+
+void SourceHealth::gap(uint64_t lostSamples) {
+    std::lock_guard<std::mutex> lck(mtx);
+    // The lost samples are accounted for so that the timing doesn't report them a second time
+    accountedSamples += lostSamples;
+    addGap(lostSamples);
+}
+
+SourceHealth::Stats SourceHealth::getStats() {
+    std::lock_guard<std::mutex> lck(mtx);
+    return stats;
+}
+
+void SourceHealth::setLogging(bool enabled, std::string name) {
+    std::lock_guard<std::mutex> lck(mtx);
+    logging = enabled;
+    logName = name;
+}
+
+void SourceHealth::resetTiming(std::chrono::steady_clock::time_point now) {
+    haveLastBlock = false;
+    lagging = false;
+    windowStart = now;
+    windowSamples = 0;
+    windowGaps = 0;
+    windowLost = 0;
+    intervalCount = 0;
+    intervalSum = 0.0;
+    intervalSqSum = 0.0;
+    intervalMax = 0.0;
+}
+
+void SourceHealth::addGap(uint64_t lostSamples) {
+    stats.gaps++;
+    stats.lostSamples += lostSamples;
+    windowGaps++;
+    windowLost += lostSamples;
+}
+
+void SourceHealth::endWindow(std::chrono::steady_clock::time_point now) {
+    double duration = std::chrono::duration<double>(now - windowStart).count();
+    stats.actualRate = (double)windowSamples / duration;
+    if (intervalCount) {
+        double mean = intervalSum / (double)intervalCount;
+        stats.jitter = sqrt(std::max<double>(0.0, (intervalSqSum / (double)intervalCount) - (mean * mean)));
+    }
+    stats.maxInterval = intervalMax;
+
+    if (logging && windowGaps) {
+        flog::warn("Source '{0}': {1} gaps with {2} samples lost in the last second", logName, windowGaps, windowLost);
+    }
+
+    windowStart = now;
+    windowSamples = 0;
+    windowGaps = 0;
+    windowLost = 0;
+    intervalCount = 0;
+    intervalSum = 0.0;
+    intervalSqSum = 0.0;
+    intervalMax = 0.0;
+}
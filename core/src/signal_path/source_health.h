@@ -0,0 +1,81 @@
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <chrono>
+
+// Lag behind the wall clock tolerated before the missing samples are counted as a gap, in seconds
+#define SOURCE_HEALTH_GAP_THRESHOLD     0.1
+
+// Clock error between the device and the host that is never reported as a gap, in parts per million
+#define SOURCE_HEALTH_CLOCK_TOLERANCE   500.0
+
+/*
+    Sample delivery counters of a source, filled in by the source module.
+
+    The module calls delivered() for every block it sends down its stream and gap() for every
+    discontinuity it knows of (sequence numbers, library drop counters). Losses it doesn't know of
+    are detected by comparing the delivered samples against the wall clock: the buffering of the
+    driver can delay samples but never make them disappear, so a lasting lag is a gap.
+*/
+class SourceHealth {
+public:
+    struct Stats {
+        bool running = false;
+        uint64_t samples = 0;       // Samples delivered since the start
+        double expectedRate = 0.0;  // Samplerate the source is configured for
+        double actualRate = 0.0;    // Measured over the last second
+        uint64_t gaps = 0;          // Discontinuities detected since the start
+        uint64_t lostSamples = 0;   // Samples lost in those, estimated when the source can't tell
+        double jitter = 0.0;        // Standard deviation of the time between blocks over the last second, in seconds
+        double maxInterval = 0.0;   // Longest time between blocks over the last second, in seconds
+    };
+
+    // Call when the source starts streaming, resets all counters
+    void start(double expectedRate);
+
+    void stop();
+
+    void setExpectedRate(double expectedRate);
+
+    // Call for every block of samples sent down the stream
+    void delivered(uint64_t count);
+
+    // Call for a known discontinuity, lostSamples being zero if the amount isn't known
+    void gap(uint64_t lostSamples = 0);
+
+    Stats getStats();
+
+    // Log gaps as they are detected, used in server mode where there's no GUI
+    void setLogging(bool enabled, std::string name = "");
+
+private:
+    void resetTiming(std::chrono::steady_clock::time_point now);
+    void addGap(uint64_t lostSamples);
+    void endWindow(std::chrono::steady_clock::time_point now);
+
+    std::mutex mtx;
+    Stats stats;
+    bool logging = false;
+    std::string logName;
+
+    // Wall clock reference of the gap detector
+    std::chrono::steady_clock::time_point anchorTime;
+    uint64_t anchorSamples = 0;
+    uint64_t accountedSamples = 0;
+    bool lagging = false;
+    std::chrono::steady_clock::time_point lagStart;
+    double minLag = 0.0;
+
+    // One second measurement window
+    std::chrono::steady_clock::time_point windowStart;
+    std::chrono::steady_clock::time_point lastBlock;
+    bool haveLastBlock = false;
+    uint64_t windowSamples = 0;
+    uint64_t windowGaps = 0;
+    uint64_t windowLost = 0;
+    int intervalCount = 0;
+    double intervalSum = 0.0;
+    double intervalSqSum = 0.0;
+    double intervalMax = 0.0;
+};
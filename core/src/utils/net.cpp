@@ -2,6 +2,7 @@
 #include <string.h>
 #include <codecvt>
 #include <stdexcept>
+#include <algorithm>
 
 #ifdef _WIN32
 #define WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
@@ -181,6 +182,68 @@ namespace net {
         return read;
     }
 
+    int Socket::recvmulti(uint8_t* data, int* lens, size_t maxLen, int count, int timeout) {
+        count = std::min<int>(count, NET_MAX_RECV_BATCH);
+
+        // Wait for the first datagram
+        if (timeout != NONBLOCKING) {
+            fd_set set;
+            FD_ZERO(&set);
+            FD_SET(sock, &set);
+
+            timeval tv;
+            tv.tv_sec = timeout / 1000;
+            tv.tv_usec = (timeout % 1000) * 1000;
+
+            int err = select(sock+1, &set, NULL, &set, (timeout > 0) ? &tv : NULL);
+            if (err <= 0) { return err; }
+        }
+
+#ifdef __linux__
+        // Fetch everything that's already queued with a single system call
+        struct mmsghdr msgs[NET_MAX_RECV_BATCH];
+        struct iovec iovs[NET_MAX_RECV_BATCH];
+        memset(msgs, 0, count * sizeof(struct mmsghdr));
+        for (int i = 0; i < count; i++) {
+            iovs[i].iov_base = &data[i * maxLen];
+            iovs[i].iov_len = maxLen;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(sock, msgs, count, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (!WOULD_BLOCK) { close(); }
+            return -1;
+        }
+        for (int i = 0; i < n; i++) { lens[i] = msgs[i].msg_len; }
+        return n;
+#else
+        // Read datagrams one by one until none are left
+        int n = 0;
+        while (n < count) {
+#ifdef _WIN32
+            u_long avail = 0;
+            if ((n || timeout == NONBLOCKING) && (ioctlsocket(sock, FIONREAD, &avail) || !avail)) { break; }
+            int flags = 0;
+#else
+            int flags = (n || timeout == NONBLOCKING) ? MSG_DONTWAIT : 0;
+#endif
+            int err = ::recv(sock, (char*)&data[n * maxLen], maxLen, flags);
+            if (err < 0) {
+                if (WOULD_BLOCK && n) { break; }
+                if (!WOULD_BLOCK) { close(); }
+                return n ? n : -1;
+            }
+            lens[n++] = err;
+        }
+        return n;
+#endif
+    }
+
+    bool Socket::setRecvBufferSize(int size) {
+        return !setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&size, sizeof(size));
+    }
+
     int Socket::recvline(std::string& str, int maxLen, int timeout, Address* dest) {
         // Disallow nonblocking mode
         if (!timeout) { return -1; }
@@ -22,6 +22,8 @@
 #include <ifaddrs.h>
 #endif
 
+#define NET_MAX_RECV_BATCH  64
+
 namespace net {
 #ifdef _WIN32
     typedef SOCKET SockHandle_t;
@@ -169,6 +171,24 @@ namespace net {
          */
         int recvline(std::string& str, int maxLen = 0, int timeout = NO_TIMEOUT, Address* dest = NULL);
 
+        /**
+         * Receive multiple datagrams in one go (UDP only). Uses recvmmsg where available.
+         * @param data Buffer of count * maxLen bytes, datagram i is written at offset i * maxLen.
+         * @param lens Receives the length of each datagram.
+         * @param maxLen Maximum size of a single datagram.
+         * @param count Maximum number of datagrams to read, at most NET_MAX_RECV_BATCH.
+         * @param timeout Timeout in milliseconds for the first datagram. Use NO_TIMEOUT or NONBLOCKING here if needed.
+         * @return Number of datagrams read. 0 means timed out or closed. -1 means would block or error.
+         */
+        int recvmulti(uint8_t* data, int* lens, size_t maxLen, int count, int timeout = NO_TIMEOUT);
+
+        /**
+         * Set the size of the kernel receive buffer.
+         * @param size Size in bytes.
+         * @return True on success, false otherwise.
+         */
+        bool setRecvBufferSize(int size);
+
     private:
         Address* raddr = NULL;
         SockHandle_t sock;
@@ -0,0 +1,101 @@
+#include <utils/net_bench.h>
+#include <utils/networking.h>
+#include <utils/flog.h>
+#include <atomic>
+#include <chrono>
+
+#define NET_BENCH_DURATION_MS       2000
+#define NET_BENCH_CHUNK_SIZE        (64 * 1024)
+#define NET_BENCH_QUEUE_SIZE        (1024 * 1024)
+#define NET_BENCH_MAX_SENDERS       4
+
+namespace net::bench {
+    struct Receiver {
+        ConnClass* conn;
+        std::atomic<uint64_t>* total;
+        uint8_t buf[NET_BENCH_CHUNK_SIZE];
+    };
+
+    static void receiveHandler(int count, uint8_t* buf, void* ctx) {
+        Receiver* rx = (Receiver*)ctx;
+        *rx->total += count;
+        rx->conn->readAsync(NET_BENCH_CHUNK_SIZE, rx->buf, receiveHandler, rx, false);
+    }
+
+    static double measure(uint16_t port, Listener& listener, int connCount) {
+        std::vector<Conn> clients;
+        std::vector<Conn> servers;
+        std::vector<Receiver*> receivers;
+        std::atomic<uint64_t> total = 0;
+
+        // Open all connections, the listener has a backlog so connecting before accepting is fine
+        for (int i = 0; i < connCount; i++) {
+            clients.push_back(connect("127.0.0.1", port));
+            servers.push_back(listener->accept());
+            clients.back()->setWritePolicy(WRITE_POLICY_BLOCK, NET_BENCH_QUEUE_SIZE);
+
+            Receiver* rx = new Receiver;
+            rx->conn = servers.back().get();
+            rx->total = &total;
+            receivers.push_back(rx);
+            rx->conn->readAsync(NET_BENCH_CHUNK_SIZE, rx->buf, receiveHandler, rx, false);
+        }
+
+        // Senders go round robin over their share of the connections
+        std::atomic<bool> stop = false;
+        std::vector<std::thread> senders;
+        int senderCount = std::min<int>(connCount, NET_BENCH_MAX_SENDERS);
+        for (int s = 0; s < senderCount; s++) {
+            senders.push_back(std::thread([&, s]() {
+                std::vector<uint8_t> chunk(NET_BENCH_CHUNK_SIZE, (uint8_t)s);
+                while (!stop) {
+                    for (int i = s; i < connCount && !stop; i += senderCount) {
+                        clients[i]->writeAsync(chunk.size(), chunk.data());
+                    }
+                }
+            }));
+        }
+
+        // Only count what was received during the measurement window
+        std::this_thread::sleep_for(std::chrono::milliseconds(NET_BENCH_DURATION_MS / 4));
+        uint64_t start = total;
+        auto startTime = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(NET_BENCH_DURATION_MS));
+        uint64_t received = total - start;
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        // Closing the clients unblocks senders waiting on a full queue
+        stop = true;
+        for (auto& c : clients) { c->close(); }
+        for (auto& t : senders) { t.join(); }
+        for (auto& c : servers) { c->close(); }
+        for (auto& rx : receivers) { delete rx; }
+
+        return (double)received / elapsed;
+    }
+
+    void run(uint16_t port) {
+        Listener listener;
+        try {
+            listener = listen("127.0.0.1", port);
+        }
+        catch (std::exception& e) {
+            flog::error("Could not start the network benchmark: {0}", e.what());
+            return;
+        }
+
+        flog::info("Network benchmark on loopback port {0}", port);
+        for (int connCount : { 1, 4, 16, 64, 256 }) {
+            try {
+                double rate = measure(port, listener, connCount);
+                flog::info("{0} connections: {1} MB/s total, {2} MB/s per connection", connCount, rate / 1e6, rate / (1e6 * connCount));
+            }
+            catch (std::exception& e) {
+                flog::error("Network benchmark failed with {0} connections: {1}", connCount, e.what());
+                break;
+            }
+        }
+
+        listener->close();
+    }
+}
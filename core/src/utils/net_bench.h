@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+namespace net::bench {
+    // Measure loopback throughput for increasing numbers of simultaneous connections
+    void run(uint16_t port);
+}
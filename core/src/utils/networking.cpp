@@ -2,6 +2,40 @@
 #include <assert.h>
 #include <utils/flog.h>
 #include <stdexcept>
+#include <string.h>
+#include <functional>
+#include <unordered_map>
+#include <list>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+#ifdef _WIN32
+#define NET_DONTWAIT    0
+#define poll            WSAPoll
+#else
+#define NET_DONTWAIT    MSG_DONTWAIT
+#endif
+
+#define NET_INTEREST_READ   (1 << 0)
+#define NET_INTEREST_WRITE  (1 << 1)
+
+// Maximum number of recv calls per readable event, keeps one busy connection from starving the others
+#define NET_MAX_READS_PER_EVENT     4
+
+// Time after which an idle handler thread exits
+#define NET_HANDLER_IDLE_TIMEOUT_S  30
+
+// Maximum number of handler threads, further jobs wait in the queue for one to be free
+#define NET_MAX_HANDLER_THREADS     64
 
 namespace net {
 
@@ -9,13 +43,229 @@ namespace net {
     extern bool winsock_init = false;
 #endif
 
+    static bool wouldBlock() {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+    }
+
+    static void setNonBlocking(Socket sock) {
+#ifdef _WIN32
+        u_long enable = 1;
+        ioctlsocket(sock, FIONBIO, &enable);
+#else
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    }
+
+    class Reactor {
+    public:
+        static Reactor& get() {
+            // Never destroyed, connections may still be closed during static destruction
+            static Reactor* reactor = new Reactor();
+            return *reactor;
+        }
+
+        void add(ConnClass* conn) {
+            std::lock_guard lck(mtx);
+            conns[conn->_sock] = conn;
+            std::lock_guard clck(conn->mtx);
+            update(conn);
+        }
+
+        void remove(ConnClass* conn) {
+            std::lock_guard lck(mtx);
+            auto it = conns.find(conn->_sock);
+            if (it != conns.end() && it->second == conn) { conns.erase(it); }
+            std::lock_guard clck(conn->mtx);
+            conn->removed = true;
+            update(conn);
+        }
+
+        // Must be called with the connection mutex held
+        void update(ConnClass* conn) {
+            int want = conn->interest();
+            if (want == conn->curInterest) { return; }
+#ifdef __linux__
+            // Connections with nothing to wait on are taken out of the set so that hangups don't wake the loop
+            struct epoll_event ev = {};
+            ev.events = ((want & NET_INTEREST_READ) ? EPOLLIN : 0) | ((want & NET_INTEREST_WRITE) ? EPOLLOUT : 0);
+            ev.data.fd = conn->_sock;
+            int op = !want ? EPOLL_CTL_DEL : (!conn->curInterest ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+            epoll_ctl(epfd, op, conn->_sock, &ev);
+            conn->curInterest = want;
+#else
+            conn->curInterest = want;
+            wake();
+#endif
+        }
+
+        void post(std::function<void()> job) {
+            std::lock_guard lck(poolMtx);
+            jobs.push_back(std::move(job));
+
+            // Threads that timed out have let go of the lock, they're only unwinding
+            for (auto& it : exitedWorkers) {
+                it->join();
+                workers.erase(it);
+            }
+            exitedWorkers.clear();
+
+            // Handlers are allowed to block, so start a new thread whenever none are free, up to the limit
+            if ((int)jobs.size() > idleWorkers) {
+                if (workers.size() < NET_MAX_HANDLER_THREADS) {
+                    workers.emplace_back();
+                    workers.back() = std::thread(&Reactor::poolWorker, this, std::prev(workers.end()));
+                    return;
+                }
+                if (!poolFullWarned) {
+                    flog::warn("All {0} network handler threads are busy, handlers are being queued", NET_MAX_HANDLER_THREADS);
+                    poolFullWarned = true;
+                }
+            }
+            poolCnd.notify_one();
+        }
+
+    private:
+        Reactor() {
+#ifdef __linux__
+            epfd = epoll_create1(EPOLL_CLOEXEC);
+            if (epfd < 0) { throw std::runtime_error("Could not create epoll instance"); }
+#else
+            // A loopback UDP socket connected to itself is used to interrupt poll()
+            wakeSock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+            struct sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            if (bind(wakeSock, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+                getsockname(wakeSock, (struct sockaddr*)&addr, &len) < 0 ||
+                ::connect(wakeSock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+                throw std::runtime_error("Could not create reactor wakeup socket");
+            }
+            setNonBlocking(wakeSock);
+#endif
+            std::thread(&Reactor::worker, this).detach();
+        }
+
+        void handle(Socket sock, bool readable, bool writable) {
+            auto it = conns.find(sock);
+            if (it == conns.end()) { return; }
+            ConnClass* conn = it->second;
+            std::lock_guard lck(conn->mtx);
+
+            // Events may be stale if the interest changed since the wait returned
+            if (readable && (conn->curInterest & NET_INTEREST_READ)) { conn->onReadable(); }
+            if (writable && (conn->curInterest & NET_INTEREST_WRITE)) { conn->onWritable(); }
+        }
+
+#ifdef __linux__
+        void worker() {
+            struct epoll_event events[256];
+            while (true) {
+                int n = epoll_wait(epfd, events, 256, -1);
+                if (n < 0) { continue; }
+                std::lock_guard lck(mtx);
+                for (int i = 0; i < n; i++) {
+                    uint32_t ev = events[i].events;
+                    bool error = (ev & (EPOLLERR | EPOLLHUP));
+                    handle(events[i].data.fd, (ev & EPOLLIN) || error, (ev & EPOLLOUT) || error);
+                }
+            }
+        }
+#else
+        void wake() {
+            char dummy = 0;
+            send(wakeSock, &dummy, 1, 0);
+        }
+
+        void worker() {
+            std::vector<struct pollfd> fds;
+            while (true) {
+                // Rebuild the set each iteration, interests are changed by other threads
+                fds.clear();
+                fds.push_back({ wakeSock, POLLIN, 0 });
+                {
+                    std::lock_guard lck(mtx);
+                    for (auto& [sock, conn] : conns) {
+                        std::lock_guard clck(conn->mtx);
+                        if (!conn->curInterest) { continue; }
+                        short events = ((conn->curInterest & NET_INTEREST_READ) ? POLLIN : 0) | ((conn->curInterest & NET_INTEREST_WRITE) ? POLLOUT : 0);
+                        fds.push_back({ sock, events, 0 });
+                    }
+                }
+
+                if (poll(fds.data(), fds.size(), -1) < 0) { continue; }
+
+                if (fds[0].revents) {
+                    char dummy[64];
+                    while (recv(wakeSock, dummy, sizeof(dummy), 0) > 0);
+                }
+
+                std::lock_guard lck(mtx);
+                for (int i = 1; i < fds.size(); i++) {
+                    short ev = fds[i].revents;
+                    if (!ev) { continue; }
+                    bool error = (ev & (POLLERR | POLLHUP | POLLNVAL));
+                    handle(fds[i].fd, (ev & POLLIN) || error, (ev & POLLOUT) || error);
+                }
+            }
+        }
+#endif
+
+        void poolWorker(std::list<std::thread>::iterator self) {
+            std::unique_lock lck(poolMtx);
+            while (true) {
+                idleWorkers++;
+                bool gotJob = poolCnd.wait_for(lck, std::chrono::seconds(NET_HANDLER_IDLE_TIMEOUT_S), [this]() { return !jobs.empty(); });
+                idleWorkers--;
+                if (!gotJob) {
+                    // Joined by the next post()
+                    exitedWorkers.push_back(self);
+                    return;
+                }
+
+                std::function<void()> job = std::move(jobs.front());
+                jobs.pop_front();
+                lck.unlock();
+                job();
+                lck.lock();
+            }
+        }
+
+        // Lock order is reactor mutex, then connection mutex, then pool mutex
+        std::mutex mtx;
+        std::unordered_map<Socket, ConnClass*> conns;
+#ifdef __linux__
+        int epfd;
+#else
+        Socket wakeSock;
+#endif
+
+        std::mutex poolMtx;
+        std::condition_variable poolCnd;
+        std::deque<std::function<void()>> jobs;
+        int idleWorkers = 0;
+        std::list<std::thread> workers;
+        std::vector<std::list<std::thread>::iterator> exitedWorkers;
+        bool poolFullWarned = false;
+    };
+
     ConnClass::ConnClass(Socket sock, struct sockaddr_in raddr, bool udp) {
         _sock = sock;
         _udp = udp;
         remoteAddr = raddr;
         connectionOpen = true;
-        readWorkerThread = std::thread(&ConnClass::readWorker, this);
-        writeWorkerThread = std::thread(&ConnClass::writeWorker, this);
+
+        // UDP sockets stay blocking, they are only polled while an async read is pending
+        if (!_udp) {
+            ring.resize(NET_READ_RING_SIZE);
+            setNonBlocking(_sock);
+        }
+
+        Reactor::get().add(this);
     }
 
     ConnClass::~ConnClass() {
@@ -23,36 +273,36 @@ namespace net {
     }
 
     void ConnClass::close() {
-        std::lock_guard lck(closeMtx);
-        // Set stopWorkers to true
         {
-            std::lock_guard lck1(readQueueMtx);
-            std::lock_guard lck2(writeQueueMtx);
-            stopWorkers = true;
+            std::unique_lock lck(mtx);
+            stopped = true;
+            connectionOpen = false;
+            readQueue.clear();
+            writeQueue.clear();
+            writeQueueSize = 0;
+            readCnd.notify_all();
+            writeCnd.notify_all();
+            connectionOpenCnd.notify_all();
+
+            // Wait for a running handler to return, unless it's the one closing the connection
+            if (handlerThread != std::this_thread::get_id()) {
+                handlerCnd.wait(lck, [this]() { return !dispatching; });
+            }
         }
 
-        // Notify the workers of the change
-        readQueueCnd.notify_all();
-        writeQueueCnd.notify_all();
+        // Once removed, the I/O thread no longer touches the connection
+        Reactor::get().remove(this);
 
-        if (connectionOpen) {
+        std::lock_guard lck(mtx);
+        if (!sockClosed) {
 #ifdef _WIN32
             closesocket(_sock);
 #else
             ::shutdown(_sock, SHUT_RDWR);
             ::close(_sock);
 #endif
+            sockClosed = true;
         }
-
-        // Wait for the theads to terminate
-        if (readWorkerThread.joinable()) { readWorkerThread.join(); }
-        if (writeWorkerThread.joinable()) { writeWorkerThread.join(); }
-
-        {
-            std::lock_guard lck(connectionOpenMtx);
-            connectionOpen = false;
-        }
-        connectionOpenCnd.notify_all();
     }
 
     bool ConnClass::isOpen() {
@@ -60,86 +310,73 @@ namespace net {
     }
 
     void ConnClass::waitForEnd() {
-        std::unique_lock lck(readQueueMtx);
+        std::unique_lock lck(mtx);
         connectionOpenCnd.wait(lck, [this]() { return !connectionOpen; });
     }
 
     int ConnClass::read(int count, uint8_t* buf, bool enforceSize) {
-        if (!connectionOpen) { return -1; }
-        std::lock_guard lck(readMtx);
-        int ret;
+        std::lock_guard rlck(readMtx);
 
         if (_udp) {
+            if (!connectionOpen) { return -1; }
             socklen_t fromLen = sizeof(remoteAddr);
-            ret = recvfrom(_sock, (char*)buf, count, 0, (struct sockaddr*)&remoteAddr, &fromLen);
+            int ret = recvfrom(_sock, (char*)buf, count, 0, (struct sockaddr*)&remoteAddr, &fromLen);
             if (ret <= 0) {
-                {
-                    std::lock_guard lck(connectionOpenMtx);
-                    connectionOpen = false;
-                }
-                connectionOpenCnd.notify_all();
+                std::lock_guard lck(mtx);
+                disconnect();
                 return -1;
             }
             return count;
         }
 
+        // Data still in the ring is returned even if the connection has ended
+        std::unique_lock lck(mtx);
         int beenRead = 0;
         while (beenRead < count) {
-            ret = recv(_sock, (char*)&buf[beenRead], count - beenRead, 0);
-
-            if (ret <= 0) {
-                {
-                    std::lock_guard lck(connectionOpenMtx);
-                    connectionOpen = false;
-                }
-                connectionOpenCnd.notify_all();
-                return -1;
-            }
-
-            if (!enforceSize) { return ret; }
-
-            beenRead += ret;
+            readCnd.wait(lck, [this]() { return ringFill > 0 || !connectionOpen; });
+            if (stopped || !ringFill) { return -1; }
+            beenRead += ringRead(&buf[beenRead], count - beenRead);
+            Reactor::get().update(this);
+            if (!enforceSize) { break; }
         }
 
         return beenRead;
     }
 
     bool ConnClass::write(int count, uint8_t* buf) {
-        if (!connectionOpen) { return false; }
-        std::lock_guard lck(writeMtx);
-        int ret;
-
         if (_udp) {
-            ret = sendto(_sock, (char*)buf, count, 0, (struct sockaddr*)&remoteAddr, sizeof(remoteAddr));
+            if (!connectionOpen) { return false; }
+            std::lock_guard wlck(writeMtx);
+            int ret = sendto(_sock, (char*)buf, count, 0, (struct sockaddr*)&remoteAddr, sizeof(remoteAddr));
             if (ret <= 0) {
-                {
-                    std::lock_guard lck(connectionOpenMtx);
-                    connectionOpen = false;
-                }
-                connectionOpenCnd.notify_all();
+                std::lock_guard lck(mtx);
+                disconnect();
             }
             return (ret > 0);
         }
 
-        int beenWritten = 0;
-        while (beenWritten < count) {
-            ret = send(_sock, (char*)buf, count, 0);
-            if (ret <= 0) {
-                {
-                    std::lock_guard lck(connectionOpenMtx);
-                    connectionOpen = false;
-                }
-                connectionOpenCnd.notify_all();
-                return false;
-            }
-            beenWritten += ret;
+        std::unique_lock lck(mtx);
+        if (!connectionOpen) { return false; }
+
+        // Try sending right away, only what doesn't fit in the socket buffer gets queued
+        int sent = 0;
+        if (writeQueue.empty()) {
+            sent = sendDirect(buf, count);
+            if (sent < 0) { return false; }
+            if (sent == count) { return true; }
         }
-        
-        return true;
+
+        // The caller's buffer is used directly since we wait for it to be sent
+        queueWrite(&buf[sent], count - sent, false);
+        uint64_t id = writeQueue.back().id;
+        writeCnd.wait(lck, [this, id]() { return completedWriteId >= id || !connectionOpen; });
+        return completedWriteId >= id;
     }
 
     void ConnClass::readAsync(int count, uint8_t* buf, void (*handler)(int count, uint8_t* buf, void* ctx), void* ctx, bool enforceSize) {
-        if (!connectionOpen) { return; }
+        std::lock_guard lck(mtx);
+        if (stopped) { return; }
+
         // Create entry
         ConnReadEntry entry;
         entry.count = count;
@@ -147,82 +384,324 @@ namespace net {
         entry.handler = handler;
         entry.ctx = ctx;
         entry.enforceSize = enforceSize;
+        entry.filled = 0;
+        readQueue.push_back(entry);
 
-        // Add entry to queue
-        {
-            std::lock_guard lck(readQueueMtx);
-            readQueue.push_back(entry);
+        // The data might already be in the ring
+        completeReads();
+    }
+
+    bool ConnClass::writeAsync(int count, uint8_t* buf) {
+        // Datagrams are never queued
+        if (_udp) { return write(count, buf); }
+
+        std::unique_lock lck(mtx);
+        if (!connectionOpen) { return false; }
+
+        // Apply the write policy if the queue is full. A write larger than the limit is still accepted into an empty queue
+        auto full = [this, count]() { return writeQueueSize && writeQueueSize + count > maxWriteQueueSize; };
+        if (full()) {
+            if (writePolicy == WRITE_POLICY_BLOCK) {
+                writeCnd.wait(lck, [&]() { return !full() || !connectionOpen; });
+                if (!connectionOpen) { return false; }
+            }
+            else if (writePolicy == WRITE_POLICY_DROP_OLDEST) {
+                // Writes that have already started or that a caller is waiting on can't be dropped
+                for (auto it = writeQueue.begin(); it != writeQueue.end() && full();) {
+                    if (!it->async || it->offset) { it++; continue; }
+                    writeQueueSize -= it->count;
+                    writesDropped++;
+                    it = writeQueue.erase(it);
+                }
+            }
+            if (full()) {
+                writesDropped++;
+                return false;
+            }
         }
 
-        // Notify read worker
-        readQueueCnd.notify_all();
+        int sent = 0;
+        if (writeQueue.empty()) {
+            sent = sendDirect(buf, count);
+            if (sent < 0) { return false; }
+            if (sent == count) { return true; }
+        }
+        queueWrite(&buf[sent], count - sent, true);
+        return true;
     }
 
-    void ConnClass::writeAsync(int count, uint8_t* buf) {
-        if (!connectionOpen) { return; }
-        // Create entry
-        ConnWriteEntry entry;
-        entry.count = count;
-        entry.buf = buf;
+    void ConnClass::setWritePolicy(WritePolicy policy, int maxQueueSize) {
+        std::lock_guard lck(mtx);
+        writePolicy = policy;
+        maxWriteQueueSize = maxQueueSize;
+        writeCnd.notify_all();
+    }
 
-        // Add entry to queue
-        {
-            std::lock_guard lck(writeQueueMtx);
-            writeQueue.push_back(entry);
+    ConnStats ConnClass::getStats() {
+        std::lock_guard lck(mtx);
+        ConnStats stats;
+        stats.bytesRead = bytesRead;
+        stats.bytesWritten = bytesWritten;
+        stats.writesDropped = writesDropped;
+        stats.writeQueueSize = writeQueueSize;
+        return stats;
+    }
+
+    int ConnClass::readFrom(int count, uint8_t* buf, struct sockaddr_in* addr) {
+        if (!connectionOpen || !_udp) { return -1; }
+        std::lock_guard lck(readMtx);
+
+        socklen_t fromLen = sizeof(struct sockaddr_in);
+        int ret = recvfrom(_sock, (char*)buf, count, 0, (struct sockaddr*)addr, &fromLen);
+        if (ret < 0) {
+#ifdef _WIN32
+            // Windows reports ICMP port unreachable from a previous send as an error, this doesn't affect the socket
+            if (WSAGetLastError() == WSAECONNRESET) { return 0; }
+#endif
+            std::lock_guard lck(mtx);
+            disconnect();
+            return -1;
         }
+        return ret;
+    }
 
-        // Notify write worker
-        writeQueueCnd.notify_all();
+    bool ConnClass::writeTo(int count, uint8_t* buf, const struct sockaddr_in* addr) {
+        if (!connectionOpen || !_udp) { return false; }
+        std::lock_guard lck(writeMtx);
+        return sendto(_sock, (char*)buf, count, 0, (const struct sockaddr*)addr, sizeof(struct sockaddr_in)) > 0;
     }
 
-    void ConnClass::readWorker() {
-        while (true) {
-            // Wait for wakeup and exit if it's for terminating the thread
-            std::unique_lock lck(readQueueMtx);
-            readQueueCnd.wait(lck, [this]() { return (readQueue.size() > 0 || stopWorkers); });
-            if (stopWorkers || !connectionOpen) { return; }
+    int ConnClass::readMulti(int maxLen, uint8_t* buf, int* lens, int count) {
+        if (!connectionOpen || !_udp) { return -1; }
+        std::lock_guard rlck(readMtx);
+        count = std::min<int>(count, NET_MAX_READ_BATCH);
+
+#ifdef __linux__
+        struct mmsghdr msgs[NET_MAX_READ_BATCH];
+        struct iovec iovs[NET_MAX_READ_BATCH];
+        memset(msgs, 0, count * sizeof(struct mmsghdr));
+        for (int i = 0; i < count; i++) {
+            iovs[i].iov_base = &buf[i * maxLen];
+            iovs[i].iov_len = maxLen;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(_sock, msgs, count, MSG_WAITFORONE, NULL);
+        if (n > 0) {
+            for (int i = 0; i < n; i++) { lens[i] = msgs[i].msg_len; }
+            return n;
+        }
+#else
+        int n = 0;
+        while (n < count) {
+#ifdef _WIN32
+            u_long avail = 0;
+            if (n && (ioctlsocket(_sock, FIONREAD, &avail) || !avail)) { break; }
+            int flags = 0;
+#else
+            int flags = n ? MSG_DONTWAIT : 0;
+#endif
+            int ret = recv(_sock, (char*)&buf[n * maxLen], maxLen, flags);
+            if (ret < 0) { break; }
+            lens[n++] = ret;
+        }
+        if (n > 0) { return n; }
+#endif
 
-            // Pop first element off the list
-            ConnReadEntry entry = readQueue[0];
-            readQueue.erase(readQueue.begin());
-            lck.unlock();
+#ifdef _WIN32
+        // Windows reports ICMP port unreachable from a previous send as an error, this doesn't affect the socket
+        if (WSAGetLastError() == WSAECONNRESET) { return 0; }
+#endif
+        std::lock_guard lck(mtx);
+        disconnect();
+        return -1;
+    }
 
-            // Read from socket and send data to the handler
-            int ret = read(entry.count, entry.buf, entry.enforceSize);
+    void ConnClass::onReadable() {
+        if (_udp) {
+            if (readQueue.empty() || dispatching) { return; }
+            ConnReadEntry entry = readQueue.front();
+            socklen_t fromLen = sizeof(remoteAddr);
+            int ret = recvfrom(_sock, (char*)entry.buf, entry.count, NET_DONTWAIT, (struct sockaddr*)&remoteAddr, &fromLen);
             if (ret <= 0) {
-                {
-                    std::lock_guard lck(connectionOpenMtx);
-                    connectionOpen = false;
-                }
-                connectionOpenCnd.notify_all();
+                if (ret < 0 && wouldBlock()) { return; }
+                disconnect();
                 return;
             }
-            entry.handler(ret, entry.buf, entry.ctx);
+            bytesRead += ret;
+            readQueue.pop_front();
+            dispatching = true;
+            Reactor::get().post([this, entry]() { runHandler(entry, entry.count); });
+            Reactor::get().update(this);
+            return;
         }
-    }
 
-    void ConnClass::writeWorker() {
-        while (true) {
-            // Wait for wakeup and exit if it's for terminating the thread
-            std::unique_lock lck(writeQueueMtx);
-            writeQueueCnd.wait(lck, [this]() { return (writeQueue.size() > 0 || stopWorkers); });
-            if (stopWorkers || !connectionOpen) { return; }
+        // Fill as much of the ring as possible
+        int size = ring.size();
+        for (int i = 0; i < NET_MAX_READS_PER_EVENT && ringFill < size; i++) {
+            int tail = (ringHead + ringFill) % size;
+            int space = std::min<int>(size - ringFill, size - tail);
+            int ret = recv(_sock, (char*)&ring[tail], space, 0);
+            if (ret < 0 && wouldBlock()) { break; }
+            if (ret <= 0) {
+                disconnect();
+                break;
+            }
+            ringFill += ret;
+            bytesRead += ret;
+            if (ret < space) { break; }
+        }
 
-            // Pop first element off the list
-            ConnWriteEntry entry = writeQueue[0];
-            writeQueue.erase(writeQueue.begin());
-            lck.unlock();
+        readCnd.notify_all();
+        completeReads();
+    }
 
-            // Write to socket
-            if (!write(entry.count, entry.buf)) {
-                {
-                    std::lock_guard lck(connectionOpenMtx);
-                    connectionOpen = false;
+    void ConnClass::onWritable() {
+        while (!writeQueue.empty()) {
+            // Gather as many queued writes as possible into a single call
+            int n = 0;
+            int total = 0;
+#ifdef _WIN32
+            WSABUF iov[NET_MAX_IOV];
+            for (auto it = writeQueue.begin(); it != writeQueue.end() && n < NET_MAX_IOV; it++, n++) {
+                iov[n].buf = (char*)&it->buf[it->offset];
+                iov[n].len = it->count - it->offset;
+                total += iov[n].len;
+            }
+            DWORD sentBytes = 0;
+            int ret = (WSASend(_sock, iov, n, &sentBytes, 0, NULL, NULL) == 0) ? (int)sentBytes : -1;
+#else
+            struct iovec iov[NET_MAX_IOV];
+            for (auto it = writeQueue.begin(); it != writeQueue.end() && n < NET_MAX_IOV; it++, n++) {
+                iov[n].iov_base = (void*)&it->buf[it->offset];
+                iov[n].iov_len = it->count - it->offset;
+                total += iov[n].iov_len;
+            }
+            int ret = ::writev(_sock, iov, n);
+#endif
+            if (ret < 0) {
+                if (wouldBlock()) { break; }
+                disconnect();
+                return;
+            }
+            bytesWritten += ret;
+            writeQueueSize -= ret;
+
+            // Pop everything that was fully sent
+            int left = ret;
+            while (left) {
+                ConnWriteEntry& entry = writeQueue.front();
+                int rem = entry.count - entry.offset;
+                if (left < rem) {
+                    entry.offset += left;
+                    break;
                 }
-                connectionOpenCnd.notify_all();
+                left -= rem;
+                completedWriteId = entry.id;
+                writeQueue.pop_front();
+            }
+
+            if (ret < total) { break; }
+        }
+
+        writeCnd.notify_all();
+        Reactor::get().update(this);
+    }
+
+    void ConnClass::completeReads() {
+        // Handlers of a connection run one at a time and in order, the next entry is only filled once the current handler returns
+        while (!_udp && !dispatching && !readQueue.empty() && ringFill) {
+            ConnReadEntry& entry = readQueue.front();
+            entry.filled += ringRead(&entry.buf[entry.filled], entry.count - entry.filled);
+            if (entry.enforceSize && entry.filled < entry.count) { continue; }
+
+            ConnReadEntry done = entry;
+            readQueue.pop_front();
+            dispatching = true;
+            Reactor::get().post([this, done]() { runHandler(done, done.filled); });
+        }
+        Reactor::get().update(this);
+    }
+
+    void ConnClass::runHandler(ConnReadEntry entry, int count) {
+        {
+            std::lock_guard lck(mtx);
+            if (stopped) {
+                dispatching = false;
+                handlerCnd.notify_all();
                 return;
             }
+            handlerThread = std::this_thread::get_id();
+        }
+
+        entry.handler(count, entry.buf, entry.ctx);
+
+        std::lock_guard lck(mtx);
+        handlerThread = std::thread::id();
+        dispatching = false;
+        if (!stopped) { completeReads(); }
+        handlerCnd.notify_all();
+    }
+
+    int ConnClass::ringRead(uint8_t* buf, int count) {
+        int size = ring.size();
+        int len = std::min<int>(count, ringFill);
+        int first = std::min<int>(len, size - ringHead);
+        memcpy(buf, &ring[ringHead], first);
+        memcpy(&buf[first], &ring[0], len - first);
+        ringHead = (ringHead + len) % size;
+        ringFill -= len;
+        return len;
+    }
+
+    int ConnClass::sendDirect(const uint8_t* buf, int count) {
+        int sent = 0;
+        while (sent < count) {
+            int ret = send(_sock, (const char*)&buf[sent], count - sent, 0);
+            if (ret < 0 && wouldBlock()) { break; }
+            if (ret <= 0) {
+                disconnect();
+                return -1;
+            }
+            sent += ret;
         }
+        bytesWritten += sent;
+        return sent;
+    }
+
+    void ConnClass::queueWrite(const uint8_t* buf, int count, bool async) {
+        ConnWriteEntry entry;
+        entry.id = nextWriteId++;
+        entry.count = count;
+        entry.offset = 0;
+        entry.async = async;
+        if (async) { entry.data.assign(buf, buf + count); }
+        writeQueue.push_back(std::move(entry));
+
+        // Async writes own a copy of the data, the pointer is set after the move
+        ConnWriteEntry& queued = writeQueue.back();
+        queued.buf = async ? queued.data.data() : buf;
+        writeQueueSize += count;
+        Reactor::get().update(this);
+    }
+
+    void ConnClass::disconnect() {
+        connectionOpen = false;
+        writeQueue.clear();
+        writeQueueSize = 0;
+        readCnd.notify_all();
+        writeCnd.notify_all();
+        connectionOpenCnd.notify_all();
+        Reactor::get().update(this);
+    }
+
+    int ConnClass::interest() {
+        if (removed || stopped || !connectionOpen) { return 0; }
+        if (_udp) { return (!readQueue.empty() && !dispatching) ? NET_INTEREST_READ : 0; }
+        int ev = 0;
+        if (ringFill < (int)ring.size()) { ev |= NET_INTEREST_READ; }
+        if (!writeQueue.empty()) { ev |= NET_INTEREST_WRITE; }
+        return ev;
     }
 
 
@@ -7,6 +7,7 @@
 #include <memory>
 #include <thread>
 #include <condition_variable>
+#include <deque>
 
 #ifdef _WIN32
 #include <WinSock2.h>
@@ -21,6 +22,18 @@
 #include <signal.h>
 #endif
 
+// Size of the per-connection receive ring, reading from the socket pauses while it is full
+#define NET_READ_RING_SIZE              (256 * 1024)
+
+// Default amount of data writeAsync can queue before the write policy applies
+#define NET_DEFAULT_WRITE_QUEUE_SIZE    (16 * 1024 * 1024)
+
+// Maximum number of queued writes sent with a single system call
+#define NET_MAX_IOV                     64
+
+// Maximum number of datagrams returned by a single readMulti call
+#define NET_MAX_READ_BATCH              64
+
 namespace net {
 #ifdef _WIN32
     typedef SOCKET Socket;
@@ -34,13 +47,39 @@ namespace net {
         void (*handler)(int count, uint8_t* buf, void* ctx);
         void* ctx;
         bool enforceSize;
+        int filled;
     };
 
     struct ConnWriteEntry {
+        uint64_t id;
+        const uint8_t* buf;
         int count;
-        uint8_t* buf;
+        int offset;
+        bool async;
+        std::vector<uint8_t> data;
+    };
+
+    enum WritePolicy {
+        WRITE_POLICY_BLOCK,         // Wait for room in the queue
+        WRITE_POLICY_DROP_NEWEST,   // Discard the write being queued
+        WRITE_POLICY_DROP_OLDEST    // Discard the oldest queued writes that haven't started sending
     };
 
+    struct ConnStats {
+        uint64_t bytesRead;
+        uint64_t bytesWritten;
+        uint64_t writesDropped;
+        int writeQueueSize;
+    };
+
+    class Reactor;
+
+    /*
+        All TCP connections are serviced by a single shared I/O thread (epoll on Linux, poll elsewhere).
+        Received data goes into a per-connection ring from which both sync and async reads are served,
+        async read handlers run on a shared pool, one at a time per connection.
+        Writes are attempted directly and the remainder is queued and flushed in batches when the socket is writable.
+    */
     class ConnClass {
     public:
         ConnClass(Socket sock, struct sockaddr_in raddr = {}, bool udp = false);
@@ -53,28 +92,68 @@ namespace net {
         int read(int count, uint8_t* buf, bool enforceSize = true);
         bool write(int count, uint8_t* buf);
         void readAsync(int count, uint8_t* buf, void (*handler)(int count, uint8_t* buf, void* ctx), void* ctx, bool enforceSize = true);
-        void writeAsync(int count, uint8_t* buf);
+        bool writeAsync(int count, uint8_t* buf);
+
+        // Limits how much data writeAsync can queue and what happens once the limit is reached
+        void setWritePolicy(WritePolicy policy, int maxQueueSize = NET_DEFAULT_WRITE_QUEUE_SIZE);
+        ConnStats getStats();
+
+        // UDP only, for sockets shared between several peers
+        int readFrom(int count, uint8_t* buf, struct sockaddr_in* addr);
+        bool writeTo(int count, uint8_t* buf, const struct sockaddr_in* addr);
+
+        // UDP only, blocks for the first datagram then returns all that are already queued.
+        // Datagram i is written at buf + i * maxLen and its length to lens[i]
+        int readMulti(int maxLen, uint8_t* buf, int* lens, int count);
 
     private:
-        void readWorker();
-        void writeWorker();
+        friend class Reactor;
+
+        // Called with the connection mutex held
+        void onReadable();
+        void onWritable();
+        void completeReads();
+        void runHandler(ConnReadEntry entry, int count);
+        int ringRead(uint8_t* buf, int count);
+        int sendDirect(const uint8_t* buf, int count);
+        void queueWrite(const uint8_t* buf, int count, bool async);
+        void disconnect();
+        int interest();
 
-        bool stopWorkers = false;
         bool connectionOpen = false;
+        bool stopped = false;
+        bool removed = false;
+        bool sockClosed = false;
+        int curInterest = 0;
 
+        std::mutex mtx;
         std::mutex readMtx;
         std::mutex writeMtx;
-        std::mutex readQueueMtx;
-        std::mutex writeQueueMtx;
-        std::mutex connectionOpenMtx;
-        std::mutex closeMtx;
-        std::condition_variable readQueueCnd;
-        std::condition_variable writeQueueCnd;
+        std::condition_variable readCnd;
+        std::condition_variable writeCnd;
         std::condition_variable connectionOpenCnd;
-        std::vector<ConnReadEntry> readQueue;
-        std::vector<ConnWriteEntry> writeQueue;
-        std::thread readWorkerThread;
-        std::thread writeWorkerThread;
+        std::condition_variable handlerCnd;
+
+        // Receive side
+        std::vector<uint8_t> ring;
+        int ringHead = 0;
+        int ringFill = 0;
+        std::deque<ConnReadEntry> readQueue;
+        bool dispatching = false;
+        std::thread::id handlerThread;
+
+        // Send side
+        std::deque<ConnWriteEntry> writeQueue;
+        int writeQueueSize = 0;
+        uint64_t nextWriteId = 1;
+        uint64_t completedWriteId = 0;
+        WritePolicy writePolicy = WRITE_POLICY_BLOCK;
+        int maxWriteQueueSize = NET_DEFAULT_WRITE_QUEUE_SIZE;
+
+        // Statistics
+        uint64_t bytesRead = 0;
+        uint64_t bytesWritten = 0;
+        uint64_t writesDropped = 0;
 
         Socket _sock;
         bool _udp;
@@ -0,0 +1,434 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <json.hpp>
+#include <imgui.h>
+#include <gui/style.h>
+#include <utils/flog.h>
+#include <utils/optionlist.h>
+#include <utils/sigmf.h>
+
+namespace rollover {
+    // When to start a new file, any combination of the limits can be used. Files are only ever cut between two blocks.
+    struct Policy {
+        uint64_t maxBytes = 0;      // Size of a file, estimated from the samples for compressed formats
+        uint64_t maxSeconds = 0;    // Duration of a file
+        uint64_t boundary = 0;      // Wall clock period in seconds, 3600 starts a file at the top of every hour
+
+        bool enabled() const { return maxBytes || maxSeconds || boundary; }
+    };
+
+    // Split settings as shown in the menu of the modules that record, saved under the same keys by all of them
+    class Settings {
+    public:
+        enum Mode {
+            MODE_OFF,
+            MODE_SIZE,
+            MODE_DURATION,
+            MODE_CLOCK
+        };
+
+        Settings() {
+            modes.define("off", "Off", MODE_OFF);
+            modes.define("size", "By size", MODE_SIZE);
+            modes.define("duration", "By duration", MODE_DURATION);
+            modes.define("clock", "On the clock", MODE_CLOCK);
+            sizes.define("100m", "100 MB", 100000000ULL);
+            sizes.define("500m", "500 MB", 500000000ULL);
+            sizes.define("1g", "1 GB", 1000000000ULL);
+            sizes.define("2g", "2 GB", 2000000000ULL);
+            sizes.define("4g", "4 GB", 4000000000ULL);
+            times.define("1m", "1 min", 60);
+            times.define("5m", "5 min", 300);
+            times.define("10m", "10 min", 600);
+            times.define("15m", "15 min", 900);
+            times.define("30m", "30 min", 1800);
+            times.define("1h", "1 hour", 3600);
+            times.define("6h", "6 hours", 21600);
+            times.define("24h", "24 hours", 86400);
+
+            modeId = modes.valueId(MODE_OFF);
+            sizeId = sizes.valueId(1000000000ULL);
+            timeId = times.valueId(3600);
+        }
+
+        // conf is the config object of the module instance
+        void load(nlohmann::json& conf) {
+            if (conf.contains("rollover") && modes.keyExists(conf["rollover"])) {
+                modeId = modes.keyId(conf["rollover"]);
+            }
+            if (conf.contains("rolloverSize") && sizes.keyExists(conf["rolloverSize"])) {
+                sizeId = sizes.keyId(conf["rolloverSize"]);
+            }
+            if (conf.contains("rolloverTime") && times.keyExists(conf["rolloverTime"])) {
+                timeId = times.keyId(conf["rolloverTime"]);
+            }
+        }
+
+        void save(nlohmann::json& conf) {
+            conf["rollover"] = modes.key(modeId);
+            conf["rolloverSize"] = sizes.key(sizeId);
+            conf["rolloverTime"] = times.key(timeId);
+        }
+
+        // Returns true if a setting was changed and needs to be saved
+        bool showMenu(const std::string& id) {
+            bool changed = false;
+            ImGui::LeftLabel("Split files");
+            ImGui::FillWidth();
+            changed |= ImGui::Combo(("##" + id + "_rollover").c_str(), &modeId, modes.txt);
+            Mode mode = modes[modeId];
+            if (mode == MODE_SIZE) {
+                ImGui::LeftLabel("File size");
+                ImGui::FillWidth();
+                changed |= ImGui::Combo(("##" + id + "_rollover_size").c_str(), &sizeId, sizes.txt);
+            }
+            else if (mode == MODE_DURATION || mode == MODE_CLOCK) {
+                ImGui::LeftLabel((mode == MODE_CLOCK) ? "Every" : "File duration");
+                ImGui::FillWidth();
+                changed |= ImGui::Combo(("##" + id + "_rollover_time").c_str(), &timeId, times.txt);
+            }
+            return changed;
+        }
+
+        bool enabled() {
+            return modes[modeId] != MODE_OFF;
+        }
+
+        Policy getPolicy() {
+            Policy policy;
+            switch (modes[modeId]) {
+            case MODE_SIZE:
+                policy.maxBytes = sizes[sizeId];
+                break;
+            case MODE_DURATION:
+                policy.maxSeconds = times[timeId];
+                break;
+            case MODE_CLOCK:
+                policy.boundary = times[timeId];
+                break;
+            default:
+                break;
+            }
+            return policy;
+        }
+
+    private:
+        OptionList<std::string, Mode> modes;
+        OptionList<std::string, uint64_t> sizes;
+        OptionList<std::string, uint64_t> times;
+        int modeId;
+        int sizeId;
+        int timeId;
+    };
+
+    /*
+        Splits a recording into segments without losing any sample. Two writers are used in turn: while the current one
+        records, a background thread opens the next file in the other. The switch done by the thread producing the samples
+        is then only a pointer swap, the old writer writes out its queue and is closed by the background thread.
+
+        The segments are listed in a JSON index next to them with the exact sample at which they start. Their startTime
+        is derived from the sample count and the time of the first sample, it's only exact if no samples were skipped
+        (the recorder's "Ignore silence" for example). Their wallTime is when the first block of the segment was
+        written, accurate to one block but unaffected by skipped samples.
+    */
+    template <class W>
+    class Segmenter {
+    public:
+        // Open the writer on the given path, which has no extension. Returns the path of the created file, empty on failure.
+        typedef std::function<std::string(W& writer, const std::string& path)> OpenHandler;
+        typedef std::function<void(W& writer)> CloseHandler;
+
+        // Called from the background thread once a writer opened ahead of time received its first block, with the wall
+        // clock time of that block in ns since the epoch
+        typedef std::function<void(W& writer, int64_t time)> SwitchHandler;
+
+        // Close a writer opened ahead of time that never got a block and delete every file it created
+        typedef std::function<void(W& writer)> DiscardHandler;
+
+        ~Segmenter() { stop(); }
+
+        // firstSampleTime is the wall clock time of the first sample in ns since the epoch, now if 0. Samples recorded ahead
+        // of the start, like a pre-record buffer, make it earlier.
+        bool start(const std::string& basePath, uint64_t samplerate, double bytesPerSample, const Policy& policy, OpenHandler openHandler, CloseHandler closeHandler, int64_t firstSampleTime = 0) {
+            std::lock_guard<std::mutex> lck(ctrlMtx);
+            if (running) { return false; }
+            _basePath = basePath;
+            _samplerate = samplerate;
+            _bytesPerSample = bytesPerSample;
+            _policy = policy;
+            open = openHandler;
+            close = closeHandler;
+            startTime = firstSampleTime ? firstSampleTime : now();
+
+            // Without a policy, the recording is a single file named as usual
+            segments.clear();
+            std::string path = open(writers[0], _policy.enabled() ? segmentPath(0) : basePath);
+            if (path.empty()) { return false; }
+            segments.push_back({ path, 0, 0, startTime });
+            currentIdx = 0;
+            samplesWritten = 0;
+            segmentStart = 0;
+            updateLimit();
+
+            if (_policy.enabled()) {
+                writeIndex();
+                spareReady = false;
+                retiredPending = false;
+                stopWorker = false;
+                workerThread = std::thread(&Segmenter::worker, this);
+            }
+            running = true;
+            return true;
+        }
+
+        void stop() {
+            std::lock_guard<std::mutex> lck(ctrlMtx);
+            if (!running) { return; }
+
+            // Stop the background thread, then finish what it might have left
+            {
+                std::lock_guard<std::mutex> wlck(workerMtx);
+                stopWorker = true;
+            }
+            workerCnd.notify_all();
+            if (workerThread.joinable()) { workerThread.join(); }
+            if (retiredPending) { retire(); }
+            if (spareReady) {
+                // The next file was never used
+                if (discard) {
+                    discard(writers[currentIdx ^ 1]);
+                }
+                else {
+                    close(writers[currentIdx ^ 1]);
+                    std::error_code ec;
+                    std::filesystem::remove(sparePath, ec);
+                }
+                spareReady = false;
+            }
+
+            close(writers[currentIdx]);
+            segments.back().samples = samplesWritten - segments.back().startSample;
+            if (_policy.enabled()) { writeIndex(); }
+            if (lateSwitches) {
+                flog::warn("{0} file switches happened late because the next file wasn't open yet", lateSwitches);
+                lateSwitches = 0;
+            }
+            running = false;
+        }
+
+        bool isRunning() {
+            return running;
+        }
+
+        // Not thread safe, call before start
+        void setSwitchHandler(SwitchHandler handler) {
+            onSwitch = handler;
+        }
+
+        // Not thread safe, call before start. Without it only the file returned by the open handler is deleted.
+        void setDiscardHandler(DiscardHandler handler) {
+            discard = handler;
+        }
+
+        // Writer to give the next block of count samples to. Only one thread at a time may call it.
+        W* next(int count) {
+            int idx = currentIdx;
+            if (_policy.enabled() && samplesWritten > segmentStart && samplesWritten + count - segmentStart > segmentLimit) {
+                if (spareReady.load(std::memory_order_acquire)) {
+                    // Switch, the background thread closes the old writer and opens the following file
+                    {
+                        std::lock_guard<std::mutex> lck(workerMtx);
+                        idx ^= 1;
+                        currentIdx = idx;
+                        switchSample = samplesWritten;
+                        switchTime = now();
+                        spareReady = false;
+                        retiredPending = true;
+                    }
+                    workerCnd.notify_all();
+                    segmentStart = samplesWritten;
+                    updateLimit();
+                }
+                else if (!lateSwitch) {
+                    lateSwitch = true;
+                    lateSwitches++;
+                }
+            }
+            samplesWritten += count;
+            return &writers[idx];
+        }
+
+        // Writer currently recording, only for showing its state
+        W* current() {
+            return &writers[currentIdx];
+        }
+
+        uint64_t getSamplesWritten() {
+            return samplesWritten;
+        }
+
+        int getSegment() {
+            std::lock_guard<std::mutex> lck(workerMtx);
+            return segments.size() - (retiredPending ? 0 : 1);
+        }
+
+    private:
+        struct Segment {
+            std::string path;
+            uint64_t startSample;
+            uint64_t samples;
+            int64_t wallTime;
+        };
+
+        static int64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        std::string segmentPath(int index) {
+            char suffix[32];
+            sprintf(suffix, "_%03d", index);
+            return _basePath + suffix;
+        }
+
+        // Number of samples in the segment that just started, called by the thread producing the samples
+        void updateLimit() {
+            lateSwitch = false;
+            segmentLimit = UINT64_MAX;
+            if (_policy.maxBytes) {
+                segmentLimit = std::min<uint64_t>(segmentLimit, std::max<uint64_t>(1, _policy.maxBytes / _bytesPerSample));
+            }
+            if (_policy.maxSeconds) {
+                segmentLimit = std::min<uint64_t>(segmentLimit, _policy.maxSeconds * _samplerate);
+            }
+            if (_policy.boundary) {
+                // Next multiple of the period after the start of the segment, in samples
+                double start = (double)startTime / 1e9 + (double)segmentStart / (double)_samplerate;
+                double next = (floor(start / (double)_policy.boundary) + 1.0) * (double)_policy.boundary;
+                segmentLimit = std::min<uint64_t>(segmentLimit, std::max<uint64_t>(1, ceil((next - start) * (double)_samplerate)));
+            }
+        }
+
+        void worker() {
+            std::unique_lock<std::mutex> lck(workerMtx);
+            while (!stopWorker) {
+                // Close the writer that was switched away from, its slot then takes the following file
+                if (retiredPending) {
+                    lck.unlock();
+                    retire();
+                    lck.lock();
+                    continue;
+                }
+
+                // Open the next file ahead of time, try again later if it fails
+                if (!spareReady) {
+                    int idx = currentIdx ^ 1;
+                    std::string path = segmentPath(segments.size());
+                    lck.unlock();
+                    std::string created = open(writers[idx], path);
+                    lck.lock();
+                    if (!created.empty()) {
+                        sparePath = created;
+                        spareReady = true;
+                        continue;
+                    }
+                    flog::error("Failed to open the next file of the recording: {0}", path);
+                    workerCnd.wait_for(lck, std::chrono::seconds(1), [this]() { return stopWorker; });
+                    continue;
+                }
+
+                workerCnd.wait(lck, [this]() { return stopWorker || retiredPending; });
+            }
+        }
+
+        // Close the previous writer once everything it had queued is written and add the new segment to the index
+        void retire() {
+            close(writers[currentIdx ^ 1]);
+            int64_t time;
+            {
+                std::lock_guard<std::mutex> lck(workerMtx);
+                segments.back().samples = switchSample - segments.back().startSample;
+                segments.push_back({ sparePath, switchSample, 0, switchTime });
+                time = switchTime;
+                retiredPending = false;
+            }
+            if (onSwitch) { onSwitch(writers[currentIdx], time); }
+            writeIndex();
+        }
+
+        // Rewritten as a whole every time, it's small
+        void writeIndex() {
+            nlohmann::json index;
+            index["samplerate"] = _samplerate;
+            index["startTime"] = sigmf::formatTime(startTime);
+            index["segments"] = nlohmann::json::array();
+            {
+                std::lock_guard<std::mutex> lck(workerMtx);
+                for (int i = 0; i < segments.size(); i++) {
+                    const Segment& seg = segments[i];
+                    nlohmann::json s;
+                    s["index"] = i;
+                    s["file"] = std::filesystem::path(seg.path).filename().string();
+                    s["startSample"] = seg.startSample;
+                    s["startTime"] = sigmf::formatTime(startTime + (int64_t)round((double)seg.startSample * 1e9 / (double)_samplerate));
+                    s["wallTime"] = sigmf::formatTime(seg.wallTime);
+                    if (seg.samples) { s["samples"] = seg.samples; }
+                    index["segments"].push_back(s);
+                }
+            }
+
+            std::ofstream file(_basePath + ".segments.json");
+            if (!file.is_open()) {
+                flog::error("Failed to write the segment index of the recording: {0}", _basePath + ".segments.json");
+                return;
+            }
+            file << index.dump(4);
+        }
+
+        std::mutex ctrlMtx;
+        bool running = false;
+        std::string _basePath;
+        uint64_t _samplerate = 0;
+        double _bytesPerSample = 1.0;
+        Policy _policy;
+        OpenHandler open;
+        CloseHandler close;
+        SwitchHandler onSwitch;
+        DiscardHandler discard;
+        int64_t startTime = 0;
+
+        W writers[2];
+        std::atomic<int> currentIdx = 0;
+
+        // Only touched by the thread producing the samples
+        std::atomic<uint64_t> samplesWritten = 0;
+        uint64_t segmentStart = 0;
+        uint64_t segmentLimit = UINT64_MAX;
+        bool lateSwitch = false;
+        uint64_t lateSwitches = 0;
+
+        // Shared with the background thread
+        std::thread workerThread;
+        std::mutex workerMtx;
+        std::condition_variable workerCnd;
+        bool stopWorker = false;
+        std::atomic<bool> spareReady = false;
+        bool retiredPending = false;
+        std::string sparePath;
+        uint64_t switchSample = 0;
+        int64_t switchTime = 0;
+        std::vector<Segment> segments;
+    };
+}
@@ -0,0 +1,116 @@
+#include "sigmf.h"
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <ctime>
+#include <stdio.h>
+#include <utils/flog.h>
+
+namespace sigmf {
+    const char* SIGMF_VERSION = "1.0.0";
+
+    MetaWriter::~MetaWriter() { close(); }
+
+    bool MetaWriter::open(std::string path, std::string datatype, double samplerate, int channels, double frequency, int64_t startTime) {
+        std::lock_guard<std::mutex> lck(mtx);
+        _path = path;
+        meta = nlohmann::json::object();
+        meta["global"]["core:datatype"] = datatype;
+        meta["global"]["core:sample_rate"] = samplerate;
+        meta["global"]["core:version"] = SIGMF_VERSION;
+        meta["global"]["core:recorder"] = "SDR++";
+        if (channels > 1) { meta["global"]["core:num_channels"] = channels; }
+        meta["annotations"] = nlohmann::json::array();
+
+        nlohmann::json capture;
+        capture["core:sample_start"] = 0;
+        capture["core:frequency"] = frequency;
+        capture["core:datetime"] = startTime ? formatTime(startTime) : now();
+        meta["captures"] = nlohmann::json::array({ capture });
+        lastFrequency = frequency;
+        lastSample = 0;
+
+        fileOpen = true;
+        write();
+        return fileOpen;
+    }
+
+    bool MetaWriter::isOpen() {
+        std::lock_guard<std::mutex> lck(mtx);
+        return fileOpen;
+    }
+
+    void MetaWriter::close() {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (!fileOpen) { return; }
+        write();
+        fileOpen = false;
+    }
+
+    void MetaWriter::discard() {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (!fileOpen) { return; }
+        fileOpen = false;
+        std::error_code ec;
+        std::filesystem::remove(_path, ec);
+    }
+
+    void MetaWriter::addCapture(uint64_t sample, double frequency) {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (!fileOpen || frequency == lastFrequency) { return; }
+
+        // Several retunes before a new sample was written only change the last capture
+        if (sample <= lastSample) {
+            meta["captures"].back()["core:frequency"] = frequency;
+        }
+        else {
+            nlohmann::json capture;
+            capture["core:sample_start"] = sample;
+            capture["core:frequency"] = frequency;
+            capture["core:datetime"] = now();
+            meta["captures"].push_back(capture);
+            lastSample = sample;
+        }
+        lastFrequency = frequency;
+        write();
+    }
+
+    void MetaWriter::setStart(int64_t startTime, double frequency) {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (!fileOpen) { return; }
+        meta["captures"][0]["core:datetime"] = formatTime(startTime);
+        meta["captures"][0]["core:frequency"] = frequency;
+        if (meta["captures"].size() == 1) { lastFrequency = frequency; }
+        write();
+    }
+
+    void MetaWriter::write() {
+        std::string tmpPath = _path + ".tmp";
+        {
+            std::ofstream file(tmpPath);
+            if (!file.is_open()) {
+                flog::error("Failed to write the SigMF metadata: {0}", _path);
+                fileOpen = false;
+                return;
+            }
+            file << meta.dump(4);
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, _path, ec);
+        if (ec) { flog::error("Failed to write the SigMF metadata: {0}", _path); }
+    }
+
+    std::string now() {
+        return formatTime(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    std::string formatTime(int64_t ns) {
+        time_t secs = ns / 1000000000;
+        int micros = (ns % 1000000000) / 1000;
+        char buf[64];
+        strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", gmtime(&secs));
+        char full[96];
+        sprintf(full, "%s.%06dZ", buf, micros);
+        return full;
+    }
+}
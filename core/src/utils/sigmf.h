@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <stdint.h>
+#include <json.hpp>
+
+namespace sigmf {
+    // Writes the .sigmf-meta file of a recording while it's being made. The file is rewritten
+    // through a temporary one whenever something changes so that it's always complete.
+    class MetaWriter {
+    public:
+        ~MetaWriter();
+
+        // Datatype as defined by the SigMF specification, for example "ci16_le". startTime is the time of the first sample
+        // in ns since the epoch, now if 0.
+        bool open(std::string path, std::string datatype, double samplerate, int channels, double frequency, int64_t startTime = 0);
+        bool isOpen();
+        void close();
+
+        // Close the file and delete it, for a recording that ended up not being used
+        void discard();
+
+        // Start a new capture segment at the given sample of the data file, ignored if the frequency didn't change
+        void addCapture(uint64_t sample, double frequency);
+
+        // Time and frequency of the first sample, for files that were opened before they started recording
+        void setStart(int64_t startTime, double frequency);
+
+    private:
+        void write();
+
+        std::mutex mtx;
+        bool fileOpen = false;
+        std::string _path;
+        nlohmann::json meta;
+        double lastFrequency = 0.0;
+        uint64_t lastSample = 0;
+    };
+
+    // Current UTC time in the ISO 8601 format used by SigMF
+    std::string now();
+
+    // Same for a time in ns since the epoch
+    std::string formatTime(int64_t ns);
+}
@@ -1,29 +1,56 @@
 #include "wav.h"
 #include <volk/volk.h>
 #include <stdexcept>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
 #include <dsp/buffer/buffer.h>
 #include <dsp/stream.h>
+#include <utils/flog.h>
 #include <map>
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace wav {
+    const char* RIFF_SIGNATURE          = "RIFF";
+    const char* RF64_SIGNATURE          = "RF64";
     const char* WAVE_FILE_TYPE          = "WAVE";
+    const char* DS64_MARKER             = "ds64";
+    const char* JUNK_MARKER             = "JUNK";
     const char* FORMAT_MARKER           = "fmt ";
     const char* DATA_MARKER             = "data";
     const uint32_t FORMAT_HEADER_LEN    = 16;
     const uint16_t SAMPLE_TYPE_PCM      = 1;
 
+    // Layout of the header: RIFF, ds64 or JUNK, fmt (with its extension if any), JUNK padding up to the data chunk header
+    const size_t DS64_OFFSET            = 12;
+    const size_t FORMAT_OFFSET          = DS64_OFFSET + sizeof(riff::ChunkHeader) + sizeof(DS64Header);
+    const size_t DATA_OFFSET            = WAV_HEADER_SIZE - sizeof(riff::ChunkHeader);
+
+    // Interval at which the sizes in the header are updated, so that a crash doesn't lose the whole recording
+    const double HEADER_UPDATE_INTERVAL = 1.0;
+
+    // KSDATAFORMAT_SUBTYPE_PCM, the first two bytes are replaced by the codec for the other subtypes
+    const uint8_t SUBFORMAT_GUID[16]    = { 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+
     std::map<SampleType, int> SAMP_BITS = {
         { SAMP_TYPE_UINT8, 8 },
         { SAMP_TYPE_INT16, 16 },
         { SAMP_TYPE_INT32, 32 },
         { SAMP_TYPE_FLOAT32, 32 }
     };
-    
+
     Writer::Writer(int channels, uint64_t samplerate, Format format, SampleType type) {
         // Validate channels and samplerate
         if (channels < 1) { throw std::runtime_error("Channel count must be greater or equal to 1"); }
         if (!samplerate) { throw std::runtime_error("Samplerate must be non-zero"); }
-        
+
         // Initialize variables
         _channels = channels;
         _samplerate = samplerate;
@@ -36,87 +63,135 @@ namespace wav {
     bool Writer::open(std::string path) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Close previous file
-        if (rw.isOpen()) { close(); }
+        if (fileOpen) { close(); }
 
         // Reset work values
         samplesWritten = 0;
+        dataWritten = 0;
+        ioError = false;
+        maxQueued = 0;
+        droppedBlocks = 0;
+        droppedSamples = 0;
 
         // Fill header
+        if (SAMP_BITS.find(_type) == SAMP_BITS.end()) { return false; }
+        uint16_t codec = (_type == SAMP_TYPE_FLOAT32) ? CODEC_FLOAT : CODEC_PCM;
         bytesPerSamp = (SAMP_BITS[_type] / 8) * _channels;
-        hdr.codec = (_type == SAMP_TYPE_FLOAT32) ? CODEC_FLOAT : CODEC_PCM;
+        extensible = (_channels > 2);
+        hdr.codec = extensible ? CODEC_EXTENSIBLE : codec;
         hdr.channelCount = _channels;
         hdr.sampleRate = _samplerate;
         hdr.bitDepth = SAMP_BITS[_type];
         hdr.bytesPerSample = bytesPerSamp;
         hdr.bytesPerSecond = bytesPerSamp * _samplerate;
 
-        // Precompute sizes and allocate buffers
-        switch (_type) {
-        case SAMP_TYPE_UINT8:
-            bufU8 = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE * _channels);
-            break;
-        case SAMP_TYPE_INT16:
-            bufI16 = dsp::buffer::alloc<int16_t>(STREAM_BUFFER_SIZE * _channels);
-            break;
-        case SAMP_TYPE_INT32:
-            bufI32 = dsp::buffer::alloc<int32_t>(STREAM_BUFFER_SIZE * _channels);
-            break;
-        case SAMP_TYPE_FLOAT32:
-            break;
-        default:
-            return false;
-            break;
-        }
+        // The channels aren't speakers, so no position is given to them
+        hdrExt.extensionSize = sizeof(FormatExtension) - sizeof(hdrExt.extensionSize);
+        hdrExt.validBits = hdr.bitDepth;
+        hdrExt.channelMask = 0;
+        memcpy(hdrExt.subFormat, SUBFORMAT_GUID, sizeof(SUBFORMAT_GUID));
+        memcpy(hdrExt.subFormat, &codec, sizeof(codec));
 
         // Open file
-        if (!rw.open(path, WAVE_FILE_TYPE)) { return false; }
+        if (!openFile(path)) { return false; }
+        _path = path;
 
-        // Write format chunk
-        rw.beginChunk(FORMAT_MARKER);
-        rw.write((uint8_t*)&hdr, sizeof(FormatHeader));
-        rw.endChunk();
+        // Blocks of about an eighth of a second so that audio reaches the disk regularly and baseband in large writes,
+        // always a multiple of the header size to keep direct I/O aligned
+        blockSize = std::clamp<size_t>(hdr.bytesPerSecond / 8, WAV_WRITER_MIN_BLOCK, WAV_WRITER_MAX_BLOCK);
+        blockSize = ((blockSize + WAV_HEADER_SIZE - 1) / WAV_HEADER_SIZE) * WAV_HEADER_SIZE;
+        int blockCount = _synchronous ? 1 : std::clamp<int>(WAV_WRITER_QUEUE_MEMORY / blockSize, 4, WAV_WRITER_MAX_BLOCKS);
+        blocks.resize(blockCount);
+        blockSizes.resize(blockCount);
+        for (auto& blk : blocks) { blk = (uint8_t*)volk_malloc(blockSize, WAV_HEADER_SIZE); }
+        headerBuf = (uint8_t*)volk_malloc(WAV_HEADER_SIZE, WAV_HEADER_SIZE);
+        fillIdx = 0;
+        fillPos = 0;
+        filling = false;
+        writeIdx = 0;
+        queued = 0;
+
+        // Write the header right away so that the file is valid even if nothing gets recorded
+        dataOffset = (_format == FORMAT_RAW) ? 0 : WAV_HEADER_SIZE;
+        writeHeader(false);
+
+        // Start the I/O thread
+        lastHeaderUpdate = std::chrono::steady_clock::now();
+        stopWorker = false;
+        if (!_synchronous) { workerThread = std::thread(&Writer::worker, this); }
 
-        // Begin data chunk
-        rw.beginChunk(DATA_MARKER);
-        
         return true;
     }
 
+    void Writer::discard() {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        if (!fileOpen) { return; }
+        close();
+        std::error_code ec;
+        std::filesystem::remove(_path, ec);
+    }
+
     bool Writer::isOpen() {
         std::lock_guard<std::recursive_mutex> lck(mtx);
-        return rw.isOpen();
+        return fileOpen;
     }
 
     void Writer::close() {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do nothing if the file is not open
-        if (!rw.isOpen()) { return; }
+        if (!fileOpen) { return; }
+
+        // Let the I/O thread write everything that is queued
+        {
+            std::lock_guard<std::mutex> qlck(queueMtx);
+            stopWorker = true;
+        }
+        queueCnd.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
 
-        // Finish data chunk
-        rw.endChunk();
+        // The last block is partial and can't go through direct I/O, neither can the padding byte of odd sizes
+        if (filling && fillPos) {
+            disableDirectIO();
+            if (!writeAt(dataOffset + dataWritten, blocks[fillIdx], fillPos)) { ioError = true; }
+            dataWritten += fillPos;
+        }
+        filling = false;
+        uint64_t fileSize = dataOffset + dataWritten;
+        if ((dataWritten & 1) && _format != FORMAT_RAW) {
+            uint8_t pad = 0;
+            disableDirectIO();
+            writeAt(fileSize, &pad, 1);
+            fileSize++;
+        }
 
-        // Close the file
-        rw.close();
+        // Write the final sizes and close the file
+        writeHeader(true);
+        closeFile(fileSize);
 
-        // Free buffers
-        if (bufU8) {
-            dsp::buffer::free(bufU8);
-            bufU8 = NULL;
+        if (ioError) {
+            flog::error("Errors occured while writing the recording, it may be incomplete");
+        }
+        if (droppedBlocks) {
+            flog::warn("Recording dropped {0} blocks ({1} samples), the disk couldn't keep up", droppedBlocks, droppedSamples);
         }
-        if (bufI16) {
-            dsp::buffer::free(bufI16);
-            bufI16 = NULL;
+
+        // Free buffers
+        {
+            std::lock_guard<std::mutex> qlck(queueMtx);
+            for (auto& blk : blocks) { volk_free(blk); }
+            blocks.clear();
+            blockSizes.clear();
         }
-        if (bufI32) {
-            dsp::buffer::free(bufI32);
-            bufI32 = NULL;
+        if (headerBuf) {
+            volk_free(headerBuf);
+            headerBuf = NULL;
         }
     }
 
     void Writer::setChannels(int channels) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (fileOpen) { throw std::runtime_error("Cannot change parameters while file is open"); }
 
         // Validate channel count
         if (channels < 1) { throw std::runtime_error("Channel count must be greater or equal to 1"); }
@@ -126,7 +201,7 @@ namespace wav {
     void Writer::setSamplerate(uint64_t samplerate) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (fileOpen) { throw std::runtime_error("Cannot change parameters while file is open"); }
 
         // Validate samplerate
         if (!samplerate) { throw std::runtime_error("Samplerate must be non-zero"); }
@@ -136,48 +211,281 @@ namespace wav {
     void Writer::setFormat(Format format) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (fileOpen) { throw std::runtime_error("Cannot change parameters while file is open"); }
         _format = format;
     }
 
     void Writer::setSampleType(SampleType type) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (fileOpen) { throw std::runtime_error("Cannot change parameters while file is open"); }
         _type = type;
     }
 
-    void Writer::write(float* samples, int count) {
+    void Writer::setPreallocation(uint64_t bytes) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (fileOpen) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _preallocation = bytes;
+    }
+
+    void Writer::setSynchronous(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (fileOpen) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _synchronous = enabled;
+    }
+
+    void Writer::setDirectIO(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (fileOpen) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        _directIO = enabled;
+    }
+
+    WriterStats Writer::getStats() {
+        std::lock_guard<std::mutex> lck(queueMtx);
+        WriterStats stats;
+        stats.queueFill = queued;
+        stats.maxQueueFill = maxQueued;
+        stats.queueSize = blocks.size();
+        stats.droppedBlocks = droppedBlocks;
+        stats.droppedSamples = droppedSamples;
+        return stats;
+    }
+
+    void Writer::write(float* samples, int count, bool wait) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
-        if (!rw.isOpen()) { return; }
-        
-        // Select different writer function depending on the chose depth
+        if (!fileOpen) { return; }
+
         int tcount = count * _channels;
-        int tbytes = count * bytesPerSamp;
+        size_t tbytes = count * bytesPerSamp;
+        size_t valueSize = bytesPerSamp / _channels;
+
+        // Drop the whole block if there isn't room for it, a partial block would leave a partial sample in the file.
+        // The I/O thread can only free more blocks in the meantime so the check stays valid.
+        if (!_synchronous) {
+            size_t room = filling ? (blockSize - fillPos) : 0;
+            size_t blocksNeeded = (tbytes > room) ? (tbytes - room + blockSize - 1) / blockSize : 0;
+            std::unique_lock<std::mutex> qlck(queueMtx);
+            auto hasRoom = [&]() { return blocksNeeded <= blocks.size() - queued - (filling ? 1 : 0); };
+            if (wait && blocksNeeded < blocks.size()) { queueCnd.wait(qlck, hasRoom); }
+            if (!hasRoom()) {
+                droppedBlocks++;
+                droppedSamples += count;
+                return;
+            }
+        }
+
+        // Convert straight into the blocks, handing them to the I/O thread as they fill up. The block size is a
+        // multiple of every value size, so a value never straddles two blocks.
+        int pos = 0;
+        while (pos < tcount) {
+            if (!filling) {
+                filling = true;
+                fillPos = 0;
+            }
+            int n = std::min<size_t>(tcount - pos, (blockSize - fillPos) / valueSize);
+            convert(&blocks[fillIdx][fillPos], &samples[pos], n);
+            fillPos += n * valueSize;
+            pos += n;
+            if (fillPos == blockSize) { submitBlock(); }
+        }
+
+        // Increment sample counter
+        samplesWritten += count;
+    }
+
+    bool Writer::openFile(std::string path) {
+#ifdef _WIN32
+        HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (h == INVALID_HANDLE_VALUE) { return false; }
+        file = h;
+#else
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef __linux__
+        if (_directIO) {
+            fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+            // Not every filesystem supports it (tmpfs for example), fall back to buffered writes
+            if (fd < 0) { flog::warn("Direct I/O not supported for {0}, using buffered writes", path); }
+        }
+#endif
+        if (fd < 0) { fd = ::open(path.c_str(), flags, 0644); }
+        if (fd < 0) { return false; }
+#ifdef __APPLE__
+        if (_directIO) { fcntl(fd, F_NOCACHE, 1); }
+#endif
+#ifdef __linux__
+        // Reserve the space without changing the file size, what isn't used is given back when closing
+        if (_preallocation && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, _preallocation)) {
+            flog::warn("Could not preallocate {0} bytes for {1}", _preallocation, path);
+        }
+#endif
+#endif
+        fileOpen = true;
+        return true;
+    }
+
+    void Writer::closeFile(uint64_t size) {
+#ifdef _WIN32
+        CloseHandle((HANDLE)file);
+        file = NULL;
+#else
+        // Truncating also releases the preallocated space past the end of the file
+        if (_preallocation && ftruncate(fd, size)) {
+            flog::warn("Could not release the preallocated space of the recording");
+        }
+        ::close(fd);
+        fd = -1;
+#endif
+        fileOpen = false;
+    }
+
+    bool Writer::writeAt(uint64_t offset, const uint8_t* data, size_t len) {
+        while (len) {
+#ifdef _WIN32
+            OVERLAPPED ov = {};
+            ov.Offset = (DWORD)offset;
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+            DWORD written = 0;
+            if (!WriteFile((HANDLE)file, data, (DWORD)len, &written, &ov) || !written) { return false; }
+#else
+            ssize_t written = pwrite(fd, data, len, offset);
+            if (written <= 0) { return false; }
+#endif
+            data += written;
+            offset += written;
+            len -= written;
+        }
+        return true;
+    }
+
+    void Writer::disableDirectIO() {
+#ifdef __linux__
+        if (_directIO) { fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT); }
+#endif
+    }
+
+    void Writer::writeHeader(bool final) {
+        if (_format == FORMAT_RAW) { return; }
+
+        // Use RF64 if asked or if the data no longer fits the 32bit sizes of WAV
+        uint64_t dataSize = dataWritten;
+        uint64_t riffSize = WAV_HEADER_SIZE - sizeof(riff::ChunkHeader) + dataSize + (dataSize & 1);
+        bool rf64 = (_format == FORMAT_RF64 || riffSize > 0xFFFFFFFFULL);
+
+        memset(headerBuf, 0, WAV_HEADER_SIZE);
+        riff::ChunkHeader chdr;
+
+        // RIFF header, the sizes are left at their maximum in RF64 and given by the ds64 chunk instead
+        memcpy(chdr.id, rf64 ? RF64_SIGNATURE : RIFF_SIGNATURE, 4);
+        chdr.size = rf64 ? 0xFFFFFFFF : riffSize;
+        memcpy(&headerBuf[0], &chdr, sizeof(chdr));
+        memcpy(&headerBuf[8], WAVE_FILE_TYPE, 4);
+
+        // ds64 chunk, or JUNK in its place so that a WAV file can become RF64 without moving the data
+        DS64Header ds64;
+        ds64.riffSize = riffSize;
+        ds64.dataSize = dataSize;
+        ds64.sampleCount = dataSize / bytesPerSamp;
+        ds64.tableLength = 0;
+        memcpy(chdr.id, rf64 ? DS64_MARKER : JUNK_MARKER, 4);
+        chdr.size = sizeof(DS64Header);
+        memcpy(&headerBuf[DS64_OFFSET], &chdr, sizeof(chdr));
+        if (rf64) { memcpy(&headerBuf[DS64_OFFSET + sizeof(chdr)], &ds64, sizeof(ds64)); }
+
+        // Format chunk
+        memcpy(chdr.id, FORMAT_MARKER, 4);
+        chdr.size = sizeof(FormatHeader) + (extensible ? sizeof(FormatExtension) : 0);
+        memcpy(&headerBuf[FORMAT_OFFSET], &chdr, sizeof(chdr));
+        memcpy(&headerBuf[FORMAT_OFFSET + sizeof(chdr)], &hdr, sizeof(hdr));
+        if (extensible) { memcpy(&headerBuf[FORMAT_OFFSET + sizeof(chdr) + sizeof(hdr)], &hdrExt, sizeof(hdrExt)); }
+        size_t paddingOffset = FORMAT_OFFSET + sizeof(chdr) + chdr.size;
+
+        // Padding to align the data
+        memcpy(chdr.id, JUNK_MARKER, 4);
+        chdr.size = DATA_OFFSET - paddingOffset - sizeof(chdr);
+        memcpy(&headerBuf[paddingOffset], &chdr, sizeof(chdr));
+
+        // Data chunk header
+        memcpy(chdr.id, DATA_MARKER, 4);
+        chdr.size = rf64 ? 0xFFFFFFFF : dataSize;
+        memcpy(&headerBuf[DATA_OFFSET], &chdr, sizeof(chdr));
+
+        if (!writeAt(0, headerBuf, WAV_HEADER_SIZE)) { ioError = true; }
+    }
+
+    void Writer::convert(uint8_t* dst, const float* src, int count) {
         switch (_type) {
         case SAMP_TYPE_UINT8:
             // Volk doesn't support unsigned ints yet :/
-            for (int i = 0; i < tcount; i++) {
-                bufU8[i] = (samples[i] * 127.0f) + 128.0f;
+            for (int i = 0; i < count; i++) {
+                dst[i] = (src[i] * 127.0f) + 128.0f;
             }
-            rw.write(bufU8, tbytes);
             break;
         case SAMP_TYPE_INT16:
-            volk_32f_s32f_convert_16i(bufI16, samples, 32767.0f, tcount);
-            rw.write((uint8_t*)bufI16, tbytes);
+            volk_32f_s32f_convert_16i((int16_t*)dst, src, 32767.0f, count);
             break;
         case SAMP_TYPE_INT32:
-            volk_32f_s32f_convert_32i(bufI32, samples, 2147483647.0f, tcount);
-            rw.write((uint8_t*)bufI32, tbytes);
+            volk_32f_s32f_convert_32i((int32_t*)dst, src, 2147483647.0f, count);
             break;
         case SAMP_TYPE_FLOAT32:
-            rw.write((uint8_t*)samples, tbytes);
+            memcpy(dst, src, count * sizeof(float));
             break;
         default:
             break;
         }
+    }
 
-        // Increment sample counter
-        samplesWritten += count;
+    void Writer::submitBlock() {
+        if (_synchronous) {
+            writeBlock(blocks[fillIdx], fillPos);
+            filling = false;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            blockSizes[fillIdx] = fillPos;
+            queued++;
+            maxQueued = std::max<int>(maxQueued, queued);
+        }
+        queueCnd.notify_all();
+        fillIdx = (fillIdx + 1) % blocks.size();
+        filling = false;
+    }
+
+    void Writer::writeBlock(const uint8_t* data, size_t size) {
+        if (!writeAt(dataOffset + dataWritten, data, size)) {
+            if (!ioError) { flog::error("Failed to write to the recording"); }
+            ioError = true;
+        }
+        dataWritten += size;
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - lastHeaderUpdate).count() >= HEADER_UPDATE_INTERVAL) {
+            writeHeader(false);
+            lastHeaderUpdate = now;
+        }
+    }
+
+    void Writer::worker() {
+        while (true) {
+            // Wait for a block, only exit once everything has been written
+            std::unique_lock<std::mutex> lck(queueMtx);
+            queueCnd.wait(lck, [this]() { return queued > 0 || stopWorker; });
+            if (!queued) { break; }
+            int idx = writeIdx;
+            size_t size = blockSizes[idx];
+            lck.unlock();
+
+            writeBlock(blocks[idx], size);
+
+            // Give the block back
+            lck.lock();
+            writeIdx = (writeIdx + 1) % blocks.size();
+            queued--;
+            lck.unlock();
+            queueCnd.notify_all();
+        }
     }
 }
@@ -1,11 +1,26 @@
 #pragma once
 #include <string>
-#include <fstream>
 #include <stdint.h>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <chrono>
 #include "riff.h"
 
-namespace wav {    
+// Size reserved for the header, the samples start at this offset so that every block written is aligned for direct I/O
+#define WAV_HEADER_SIZE             4096
+
+// Size limits of the blocks queued for the I/O thread, in bytes
+#define WAV_WRITER_MIN_BLOCK        (64 * 1024)
+#define WAV_WRITER_MAX_BLOCK        (4 * 1024 * 1024)
+
+// Memory given to the queue between the DSP and the disk, and upper limit of blocks in it
+#define WAV_WRITER_QUEUE_MEMORY     (64 * 1024 * 1024)
+#define WAV_WRITER_MAX_BLOCKS       64
+
+namespace wav {
     #pragma pack(push, 1)
     struct FormatHeader {
         uint16_t codec;
@@ -15,11 +30,28 @@ namespace wav {
         uint16_t bytesPerSample;
         uint16_t bitDepth;
     };
+
+    // Follows the format header when the codec is CODEC_EXTENSIBLE
+    struct FormatExtension {
+        uint16_t extensionSize;
+        uint16_t validBits;
+        uint32_t channelMask;
+        uint8_t subFormat[16];
+    };
+
+    // Sizes of an RF64 file, in the place of a JUNK chunk of the same size in regular WAV files
+    struct DS64Header {
+        uint64_t riffSize;
+        uint64_t dataSize;
+        uint64_t sampleCount;
+        uint32_t tableLength;
+    };
     #pragma pack(pop)
 
     enum Format {
         FORMAT_WAV,
-        FORMAT_RF64
+        FORMAT_RF64,
+        FORMAT_RAW      // Samples only, for containers that keep their metadata in another file
     };
 
     enum SampleType {
@@ -30,10 +62,22 @@ namespace wav {
     };
 
     enum Codec {
-        CODEC_PCM   = 1,
-        CODEC_FLOAT = 3
+        CODEC_PCM           = 1,
+        CODEC_FLOAT         = 3,
+        CODEC_EXTENSIBLE    = 0xFFFE    // Required for more than two channels, the real codec is in the extension
+    };
+
+    struct WriterStats {
+        int queueFill;
+        int maxQueueFill; // High-water mark since the file was opened
+        int queueSize;
+        uint64_t droppedBlocks;
+        uint64_t droppedSamples;
     };
 
+    // The DSP only converts the samples into preallocated blocks, a dedicated thread writes them to disk.
+    // If the disk can't keep up, the samples are dropped and counted instead of stalling the DSP.
+    // WAV files that grow past 4GB are turned into RF64 when closed.
     class Writer {
     public:
         Writer(int channels = 2, uint64_t samplerate = 48000, Format format = FORMAT_WAV, SampleType type = SAMP_TYPE_INT16);
@@ -43,29 +87,86 @@ namespace wav {
         bool isOpen();
         void close();
 
+        // Close the file and delete it, for a file that ended up not being used
+        void discard();
+
         void setChannels(int channels);
         void setSamplerate(uint64_t samplerate);
         void setFormat(Format format);
         void setSampleType(SampleType type);
 
+        // Space to reserve on disk when opening, unused space is given back when closing. Only supported on Linux.
+        void setPreallocation(uint64_t bytes);
+
+        // Write from the caller's thread instead of a dedicated one, for callers that already write from their own I/O thread.
+        // Samples are then never dropped.
+        void setSynchronous(bool enabled);
+
+        // Bypass the OS page cache, only supported on Linux (O_DIRECT) and MacOS (F_NOCACHE)
+        void setDirectIO(bool enabled);
+
         size_t getSamplesWritten() { return samplesWritten; }
+        WriterStats getStats();
 
-        void write(float* samples, int count);
+        // When wait is set, wait for room in the queue instead of dropping. Only for bulk writes outside of the DSP.
+        void write(float* samples, int count, bool wait = false);
 
     private:
+        bool openFile(std::string path);
+        void closeFile(uint64_t size);
+        bool writeAt(uint64_t offset, const uint8_t* data, size_t len);
+        void disableDirectIO();
+        void writeHeader(bool final);
+        void convert(uint8_t* dst, const float* src, int count);
+        void submitBlock();
+        void writeBlock(const uint8_t* data, size_t size);
+        void worker();
+
         std::recursive_mutex mtx;
         FormatHeader hdr;
-        riff::Writer rw;
+        FormatExtension hdrExt;
+        bool extensible = false;
+        bool fileOpen = false;
+        std::string _path;
+#ifdef _WIN32
+        void* file = NULL; // HANDLE, kept opaque to not pull Windows.h into every user
+#else
+        int fd = -1;
+#endif
 
         int _channels;
         uint64_t _samplerate;
         Format _format;
         SampleType _type;
+        uint64_t _preallocation = 0;
+        bool _directIO = false;
+        bool _synchronous = false;
         size_t bytesPerSamp;
 
-        uint8_t* bufU8 = NULL;
-        int16_t* bufI16 = NULL;
-        int32_t* bufI32 = NULL;
-        size_t samplesWritten = 0;
+        // Blocks are filled by the DSP and written by the I/O thread in the same circular order
+        std::vector<uint8_t*> blocks;
+        std::vector<size_t> blockSizes;
+        size_t blockSize = 0;
+        int fillIdx = 0;
+        size_t fillPos = 0;
+        bool filling = false;
+        int writeIdx = 0;
+        int queued = 0;
+        std::mutex queueMtx;
+        std::condition_variable queueCnd;
+        bool stopWorker = false;
+        std::thread workerThread;
+
+        // Only touched by the I/O thread while it runs
+        uint8_t* headerBuf = NULL;
+        uint64_t dataOffset = WAV_HEADER_SIZE;
+        std::chrono::steady_clock::time_point lastHeaderUpdate;
+        uint64_t dataWritten = 0;
+        bool ioError = false;
+
+        std::atomic<size_t> samplesWritten = 0;
+        int maxQueued = 0;
+        uint64_t droppedBlocks = 0;
+        uint64_t droppedSamples = 0;
     };
 }
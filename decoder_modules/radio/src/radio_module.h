@@ -91,6 +91,7 @@ public:
         srChangeHandler.ctx = this;
         srChangeHandler.handler = sampleRateChangeHandler;
         stream.init(afChain.out, &srChangeHandler, audioSampleRate);
+        stream.setInputClock(&vfo->dspVFO->inputTime);
         sigpath::sinkManager.registerStream(name, &stream);
 
         // Select the demodulator
@@ -130,6 +131,7 @@ public:
             vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, 0, 200000, 200000, 50000, 200000, false);
             vfo->wtfVFO->onUserChangedBandwidth.bindHandler(&onUserChangedBandwidthHandler);
         }
+        stream.setInputClock(&vfo->dspVFO->inputTime);
         ifChain.setInput(vfo->output, [=](dsp::stream<dsp::complex_t>* out){ ifChainOutputChangeHandler(out, this); });
         ifChain.start();
         selectDemodByID((DemodID)selectedDemodID);
@@ -141,6 +143,7 @@ public:
         ifChain.stop();
         if (selectedDemod) { selectedDemod->stop(); }
         afChain.stop();
+        stream.setInputClock(NULL);
         if (vfo) { sigpath::vfoManager.deleteVFO(vfo); }
         vfo = NULL;
     }
@@ -20,6 +20,7 @@
 #include <core.h>
 #include <utils/optionlist.h>
 #include <utils/wav.h>
+#include <utils/rollover.h>
 #include "baseband_sink_interface.h"
 
 #include "baseband_interface.h"
@@ -54,9 +55,16 @@ public:
         sampleTypes.define(dsp::ZIQ, "ziq", dsp::ZIQ);
         sampleTypes.define(dsp::ZIQ2, "ziq2", dsp::ZIQ2);
 
+        preallocSizes.define("off", "Off", 0);
+        preallocSizes.define("1g", "1 GB", 1ULL << 30);
+        preallocSizes.define("4g", "4 GB", 4ULL << 30);
+        preallocSizes.define("16g", "16 GB", 16ULL << 30);
+        preallocSizes.define("64g", "64 GB", 64ULL << 30);
+
 
         // Load default config for option lists
         sampleTypeId = sampleTypes.valueId(dsp::ZIQ2);
+        preallocId = preallocSizes.valueId(0);
 
         // Load config
         config.acquire();
@@ -78,6 +86,16 @@ public:
         if (config.conf[name].contains("stereo")) {
             stereo = config.conf[name]["stereo"];
         }
+        if (config.conf[name].contains("ziq2Index")) {
+            writeIndex = config.conf[name]["ziq2Index"];
+        }
+        if (config.conf[name].contains("sigmf")) {
+            writeSigMF = config.conf[name]["sigmf"];
+        }
+        if (config.conf[name].contains("preallocate") && preallocSizes.keyExists(config.conf[name]["preallocate"])) {
+            preallocId = preallocSizes.keyId(config.conf[name]["preallocate"]);
+        }
+        splitSettings.load(config.conf[name]);
         if (config.conf[name].contains("nameTemplate")) {
             std::string _nameTemplate = config.conf[name]["nameTemplate"];
             if (_nameTemplate.length() > sizeof(nameTemplate) - 1) {
@@ -94,6 +112,8 @@ public:
         // Init sinks
         basebandSink.init(NULL, complexHandler, this);
         stereoSink.init(&stereoStream, stereoHandler, this);
+        segmenter.setSwitchHandler([this](dsp::BasebandWriter& writer, int64_t time) { writer.set_start(time, recFrequency); });
+        segmenter.setDiscardHandler([](dsp::BasebandWriter& writer) { writer.discard_recording(); });
 
         gui::menu.registerEntry(name, menuHandler, this);
         core::modComManager.registerInterface("baseband_sink", name, moduleInterfaceHandler, this);
@@ -107,6 +127,7 @@ public:
         deselectStream();
         sigpath::sinkManager.onStreamRegistered.unbindHandler(&onStreamRegisteredHandler);
         sigpath::sinkManager.onStreamUnregister.unbindHandler(&onStreamUnregisterHandler);
+        sigpath::sourceManager.onRetune.unbindHandler(&onRetuneHandler);
     }
 
     void postInit() {
@@ -125,6 +146,11 @@ public:
         onStreamUnregisterHandler.handler = streamUnregisterHandler;
         sigpath::sinkManager.onStreamUnregister.bindHandler(&onStreamUnregisterHandler);
 
+        // Follow the tuning to describe it in the SigMF metadata
+        onRetuneHandler.ctx = this;
+        onRetuneHandler.handler = retuneHandler;
+        sigpath::sourceManager.onRetune.bindHandler(&onRetuneHandler);
+
         // Select the stream
         selectStream(selectedStreamName);
     }
@@ -177,8 +203,25 @@ public:
         std::string vfoName = (recMode == BASEBAND_SINK_MODE_AUDIO) ? gui::waterfall.selectedVFO : "";
         std::string expandedPath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, type, vfoName));
 
-        baseband_writer.set_output_sample_type(sampleTypes[sampleTypeId]);
-        baseband_writer.start_recording(expandedPath, samplerate, actual_bit_depth);
+        dsp::BasebandType sampleType = sampleTypes[sampleTypeId];
+        bool index = writeIndex;
+        uint64_t prealloc = preallocSizes[preallocId];
+        uint64_t rate = samplerate;
+        int depth = actual_bit_depth;
+        bool sigmf = sigmfAvailable() && writeSigMF;
+        recFrequency = gui::waterfall.getCenterFrequency();
+        auto openHandler = [=](dsp::BasebandWriter& writer, const std::string& path) {
+            writer.set_output_sample_type(sampleType);
+            writer.set_write_index(index);
+            writer.set_preallocate(prealloc);
+            writer.set_sigmf(sigmf);
+            writer.set_frequency(recFrequency);
+            return writer.start_recording(path, rate, depth);
+        };
+        auto closeHandler = [](dsp::BasebandWriter& writer) { writer.stop_recording(); };
+        if (!segmenter.start(expandedPath, samplerate, getSampleSize(), splitSettings.getPolicy(), openHandler, closeHandler)) {
+            return;
+        }
 
         // Open audio stream or baseband
         if (recMode == BASEBAND_SINK_MODE_AUDIO) {
@@ -219,7 +262,7 @@ public:
         }
 
         // Close file
-        baseband_writer.stop_recording();
+        segmenter.stop();
 
         recording = false;
     }
@@ -290,6 +333,45 @@ private:
         if (!(_this->sampleTypes[_this->sampleTypeId] == dsp::ZIQ || _this->sampleTypes[_this->sampleTypeId] == dsp::ZIQ2))
             style::endDisabled();
 
+        if (_this->sampleTypes[_this->sampleTypeId] == dsp::ZIQ2) {
+            if (ImGui::Checkbox(CONCAT("Write packet index##_BASEBAND_SINK_idx_", _this->name), &_this->writeIndex)) {
+                config.acquire();
+                config.conf[_this->name]["ziq2Index"] = _this->writeIndex;
+                config.release(true);
+            }
+        }
+
+        if (_this->sigmfAvailable()) {
+            if (_this->recording) { style::beginDisabled(); }
+            if (ImGui::Checkbox(CONCAT("SigMF##_BASEBAND_SINK_sigmf_", _this->name), &_this->writeSigMF)) {
+                config.acquire();
+                config.conf[_this->name]["sigmf"] = _this->writeSigMF;
+                config.release(true);
+            }
+            if (_this->recording) { style::endDisabled(); }
+        }
+
+#ifdef __linux__
+        if (_this->recording) { style::beginDisabled(); }
+        ImGui::LeftLabel("Preallocate");
+        ImGui::FillWidth();
+        if (ImGui::Combo(CONCAT("##_BASEBAND_SINK_prealloc_", _this->name), &_this->preallocId, _this->preallocSizes.txt)) {
+            config.acquire();
+            config.conf[_this->name]["preallocate"] = _this->preallocSizes.key(_this->preallocId);
+            config.release(true);
+        }
+        if (_this->recording) { style::endDisabled(); }
+#endif
+
+        // Splitting the recording into several files
+        if (_this->recording) { style::beginDisabled(); }
+        if (_this->splitSettings.showMenu(_this->name)) {
+            config.acquire();
+            _this->splitSettings.save(config.conf[_this->name]);
+            config.release(true);
+        }
+        if (_this->recording) { style::endDisabled(); }
+
         // Show additional audio options
         if (_this->recMode == BASEBAND_SINK_MODE_AUDIO) {
             ImGui::LeftLabel("Stream");
@@ -335,16 +417,27 @@ private:
             }
 
 
-            if (_this->baseband_writer.get_written() < 1e9)
-                ImGui::Text("Size : %.2f MB", _this->baseband_writer.get_written() / 1e6);
+            dsp::BasebandWriter* writer = _this->segmenter.current();
+            if (_this->splitSettings.enabled()) {
+                ImGui::Text("File : %d", _this->segmenter.getSegment() + 1);
+            }
+
+            if (writer->get_written() < 1e9)
+                ImGui::Text("Size : %.2f MB", writer->get_written() / 1e6);
             else
-                ImGui::Text("Size : %.2f GB", _this->baseband_writer.get_written() / 1e9);
+                ImGui::Text("Size : %.2f GB", writer->get_written() / 1e9);
 
             if (_this->sampleTypes[_this->sampleTypeId] == dsp::ZIQ) {
-                if (_this->baseband_writer.get_written_raw() < 1e9)
-                    ImGui::Text("Size (raw) : %.2f MB", _this->baseband_writer.get_written_raw() / 1e6);
+                if (writer->get_written_raw() < 1e9)
+                    ImGui::Text("Size (raw) : %.2f MB", writer->get_written_raw() / 1e6);
                 else
-                    ImGui::Text("Size (raw) : %.2f GB", _this->baseband_writer.get_written_raw() / 1e9);
+                    ImGui::Text("Size (raw) : %.2f GB", writer->get_written_raw() / 1e9);
+            }
+
+            dsp::BasebandWriterStats stats = writer->get_stats();
+            ImGui::Text("Queue : %d/%d (max %d)", stats.queueFill, stats.queueSize, stats.maxQueueFill);
+            if (stats.droppedBlocks) {
+                ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Dropped : %llu blocks", (unsigned long long)stats.droppedBlocks);
             }
         }
     }
@@ -383,6 +476,21 @@ private:
         audioStream = NULL;
     }
 
+    // Bytes per sample before compression, the compressed formats are split on that estimate
+    double getSampleSize() {
+        switch (sampleTypes[sampleTypeId]) {
+        case dsp::CF_32:
+            return sizeof(dsp::complex_t);
+        case dsp::IS_8:
+            return 2;
+        case dsp::ZIQ:
+        case dsp::ZIQ2:
+            return (actual_bit_depth == 8) ? 2 : 4;
+        default:
+            return 4;
+        }
+    }
+
     void startAudioPath() {
         volume.start();
         splitter.start();
@@ -467,14 +575,28 @@ private:
         return std::regex_replace(input, std::regex("//"), "/");
     }
 
+    // SigMF describes complex samples, so only raw IQ recordings can be written that way
+    bool sigmfAvailable() {
+        dsp::BasebandType type = sampleTypes[sampleTypeId];
+        return recMode == BASEBAND_SINK_MODE_BASEBAND && (type == dsp::CF_32 || type == dsp::IS_16 || type == dsp::IS_8);
+    }
+
+    static void retuneHandler(double freq, void* ctx) {
+        BasebandSinkModule* _this = (BasebandSinkModule*)ctx;
+        std::lock_guard<std::recursive_mutex> lck(_this->recMtx);
+        _this->recFrequency = freq;
+        if (!_this->recording) { return; }
+        _this->segmenter.current()->set_frequency(freq);
+    }
+
     static void complexHandler(dsp::complex_t* data, int count, void* ctx) {
         BasebandSinkModule* _this = (BasebandSinkModule*)ctx;
-        _this->baseband_writer.feed_samples(data, count);
+        _this->segmenter.next(count)->feed_samples(data, count);
     }
 
     static void stereoHandler(dsp::stereo_t* data, int count, void* ctx) {
         BasebandSinkModule* _this = (BasebandSinkModule*)ctx;
-        _this->baseband_writer.feed_samples((dsp::complex_t*)data, count);
+        _this->segmenter.next(count)->feed_samples((dsp::complex_t*)data, count);
     }
 
     static void monoHandler(float* data, int count, void* ctx) {
@@ -508,6 +630,9 @@ private:
     char nameTemplate[1024];
 
     OptionList<int, dsp::BasebandType> sampleTypes;
+    OptionList<std::string, uint64_t> preallocSizes;
+    int preallocId = 0;
+    rollover::Settings splitSettings;
     FolderSelect folderSelect;
 
     int recMode = BASEBAND_SINK_MODE_BASEBAND;
@@ -536,11 +661,15 @@ private:
 
     EventHandler<std::string> onStreamRegisteredHandler;
     EventHandler<std::string> onStreamUnregisterHandler;
+    EventHandler<double> onRetuneHandler;
 
     int selected_bit_depth = 0;
     int actual_bit_depth = 8;
+    bool writeIndex = true;
+    bool writeSigMF = false;
+    std::atomic<double> recFrequency = 0.0;
 
-    dsp::BasebandWriter baseband_writer;
+    rollover::Segmenter<dsp::BasebandWriter> segmenter;
 };
 
 MOD_EXPORT void _INIT_() {
@@ -9,6 +9,7 @@
 #include <dsp/convert/stereo_to_mono.h>
 #include <thread>
 #include <ctime>
+#include <set>
 #include <gui/gui.h>
 #include <filesystem>
 #include <signal_path/signal_path.h>
@@ -21,11 +22,27 @@
 #include <core.h>
 #include <utils/optionlist.h>
 #include <utils/wav.h>
+#include <utils/rollover.h>
+#include <utils/sigmf.h>
+#include "pre_record.h"
+#include "multi_recorder.h"
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
 #define SILENCE_LVL 10e-6
 
+// Largest amount of memory a pre-record buffer may use
+#define RECORDER_PRE_RECORD_MAX_MEMORY  (512ULL * 1024 * 1024)
+
+// Number of samples moved from the pre-record buffer to the file at once
+#define RECORDER_DRAIN_CHUNK            16384
+
+// One file of the recording, the metadata is only used by SigMF
+struct RecordingFile {
+    wav::Writer writer;
+    sigmf::MetaWriter meta;
+};
+
 SDRPP_MOD_INFO{
     /* Name:            */ "recorder",
     /* Description:     */ "Recorder module for SDR++",
@@ -45,15 +62,38 @@ public:
 
         // Define option lists
         containers.define("WAV", wav::FORMAT_WAV);
-        // containers.define("RF64", wav::FORMAT_RF64); // Disabled for now
+        containers.define("RF64", wav::FORMAT_RF64);
+        containers.define("SigMF", wav::FORMAT_RAW);
         sampleTypes.define(wav::SAMP_TYPE_UINT8, "Uint8", wav::SAMP_TYPE_UINT8);
         sampleTypes.define(wav::SAMP_TYPE_INT16, "Int16", wav::SAMP_TYPE_INT16);
         sampleTypes.define(wav::SAMP_TYPE_INT32, "Int32", wav::SAMP_TYPE_INT32);
         sampleTypes.define(wav::SAMP_TYPE_FLOAT32, "Float32", wav::SAMP_TYPE_FLOAT32);
+        preallocSizes.define("off", "Off", 0);
+        preallocSizes.define("1g", "1 GB", 1ULL << 30);
+        preallocSizes.define("4g", "4 GB", 4ULL << 30);
+        preallocSizes.define("16g", "16 GB", 16ULL << 30);
+        preallocSizes.define("64g", "64 GB", 64ULL << 30);
+        preRecordTimes.define(0, "Off", 0);
+        preRecordTimes.define(1, "1s", 1);
+        preRecordTimes.define(2, "2s", 2);
+        preRecordTimes.define(5, "5s", 5);
+        preRecordTimes.define(10, "10s", 10);
+        preRecordTimes.define(30, "30s", 30);
+        preRecordTimes.define(60, "60s", 60);
+        preRecordTimes.define(120, "120s", 120);
+        preRecordStorages.define("float32", "Float32", PreRecordBuffer::STORAGE_FLOAT32);
+        preRecordStorages.define("int16", "Int16", PreRecordBuffer::STORAGE_INT16);
+        preRecordStorages.define("int8", "Int8", PreRecordBuffer::STORAGE_INT8);
+        multiLayouts.define("interleaved", "Interleaved", MultiRecorder::LAYOUT_INTERLEAVED);
+        multiLayouts.define("separate", "Separate files", MultiRecorder::LAYOUT_SEPARATE);
 
         // Load default config for option lists
         containerId = containers.valueId(wav::FORMAT_WAV);
         sampleTypeId = sampleTypes.valueId(wav::SAMP_TYPE_INT16);
+        preallocId = preallocSizes.valueId(0);
+        preRecordId = preRecordTimes.valueId(0);
+        preRecordStorageId = preRecordStorages.valueId(PreRecordBuffer::STORAGE_INT16);
+        multiLayoutId = multiLayouts.valueId(MultiRecorder::LAYOUT_INTERLEAVED);
 
         // Load config
         config.acquire();
@@ -69,6 +109,30 @@ public:
         if (config.conf[name].contains("sampleType") && sampleTypes.keyExists(config.conf[name]["sampleType"])) {
             sampleTypeId = sampleTypes.keyId(config.conf[name]["sampleType"]);
         }
+        if (config.conf[name].contains("preallocate") && preallocSizes.keyExists(config.conf[name]["preallocate"])) {
+            preallocId = preallocSizes.keyId(config.conf[name]["preallocate"]);
+        }
+        if (config.conf[name].contains("directIO")) {
+            directIO = config.conf[name]["directIO"];
+        }
+        if (config.conf[name].contains("preRecord") && preRecordTimes.keyExists(config.conf[name]["preRecord"])) {
+            preRecordId = preRecordTimes.keyId(config.conf[name]["preRecord"]);
+        }
+        if (config.conf[name].contains("preRecordStorage") && preRecordStorages.keyExists(config.conf[name]["preRecordStorage"])) {
+            preRecordStorageId = preRecordStorages.keyId(config.conf[name]["preRecordStorage"]);
+        }
+        splitSettings.load(config.conf[name]);
+        if (config.conf[name].contains("multiLayout") && multiLayouts.keyExists(config.conf[name]["multiLayout"])) {
+            multiLayoutId = multiLayouts.keyId(config.conf[name]["multiLayout"]);
+        }
+        if (config.conf[name].contains("multiStereo")) {
+            multiStereo = config.conf[name]["multiStereo"];
+        }
+        if (config.conf[name].contains("multiStreams")) {
+            for (const auto& s : config.conf[name]["multiStreams"]) {
+                multiStreams.insert((std::string)s);
+            }
+        }
         if (config.conf[name].contains("audioStream")) {
             selectedStreamName = config.conf[name]["audioStream"];
         }
@@ -101,6 +165,11 @@ public:
         basebandSink.init(NULL, complexHandler, this);
         stereoSink.init(&stereoStream, stereoHandler, this);
         monoSink.init(&s2m.out, monoHandler, this);
+        segmenter.setSwitchHandler([this](RecordingFile& file, int64_t time) { file.meta.setStart(time, recFrequency); });
+        segmenter.setDiscardHandler([](RecordingFile& file) {
+            file.writer.discard();
+            file.meta.discard();
+        });
 
         gui::menu.registerEntry(name, menuHandler, this);
         core::modComManager.registerInterface("recorder", name, moduleInterfaceHandler, this);
@@ -112,8 +181,11 @@ public:
         gui::menu.removeEntry(name);
         stop();
         deselectStream();
+        if (pathRunning) { stopPath(); }
         sigpath::sinkManager.onStreamRegistered.unbindHandler(&onStreamRegisteredHandler);
         sigpath::sinkManager.onStreamUnregister.unbindHandler(&onStreamUnregisterHandler);
+        sigpath::sourceManager.onRetune.unbindHandler(&onRetuneHandler);
+        sigpath::iqFrontEnd.onSampleRateChanged.unbindHandler(&onIQSampleRateHandler);
         meter.stop();
     }
 
@@ -132,9 +204,18 @@ public:
         onStreamUnregisterHandler.ctx = this;
         onStreamUnregisterHandler.handler = streamUnregisterHandler;
         sigpath::sinkManager.onStreamUnregister.bindHandler(&onStreamUnregisterHandler);
-
-        // Select the stream
+        onRetuneHandler.ctx = this;
+        onRetuneHandler.handler = retuneHandler;
+        sigpath::sourceManager.onRetune.bindHandler(&onRetuneHandler);
+        onIQSampleRateHandler.ctx = this;
+        onIQSampleRateHandler.handler = iqSampleRateHandler;
+        sigpath::iqFrontEnd.onSampleRateChanged.bindHandler(&onIQSampleRateHandler);
+        onStreamSampleRateHandler.ctx = this;
+        onStreamSampleRateHandler.handler = streamSampleRateHandler;
+
+        // Select the stream, this also starts the pre-record buffer in audio mode
         selectStream(selectedStreamName);
+        if (recMode == RECORDER_MODE_BASEBAND) { updatePreRecord(); }
     }
 
     void enable() {
@@ -152,6 +233,10 @@ public:
     void start() {
         std::lock_guard<std::recursive_mutex> lck(recMtx);
         if (recording) { return; }
+        if (recMode == RECORDER_MODE_MULTI) {
+            startMulti();
+            return;
+        }
 
         // Configure the wav writer
         if (recMode == RECORDER_MODE_AUDIO) {
@@ -161,67 +246,118 @@ public:
         else {
             samplerate = sigpath::iqFrontEnd.getSampleRate();
         }
-        writer.setFormat(containers[containerId]);
-        writer.setChannels((recMode == RECORDER_MODE_AUDIO && !stereo) ? 1 : 2);
-        writer.setSampleType(sampleTypes[sampleTypeId]);
-        writer.setSamplerate(samplerate);
+        int channels = getChannelCount();
+        wav::Format format = containers[containerId];
+        wav::SampleType sampleType = sampleTypes[sampleTypeId];
+        uint64_t prealloc = preallocSizes[preallocId];
+        bool direct = directIO;
+        uint64_t rate = samplerate;
+        std::string datatype = getSigMFDatatype(sampleType, recMode == RECORDER_MODE_BASEBAND);
+        int sigmfChannels = (recMode == RECORDER_MODE_BASEBAND) ? 1 : channels;
+        recVFO = (recMode == RECORDER_MODE_AUDIO) ? gui::waterfall.selectedVFO : "";
+        recFrequency = getRecordFrequency(gui::waterfall.getCenterFrequency());
+
+        // The recording starts with the oldest pre-recorded sample
+        size_t preRecorded;
+        {
+            std::lock_guard<std::mutex> plck(preRecordMtx);
+            bool usable = (preRecordSamplerate == samplerate && preRecordChannels == channels);
+            preRecorded = usable ? preRecord.getCount() : 0;
+        }
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        int64_t firstSampleTime = now - (int64_t)round((double)preRecorded * 1e9 / (double)samplerate);
+
+        // Files opened ahead for the next segments get their real start time once they're switched to
+        auto openHandler = [=](RecordingFile& file, const std::string& path) -> std::string {
+            file.writer.setFormat(format);
+            file.writer.setChannels(channels);
+            file.writer.setSampleType(sampleType);
+            file.writer.setSamplerate(rate);
+            file.writer.setPreallocation(prealloc);
+            file.writer.setDirectIO(direct);
+            std::string fullPath = path + ((format == wav::FORMAT_RAW) ? ".sigmf-data" : ".wav");
+            if (!file.writer.open(fullPath)) {
+                flog::error("Failed to open file for recording: {0}", fullPath);
+                return "";
+            }
 
-        // Open file
+            // SigMF keeps everything but the samples in the metadata file
+            if (format == wav::FORMAT_RAW && !file.meta.open(path + ".sigmf-meta", datatype, rate, sigmfChannels, recFrequency, firstSampleTime)) {
+                file.writer.close();
+                return "";
+            }
+            return fullPath;
+        };
+        auto closeHandler = [](RecordingFile& file) {
+            file.writer.close();
+            file.meta.close();
+        };
+
+        // Open file, or the first one if the recording is split
         std::string type = (recMode == RECORDER_MODE_AUDIO) ? "audio" : "baseband";
         std::string vfoName = (recMode == RECORDER_MODE_AUDIO) ? gui::waterfall.selectedVFO : "";
-        std::string extension = ".wav";
-        std::string expandedPath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, type, vfoName) + extension);
-        if (!writer.open(expandedPath)) {
-            flog::error("Failed to open file for recording: {0}", expandedPath);
+        std::string expandedPath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, type, vfoName));
+        int sampleSize = (sampleType == wav::SAMP_TYPE_UINT8) ? 1 : ((sampleType == wav::SAMP_TYPE_INT16) ? 2 : 4);
+        if (!segmenter.start(expandedPath, samplerate, sampleSize * channels, splitSettings.getPolicy(), openHandler, closeHandler, firstSampleTime)) {
             return;
         }
 
-        // Open audio stream or baseband
-        if (recMode == RECORDER_MODE_AUDIO) {
-            // Start correct path depending on 
-            if (stereo) {
-                stereoSink.start();
+        // The pre-recorded samples go first. The DSP keeps adding to the buffer while it's being written
+        // and only writes directly once it's empty, so nothing is lost in between.
+        {
+            std::lock_guard<std::mutex> plck(preRecordMtx);
+            preRecordDropped = 0;
+            if (preRecord.getCount() && preRecordSamplerate == samplerate && preRecordChannels == channels) {
+                writeState = WRITE_STATE_DRAINING;
+                stopDrain = false;
+                drainThread = std::thread(&RecorderModule::drainWorker, this);
             }
             else {
-                s2m.start();
-                monoSink.start();
+                if (preRecord.getCount()) {
+                    flog::warn("Discarding {0} pre-recorded samples, they don't match the format of the recording", preRecord.getCount());
+                }
+                preRecord.clear();
+                writeState = WRITE_STATE_LIVE;
             }
-            splitter.bindStream(&stereoStream);
-        }
-        else {
-            // Create and bind IQ stream
-            basebandStream = new dsp::stream<dsp::complex_t>();
-            basebandSink.setInput(basebandStream);
-            basebandSink.start();
-            sigpath::iqFrontEnd.bindIQStream(basebandStream);
         }
 
+        // Open audio stream or baseband, unless it's already running to fill the pre-record buffer
+        if (!pathRunning) { startPath(); }
+
         recording = true;
     }
 
     void stop() {
         std::lock_guard<std::recursive_mutex> lck(recMtx);
         if (!recording) { return; }
+        if (multi.isRunning()) {
+            multi.stop();
+            recording = false;
+            return;
+        }
 
-        // Close audio stream or baseband
-        if (recMode == RECORDER_MODE_AUDIO) {
-            splitter.unbindStream(&stereoStream);
-            monoSink.stop();
-            stereoSink.stop();
-            s2m.stop();
-            
+        // Stop writing to the file, the DSP goes back to filling the pre-record buffer
+        stopDrain = true;
+        if (drainThread.joinable()) { drainThread.join(); }
+        {
+            std::lock_guard<std::mutex> plck(preRecordMtx);
+            writeState = WRITE_STATE_BUFFERING;
+            preRecord.clear();
         }
-        else {
-            // Unbind and destroy IQ stream
-            sigpath::iqFrontEnd.unbindIQStream(basebandStream);
-            basebandSink.stop();
-            delete basebandStream;
+        if (preRecordDropped) {
+            flog::warn("Recording dropped {0} samples while writing the pre-recorded ones", preRecordDropped);
         }
 
         // Close file
-        writer.close();
-        
+        segmenter.stop();
+
+        // Close audio stream or baseband if not pre-recording
+        if (!preRecord.getCapacity()) { stopPath(); }
+
         recording = false;
+
+        // The sample rate changed during the recording, the buffer has to be sized for the new one
+        if (preRecordStale) { updatePreRecord(); }
     }
 
 private:
@@ -232,9 +368,10 @@ private:
         // Recording mode
         if (_this->recording) { style::beginDisabled(); }
         ImGui::BeginGroup();
-        ImGui::Columns(2, CONCAT("RecorderModeColumns##_", _this->name), false);
+        ImGui::Columns(3, CONCAT("RecorderModeColumns##_", _this->name), false);
         if (ImGui::RadioButton(CONCAT("Baseband##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_BASEBAND)) {
             _this->recMode = RECORDER_MODE_BASEBAND;
+            _this->updatePreRecord();
             config.acquire();
             config.conf[_this->name]["mode"] = _this->recMode;
             config.release(true);
@@ -242,6 +379,15 @@ private:
         ImGui::NextColumn();
         if (ImGui::RadioButton(CONCAT("Audio##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_AUDIO)) {
             _this->recMode = RECORDER_MODE_AUDIO;
+            _this->updatePreRecord();
+            config.acquire();
+            config.conf[_this->name]["mode"] = _this->recMode;
+            config.release(true);
+        }
+        ImGui::NextColumn();
+        if (ImGui::RadioButton(CONCAT("Multi##_recorder_mode_", _this->name), _this->recMode == RECORDER_MODE_MULTI)) {
+            _this->recMode = RECORDER_MODE_MULTI;
+            _this->updatePreRecord();
             config.acquire();
             config.conf[_this->name]["mode"] = _this->recMode;
             config.release(true);
@@ -283,6 +429,69 @@ private:
             config.release(true);
         }
 
+#if defined(__linux__) || defined(__APPLE__)
+        if (_this->recording) { style::beginDisabled(); }
+#ifdef __linux__
+        ImGui::LeftLabel("Preallocate");
+        ImGui::FillWidth();
+        if (ImGui::Combo(CONCAT("##_recorder_prealloc_", _this->name), &_this->preallocId, _this->preallocSizes.txt)) {
+            config.acquire();
+            config.conf[_this->name]["preallocate"] = _this->preallocSizes.key(_this->preallocId);
+            config.release(true);
+        }
+#endif
+        if (ImGui::Checkbox(CONCAT("Direct I/O##_recorder_direct_io_", _this->name), &_this->directIO)) {
+            config.acquire();
+            config.conf[_this->name]["directIO"] = _this->directIO;
+            config.release(true);
+        }
+        if (_this->recording) { style::endDisabled(); }
+#endif
+
+        // Splitting the recording into several files
+        if (_this->recMode != RECORDER_MODE_MULTI) {
+            if (_this->recording) { style::beginDisabled(); }
+            if (_this->splitSettings.showMenu(_this->name)) {
+                config.acquire();
+                _this->splitSettings.save(config.conf[_this->name]);
+                config.release(true);
+            }
+            if (_this->recording) { style::endDisabled(); }
+        }
+
+        // Pre-record buffer, not available when recording many streams
+        if (_this->recMode != RECORDER_MODE_MULTI) {
+            if (_this->recording) { style::beginDisabled(); }
+            ImGui::LeftLabel("Pre-record");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_pre_record_", _this->name), &_this->preRecordId, _this->preRecordTimes.txt)) {
+                _this->updatePreRecord();
+                config.acquire();
+                config.conf[_this->name]["preRecord"] = _this->preRecordTimes.key(_this->preRecordId);
+                config.release(true);
+            }
+            if (_this->preRecordTimes[_this->preRecordId]) {
+                ImGui::LeftLabel("Pre-record storage");
+                ImGui::FillWidth();
+                if (ImGui::Combo(CONCAT("##_recorder_pre_record_storage_", _this->name), &_this->preRecordStorageId, _this->preRecordStorages.txt)) {
+                    _this->updatePreRecord();
+                    config.acquire();
+                    config.conf[_this->name]["preRecordStorage"] = _this->preRecordStorages.key(_this->preRecordStorageId);
+                    config.release(true);
+                }
+            }
+            if (_this->recording) { style::endDisabled(); }
+            if (!_this->recording && _this->pathRunning) {
+                size_t count, capacity;
+                {
+                    std::lock_guard<std::mutex> lck(_this->preRecordMtx);
+                    count = _this->preRecord.getCount();
+                    capacity = _this->preRecord.getCapacity();
+                }
+                ImGui::Text("Pre-recorded: %.1f/%.1fs", (double)count / (double)_this->preRecordSamplerate, (double)capacity / (double)_this->preRecordSamplerate);
+            }
+        }
+
         // Show additional audio options
         if (_this->recMode == RECORDER_MODE_AUDIO) {
             ImGui::LeftLabel("Stream");
@@ -310,6 +519,7 @@ private:
 
             if (_this->recording) { style::beginDisabled(); }
             if (ImGui::Checkbox(CONCAT("Stereo##_recorder_stereo_", _this->name), &_this->stereo)) {
+                _this->updatePreRecord();
                 config.acquire();
                 config.conf[_this->name]["stereo"] = _this->stereo;
                 config.release(true);
@@ -323,9 +533,42 @@ private:
             }
         }
 
+        // Show the streams to record in multi mode
+        if (_this->recMode == RECORDER_MODE_MULTI) {
+            if (_this->recording) { style::beginDisabled(); }
+            ImGui::LeftLabel("Layout");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_recorder_multi_layout_", _this->name), &_this->multiLayoutId, _this->multiLayouts.txt)) {
+                config.acquire();
+                config.conf[_this->name]["multiLayout"] = _this->multiLayouts.key(_this->multiLayoutId);
+                config.release(true);
+            }
+            if (ImGui::Checkbox(CONCAT("Stereo##_recorder_multi_stereo_", _this->name), &_this->multiStereo)) {
+                config.acquire();
+                config.conf[_this->name]["multiStereo"] = _this->multiStereo;
+                config.release(true);
+            }
+
+            // One checkbox per stream, every checked stream gets its own channel
+            ImGui::TextUnformatted("Streams");
+            for (int i = 0; i < _this->audioStreams.size(); i++) {
+                std::string stream = _this->audioStreams.key(i);
+                bool checked = _this->multiStreams.find(stream) != _this->multiStreams.end();
+                if (ImGui::Checkbox(CONCAT(stream, "##_recorder_multi_stream_" + _this->name), &checked)) {
+                    if (checked) { _this->multiStreams.insert(stream); }
+                    else { _this->multiStreams.erase(stream); }
+                    config.acquire();
+                    config.conf[_this->name]["multiStreams"] = _this->multiStreams;
+                    config.release(true);
+                }
+            }
+            if (_this->recording) { style::endDisabled(); }
+        }
+
         // Record button
         bool canRecord = _this->folderSelect.pathIsValid();
         if (_this->recMode == RECORDER_MODE_AUDIO) { canRecord &= !_this->selectedStreamName.empty(); }
+        if (_this->recMode == RECORDER_MODE_MULTI) { canRecord &= !_this->multiStreams.empty(); }
         if (!_this->recording) {
             if (ImGui::Button(CONCAT("Record##_recorder_rec_", _this->name), ImVec2(menuWidth, 0))) {
                 _this->start();
@@ -336,16 +579,35 @@ private:
             if (ImGui::Button(CONCAT("Stop##_recorder_rec_", _this->name), ImVec2(menuWidth, 0))) {
                 _this->stop();
             }
-            uint64_t seconds = _this->writer.getSamplesWritten() / _this->samplerate;
+            bool multi = _this->multi.isRunning();
+            uint64_t seconds = multi ? _this->multi.getDuration() : (_this->segmenter.getSamplesWritten() / _this->samplerate);
             time_t diff = seconds;
             tm* dtm = gmtime(&diff);
 
-            if (_this->ignoreSilence && _this->ignoringSilence) {
+            if (_this->ignoreSilence && _this->ignoringSilence && !multi) {
                 ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Paused %02d:%02d:%02d", dtm->tm_hour, dtm->tm_min, dtm->tm_sec);
             }
             else {
                 ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Recording %02d:%02d:%02d", dtm->tm_hour, dtm->tm_min, dtm->tm_sec);
             }
+
+            if (multi) {
+                ImGui::Text("Channels : %d", _this->multi.getChannelCount());
+                uint64_t dropped = _this->multi.getDropped();
+                if (dropped) {
+                    ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Dropped : %llu samples", (unsigned long long)dropped);
+                }
+            }
+            else {
+                if (_this->splitSettings.enabled()) {
+                    ImGui::Text("File : %d", _this->segmenter.getSegment() + 1);
+                }
+                wav::WriterStats stats = _this->segmenter.current()->writer.getStats();
+                ImGui::Text("Queue : %d/%d (max %d)", stats.queueFill, stats.queueSize, stats.maxQueueFill);
+                if (stats.droppedBlocks) {
+                    ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Dropped : %llu blocks", (unsigned long long)stats.droppedBlocks);
+                }
+            }
         }
     }
 
@@ -364,10 +626,12 @@ private:
 
         audioStream = sigpath::sinkManager.bindStream(name);
         if (!audioStream) { return; }
+        sigpath::sinkManager.bindSampleRateHandler(name, &onStreamSampleRateHandler);
         selectedStreamName = name;
         streamId = audioStreams.keyId(name);
         volume.setInput(audioStream);
         startAudioPath();
+        if (recMode == RECORDER_MODE_AUDIO) { updatePreRecord(); }
     }
 
     void deselectStream() {
@@ -377,12 +641,176 @@ private:
             return;
         }
         if (recording && recMode == RECORDER_MODE_AUDIO) { stop(); }
+        if (pathRunning && pathMode == RECORDER_MODE_AUDIO) { stopPath(); }
         stopAudioPath();
+        sigpath::sinkManager.unbindSampleRateHandler(selectedStreamName, &onStreamSampleRateHandler);
         sigpath::sinkManager.unbindStream(selectedStreamName, audioStream);
         selectedStreamName.clear();
         audioStream = NULL;
     }
 
+    // Record every selected stream that still exists, each into its own channel
+    void startMulti() {
+        std::vector<std::string> streams;
+        for (const auto& stream : multiStreams) {
+            if (audioStreams.keyExists(stream)) { streams.push_back(stream); }
+        }
+        if (streams.empty()) { return; }
+
+        MultiRecorder::Settings settings;
+        settings.layout = multiLayouts[multiLayoutId];
+        settings.format = containers[containerId];
+        if (settings.format == wav::FORMAT_RAW) {
+            // SigMF has no frequency per channel, the streams would all be described as the same one
+            flog::warn("SigMF isn't supported when recording multiple streams, using WAV instead");
+            settings.format = wav::FORMAT_WAV;
+        }
+        settings.type = sampleTypes[sampleTypeId];
+        settings.preallocation = preallocSizes[preallocId];
+        settings.directIO = directIO;
+        settings.stereo = multiStereo;
+        std::string basePath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, "multi", ""));
+        if (!multi.start(streams, basePath, settings)) { return; }
+        recording = true;
+    }
+
+    // Frequency of what's being recorded for the given center frequency
+    double getRecordFrequency(double centerFreq) {
+        if (!recVFO.empty() && gui::waterfall.vfos.find(recVFO) != gui::waterfall.vfos.end()) {
+            return centerFreq + gui::waterfall.vfos[recVFO]->generalOffset;
+        }
+        return centerFreq;
+    }
+
+    static std::string getSigMFDatatype(wav::SampleType type, bool complex) {
+        std::string prefix = complex ? "c" : "r";
+        switch (type) {
+        case wav::SAMP_TYPE_UINT8:
+            return prefix + "u8";
+        case wav::SAMP_TYPE_INT16:
+            return prefix + "i16_le";
+        case wav::SAMP_TYPE_INT32:
+            return prefix + "i32_le";
+        default:
+            return prefix + "f32_le";
+        }
+    }
+
+    int getChannelCount() {
+        return (recMode == RECORDER_MODE_AUDIO && !stereo) ? 1 : 2;
+    }
+
+    // Connect the sinks to the audio stream or baseband
+    void startPath() {
+        if (recMode == RECORDER_MODE_AUDIO) {
+            // Start correct path depending on 
+            if (stereo) {
+                stereoSink.start();
+            }
+            else {
+                s2m.start();
+                monoSink.start();
+            }
+            splitter.bindStream(&stereoStream);
+        }
+        else {
+            // Create and bind IQ stream
+            basebandStream = new dsp::stream<dsp::complex_t>();
+            basebandSink.setInput(basebandStream);
+            basebandSink.start();
+            sigpath::iqFrontEnd.bindIQStream(basebandStream);
+        }
+        pathMode = recMode;
+        pathRunning = true;
+    }
+
+    void stopPath() {
+        if (pathMode == RECORDER_MODE_AUDIO) {
+            splitter.unbindStream(&stereoStream);
+            monoSink.stop();
+            stereoSink.stop();
+            s2m.stop();
+        }
+        else {
+            // Unbind and destroy IQ stream
+            sigpath::iqFrontEnd.unbindIQStream(basebandStream);
+            basebandSink.stop();
+            delete basebandStream;
+        }
+        pathRunning = false;
+    }
+
+    // Restart the pre-record buffer with the current settings, or stop it if disabled
+    void updatePreRecord() {
+        std::lock_guard<std::recursive_mutex> lck(recMtx);
+        // Applied once the recording is over
+        if (recording) { return; }
+
+        preRecordStale = false;
+        if (pathRunning) { stopPath(); }
+        if (preRecord.getCount()) {
+            flog::info("Discarding {0}s of pre-recorded samples", (double)preRecord.getCount() / (double)preRecordSamplerate);
+        }
+        preRecord.free();
+
+        int seconds = preRecordTimes[preRecordId];
+        if (!seconds || recMode == RECORDER_MODE_MULTI) { return; }
+        if (recMode == RECORDER_MODE_AUDIO) {
+            if (selectedStreamName.empty()) { return; }
+            preRecordSamplerate = sigpath::sinkManager.getStreamSampleRate(selectedStreamName);
+        }
+        else {
+            preRecordSamplerate = sigpath::iqFrontEnd.getSampleRate();
+        }
+
+        // Shorten the buffer if the memory budget doesn't allow the full duration
+        PreRecordBuffer::Storage storage = preRecordStorages[preRecordStorageId];
+        preRecordChannels = getChannelCount();
+        size_t frames = (size_t)seconds * preRecordSamplerate;
+        size_t maxFrames = RECORDER_PRE_RECORD_MAX_MEMORY / (preRecordChannels * PreRecordBuffer::bytesPerValue(storage));
+        if (frames > maxFrames) {
+            flog::warn("Pre-record buffer limited to {0}s by the memory budget", maxFrames / preRecordSamplerate);
+            frames = maxFrames;
+        }
+        preRecord.init(preRecordChannels, frames, storage);
+        writeState = WRITE_STATE_BUFFERING;
+
+        startPath();
+    }
+
+    // Moves the pre-recorded samples to the file, then lets the DSP write directly
+    void drainWorker() {
+        std::vector<float> buf(RECORDER_DRAIN_CHUNK * preRecordChannels);
+        while (!stopDrain) {
+            size_t count;
+            {
+                std::lock_guard<std::mutex> lck(preRecordMtx);
+                count = preRecord.read(buf.data(), RECORDER_DRAIN_CHUNK);
+                if (!count) {
+                    writeState = WRITE_STATE_LIVE;
+                    return;
+                }
+            }
+            segmenter.next(count)->writer.write(buf.data(), count, true);
+        }
+    }
+
+    // Called by the DSP with every block, while not recording and when recording just started the samples go through the pre-record buffer
+    void handleSamples(float* data, int count) {
+        std::lock_guard<std::mutex> lck(preRecordMtx);
+        switch (writeState) {
+        case WRITE_STATE_LIVE:
+            segmenter.next(count)->writer.write(data, count);
+            break;
+        case WRITE_STATE_DRAINING:
+            if (!preRecord.push(data, count, false)) { preRecordDropped += count; }
+            break;
+        default:
+            preRecord.push(data, count);
+            break;
+        }
+    }
+
     void startAudioPath() {
         volume.start();
         splitter.start();
@@ -416,6 +844,11 @@ private:
         // Remove stream from list
         _this->audioStreams.undefineKey(name);
 
+        // A multi-channel recording can't go on without one of its streams
+        if (_this->multi.isRunning() && _this->multi.isRecording(name)) {
+            _this->stop();
+        }
+
         // If the stream is in used, deselect it and reselect default. Otherwise, update ID.
         if (_this->selectedStreamName == name) {
             _this->selectStream("");
@@ -482,7 +915,7 @@ private:
 
     static void complexHandler(dsp::complex_t* data, int count, void* ctx) {
         RecorderModule* _this = (RecorderModule*)ctx;
-        _this->writer.write((float*)data, count);
+        _this->handleSamples((float*)data, count);
     }
 
     static void stereoHandler(dsp::stereo_t* data, int count, void* ctx) {
@@ -498,7 +931,7 @@ private:
             _this->ignoringSilence = (absMax < SILENCE_LVL);
             if (_this->ignoringSilence) { return; }
         }
-        _this->writer.write((float*)data, count);
+        _this->handleSamples((float*)data, count);
     }
 
     static void monoHandler(float* data, int count, void* ctx) {
@@ -512,7 +945,38 @@ private:
             _this->ignoringSilence = (absMax < SILENCE_LVL);
             if (_this->ignoringSilence) { return; }
         }
-        _this->writer.write(data, count);
+        _this->handleSamples(data, count);
+    }
+
+    // A retune starts a new capture segment in the SigMF metadata
+    static void retuneHandler(double freq, void* ctx) {
+        RecorderModule* _this = (RecorderModule*)ctx;
+        std::lock_guard<std::recursive_mutex> lck(_this->recMtx);
+        if (!_this->recording || _this->multi.isRunning()) { return; }
+        _this->recFrequency = _this->getRecordFrequency(freq);
+        RecordingFile* file = _this->segmenter.current();
+        file->meta.addCapture(file->writer.getSamplesWritten(), _this->recFrequency);
+    }
+
+    // The pre-record buffer holds samples at the old rate, they can't go in a recording at the new one
+    static void iqSampleRateHandler(double sampleRate, void* ctx) {
+        RecorderModule* _this = (RecorderModule*)ctx;
+        if (_this->recMode == RECORDER_MODE_BASEBAND) { _this->sampleRateChanged(); }
+    }
+
+    static void streamSampleRateHandler(float sampleRate, void* ctx) {
+        RecorderModule* _this = (RecorderModule*)ctx;
+        if (_this->recMode == RECORDER_MODE_AUDIO) { _this->sampleRateChanged(); }
+    }
+
+    void sampleRateChanged() {
+        std::lock_guard<std::recursive_mutex> lck(recMtx);
+        if (!preRecord.getCapacity()) { return; }
+        if (recording) {
+            preRecordStale = true;
+            return;
+        }
+        updatePreRecord();
     }
 
     static void moduleInterfaceHandler(int code, void* in, void* out, void* ctx) {
@@ -525,7 +989,8 @@ private:
         else if (code == RECORDER_IFACE_CMD_SET_MODE) {
             if (_this->recording) { return; }
             int* _in = (int*)in;
-            _this->recMode = std::clamp<int>(*_in, 0, 1);
+            _this->recMode = std::clamp<int>(*_in, 0, 2);
+            _this->updatePreRecord();
         }
         else if (code == RECORDER_IFACE_CMD_START) {
             if (!_this->recording) { _this->start(); }
@@ -542,11 +1007,23 @@ private:
 
     OptionList<std::string, wav::Format> containers;
     OptionList<int, wav::SampleType> sampleTypes;
+    OptionList<std::string, uint64_t> preallocSizes;
+    OptionList<int, int> preRecordTimes;
+    OptionList<std::string, PreRecordBuffer::Storage> preRecordStorages;
+    OptionList<std::string, MultiRecorder::Layout> multiLayouts;
+    rollover::Settings splitSettings;
     FolderSelect folderSelect;
 
     int recMode = RECORDER_MODE_AUDIO;
     int containerId;
     int sampleTypeId;
+    int preallocId;
+    bool directIO = false;
+    int preRecordId;
+    int preRecordStorageId;
+    int multiLayoutId;
+    std::set<std::string> multiStreams;
+    bool multiStereo = true;
     bool stereo = true;
     std::string selectedStreamName = "";
     float audioVolume = 1.0f;
@@ -555,8 +1032,31 @@ private:
 
     bool recording = false;
     bool ignoringSilence = false;
-    wav::Writer writer;
+    rollover::Segmenter<RecordingFile> segmenter;
+    EventHandler<double> onRetuneHandler;
+    EventHandler<double> onIQSampleRateHandler;
+    EventHandler<float> onStreamSampleRateHandler;
+    std::string recVFO;
+    std::atomic<double> recFrequency = 0.0;
     std::recursive_mutex recMtx;
+    bool pathRunning = false;
+    int pathMode = RECORDER_MODE_AUDIO;
+
+    // Pre-record buffer, the write state decides where the DSP puts the samples
+    enum WriteState {
+        WRITE_STATE_BUFFERING,
+        WRITE_STATE_DRAINING,
+        WRITE_STATE_LIVE
+    };
+    PreRecordBuffer preRecord;
+    std::mutex preRecordMtx;
+    WriteState writeState = WRITE_STATE_BUFFERING;
+    uint64_t preRecordSamplerate = 48000;
+    int preRecordChannels = 2;
+    uint64_t preRecordDropped = 0;
+    bool preRecordStale = false;
+    std::thread drainThread;
+    std::atomic<bool> stopDrain = false;
     dsp::stream<dsp::complex_t>* basebandStream;
     dsp::stream<dsp::stereo_t> stereoStream;
     dsp::sink::Handler<dsp::complex_t> basebandSink;
@@ -574,6 +1074,9 @@ private:
 
     uint64_t samplerate = 48000;
 
+    // Multi-channel recording
+    MultiRecorder multi;
+
     EventHandler<std::string> onStreamRegisteredHandler;
     EventHandler<std::string> onStreamUnregisterHandler;
 
@@ -0,0 +1,495 @@
+#pragma once
+#include <signal_path/signal_path.h>
+#include <dsp/buffer/spsc_ring.h>
+#include <utils/wav.h>
+#include <utils/flog.h>
+#include <gui/gui.h>
+#include <json.hpp>
+#include <fstream>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+
+using nlohmann::json;
+
+// Seconds of audio each channel can hold before the I/O thread has to take it
+#define MULTI_RECORDER_RING_TIME    1.0
+
+// Interval at which the I/O thread collects the channels, in ms
+#define MULTI_RECORDER_INTERVAL     50
+
+// Frames moved from the channels to the file(s) at once
+#define MULTI_RECORDER_CHUNK        1024
+
+// Drops a channel can report before the I/O thread takes them, more are merged into the last one
+#define MULTI_RECORDER_MAX_DROPS    256
+
+/*
+    Records many audio streams at once. Every stream is tapped directly from its splitter into a
+    lock-free ring, so a channel costs one callback and one ring instead of a stream and a thread.
+    A single thread then lines the channels up and does all the writing, either into one file with
+    the channels of every stream or into one file per stream. Each stream is recorded as its left and
+    right channel, or mixed down to one channel when the settings ask for mono.
+
+    Channels are aligned on the arrival time of their first block, snapped to whole blocks since the
+    VFOs all produce their blocks from the same baseband block. Samples a channel loses because its ring
+    overflowed are replaced with silence at the point where they went missing, so that the following
+    ones stay aligned.
+*/
+class MultiRecorder {
+public:
+    enum Layout {
+        LAYOUT_INTERLEAVED,
+        LAYOUT_SEPARATE
+    };
+
+    struct Settings {
+        Layout layout = LAYOUT_INTERLEAVED;
+        wav::Format format = wav::FORMAT_WAV;
+        wav::SampleType type = wav::SAMP_TYPE_INT16;
+        uint64_t preallocation = 0;
+        bool directIO = false;
+        bool stereo = true;
+    };
+
+    ~MultiRecorder() {
+        stop();
+    }
+
+    // basePath is the path of the recording without extension, files are named after it
+    bool start(const std::vector<std::string>& streams, const std::string& basePath, const Settings& settings) {
+        std::lock_guard<std::mutex> lck(ctrlMtx);
+        if (running || streams.empty()) { return false; }
+        _settings = settings;
+        _basePath = basePath;
+
+        // Create channels
+        channels.clear();
+        for (const auto& name : streams) {
+            auto ch = std::make_unique<Channel>();
+            ch->stream = name;
+            ch->samplerate = sigpath::sinkManager.getStreamSampleRate(name);
+            ch->frequency = gui::waterfall.getCenterFrequency();
+            if (gui::waterfall.vfos.find(name) != gui::waterfall.vfos.end()) {
+                ch->frequency += gui::waterfall.vfos[name]->generalOffset;
+            }
+            ch->ring.init(ch->samplerate * MULTI_RECORDER_RING_TIME);
+            ch->drops.init(MULTI_RECORDER_MAX_DROPS);
+            channels.push_back(std::move(ch));
+        }
+
+        // A single file needs a single samplerate
+        if (settings.layout == LAYOUT_INTERLEAVED) {
+            for (const auto& ch : channels) {
+                if (ch->samplerate == channels[0]->samplerate) { continue; }
+                flog::error("Cannot record '{0}' and '{1}' into the same file, their samplerates differ", channels[0]->stream, ch->stream);
+                channels.clear();
+                return false;
+            }
+        }
+
+        // Open the file(s)
+        if (settings.layout == LAYOUT_INTERLEAVED) {
+            configureWriter(writer, channels.size() * getWidth(), channels[0]->samplerate);
+            if (!writer.open(basePath + ".wav")) {
+                flog::error("Failed to open file for recording: {0}", basePath + ".wav");
+                channels.clear();
+                return false;
+            }
+        }
+        else {
+            for (auto& ch : channels) {
+                // Synchronous since the I/O thread already is the only writer
+                configureWriter(ch->writer, getWidth(), ch->samplerate);
+                ch->writer.setSynchronous(true);
+                ch->path = basePath + "_" + ch->stream + ".wav";
+                if (ch->writer.open(ch->path)) { continue; }
+                flog::error("Failed to open file for recording: {0}", ch->path);
+                for (auto& c : channels) { c->writer.close(); }
+                channels.clear();
+                return false;
+            }
+        }
+
+        // Start the I/O thread and then the taps
+        startWallTime = time(NULL);
+        referenceTime = -1;
+        stopWorker = false;
+        workerThread = std::thread(&MultiRecorder::worker, this);
+        for (auto& ch : channels) {
+            ch->tapped = sigpath::sinkManager.bindTap(ch->stream, tapHandler, ch.get());
+        }
+        running = true;
+        return true;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lck(ctrlMtx);
+        if (!running) { return; }
+
+        // Stop the taps first so that the I/O thread can write everything that's left
+        for (auto& ch : channels) {
+            if (ch->tapped) { sigpath::sinkManager.unbindTap(ch->stream, tapHandler, ch.get()); }
+            ch->tapped = false;
+
+            // A drop at the very end has no samples after it to push it out
+            pushDrop(ch.get());
+        }
+        {
+            std::lock_guard<std::mutex> wlck(workerMtx);
+            stopWorker = true;
+        }
+        workerCnd.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
+
+        // Close the file(s) and describe them
+        if (_settings.layout == LAYOUT_INTERLEAVED) {
+            writer.close();
+        }
+        else {
+            for (auto& ch : channels) { ch->writer.close(); }
+        }
+        writeSidecar();
+        for (auto& ch : channels) {
+            if (ch->dropped) { flog::warn("Multi-channel recording of '{0}' dropped {1} samples", ch->stream, (uint64_t)ch->dropped); }
+        }
+        channels.clear();
+        running = false;
+    }
+
+    bool isRunning() {
+        return running;
+    }
+
+    bool isRecording(const std::string& stream) {
+        std::lock_guard<std::mutex> lck(ctrlMtx);
+        for (const auto& ch : channels) {
+            if (ch->stream == stream) { return true; }
+        }
+        return false;
+    }
+
+    // Duration recorded so far, in seconds
+    double getDuration() {
+        std::lock_guard<std::mutex> lck(ctrlMtx);
+        if (channels.empty()) { return 0.0; }
+        return (double)channels[0]->written / (double)channels[0]->samplerate;
+    }
+
+    uint64_t getDropped() {
+        std::lock_guard<std::mutex> lck(ctrlMtx);
+        uint64_t total = 0;
+        for (const auto& ch : channels) { total += ch->dropped; }
+        return total;
+    }
+
+    int getChannelCount() {
+        std::lock_guard<std::mutex> lck(ctrlMtx);
+        return channels.size();
+    }
+
+private:
+    // Samples a channel lost, position is the number of samples that went in the ring before them
+    struct Drop {
+        uint64_t position;
+        uint64_t count;
+    };
+
+    struct Channel {
+        std::string stream;
+        std::string path;
+        uint64_t samplerate;
+        double frequency;
+        bool tapped = false;
+        dsp::buffer::SPSCRing<dsp::stereo_t> ring;
+
+        // Set once by the tap with its first block
+        std::atomic<bool> started = false;
+        int64_t firstTime = 0;
+        int blockLen = 0;
+
+        std::atomic<uint64_t> dropped = 0;
+
+        // Drops in the order they happened, sent by the tap before the samples that follow them
+        dsp::buffer::SPSCRing<Drop> drops;
+        std::atomic<uint64_t> droppedQueued = 0;
+
+        // Only touched by the tap
+        uint64_t ringWritten = 0;
+        Drop pendingDrop = { 0, 0 };
+
+        // Only touched by the I/O thread
+        bool aligned = false;
+        uint64_t startOffset = 0;   // Silence written before the first sample
+        uint64_t forced = 0;        // Silence written before the first sample was there
+        uint64_t padding = 0;       // Silence still to write before the next sample from the ring
+        uint64_t ringRead = 0;
+        uint64_t droppedTaken = 0;
+        Drop nextDrop = { 0, 0 };
+        std::atomic<uint64_t> written = 0;
+        wav::Writer writer;
+    };
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // File channels per stream
+    int getWidth() {
+        return _settings.stereo ? 2 : 1;
+    }
+
+    void configureWriter(wav::Writer& w, int channelCount, uint64_t samplerate) {
+        w.setFormat(_settings.format);
+        w.setChannels(channelCount);
+        w.setSampleType(_settings.type);
+        w.setSamplerate(samplerate);
+        w.setPreallocation(_settings.preallocation);
+        w.setDirectIO(_settings.directIO);
+    }
+
+    // Called from the thread of each stream, must not block
+    static void tapHandler(const dsp::stereo_t* data, int count, void* ctx) {
+        Channel* ch = (Channel*)ctx;
+        if (!ch->started.load(std::memory_order_relaxed)) {
+            ch->firstTime = now();
+            ch->blockLen = count;
+            ch->started.store(true, std::memory_order_release);
+        }
+
+        // Only whole blocks so that a drop doesn't leave part of a block behind. The drop has to be
+        // queued before any sample that comes after it, otherwise it's merged with the next one.
+        pushDrop(ch);
+        if (ch->pendingDrop.count || ch->ring.getWritable() < count) {
+            if (!ch->pendingDrop.count) { ch->pendingDrop.position = ch->ringWritten; }
+            ch->pendingDrop.count += count;
+            ch->dropped += count;
+            return;
+        }
+        ch->ring.write(data, count);
+        ch->ringWritten += count;
+    }
+
+    // Writer side of the drop queue, only from the tap or once the tap is unbound
+    static void pushDrop(Channel* ch) {
+        if (!ch->pendingDrop.count || !ch->drops.write(&ch->pendingDrop, 1)) { return; }
+        ch->droppedQueued.fetch_add(ch->pendingDrop.count, std::memory_order_release);
+        ch->pendingDrop.count = 0;
+    }
+
+    // Work out the silence to put in front of the channels that just started, relative to the first one
+    void align() {
+        for (auto& ch : channels) {
+            if (ch->aligned || !ch->started.load(std::memory_order_acquire)) { continue; }
+            if (referenceTime < 0) { referenceTime = ch->firstTime; }
+            double delay = (double)(ch->firstTime - referenceTime) * (double)ch->samplerate / 1e9;
+            int64_t blocks = std::max<int64_t>(0, round(delay / (double)std::max<int>(ch->blockLen, 1)));
+            uint64_t offset = blocks * ch->blockLen;
+            if (offset > ch->forced) { ch->padding += offset - ch->forced; }
+            ch->startOffset = std::max<uint64_t>(offset, ch->forced);
+            ch->aligned = true;
+        }
+    }
+
+    // Number of frames a channel can provide right now. The ring is read before the drops since the
+    // tap queues a drop before the samples that follow it.
+    uint64_t available(Channel* ch) {
+        if (!ch->aligned) { return ch->padding; }
+        uint64_t readable = ch->ring.getReadable();
+        uint64_t drops = ch->droppedQueued.load(std::memory_order_acquire) - ch->droppedTaken;
+        return ch->padding + readable + drops + ch->nextDrop.count;
+    }
+
+    // Fill buf with n frames of the channel, silence goes where samples were dropped
+    void take(Channel* ch, dsp::stereo_t* buf, int n) {
+        int done = 0;
+        while (done < n) {
+            if (ch->padding) {
+                int zeros = std::min<uint64_t>(ch->padding, n - done);
+                memset(&buf[done], 0, zeros * sizeof(dsp::stereo_t));
+                ch->padding -= zeros;
+                done += zeros;
+                continue;
+            }
+
+            // Turn the next drop into silence once the samples before it are read
+            if (!ch->nextDrop.count && ch->drops.read(&ch->nextDrop, 1)) { ch->droppedTaken += ch->nextDrop.count; }
+            if (ch->nextDrop.count && ch->nextDrop.position <= ch->ringRead) {
+                ch->padding = ch->nextDrop.count;
+                ch->nextDrop.count = 0;
+                continue;
+            }
+
+            int toRead = n - done;
+            if (ch->nextDrop.count) { toRead = std::min<uint64_t>(toRead, ch->nextDrop.position - ch->ringRead); }
+            int got = ch->ring.read(&buf[done], toRead);
+            ch->ringRead += got;
+            done += got;
+
+            // Can't happen with n up to available(), but never leave garbage behind
+            if (!got) {
+                memset(&buf[done], 0, (n - done) * sizeof(dsp::stereo_t));
+                break;
+            }
+        }
+        ch->written += n;
+    }
+
+    // Store n frames of a channel at out[i * stride], either both sides or their average
+    void place(const dsp::stereo_t* in, float* out, int n, int stride) {
+        if (_settings.stereo) {
+            for (int i = 0; i < n; i++) {
+                out[i * stride] = in[i].l;
+                out[i * stride + 1] = in[i].r;
+            }
+        }
+        else {
+            for (int i = 0; i < n; i++) { out[i * stride] = (in[i].l + in[i].r) * 0.5f; }
+        }
+    }
+
+    void writeInterleaved(bool final) {
+        int count = channels.size();
+        uint64_t minAvail = UINT64_MAX;
+        uint64_t maxAvail = 0;
+        for (auto& ch : channels) {
+            uint64_t avail = available(ch.get());
+            minAvail = std::min<uint64_t>(minAvail, avail);
+            maxAvail = std::max<uint64_t>(maxAvail, avail);
+        }
+
+        // Don't let a channel that's late or gave nothing hold back the others until their rings overflow
+        uint64_t limit = channels[0]->ring.getCapacity() / 2;
+        if (maxAvail > minAvail && (maxAvail >= limit || final)) {
+            for (auto& ch : channels) {
+                uint64_t missing = maxAvail - available(ch.get());
+                if (!ch->aligned) { ch->forced += missing; }
+                ch->padding += missing;
+            }
+            minAvail = maxAvail;
+        }
+
+        std::vector<float>& frames = interleaveBuf;
+        int width = getWidth();
+        for (uint64_t done = 0; done < minAvail;) {
+            int n = std::min<uint64_t>(minAvail - done, MULTI_RECORDER_CHUNK);
+            for (int c = 0; c < count; c++) {
+                take(channels[c].get(), channelBuf.data(), n);
+                place(channelBuf.data(), &frames[c * width], n, count * width);
+            }
+            writer.write(frames.data(), n, true);
+            done += n;
+        }
+    }
+
+    void writeSeparate() {
+        int width = getWidth();
+        for (auto& ch : channels) {
+            uint64_t avail = available(ch.get());
+            if (!ch->aligned) { continue; }
+            for (uint64_t done = 0; done < avail;) {
+                int n = std::min<uint64_t>(avail - done, MULTI_RECORDER_CHUNK);
+                take(ch.get(), channelBuf.data(), n);
+                place(channelBuf.data(), separateBuf.data(), n, width);
+                ch->writer.write(separateBuf.data(), n);
+                done += n;
+            }
+        }
+    }
+
+    void worker() {
+        channelBuf.resize(MULTI_RECORDER_CHUNK);
+        if (_settings.layout == LAYOUT_INTERLEAVED) {
+            interleaveBuf.resize(MULTI_RECORDER_CHUNK * channels.size() * getWidth());
+        }
+        else {
+            separateBuf.resize(MULTI_RECORDER_CHUNK * getWidth());
+        }
+
+        while (true) {
+            bool final;
+            {
+                std::unique_lock<std::mutex> lck(workerMtx);
+                workerCnd.wait_for(lck, std::chrono::milliseconds(MULTI_RECORDER_INTERVAL), [this]() { return stopWorker; });
+                final = stopWorker;
+            }
+
+            align();
+            if (_settings.layout == LAYOUT_INTERLEAVED) {
+                writeInterleaved(final);
+            }
+            else {
+                writeSeparate();
+            }
+            if (final) { break; }
+        }
+
+        interleaveBuf.clear();
+        interleaveBuf.shrink_to_fit();
+        separateBuf.clear();
+        separateBuf.shrink_to_fit();
+    }
+
+    // Describe the channels next to the recording, the offsets say where each one really starts
+    void writeSidecar() {
+        char timeStr[64];
+        strftime(timeStr, sizeof(timeStr), "%Y-%m-%dT%H:%M:%SZ", gmtime(&startWallTime));
+
+        json meta;
+        meta["layout"] = (_settings.layout == LAYOUT_INTERLEAVED) ? "interleaved" : "separate";
+        meta["startTime"] = timeStr;
+        meta["stereo"] = _settings.stereo;
+        if (_settings.layout == LAYOUT_INTERLEAVED) { meta["file"] = std::filesystem::path(_basePath + ".wav").filename().string(); }
+        meta["channels"] = json::array();
+        for (int i = 0; i < channels.size(); i++) {
+            const auto& ch = channels[i];
+            json c;
+            c["index"] = i;
+            c["stream"] = ch->stream;
+
+            // Channels of the file holding the stream, left and right or the mono mix
+            int width = getWidth();
+            int first = (_settings.layout == LAYOUT_INTERLEAVED) ? i * width : 0;
+            c["fileChannels"] = json::array();
+            for (int j = 0; j < width; j++) { c["fileChannels"].push_back(first + j); }
+            if (_settings.layout == LAYOUT_SEPARATE) { c["file"] = std::filesystem::path(ch->path).filename().string(); }
+            c["frequency"] = ch->frequency;
+            c["samplerate"] = ch->samplerate;
+            c["startOffset"] = ch->startOffset;
+            c["droppedSamples"] = (uint64_t)ch->dropped;
+            c["samples"] = (uint64_t)ch->written;
+            meta["channels"].push_back(c);
+        }
+
+        std::ofstream file(_basePath + ".json");
+        if (!file.is_open()) {
+            flog::error("Failed to write the channel list of the recording: {0}", _basePath + ".json");
+            return;
+        }
+        file << meta.dump(4);
+    }
+
+    std::mutex ctrlMtx;
+    bool running = false;
+    Settings _settings;
+    std::string _basePath;
+    std::vector<std::unique_ptr<Channel>> channels;
+    wav::Writer writer;
+
+    time_t startWallTime;
+    int64_t referenceTime = -1;
+
+    // I/O thread
+    std::thread workerThread;
+    std::mutex workerMtx;
+    std::condition_variable workerCnd;
+    bool stopWorker = false;
+    std::vector<dsp::stereo_t> channelBuf;
+    std::vector<float> interleaveBuf;
+    std::vector<float> separateBuf;
+};
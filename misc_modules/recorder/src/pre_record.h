@@ -0,0 +1,125 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <volk/volk.h>
+
+// Holds the last few seconds of interleaved samples, optionally quantized to save memory.
+// Not thread safe, the recorder guards it with its own mutex.
+class PreRecordBuffer {
+public:
+    enum Storage {
+        STORAGE_FLOAT32,
+        STORAGE_INT16,
+        STORAGE_INT8
+    };
+
+    static int bytesPerValue(Storage storage) {
+        switch (storage) {
+        case STORAGE_INT16: return 2;
+        case STORAGE_INT8:  return 1;
+        default:            return 4;
+        }
+    }
+
+    void init(int channels, size_t frames, Storage storage) {
+        _channels = channels;
+        _storage = storage;
+        capacity = frames;
+        data.resize(frames * channels * bytesPerValue(storage));
+        data.shrink_to_fit();
+        clear();
+    }
+
+    void free() {
+        data.clear();
+        data.shrink_to_fit();
+        capacity = 0;
+        clear();
+    }
+
+    void clear() {
+        readPos = 0;
+        count = 0;
+    }
+
+    size_t getCount() { return count; }
+    size_t getCapacity() { return capacity; }
+
+    // Add frames, dropping the oldest ones if full. Without overwrite, nothing is added and false
+    // is returned if there isn't room for all of them.
+    bool push(const float* in, size_t frames, bool overwrite = true) {
+        if (!capacity) { return !frames; }
+        if (!overwrite && frames > capacity - count) { return false; }
+
+        // Only the end of a block bigger than the whole buffer would survive anyway
+        if (frames > capacity) {
+            in += (frames - capacity) * _channels;
+            frames = capacity;
+        }
+
+        size_t writePos = (readPos + count) % capacity;
+        size_t first = std::min<size_t>(frames, capacity - writePos);
+        store(in, writePos, first);
+        store(&in[first * _channels], 0, frames - first);
+
+        count += frames;
+        if (count > capacity) {
+            readPos = (readPos + count - capacity) % capacity;
+            count = capacity;
+        }
+        return true;
+    }
+
+    // Take up to maxFrames of the oldest frames out of the buffer, returns the number of frames read
+    size_t read(float* out, size_t maxFrames) {
+        size_t frames = std::min<size_t>(maxFrames, count);
+        size_t first = std::min<size_t>(frames, capacity - readPos);
+        load(out, readPos, first);
+        load(&out[first * _channels], 0, frames - first);
+        readPos = (readPos + frames) % (capacity ? capacity : 1);
+        count -= frames;
+        return frames;
+    }
+
+private:
+    void store(const float* in, size_t pos, size_t frames) {
+        size_t n = frames * _channels;
+        size_t offset = pos * _channels;
+        switch (_storage) {
+        case STORAGE_INT16:
+            volk_32f_s32f_convert_16i(&((int16_t*)data.data())[offset], in, 32767.0f, n);
+            break;
+        case STORAGE_INT8:
+            volk_32f_s32f_convert_8i(&((int8_t*)data.data())[offset], in, 127.0f, n);
+            break;
+        default:
+            memcpy(&((float*)data.data())[offset], in, n * sizeof(float));
+            break;
+        }
+    }
+
+    void load(float* out, size_t pos, size_t frames) {
+        size_t n = frames * _channels;
+        size_t offset = pos * _channels;
+        switch (_storage) {
+        case STORAGE_INT16:
+            volk_16i_s32f_convert_32f(out, &((int16_t*)data.data())[offset], 32767.0f, n);
+            break;
+        case STORAGE_INT8:
+            volk_8i_s32f_convert_32f(out, &((int8_t*)data.data())[offset], 127.0f, n);
+            break;
+        default:
+            memcpy(out, &((float*)data.data())[offset], n * sizeof(float));
+            break;
+        }
+    }
+
+    std::vector<uint8_t> data;
+    int _channels = 1;
+    Storage _storage = STORAGE_FLOAT32;
+    size_t capacity = 0;
+    size_t readPos = 0;
+    size_t count = 0;
+};
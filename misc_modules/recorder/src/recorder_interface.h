@@ -9,5 +9,6 @@ enum {
 
 enum {
     RECORDER_MODE_BASEBAND,
-    RECORDER_MODE_AUDIO
+    RECORDER_MODE_AUDIO,
+    RECORDER_MODE_MULTI
 };
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include <config.h>
 #include <cctype>
 #include <radio_interface.h>
+#include <file_source_interface.h>
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
 #define MAX_COMMAND_LENGTH 8192
@@ -233,6 +234,13 @@ private:
         }
     }
 
+    std::string findFileSource() {
+        for (auto const& [_name, inst] : core::moduleManager.instances) {
+            if (core::moduleManager.getInstanceModuleName(_name) == "file_source") { return _name; }
+        }
+        return "";
+    }
+
     void selectVfoByName(std::string _name, bool lock = true) {
         if (vfoNames.empty()) {
             if (lock) { std::lock_guard lck(vfoMtx); }
@@ -618,6 +626,32 @@ private:
         else if (parts[0] == "\\stop") {
             gui::mainWindow.setPlayState(false);
         }
+        else if (parts[0] == "\\get_file_pos") {
+            // Respond with the position, length and samplerate of the file being played
+            FileSourceProgress progress;
+            std::string fileSource = findFileSource();
+            if (fileSource.empty() || !core::modComManager.callInterface(fileSource, FILE_SOURCE_IFACE_CMD_GET_PROGRESS, NULL, &progress)) {
+                resp = "RPRT 1\n";
+                client->write(resp.size(), (uint8_t*)resp.c_str());
+                return;
+            }
+            char buf[128];
+            sprintf(buf, "%" PRIu64 "\n%" PRIu64 "\n%d\n%d\n", progress.position, progress.length, (int)progress.sampleRate, (int)progress.finished);
+            client->write(strlen(buf), (uint8_t*)buf);
+        }
+        else if (parts[0] == "\\set_file_pos") {
+            // Seek the file being played, in samples
+            std::string fileSource = findFileSource();
+            if (parts.size() != 2 || fileSource.empty()) {
+                resp = "RPRT 1\n";
+                client->write(resp.size(), (uint8_t*)resp.c_str());
+                return;
+            }
+            uint64_t pos = std::stoull(parts[1]);
+            core::modComManager.callInterface(fileSource, FILE_SOURCE_IFACE_CMD_SEEK, &pos, NULL);
+            resp = "RPRT 0\n";
+            client->write(resp.size(), (uint8_t*)resp.c_str());
+        }
         else if (parts[0] == "\\dump_state") {
             std::lock_guard lck(vfoMtx);
             resp =
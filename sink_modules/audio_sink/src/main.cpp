@@ -1,17 +1,43 @@
 #include <imgui.h>
 #include <module.h>
 #include <gui/gui.h>
+#include <gui/style.h>
 #include <signal_path/signal_path.h>
 #include <signal_path/sink.h>
 #include <dsp/buffer/packer.h>
+#include <dsp/buffer/spsc_ring.h>
 #include <dsp/convert/stereo_to_mono.h>
+#include <dsp/multirate/fractional_resampler.h>
+#include <dsp/sink/handler_sink.h>
 #include <utils/flog.h>
+#include <utils/optionlist.h>
 #include <RtAudio.h>
 #include <config.h>
 #include <core.h>
+#include <atomic>
+#include <chrono>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
 
+// Largest correction of the samplerate applied to follow the clock of the sound card
+#define AUDIO_SINK_MAX_CORRECTION   0.005
+
+// Gains of the control loop keeping the buffered audio at the target latency, the error being in seconds
+#define AUDIO_SINK_LOOP_KP          0.1
+#define AUDIO_SINK_LOOP_KI          0.002
+
+// Time constant of the averaging of the buffer fill level, in seconds
+#define AUDIO_SINK_FILL_TAU         1.0
+
+// Largest block resampled at once
+#define AUDIO_SINK_CHUNK            4096
+
+// Smallest device buffer used by the low latency profile, in frames
+#define AUDIO_SINK_MIN_BUFFER       64
+
+// Blocks whose timestamp can be waiting in the ring, a second of audio in blocks of at least 1ms
+#define AUDIO_SINK_MAX_STAMPS       1024
+
 SDRPP_MOD_INFO{
     /* Name:            */ "audio_sink",
     /* Description:     */ "Audio sink module for SDR++",
@@ -29,7 +55,22 @@ public:
         _streamName = streamName;
         s2m.init(_stream->sinkOut);
         monoPacker.init(&s2m.out, 512);
-        stereoPacker.init(_stream->sinkOut, 512);
+        resamp.init(NULL, 1.0);
+        resamp.out.free();
+        handler.init(_stream->sinkOut, dataHandler, this);
+
+        latencyTargetChangedHandler.handler = latencyTargetChanged;
+        latencyTargetChangedHandler.ctx = this;
+        sigpath::sinkManager.onLatencyTargetChanged.bindHandler(&latencyTargetChangedHandler);
+
+        latencies.define(20, "20ms", 20);
+        latencies.define(40, "40ms", 40);
+        latencies.define(60, "60ms", 60);
+        latencies.define(80, "80ms", 80);
+        latencies.define(100, "100ms", 100);
+        latencies.define(150, "150ms", 150);
+        latencies.define(200, "200ms", 200);
+        latencies.define(300, "300ms", 300);
 
         bool created = false;
         std::string device = "";
@@ -39,8 +80,14 @@ public:
             config.conf[_streamName]["device"] = "";
             config.conf[_streamName]["devices"] = json({});
         }
+        if (!config.conf[_streamName].contains("latency")) {
+            created = true;
+            config.conf[_streamName]["latency"] = 60;
+        }
         device = config.conf[_streamName]["device"];
+        int latency = config.conf[_streamName]["latency"];
         config.release(created);
+        latencyId = latencies.keyExists(latency) ? latencies.keyId(latency) : latencies.keyId(60);
 
         int count = audio.getDeviceCount();
         RtAudio::DeviceInfo info;
@@ -59,6 +106,7 @@ public:
     }
 
     ~AudioSink() {
+        sigpath::sinkManager.onLatencyTargetChanged.unbindHandler(&latencyTargetChangedHandler);
         stop();
     }
 
@@ -150,6 +198,38 @@ public:
             config.conf[_streamName]["devices"][devList[devId].name] = sampleRate;
             config.release(true);
         }
+
+        // The low latency profile overrides the latency of every sink
+        if (!sigpath::sinkManager.getLatencyTarget()) {
+            ImGui::LeftLabel("Latency");
+            ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+            if (ImGui::Combo(("##_audio_sink_latency_" + _streamName).c_str(), &latencyId, latencies.txt)) {
+                if (running) {
+                    doStop();
+                    doStart();
+                }
+                config.acquire();
+                config.conf[_streamName]["latency"] = latencies.key(latencyId);
+                config.release(true);
+            }
+        }
+
+        if (running) {
+            double latency = latencyMs;
+            if (latency > 0.0) {
+                ImGui::Text("Latency (VFO to DAC): %.1fms", latency);
+            }
+            ImGui::Text("Buffered: %.1fms, device %.1fms", bufferedMs.load(), deviceMs.load());
+            ImGui::Text("Correction: %+.0fppm", correctionPpm.load());
+            uint64_t under = underruns;
+            uint64_t over = overruns;
+            if (under || over) {
+                ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Underruns: %llu, overruns: %llu", (unsigned long long)under, (unsigned long long)over);
+            }
+            else {
+                ImGui::Text("Underruns: 0, overruns: 0");
+            }
+        }
     }
 
 private:
@@ -157,16 +237,49 @@ private:
         RtAudio::StreamParameters parameters;
         parameters.deviceId = deviceIds[devId];
         parameters.nChannels = 2;
+
+        // In the low latency profile a quarter of the target goes to the device buffer and the rest to the ring,
+        // otherwise the device gets a fixed 1/60th of a second
+        int lowLatencyTarget = sigpath::sinkManager.getLatencyTarget();
+        double targetMs = lowLatencyTarget ? lowLatencyTarget : latencies.value(latencyId);
         unsigned int bufferFrames = sampleRate / 60;
+        if (lowLatencyTarget) {
+            bufferFrames = std::clamp<unsigned int>(targetMs * (double)sampleRate / 4000.0, AUDIO_SINK_MIN_BUFFER, bufferFrames);
+        }
         RtAudio::StreamOptions opts;
         opts.flags = RTAUDIO_MINIMIZE_LATENCY;
         opts.streamName = _streamName;
 
         try {
             audio.openStream(&parameters, NULL, RTAUDIO_FLOAT32, sampleRate, &bufferFrames, &callback, this, &opts);
-            stereoPacker.setSampleCount(bufferFrames);
+
+            // Not every API reports its latency, at least one buffer is always queued in the device
+            deviceFrames = std::max<long>(audio.getStreamLatency(), bufferFrames);
+            deviceMs = (double)deviceFrames * 1000.0 / (double)sampleRate;
+
+            // The ring holds a second of audio, far more than the target so that it only overflows if the audio device stalls.
+            // The target can't be less than two device buffers since the callback takes a whole one at a time.
+            // In the low latency profile the target is end to end, so the device latency comes out of it.
+            ring.init(sampleRate);
+            stamps.init(AUDIO_SINK_MAX_STAMPS);
+            ringWritten = 0;
+            ringRead = 0;
+            playing = { 0, 0 };
+            double targetFrames = targetMs * (double)sampleRate / 1000.0;
+            if (lowLatencyTarget) { targetFrames -= deviceFrames; }
+            targetFill = std::max<double>(targetFrames, 2.0 * bufferFrames);
+            maxFill = targetFill * 2.0 + 2.0 * bufferFrames;
+            avgFill = targetFill;
+            loopIntegral = 0.0;
+            resamp.setRatio(1.0);
+            primed = false;
+            underruns = 0;
+            overruns = 0;
+            pipelineDelay = -1.0;
+            latencyMs = 0.0;
+
             audio.startStream();
-            stereoPacker.start();
+            handler.start();
         }
         catch (RtAudioError& e) {
             flog::error("Could not open audio device");
@@ -180,37 +293,140 @@ private:
     void doStop() {
         s2m.stop();
         monoPacker.stop();
-        stereoPacker.stop();
+        handler.stop();
         monoPacker.out.stopReader();
-        stereoPacker.out.stopReader();
         audio.stopStream();
         audio.closeStream();
         monoPacker.out.clearReadStop();
-        stereoPacker.out.clearReadStop();
     }
 
+    // Runs in the DSP thread, corrects the samplerate to keep the buffered audio at the target and fills the ring
+    static void dataHandler(dsp::stereo_t* data, int count, void* ctx) {
+        AudioSink* _this = (AudioSink*)ctx;
+
+        // Average the fill level, it jumps by a whole buffer each time the audio callback runs
+        double fill = _this->ring.getReadable();
+        double alpha = std::min<double>(1.0, (double)count / (AUDIO_SINK_FILL_TAU * (double)_this->sampleRate));
+        _this->avgFill += alpha * (fill - _this->avgFill);
+
+        // PI loop on the latency error, too much audio buffered means producing fewer samples
+        double error = (_this->avgFill - _this->targetFill) / (double)_this->sampleRate;
+        double dt = (double)count / (double)_this->sampleRate;
+        _this->loopIntegral = std::clamp<double>(_this->loopIntegral + error * dt, -AUDIO_SINK_MAX_CORRECTION / AUDIO_SINK_LOOP_KI, AUDIO_SINK_MAX_CORRECTION / AUDIO_SINK_LOOP_KI);
+        double correction = -std::clamp<double>(AUDIO_SINK_LOOP_KP * error + AUDIO_SINK_LOOP_KI * _this->loopIntegral, -AUDIO_SINK_MAX_CORRECTION, AUDIO_SINK_MAX_CORRECTION);
+        _this->resamp.setRatio(1.0 + correction);
+        _this->bufferedMs = _this->avgFill * 1000.0 / (double)_this->sampleRate;
+        _this->correctionPpm = correction * 1e6;
+
+        // Resample in chunks that can't overflow the work buffer
+        for (int i = 0; i < count; i += AUDIO_SINK_CHUNK) {
+            int n = std::min<int>(AUDIO_SINK_CHUNK, count - i);
+            int outCount = _this->resamp.process(n, &data[i], _this->resampBuf);
+            int written = _this->ring.write(_this->resampBuf, outCount);
+            _this->ringWritten += written;
+            if (written < outCount) { _this->overruns++; }
+        }
+
+        // Tag the end of the block in the ring with the time it entered the VFO, so that the callback
+        // knows how old the audio it plays is. If the tags pile up the block shares the next one's.
+        Stamp stamp = { _this->ringWritten, _this->_stream->getInputTime() };
+        if (stamp.time) { _this->stamps.write(&stamp, 1); }
+    }
+
+    // Runs in the real-time audio thread, measures how long ago the audio that starts playing entered the VFO
+    void updateLatency(unsigned int nBufferFrames) {
+        while (playing.end <= ringRead && stamps.read(&playing, 1)) {}
+        if (!playing.time || playing.end <= ringRead) { return; }
+
+        // It still has to go through the device before being heard
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        double delay = (double)(now - playing.time) * 1e-9 + deviceMs / 1000.0;
+        if (pipelineDelay < 0.0) { pipelineDelay = delay; }
+        double dt = (double)nBufferFrames / (double)sampleRate;
+        pipelineDelay += std::min<double>(1.0, dt / AUDIO_SINK_FILL_TAU) * (delay - pipelineDelay);
+        latencyMs = pipelineDelay * 1000.0;
+    }
+
+    // Runs in the real-time audio thread, must never block
     static int callback(void* outputBuffer, void* inputBuffer, unsigned int nBufferFrames, double streamTime, RtAudioStreamStatus status, void* userData) {
         AudioSink* _this = (AudioSink*)userData;
-        int count = _this->stereoPacker.out.read();
-        if (count < 0) { return 0; }
-
-        // For debug purposes only...
-        // if (nBufferFrames != count) { flog::warn("Buffer size mismatch, wanted {0}, was asked for {1}", count, nBufferFrames); }
-        // for (int i = 0; i < count; i++) {
-        //     if (_this->stereoPacker.out.readBuf[i].l == NAN || _this->stereoPacker.out.readBuf[i].r == NAN) { flog::error("NAN in audio data"); }
-        //     if (_this->stereoPacker.out.readBuf[i].l == INFINITY || _this->stereoPacker.out.readBuf[i].r == INFINITY) { flog::error("INFINITY in audio data"); }
-        //     if (_this->stereoPacker.out.readBuf[i].l == -INFINITY || _this->stereoPacker.out.readBuf[i].r == -INFINITY) { flog::error("-INFINITY in audio data"); }
-        // }
-
-        memcpy(outputBuffer, _this->stereoPacker.out.readBuf, nBufferFrames * sizeof(dsp::stereo_t));
-        _this->stereoPacker.out.flush();
+        dsp::stereo_t* out = (dsp::stereo_t*)outputBuffer;
+        if (status & RTAUDIO_OUTPUT_UNDERFLOW) { _this->underruns++; }
+
+        // Play silence until the target latency is buffered, at the start and after running empty
+        int readable = _this->ring.getReadable();
+        if (!_this->primed) {
+            if (readable < _this->targetFill) {
+                memset(out, 0, nBufferFrames * sizeof(dsp::stereo_t));
+                return 0;
+            }
+            _this->primed = true;
+        }
+
+        // If way too much got buffered, such as after the audio device stalled, jump back to the target
+        if (readable > _this->maxFill) {
+            _this->ringRead += _this->ring.skip(readable - (int)_this->targetFill);
+            _this->overruns++;
+        }
+
+        _this->updateLatency(nBufferFrames);
+        int count = _this->ring.read(out, nBufferFrames);
+        _this->ringRead += count;
+        if (count < (int)nBufferFrames) {
+            memset(&out[count], 0, (nBufferFrames - count) * sizeof(dsp::stereo_t));
+            _this->underruns++;
+            _this->primed = false;
+        }
         return 0;
     }
 
+    static void latencyTargetChanged(int target, void* ctx) {
+        AudioSink* _this = (AudioSink*)ctx;
+        if (!_this->running) { return; }
+        _this->doStop();
+        _this->running = _this->doStart();
+    }
+
     SinkManager::Stream* _stream;
     dsp::convert::StereoToMono s2m;
     dsp::buffer::Packer<float> monoPacker;
-    dsp::buffer::Packer<dsp::stereo_t> stereoPacker;
+    dsp::sink::Handler<dsp::stereo_t> handler;
+    dsp::multirate::FractionalResampler<dsp::stereo_t> resamp;
+    dsp::stereo_t resampBuf[AUDIO_SINK_CHUNK * 2];
+    dsp::buffer::SPSCRing<dsp::stereo_t> ring;
+
+    // End of a block in the ring, in frames written since the start, and the time it entered the VFO
+    struct Stamp {
+        uint64_t end;
+        int64_t time;
+    };
+    dsp::buffer::SPSCRing<Stamp> stamps;
+    uint64_t ringWritten = 0;
+
+    // Latency control, only touched by the DSP thread except for the targets
+    OptionList<int, int> latencies;
+    int latencyId = 0;
+    double targetFill = 0.0;
+    double maxFill = 0.0;
+    double avgFill = 0.0;
+    double loopIntegral = 0.0;
+    long deviceFrames = 0;
+    bool primed = false;
+
+    // Latency measurement, only touched by the audio callback
+    uint64_t ringRead = 0;
+    Stamp playing = { 0, 0 };
+    double pipelineDelay = -1.0;
+
+    // Statistics for the GUI
+    std::atomic<uint64_t> underruns = 0;
+    std::atomic<uint64_t> overruns = 0;
+    std::atomic<double> bufferedMs = 0.0;
+    std::atomic<double> correctionPpm = 0.0;
+    std::atomic<double> latencyMs = 0.0;
+    std::atomic<double> deviceMs = 0.0;
+
+    EventHandler<int> latencyTargetChangedHandler;
 
     std::string _streamName;
 
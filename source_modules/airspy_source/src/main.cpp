@@ -42,6 +42,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         refresh();
         if (sampleRateList.size() > 0) {
@@ -312,6 +313,7 @@ private:
 
         airspy_start_rx(_this->openDev, callback, _this);
 
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         flog::info("AirspySourceModule '{0}': Start!", _this->name);
     }
@@ -320,6 +322,7 @@ private:
         AirspySourceModule* _this = (AirspySourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         _this->stream.stopWriter();
         airspy_close(_this->openDev);
         _this->stream.clearWriteStop();
@@ -564,6 +567,8 @@ private:
 
     static int callback(airspy_transfer_t* transfer) {
         AirspySourceModule* _this = (AirspySourceModule*)transfer->ctx;
+        if (transfer->dropped_samples) { _this->health.gap(transfer->dropped_samples); }
+        _this->health.delivered(transfer->sample_count);
         memcpy(_this->stream.writeBuf, transfer->samples, transfer->sample_count * sizeof(dsp::complex_t));
         if (!_this->stream.swap(transfer->sample_count)) { return -1; }
         return 0;
@@ -575,6 +580,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     double freq;
     uint64_t selectedSerial = 0;
@@ -42,6 +42,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         refresh();
 
@@ -266,6 +267,7 @@ private:
 
         airspyhf_start(_this->openDev, callback, _this);
 
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         flog::info("AirspyHFSourceModule '{0}': Start!", _this->name);
     }
@@ -274,6 +276,7 @@ private:
         AirspyHFSourceModule* _this = (AirspyHFSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         _this->stream.stopWriter();
         airspyhf_close(_this->openDev);
         _this->stream.clearWriteStop();
@@ -373,6 +376,8 @@ private:
 
     static int callback(airspyhf_transfer_t* transfer) {
         AirspyHFSourceModule* _this = (AirspyHFSourceModule*)transfer->ctx;
+        if (transfer->dropped_samples) { _this->health.gap(transfer->dropped_samples); }
+        _this->health.delivered(transfer->sample_count);
         memcpy(_this->stream.writeBuf, transfer->samples, transfer->sample_count * sizeof(dsp::complex_t));
         if (!_this->stream.swap(transfer->sample_count)) { return -1; }
         return 0;
@@ -384,6 +389,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     double freq;
     uint64_t selectedSerial = 0;
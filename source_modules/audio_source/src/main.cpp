@@ -45,6 +45,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         // Refresh devices
         refresh();
@@ -187,6 +188,7 @@ private:
         try {
             _this->audio.openStream(NULL, &parameters, RTAUDIO_FLOAT32, _this->sampleRate, &bufferFrames, callback, _this, &opts);
             _this->audio.startStream();
+            _this->health.start(_this->sampleRate);
             _this->running = true;
         }
         catch (std::exception e) {
@@ -200,6 +202,7 @@ private:
         AudioSourceModule* _this = (AudioSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         
         _this->audio.stopStream();
         _this->audio.closeStream();
@@ -250,6 +253,7 @@ private:
     static int callback(void* outputBuffer, void* inputBuffer, unsigned int nBufferFrames, double streamTime, RtAudioStreamStatus status, void* userData) {
         AudioSourceModule* _this = (AudioSourceModule*)userData;
         memcpy(_this->stream.writeBuf, inputBuffer, nBufferFrames * sizeof(dsp::complex_t));
+        _this->health.delivered(nBufferFrames);
         _this->stream.swap(nBufferFrames);
         return 0;
     }
@@ -259,6 +263,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     
     OptionList<std::string, DeviceInfo> devices;
@@ -43,6 +43,7 @@ public:
         config.acquire();
         fileSelect.setPath(config.conf["path"], true);
         config.release();
+        hasIndex = std::filesystem::exists(ziq2::ziq2_index_path(fileSelect.path));
 
         handler.ctx = this;
         handler.selectHandler = menuSelected;
@@ -58,6 +59,7 @@ public:
     ~BasebandSourceModule() {
         stop(this);
         sigpath::sourceManager.unregisterSource("Baseband");
+        if (indexThread.joinable()) { indexThread.join(); }
     }
 
     void postInit() {}
@@ -110,6 +112,7 @@ private:
         _this->stream.stopWriter();
         _this->workerThread.join();
         _this->stream.clearWriteStop();
+        _this->baseband_reader.close();
         _this->running = false;
         // _this->reader->rewind();
         flog::info("BasebandSourceModule '{0}': Stop!", _this->name);
@@ -127,6 +130,7 @@ private:
             style::beginDisabled();
         if (_this->fileSelect.render("##baseband_source_" + _this->name)) {
             if (_this->fileSelect.pathIsValid()) {
+                _this->hasIndex = std::filesystem::exists(ziq2::ziq2_index_path(_this->fileSelect.path));
                 try {
                     HeaderInfo hdr = try_parse_header(_this->fileSelect.path);
 
@@ -184,21 +188,69 @@ private:
         if (_this->running)
             style::endDisabled();
 
-        if (_this->select_sample_format == 4)
+        // Only seekable ZIQ files can be scrolled, which is known once the file is open
+        bool noScroll = (_this->select_sample_format == 4 && !_this->baseband_reader.get_sample_count());
+        if (noScroll)
             style::beginDisabled();
-        float file_progress = (float(_this->baseband_reader.progress) / float(_this->baseband_reader.filesize)) * 100.0;
-        if (ImGui::SliderFloat("Progress", &file_progress, 0, 100))
-            _this->baseband_reader.set_progress(file_progress);
-        if (_this->select_sample_format == 4) {
-            ImGui::TextColored(ImColor(255, 0, 0), "Scrolling not\navailable on ZIQ!");
+        // Files with a known length, such as indexed ZIQ2, are scrolled by sample, others by their position in bytes
+        uint64_t sampleCount = _this->baseband_reader.get_sample_count();
+        if (sampleCount && _this->sampleRate > 0) {
+            uint64_t samplePos = _this->baseband_reader.get_sample_position();
+            uint64_t sampleStart = 0;
+            char posStr[64];
+            int p = (double)samplePos / _this->sampleRate;
+            sprintf(posStr, "%02d:%02d:%02d", p / 3600, (p / 60) % 60, p % 60);
+            if (ImGui::SliderScalar("Progress", ImGuiDataType_U64, &samplePos, &sampleStart, &sampleCount, posStr))
+                _this->baseband_reader.seek_samples(samplePos);
+        }
+        else {
+            float file_progress = (float(_this->baseband_reader.progress) / float(_this->baseband_reader.filesize)) * 100.0;
+            if (ImGui::SliderFloat("Progress", &file_progress, 0, 100))
+                _this->baseband_reader.set_progress(file_progress);
+        }
+        if (noScroll) {
+            ImGui::TextColored(ImColor(255, 0, 0), "Scrolling not available\non non-seekable ZIQ!");
             style::endDisabled();
         }
 
+        // Exact position when the length is known
+        uint64_t totalSamples = _this->baseband_reader.get_sample_count();
+        if (_this->running && totalSamples && _this->sampleRate > 0) {
+            double pos = (double)_this->baseband_reader.get_sample_position() / _this->sampleRate;
+            double len = (double)totalSamples / _this->sampleRate;
+            ImGui::Text("%02d:%02d:%06.3f / %02d:%02d:%06.3f", (int)pos / 3600, ((int)pos / 60) % 60, fmod(pos, 60.0),
+                        (int)len / 3600, ((int)len / 60) % 60, fmod(len, 60.0));
+        }
+
+        // ZIQ2 recordings without a packet index can only be seeked approximately, offer to build one
+        if (_this->select_sample_format == 5 && _this->fileSelect.pathIsValid()) {
+            if (_this->indexBuilding) {
+                ImGui::ProgressBar(_this->indexProgress, ImVec2(ImGui::GetContentRegionAvail().x, 0), "Building index...");
+            }
+            else if (!_this->hasIndex) {
+                if (ImGui::Button(CONCAT("Build index##_baseband_source_idx_", _this->name), ImVec2(ImGui::GetContentRegionAvail().x, 0))) {
+                    if (_this->indexThread.joinable()) { _this->indexThread.join(); }
+                    _this->indexBuilding = true;
+                    _this->indexProgress = 0.0f;
+                    _this->indexThread = std::thread([_this](std::string path) {
+                        _this->hasIndex = ziq2::ziq2_build_index(path, &_this->indexProgress);
+                        _this->indexBuilding = false;
+                    }, _this->fileSelect.path);
+                }
+            }
+        }
+
         if (_this->running)
             style::beginDisabled();
         ImGui::Checkbox("Enforce Realtime", &_this->enforce_realtime_samplerate);
         if (_this->running)
             style::endDisabled();
+
+        if (_this->running) {
+            dsp::BasebandReaderStats stats = _this->baseband_reader.get_stats();
+            ImGui::Text("Decoding: %.2f MS/s", stats.decodeRate);
+            ImGui::Text("Read-ahead: %d/%d blocks", stats.queueFill, stats.queueSize);
+        }
     }
 
     static void worker(void* ctx) {
@@ -206,8 +258,8 @@ private:
         double sampleRate = _this->sampleRate;
         int blockSize = sampleRate / 200.0f;
 
-        _this->baseband_reader.set_file(_this->fileSelect.path, dsp::basebandTypeFromString(_this->baseband_type));
         _this->baseband_reader.should_repeat = true;
+        _this->baseband_reader.set_file(_this->fileSelect.path, dsp::basebandTypeFromString(_this->baseband_type));
 
         uint64_t total_samples = 0;
         auto start_time_point = std::chrono::steady_clock::now();
@@ -256,6 +308,11 @@ private:
     int select_sample_format = 0;
     std::string baseband_type = "f32";
     dsp::BasebandReader baseband_reader;
+
+    std::atomic<bool> hasIndex = false;
+    std::atomic<bool> indexBuilding = false;
+    std::atomic<float> indexProgress = 0.0f;
+    std::thread indexThread;
 };
 
 MOD_EXPORT void _INIT_() {
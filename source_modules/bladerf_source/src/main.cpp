@@ -47,6 +47,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         refresh();
 
@@ -386,6 +387,7 @@ private:
         // Enable streaming
         bladerf_enable_module(_this->openDev, BLADERF_CHANNEL_RX(_this->chanId), true);
 
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         _this->workerThread = std::thread(&BladeRFSourceModule::worker, _this);
 
@@ -396,6 +398,7 @@ private:
         BladeRFSourceModule* _this = (BladeRFSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         _this->stream.stopWriter();
 
         _this->streamingEnabled = false;
@@ -548,6 +551,7 @@ private:
 
             // Convert to complex float and swap buffers
             volk_16i_s32f_convert_32f((float*)stream.writeBuf, buffer, 32768.0f, bufferSize * 2);
+            health.delivered(bufferSize);
             if (!stream.swap(bufferSize)) { break; }
         }
 
@@ -560,6 +564,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     double freq;
     int devId = 0;
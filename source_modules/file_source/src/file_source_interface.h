@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+
+enum {
+    FILE_SOURCE_IFACE_CMD_GET_PROGRESS,
+    FILE_SOURCE_IFACE_CMD_SEEK,
+    FILE_SOURCE_IFACE_CMD_GET_SPEED_MODE,
+    FILE_SOURCE_IFACE_CMD_SET_SPEED_MODE
+};
+
+enum {
+    FILE_SOURCE_SPEED_REALTIME,
+    FILE_SOURCE_SPEED_MAX
+};
+
+struct FileSourceProgress {
+    uint64_t position;  // In samples
+    uint64_t length;    // In samples
+    double sampleRate;
+    bool finished;      // Reached the end of a file that isn't looped
+};
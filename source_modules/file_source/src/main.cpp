@@ -4,10 +4,16 @@
 #include <gui/gui.h>
 #include <signal_path/signal_path.h>
 #include <wavreader.h>
+#include <file_source_interface.h>
 #include <core.h>
 #include <gui/widgets/file_select.h>
+#include <gui/style.h>
+#include <utils/optionlist.h>
 #include <filesystem>
 #include <regex>
+#include <atomic>
+#include <mutex>
+#include <chrono>
 #include <gui/tuner.h>
 
 #define CONCAT(a, b) ((std::string(a) + b).c_str())
@@ -29,9 +35,20 @@ public:
 
         if (core::args["server"].b()) { return; }
 
+        speedModes.define("realtime", "Realtime", FILE_SOURCE_SPEED_REALTIME);
+        speedModes.define("max", "Max speed", FILE_SOURCE_SPEED_MAX);
+
         config.acquire();
         fileSelect.setPath(config.conf["path"], true);
+        if (config.conf.contains("speed")) {
+            std::string speedKey = config.conf["speed"];
+            if (speedModes.keyExists(speedKey)) { speedModeId = speedModes.keyId(speedKey); }
+        }
+        if (config.conf.contains("loop")) {
+            loop = config.conf["loop"];
+        }
         config.release();
+        speedMode = speedModes[speedModeId];
 
         handler.ctx = this;
         handler.selectHandler = menuSelected;
@@ -42,11 +59,16 @@ public:
         handler.tuneHandler = tune;
         handler.stream = &stream;
         sigpath::sourceManager.registerSource("File", &handler);
+
+        core::modComManager.registerInterface("file_source", name, moduleInterfaceHandler, this);
     }
 
     ~FileSourceModule() {
+        if (eofThread.joinable()) { eofThread.join(); }
         stop(this);
         sigpath::sourceManager.unregisterSource("File");
+        core::modComManager.unregisterInterface(name);
+        delete reader;
     }
 
     void postInit() {}
@@ -86,8 +108,20 @@ private:
 
     static void start(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
+        if (_this->eofThread.joinable()) { _this->eofThread.join(); }
         if (_this->running) { return; }
+        std::lock_guard<std::mutex> lck(_this->readerMtx);
         if (_this->reader == NULL) { return; }
+
+        // The samples are read straight from the file, the bit depth in its header picks the worker
+        int depth = _this->reader->getBitDepth();
+        if (_this->reader->getChannelCount() != 2 || (depth != 16 && depth != 32)) {
+            flog::error("FileSourceModule '{0}': Expected a 16 or 32bit stereo file, got {1}bit with {2} channels", _this->name, depth, _this->reader->getChannelCount());
+            return;
+        }
+        _this->float32Mode = (depth == 32);
+
+        _this->finished = false;
         _this->running = true;
         _this->workerThread = _this->float32Mode ? std::thread(floatWorker, _this) : std::thread(worker, _this);
         flog::info("FileSourceModule '{0}': Start!", _this->name);
@@ -96,12 +130,13 @@ private:
     static void stop(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
         if (!_this->running) { return; }
-        if (_this->reader == NULL) { return; }
         _this->stream.stopWriter();
         _this->workerThread.join();
         _this->stream.clearWriteStop();
         _this->running = false;
-        _this->reader->rewind();
+        _this->finished = false;
+        std::lock_guard<std::mutex> lck(_this->readerMtx);
+        if (_this->reader) { _this->reader->rewind(); }
         flog::info("FileSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -115,13 +150,26 @@ private:
 
         if (_this->fileSelect.render("##file_source_" + _this->name)) {
             if (_this->fileSelect.pathIsValid()) {
-                if (_this->reader != NULL) {
-                    _this->reader->close();
-                    delete _this->reader;
+                {
+                    std::lock_guard<std::mutex> lck(_this->readerMtx);
+                    if (_this->reader != NULL) {
+                        _this->reader->close();
+                        delete _this->reader;
+                        _this->reader = NULL;
+                    }
                 }
                 try {
-                    _this->reader = new WavReader(_this->fileSelect.path);
-                    _this->sampleRate = _this->reader->getSampleRate();
+                    WavReader* reader = new WavReader(_this->fileSelect.path);
+                    if (!reader->isValid()) {
+                        delete reader;
+                        throw std::runtime_error("Invalid or unsupported WAV file");
+                    }
+                    _this->sampleRate = reader->getSampleRate();
+                    _this->float32Mode = (reader->getBitDepth() == 32);
+                    {
+                        std::lock_guard<std::mutex> lck(_this->readerMtx);
+                        _this->reader = reader;
+                    }
                     core::setInputSampleRate(_this->sampleRate);
                     std::string filename = std::filesystem::path(_this->fileSelect.path).filename().string();
                     _this->centerFreq = _this->getFrequency(filename);
@@ -139,36 +187,162 @@ private:
             }
         }
 
+        // Only shows the format of the file, reading it any other way would give garbage
+        style::beginDisabled();
         ImGui::Checkbox("Float32 Mode##_file_source", &_this->float32Mode);
+        style::endDisabled();
+
+        ImGui::LeftLabel("Speed");
+        ImGui::FillWidth();
+        if (ImGui::Combo(CONCAT("##_file_source_speed_", _this->name), &_this->speedModeId, _this->speedModes.txt)) {
+            _this->speedMode = _this->speedModes[_this->speedModeId];
+            config.acquire();
+            config.conf["speed"] = _this->speedModes.key(_this->speedModeId);
+            config.release(true);
+        }
+
+        if (ImGui::Checkbox(CONCAT("Loop##_file_source_loop_", _this->name), &_this->loop)) {
+            config.acquire();
+            config.conf["loop"] = _this->loop;
+            config.release(true);
+        }
+
+        // Position, dragging it seeks
+        FileSourceProgress progress;
+        _this->getProgress(progress);
+        if (progress.length) {
+            // In samples so that long files can still be positioned exactly
+            uint64_t pos = progress.position;
+            uint64_t start = 0;
+            char posStr[128];
+            int p = (double)progress.position / progress.sampleRate;
+            int l = (double)progress.length / progress.sampleRate;
+            sprintf(posStr, "%02d:%02d:%02d / %02d:%02d:%02d", p / 3600, (p / 60) % 60, p % 60, l / 3600, (l / 60) % 60, l % 60);
+            ImGui::FillWidth();
+            if (ImGui::SliderScalar(CONCAT("##_file_source_pos_", _this->name), ImGuiDataType_U64, &pos, &start, &progress.length, posStr)) {
+                _this->seek(pos);
+            }
+        }
     }
 
     static void worker(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
-        double sampleRate = _this->reader->getSampleRate();
+        double sampleRate = _this->sampleRate;
         int blockSize = sampleRate / 200.0f;
-        int16_t* inBuf = new int16_t[blockSize * 2];
+        auto nextTime = std::chrono::steady_clock::now();
 
         while (true) {
-            _this->reader->readSamples(inBuf, blockSize * 2 * sizeof(int16_t));
-            volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, inBuf, 32768.0f, blockSize * 2);
-            if (!_this->stream.swap(blockSize)) { break; };
+            // The data points into the reader's mapping, only use it with the reader locked
+            int count;
+            {
+                std::lock_guard<std::mutex> lck(_this->readerMtx);
+                const void* data;
+                count = _this->readBlock(&data, blockSize, nextTime);
+                if (count) { volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, (const int16_t*)data, 32768.0f, count * 2); }
+            }
+            if (!count) { break; }
+            if (!_this->stream.swap(count)) { break; };
+            _this->pace(nextTime, count, sampleRate);
         }
-
-        delete[] inBuf;
+        if (_this->finished) { _this->endOfFile(); }
     }
 
     static void floatWorker(void* ctx) {
         FileSourceModule* _this = (FileSourceModule*)ctx;
-        double sampleRate = _this->reader->getSampleRate();
+        double sampleRate = _this->sampleRate;
         int blockSize = sampleRate / 200.0f;
-        dsp::complex_t* inBuf = new dsp::complex_t[blockSize];
+        auto nextTime = std::chrono::steady_clock::now();
 
         while (true) {
-            _this->reader->readSamples(_this->stream.writeBuf, blockSize * sizeof(dsp::complex_t));
-            if (!_this->stream.swap(blockSize)) { break; };
+            int count;
+            {
+                std::lock_guard<std::mutex> lck(_this->readerMtx);
+                const void* data;
+                count = _this->readBlock(&data, blockSize, nextTime);
+                if (count) { memcpy(_this->stream.writeBuf, data, count * sizeof(dsp::complex_t)); }
+            }
+            if (!count) { break; }
+            if (!_this->stream.swap(count)) { break; };
+            _this->pace(nextTime, count, sampleRate);
+        }
+        if (_this->finished) { _this->endOfFile(); }
+    }
+
+    // Stop once a file that isn't looped has been played through. Stopping the source joins the worker,
+    // so it's done from another thread, which is joined on the next start.
+    void endOfFile() {
+        eofThread = std::thread([]() { gui::mainWindow.setPlayState(false); });
+    }
+
+    // Must be called with the reader locked
+    int readBlock(const void** data, int blockSize, std::chrono::steady_clock::time_point& nextTime) {
+        if (!reader) { return 0; }
+
+        // Apply any pending seek, done here so that the reader is only ever moved by the worker while running
+        int64_t target = seekTarget.exchange(-1);
+        if (target >= 0) {
+            reader->seek(target);
+            nextTime = std::chrono::steady_clock::now();
+        }
+
+        int count = reader->readSamples(data, blockSize);
+        if (!count && loop) {
+            reader->rewind();
+            count = reader->readSamples(data, blockSize);
         }
+        if (!count) { finished = true; }
+        return count;
+    }
 
-        delete[] inBuf;
+    void pace(std::chrono::steady_clock::time_point& nextTime, int count, double sampleRate) {
+        auto now = std::chrono::steady_clock::now();
+        if (speedMode == FILE_SOURCE_SPEED_MAX) {
+            nextTime = now;
+            return;
+        }
+
+        // Don't try to catch up after falling behind by a lot, eg. when the DSP was blocked
+        nextTime += std::chrono::nanoseconds((int64_t)((double)count * 1e9 / sampleRate));
+        if (now - nextTime > std::chrono::milliseconds(100)) { nextTime = now; }
+        std::this_thread::sleep_until(nextTime);
+    }
+
+    void seek(uint64_t sample) {
+        std::lock_guard<std::mutex> lck(readerMtx);
+        if (!reader) { return; }
+        if (running) {
+            seekTarget = std::min<uint64_t>(sample, reader->getSampleCount());
+        }
+        else {
+            reader->seek(sample);
+        }
+    }
+
+    static void moduleInterfaceHandler(int code, void* in, void* out, void* ctx) {
+        FileSourceModule* _this = (FileSourceModule*)ctx;
+        if (code == FILE_SOURCE_IFACE_CMD_GET_PROGRESS && out) {
+            _this->getProgress(*(FileSourceProgress*)out);
+        }
+        else if (code == FILE_SOURCE_IFACE_CMD_SEEK && in) {
+            _this->seek(*(uint64_t*)in);
+        }
+        else if (code == FILE_SOURCE_IFACE_CMD_GET_SPEED_MODE && out) {
+            *(int*)out = _this->speedMode;
+        }
+        else if (code == FILE_SOURCE_IFACE_CMD_SET_SPEED_MODE && in) {
+            int mode = *(int*)in;
+            if (!_this->speedModes.valueExists(mode)) { return; }
+            _this->speedModeId = _this->speedModes.valueId(mode);
+            _this->speedMode = mode;
+        }
+    }
+
+    void getProgress(FileSourceProgress& progress) {
+        std::lock_guard<std::mutex> lck(readerMtx);
+        progress.position = reader ? reader->getPosition() : 0;
+        progress.length = reader ? reader->getSampleCount() : 0;
+        progress.sampleRate = reader ? reader->getSampleRate() : 0.0;
+        progress.finished = finished;
     }
 
     double getFrequency(std::string filename) {
@@ -185,6 +359,8 @@ private:
     dsp::stream<dsp::complex_t> stream;
     SourceManager::SourceHandler handler;
     WavReader* reader = NULL;
+    std::mutex readerMtx;       // Guards the reader, used by the GUI, the worker and other modules through the interface
+    std::thread eofThread;
     bool running = false;
     bool enabled = true;
     float sampleRate = 1000000;
@@ -193,11 +369,20 @@ private:
     double centerFreq = 100000000;
 
     bool float32Mode = false;
+
+    OptionList<std::string, int> speedModes;
+    int speedModeId = 0;
+    std::atomic<int> speedMode = FILE_SOURCE_SPEED_REALTIME;
+    bool loop = true;
+    std::atomic<bool> finished = false;
+    std::atomic<int64_t> seekTarget = -1;
 };
 
 MOD_EXPORT void _INIT_() {
     json def = json({});
     def["path"] = "";
+    def["speed"] = "realtime";
+    def["loop"] = true;
     config.setPath(core::args["root"].s() + "/file_source_config.json");
     config.load(def);
     config.enableAutoSave();
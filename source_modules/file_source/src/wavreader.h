@@ -1,82 +1,186 @@
-#pragma once
-
 #pragma once
 #include <stdint.h>
 #include <string.h>
-#include <fstream>
+#include <string>
+#include <atomic>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define WAV_SIGNATURE       "RIFF"
+#define RF64_SIGNATURE      "RF64"
+#define DS64_MARK           "ds64"
 #define WAV_TYPE            "WAVE"
 #define WAV_FORMAT_MARK     "fmt "
 #define WAV_DATA_MARK       "data"
 #define WAV_SAMPLE_TYPE_PCM 1
 
+// Amount of data to ask the OS to prefetch after a seek
+#define WAV_READAHEAD_SIZE  (16 * 1024 * 1024)
+
+// Memory mapped WAV reader, the samples are read straight from the page cache without copying
 class WavReader {
 public:
     WavReader(std::string path) {
-        file = std::ifstream(path.c_str(), std::ios::binary);
-        file.read((char*)&hdr, sizeof(WavHeader_t));
-        valid = false;
-        if (memcmp(hdr.signature, "RIFF", 4) != 0) { return; }
-        if (memcmp(hdr.fileType, "WAVE", 4) != 0) { return; }
-        valid = true;
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) { return; }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || !size.QuadPart) { return; }
+        fileSize = size.QuadPart;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping) { return; }
+        map = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!map) { return; }
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) { return; }
+        struct stat st;
+        if (fstat(fd, &st) || !st.st_size) { return; }
+        fileSize = st.st_size;
+        void* ptr = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) { return; }
+        map = (uint8_t*)ptr;
+        madvise(map, fileSize, MADV_SEQUENTIAL);
+#endif
+        valid = parseHeader();
+    }
+
+    ~WavReader() {
+        close();
     }
 
     uint16_t getBitDepth() {
-        return hdr.bitDepth;
+        return bitDepth;
     }
 
     uint16_t getChannelCount() {
-        return hdr.channelCount;
+        return channelCount;
     }
 
     uint32_t getSampleRate() {
-        return hdr.sampleRate;
+        return sampleRate;
     }
 
     bool isValid() {
         return valid;
     }
 
-    void readSamples(void* data, size_t size) {
-        char* _data = (char*)data;
-        file.read(_data, size);
-        int read = file.gcount();
-        if (read < size) {
-            file.clear();
-            file.seekg(sizeof(WavHeader_t));
-            file.read(&_data[read], size - read);
+    // Length of the data in samples (one sample being one value of each channel)
+    uint64_t getSampleCount() {
+        return sampleCount;
+    }
+
+    uint64_t getPosition() {
+        return position;
+    }
+
+    void seek(uint64_t sample) {
+        position = std::min<uint64_t>(sample, sampleCount);
+#ifndef _WIN32
+        // Start fetching from the new position right away instead of faulting page by page
+        if (valid) {
+            size_t pageSize = sysconf(_SC_PAGESIZE);
+            size_t begin = dataOffset + position * frameSize;
+            size_t alignedBegin = begin - (begin % pageSize);
+            size_t len = std::min<size_t>(WAV_READAHEAD_SIZE, fileSize - alignedBegin);
+            madvise(&map[alignedBegin], len, MADV_WILLNEED);
         }
-        bytesRead += size;
+#endif
     }
 
     void rewind() {
-        file.seekg(sizeof(WavHeader_t));
+        seek(0);
+    }
+
+    // Get a pointer to at most count samples at the current position and advance past them.
+    // Returns the number of samples available, which is less than requested at the end of the data.
+    size_t readSamples(const void** data, size_t count) {
+        uint64_t pos = position;
+        size_t n = std::min<uint64_t>(count, sampleCount - pos);
+        *data = &map[dataOffset + pos * frameSize];
+        position = pos + n;
+        return n;
     }
 
     void close() {
-        file.close();
+#ifdef _WIN32
+        if (map) { UnmapViewOfFile(map); }
+        if (mapping) { CloseHandle(mapping); }
+        if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (map) { munmap(map, fileSize); }
+        if (fd >= 0) { ::close(fd); }
+        fd = -1;
+#endif
+        map = NULL;
+        valid = false;
     }
 
 private:
-    struct WavHeader_t {
-        char signature[4];           // "RIFF"
-        uint32_t fileSize;           // data bytes + sizeof(WavHeader_t) - 8
-        char fileType[4];            // "WAVE"
-        char formatMarker[4];        // "fmt "
-        uint32_t formatHeaderLength; // Always 16
-        uint16_t sampleType;         // PCM (1)
-        uint16_t channelCount;
-        uint32_t sampleRate;
-        uint32_t bytesPerSecond;
-        uint16_t bytesPerSample;
-        uint16_t bitDepth;
-        char dataMarker[4]; // "data"
-        uint32_t dataSize;
-    };
+    bool parseHeader() {
+        if (fileSize < 12) { return false; }
+        if (memcmp(&map[0], WAV_SIGNATURE, 4) != 0 && memcmp(&map[0], RF64_SIGNATURE, 4) != 0) { return false; }
+        if (memcmp(&map[8], WAV_TYPE, 4) != 0) { return false; }
+
+        // Walk the chunks until the data, picking up the format on the way
+        bool gotFormat = false;
+        uint64_t ds64DataSize = 0;
+        size_t offset = 12;
+        while (offset + 8 <= fileSize) {
+            uint32_t chunkSize;
+            memcpy(&chunkSize, &map[offset + 4], 4);
+            if (!memcmp(&map[offset], WAV_FORMAT_MARK, 4) && offset + 8 + 16 <= fileSize) {
+                memcpy(&channelCount, &map[offset + 10], 2);
+                memcpy(&sampleRate, &map[offset + 12], 4);
+                memcpy(&bitDepth, &map[offset + 22], 2);
+                gotFormat = true;
+            }
+            else if (!memcmp(&map[offset], DS64_MARK, 4) && offset + 8 + 16 <= fileSize) {
+                // RF64 gives the real data size here, the data chunk only has 0xFFFFFFFF
+                memcpy(&ds64DataSize, &map[offset + 16], 8);
+            }
+            else if (!memcmp(&map[offset], WAV_DATA_MARK, 4)) {
+                if (!gotFormat || !channelCount || !bitDepth) { return false; }
+                dataOffset = offset + 8;
+                frameSize = channelCount * (bitDepth / 8);
+                if (!frameSize) { return false; }
+
+                // Recordings that weren't closed properly have a wrong size, use whatever is in the file
+                uint64_t dataSize = std::min<uint64_t>((chunkSize == 0xFFFFFFFF && ds64DataSize) ? ds64DataSize : chunkSize, fileSize - dataOffset);
+                if (!chunkSize) { dataSize = fileSize - dataOffset; }
+                sampleCount = dataSize / frameSize;
+                return true;
+            }
+            offset += 8 + chunkSize + (chunkSize & 1);
+        }
+        return false;
+    }
 
     bool valid = false;
-    std::ifstream file;
-    size_t bytesRead = 0;
-    WavHeader_t hdr;
-};
\ No newline at end of file
+    uint8_t* map = NULL;
+    size_t fileSize = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+
+    uint16_t channelCount = 0;
+    uint32_t sampleRate = 0;
+    uint16_t bitDepth = 0;
+    size_t dataOffset = 0;
+    size_t frameSize = 0;
+    uint64_t sampleCount = 0;
+    std::atomic<uint64_t> position = 0;
+};
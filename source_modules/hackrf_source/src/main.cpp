@@ -97,6 +97,8 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.stream8 = &stream8;
+        handler.health = &health;
 
         refresh();
 
@@ -265,6 +267,7 @@ private:
 
         hackrf_start_rx(_this->openDev, callback, _this);
 
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         flog::info("HackRFSourceModule '{0}': Start!", _this->name);
     }
@@ -273,13 +276,16 @@ private:
         HackRFSourceModule* _this = (HackRFSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         _this->stream.stopWriter();
+        _this->stream8.stopWriter();
         // TODO: Stream stop
         hackrf_error err = (hackrf_error)hackrf_close(_this->openDev);
         if (err != HACKRF_SUCCESS) {
             flog::error("Could not close HackRF {0}: {1}", _this->selectedSerial, hackrf_error_name(err));
         }
         _this->stream.clearWriteStop();
+        _this->stream8.clearWriteStop();
         flog::info("HackRFSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -378,8 +384,16 @@ private:
 
     static int callback(hackrf_transfer* transfer) {
         HackRFSourceModule* _this = (HackRFSourceModule*)transfer->rx_ctx;
-        volk_8i_s32f_convert_32f((float*)_this->stream.writeBuf, (int8_t*)transfer->buffer, 128.0f, transfer->valid_length);
-        if (!_this->stream.swap(transfer->valid_length / 2)) { return -1; }
+        int count = transfer->valid_length / 2;
+        _this->health.delivered(count);
+        if (_this->handler.nativeOutput) {
+            memcpy(_this->stream8.writeBuf, transfer->buffer, transfer->valid_length);
+            if (!_this->stream8.swap(count)) { return -1; }
+        }
+        else {
+            volk_8i_s32f_convert_32f((float*)_this->stream.writeBuf, (int8_t*)transfer->buffer, 128.0f, transfer->valid_length);
+            if (!_this->stream.swap(count)) { return -1; }
+        }
         return 0;
     }
 
@@ -387,8 +401,10 @@ private:
     hackrf_device* openDev;
     bool enabled = true;
     dsp::stream<dsp::complex_t> stream;
+    dsp::stream<dsp::complex8_t> stream8;
     int sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     double freq;
     std::string selectedSerial = "";
@@ -1,9 +1,15 @@
 #include "hermes.h"
 #include <utils/flog.h>
+#include <volk/volk.h>
+#include <algorithm>
 
 namespace hermes {
     Client::Client(std::shared_ptr<net::Socket> sock) {
         this->sock = sock;
+        updateBlockSize();
+
+        // Give the kernel room to absorb bursts while a batch is being processed
+        sock->setRecvBufferSize(HERMES_RECV_BUFFER_SIZE);
 
         // Start worker
         workerThread = std::thread(&Client::worker, this);
@@ -19,6 +25,9 @@ namespace hermes {
     }
 
     void Client::start() {
+        // The device restarts its sequence numbers with the stream
+        seqValid = false;
+
         // Start metis stream
         for (int i = 0; i < HERMES_METIS_REPEAT; i++) {
             sendMetisControl((MetisControl)(METIS_CTRL_IQ | METIS_CTRL_NO_WD));
@@ -33,6 +42,27 @@ namespace hermes {
 
     void Client::setSamplerate(HermesLiteSamplerate samplerate) {
         writeReg(0, (uint32_t)samplerate << 24);
+        this->samplerate = 48000 << samplerate;
+        updateBlockSize();
+    }
+
+    void Client::setLatency(int ms) {
+        latency = ms;
+        updateBlockSize();
+    }
+
+    Stats Client::getStats() {
+        Stats stats;
+        stats.packets = packets;
+        stats.lost = lost;
+        stats.reordered = reordered;
+        return stats;
+    }
+
+    void Client::updateBlockSize() {
+        // Keep room for a whole frame past the block size
+        int size = ((int64_t)samplerate * latency) / 1000;
+        blockSize = std::clamp<int>(size, HERMES_SAMPLES_PER_FRAME, STREAM_BUFFER_SIZE - HERMES_SAMPLES_PER_FRAME);
     }
 
     void Client::setFrequency(double freq) {
@@ -155,53 +185,92 @@ namespace hermes {
     }
 
     void Client::worker() {
-        uint8_t rbuf[2048];
-        MetisUSBPacket* pkt = (MetisUSBPacket*)rbuf;
+        std::vector<uint8_t> rbuf(HERMES_RECV_BATCH * HERMES_MAX_PACKET_SIZE);
+        int lens[HERMES_RECV_BATCH];
+        int filled = 0;
         while (true) {
-            // Wait for a packet or exit if connection closed
-            int len = sock->recv(rbuf, 2048);
-            if (len <= 0) { break; }
-
-            // Ignore anything that's not a USB packet
-            if (htons(pkt->hdr.signature) != HERMES_METIS_SIGNATURE || pkt->hdr.type != METIS_PKT_USB) {
+            // Wait for a batch of packets or exit if connection closed. Real errors close the socket, anything
+            // else (a wakeup with nothing to read, an interrupted wait) is retried.
+            int count = sock->recvmulti(rbuf.data(), lens, HERMES_MAX_PACKET_SIZE, HERMES_RECV_BATCH, HERMES_RECV_TIMEOUT);
+            if (!sock->isOpen()) { break; }
+            if (count < 0) { continue; }
+
+            // On timeout, send out what was accumulated so it doesn't go stale
+            if (!count) {
+                if (filled && health) { health->delivered(filled); }
+                if (filled && !out.swap(filled)) { break; }
+                filled = 0;
                 continue;
             }
 
-            // Parse frames
-            for (int frn = 0; frn < 2; frn++) {
-                uint8_t* frame = pkt->frame[frn];
-                HPSDRUSBHeader* hdr = (HPSDRUSBHeader*)frame;
+            for (int p = 0; p < count; p++) {
+                MetisUSBPacket* pkt = (MetisUSBPacket*)&rbuf[p * HERMES_MAX_PACKET_SIZE];
 
-                // Make sure this is a valid frame by checking the sync
-                if (hdr->sync[0] != 0x7F || hdr->sync[1] != 0x7F || hdr->sync[2] != 0x7F) {
+                // Ignore anything that's not a USB packet
+                if (lens[p] < (int)sizeof(MetisUSBPacket) || htons(pkt->hdr.signature) != HERMES_METIS_SIGNATURE || pkt->hdr.type != METIS_PKT_USB) {
                     continue;
                 }
-
-                // Check if this is a response
-                if (hdr->c0 & (1 << 7)) {
-                    uint8_t reg = (hdr->c0 >> 1) & 0x3F;
-                    flog::warn("Got response! Reg={0}, Seq={1}", reg, (uint32_t)htonl(pkt->seq));
+                checkSequence(htonl(pkt->seq));
+
+                // Parse frames
+                for (int frn = 0; frn < 2; frn++) {
+                    uint8_t* frame = pkt->frame[frn];
+                    HPSDRUSBHeader* hdr = (HPSDRUSBHeader*)frame;
+
+                    // Make sure this is a valid frame by checking the sync
+                    if (hdr->sync[0] != 0x7F || hdr->sync[1] != 0x7F || hdr->sync[2] != 0x7F) {
+                        continue;
+                    }
+
+                    // Check if this is a response
+                    if (hdr->c0 & (1 << 7)) {
+                        uint8_t reg = (hdr->c0 >> 1) & 0x3F;
+                        flog::warn("Got response! Reg={0}, Seq={1}", reg, (uint32_t)htonl(pkt->seq));
+                    }
+
+                    // Decode IQ and send it once enough has been accumulated
+                    unpackFrame(&frame[8], &out.writeBuf[filled]);
+                    filled += HERMES_SAMPLES_PER_FRAME;
+                    if (filled >= blockSize) {
+                        if (health) { health->delivered(filled); }
+                        if (!out.swap(filled)) { return; }
+                        filled = 0;
+                    }
                 }
+            }
+        }
+    }
 
-                // Decode and send IQ to stream
-                uint8_t* iq = &frame[8];
-                for (int i = 0; i < 63; i++) {
-                    // Convert to 32bit
-                    int32_t si = ((uint32_t)iq[(i*8) + 0] << 16) | ((uint32_t)iq[(i*8) + 1] << 8) | (uint32_t)iq[(i*8) + 2];
-                    int32_t sq = ((uint32_t)iq[(i*8) + 3] << 16) | ((uint32_t)iq[(i*8) + 4] << 8) | (uint32_t)iq[(i*8) + 5];
-                    
-                    // Sign extend
-                    si = (si << 8) >> 8;
-                    sq = (sq << 8) >> 8;
-
-                    // Convert to float (IQ swapped for some reason)
-                    out.writeBuf[i].im = (float)si / (float)0x1000000;
-                    out.writeBuf[i].re = (float)sq / (float)0x1000000;
-                }
-                out.swap(63);
-                // TODO: Buffer the data to avoid having a very high DSP frame rate
-            }            
+    void Client::checkSequence(uint32_t seq) {
+        packets++;
+        if (seqValid) {
+            int32_t diff = (int32_t)(seq - (lastSeq + 1));
+            if (diff > 0) {
+                lost += diff;
+                if (health) { health->gap((uint64_t)diff * 2 * HERMES_SAMPLES_PER_FRAME); }
+            }
+            else if (diff < 0) {
+                // Late packet, its data is used but the sequence doesn't go back
+                reordered++;
+                return;
+            }
+        }
+        lastSeq = seq;
+        seqValid = true;
+    }
+
+    void Client::unpackFrame(const uint8_t* iq, dsp::complex_t* out) {
+        // Each sample is 24bit big endian I and Q followed by 16bit of mic audio. The samples are
+        // placed in the upper bits of 32bit integers so that no sign extension is needed
+        int32_t ibuf[HERMES_SAMPLES_PER_FRAME * 2];
+        for (int i = 0; i < HERMES_SAMPLES_PER_FRAME; i++) {
+            const uint8_t* s = &iq[i * 8];
+
+            // IQ swapped for some reason
+            ibuf[(i * 2) + 0] = (int32_t)(((uint32_t)s[3] << 24) | ((uint32_t)s[4] << 16) | ((uint32_t)s[5] << 8));
+            ibuf[(i * 2) + 1] = (int32_t)(((uint32_t)s[0] << 24) | ((uint32_t)s[1] << 16) | ((uint32_t)s[2] << 8));
         }
+        volk_32i_s32f_convert_32f((float*)out, ibuf, 4294967296.0f, HERMES_SAMPLES_PER_FRAME * 2);
     }
 
     std::vector<Info> discover() {
@@ -2,10 +2,12 @@
 #include <utils/net.h>
 #include <dsp/stream.h>
 #include <dsp/types.h>
+#include <signal_path/source_health.h>
 #include <memory>
 #include <vector>
 #include <string>
 #include <thread>
+#include <atomic>
 
 #define HERMES_METIS_REPEAT     5
 #define HERMES_METIS_TIMEOUT    1000
@@ -13,6 +15,13 @@
 #define HERMES_HPSDR_USB_SYNC   0x7F
 #define HERMES_I2C_DELAY        50
 
+#define HERMES_SAMPLES_PER_FRAME    63
+#define HERMES_MAX_PACKET_SIZE      2048
+#define HERMES_RECV_BATCH           32
+#define HERMES_RECV_BUFFER_SIZE     (4 * 1024 * 1024)
+#define HERMES_RECV_TIMEOUT         100
+#define HERMES_DEFAULT_LATENCY      20
+
 namespace hermes {
     enum MetisPacketType {
         METIS_PKT_USB       = 0x01,
@@ -124,6 +133,12 @@ namespace hermes {
     // };
 #pragma pack(pop)
 
+    struct Stats {
+        uint64_t packets;
+        uint64_t lost;
+        uint64_t reordered;
+    };
+
     class Client {
     public:
         Client(std::shared_ptr<net::Socket> sock);
@@ -138,8 +153,15 @@ namespace hermes {
         void setGain(int gain);
         void autoFilters(double freq);
 
+        // Samples are accumulated until about this many milliseconds worth are available
+        void setLatency(int ms);
+        Stats getStats();
+
         dsp::stream<dsp::complex_t> out;
 
+        // Optional delivery counters of the source, must be set before starting
+        SourceHealth* health = NULL;
+
     //private:
         void sendMetisUSB(uint8_t endpoint, void* frame0, void* frame1 = NULL);
         void sendMetisControl(MetisControl ctrl);
@@ -152,6 +174,9 @@ namespace hermes {
         
 
         void worker();
+        void checkSequence(uint32_t seq);
+        void unpackFrame(const uint8_t* iq, dsp::complex_t* out);
+        void updateBlockSize();
 
         double freq = 0;
 
@@ -160,6 +185,17 @@ namespace hermes {
         uint32_t usbSeq = 0;
         uint8_t lastFilt = 0;
 
+        // Output blocking
+        int samplerate = 48000;
+        int latency = HERMES_DEFAULT_LATENCY;
+        std::atomic<int> blockSize = HERMES_SAMPLES_PER_FRAME;
+
+        // Sequence tracking
+        std::atomic<bool> seqValid = false;
+        uint32_t lastSeq = 0;
+        std::atomic<uint64_t> packets = 0;
+        std::atomic<uint64_t> lost = 0;
+        std::atomic<uint64_t> reordered = 0;
     };
 
     std::vector<Info> discover();
@@ -36,6 +36,22 @@ public:
 
         srId = samplerates.keyId(384000);
 
+        // Define latencies
+        latencies.define(5, "5ms", 5);
+        latencies.define(10, "10ms", 10);
+        latencies.define(20, "20ms", 20);
+        latencies.define(50, "50ms", 50);
+        latencies.define(100, "100ms", 100);
+
+        // Load latency
+        latencyId = latencies.keyId(HERMES_DEFAULT_LATENCY);
+        config.acquire();
+        if (config.conf.contains("latency")) {
+            int lat = config.conf["latency"];
+            if (latencies.keyExists(lat)) { latencyId = latencies.keyId(lat); }
+        }
+        config.release();
+
         lnk.init(NULL, &stream);
 
         sampleRate = 384000.0;
@@ -48,6 +64,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         sigpath::sourceManager.registerSource("Hermes", &handler);
     }
@@ -152,10 +169,13 @@ private:
         
         // TODO: Implement start
         _this->dev = hermes::open(_this->devices[_this->devId].addr);
+        _this->dev->setLatency(_this->latencies[_this->latencyId]);
 
         // TODO: STOP USING A LINK, FIND A BETTER WAY
         _this->lnk.setInput(&_this->dev->out);
         _this->lnk.start();
+        _this->health.start(_this->sampleRate);
+        _this->dev->health = &_this->health;
         _this->dev->start();
 
         // TODO: Check if the USB commands are accepted before start
@@ -171,6 +191,7 @@ private:
         HermesSourceModule* _this = (HermesSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         
         // TODO: Implement stop
         _this->dev->stop();
@@ -231,6 +252,17 @@ private:
 
         // TODO: Device parameters
 
+        SmGui::LeftLabel("Latency");
+        SmGui::FillWidth();
+        if (SmGui::Combo(CONCAT("##_hermes_latency_", _this->name), &_this->latencyId, _this->latencies.txt)) {
+            if (_this->running) {
+                _this->dev->setLatency(_this->latencies[_this->latencyId]);
+            }
+            config.acquire();
+            config.conf["latency"] = _this->latencies.key(_this->latencyId);
+            config.release(true);
+        }
+
         SmGui::LeftLabel("LNA Gain");
         SmGui::FillWidth();
         if (SmGui::SliderInt("##hermes_source_lna_gain", &_this->gain, 0, 60)) {
@@ -243,6 +275,13 @@ private:
                 config.release(true);
             }
         }
+
+        if (_this->running) {
+            char buf[128];
+            hermes::Stats stats = _this->dev->getStats();
+            sprintf(buf, "Packets lost: %llu, reordered: %llu", (unsigned long long)stats.lost, (unsigned long long)stats.reordered);
+            SmGui::Text(buf);
+        }
     }
 
     std::string name;
@@ -251,16 +290,19 @@ private:
     dsp::routing::StreamLink<dsp::complex_t> lnk;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     std::string selectedMac = "";
 
     OptionList<std::string, hermes::Info> devices;
     OptionList<int, hermes::HermesLiteSamplerate> samplerates;
+    OptionList<int, int> latencies;
 
     double freq;
     int devId = 0;
     int srId = 0;
     int gain = 0;
+    int latencyId = 0;
 
     bool firstSelect = true;
 
@@ -38,6 +38,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         refresh();
 
@@ -357,6 +358,7 @@ private:
         LMS_SetupStream(_this->openDev, &_this->devStream);
 
         // Start stream
+        _this->health.start(_this->sampleRate);
         _this->streamRunning = true;
         LMS_StartStream(&_this->devStream);
         _this->workerThread = std::thread(&LimeSDRSourceModule::worker, _this);
@@ -370,6 +372,7 @@ private:
         LimeSDRSourceModule* _this = (LimeSDRSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
 
         _this->streamRunning = false;
         if (_this->workerThread.joinable()) { _this->workerThread.join(); }
@@ -482,8 +485,19 @@ private:
     void worker() {
         int sampCount = sampleRate / 200;
         lms_stream_meta_t meta;
+        bool timestampValid = false;
+        uint64_t nextTimestamp = 0;
         while (streamRunning) {
             int ret = LMS_RecvStream(&devStream, stream.writeBuf, sampCount, &meta, 1000);
+
+            // The timestamp counts samples, a jump means some were dropped
+            if (ret > 0) {
+                if (timestampValid && meta.timestamp > nextTimestamp) { health.gap(meta.timestamp - nextTimestamp); }
+                nextTimestamp = meta.timestamp + ret;
+                timestampValid = true;
+                health.delivered(ret);
+            }
+
             if (!stream.swap(sampCount) || ret < 0) { break; }
         }
     }
@@ -492,6 +506,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     bool enabled = true;
     bool streamRunning = false;
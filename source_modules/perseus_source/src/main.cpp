@@ -39,6 +39,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         perseus_set_debug(9);
 
@@ -290,6 +291,7 @@ private:
             return;
         }
 
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         flog::info("PerseusSourceModule '{0}': Start!", _this->name);
     }
@@ -298,6 +300,7 @@ private:
         PerseusSourceModule* _this = (PerseusSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
 
         // Stop stream
         _this->stream.stopWriter();
@@ -419,6 +422,7 @@ private:
             _this->stream.writeBuf[i].re = ((float)re / (float)0x7FFFFF);
             _this->stream.writeBuf[i].im = ((float)im / (float)0x7FFFFF);
         }
+        _this->health.delivered(sampleCount);
         _this->stream.swap(sampleCount);
         return 0;
     }
@@ -428,6 +432,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     int sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     double freq;
     int devId = 0;
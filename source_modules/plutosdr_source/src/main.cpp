@@ -68,6 +68,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
         sigpath::sourceManager.registerSource("PlutoSDR", &handler);
     }
 
@@ -150,6 +151,7 @@ private:
         iio_channel_attr_write_longlong(iio_device_find_channel(_this->phy, "voltage0", false), "hardwaregain", round(_this->gain));             // gain
         ad9361_set_bb_rate(_this->phy, round(_this->sampleRate));
 
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         _this->workerThread = std::thread(worker, _this);
         flog::info("PlutoSDRSourceModule '{0}': Start!", _this->name);
@@ -159,6 +161,7 @@ private:
         PlutoSDRSourceModule* _this = (PlutoSDRSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         _this->stream.stopWriter();
         _this->workerThread.join();
         _this->stream.clearWriteStop();
@@ -264,6 +267,7 @@ private:
 
             volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, buf, 32768.0f, blockSize * 2);
 
+            _this->health.delivered(blockSize);
             if (!_this->stream.swap(blockSize)) { break; };
         }
 
@@ -275,6 +279,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     float sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     std::thread workerThread;
     struct iio_context* ctx = NULL;
     struct iio_device* phy = NULL;
@@ -36,6 +36,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         // Load config
         config.acquire();
@@ -99,6 +100,7 @@ private:
         if (_this->running) { return; }
 
         // TODO: Set configuration here
+        _this->health.start(_this->sampleRate);
         if (_this->client) { _this->client->start(rfspace::RFSPACE_SAMP_FORMAT_COMPLEX, rfspace::RFSPACE_SAMP_FORMAT_16BIT); }
 
         _this->running = true;
@@ -112,6 +114,7 @@ private:
         if (_this->client) { _this->client->stop(); }
 
         _this->running = false;
+        _this->health.stop();
         flog::info("RFSpaceSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -152,6 +155,7 @@ private:
             try {
                 if (_this->client) { _this->client.reset(); }
                 _this->client = rfspace::connect(_this->hostname, _this->port, &_this->stream);
+                if (_this->client) { _this->client->health = &_this->health; }
                 _this->deviceInit();
             }
             catch (std::exception e) {
@@ -206,6 +210,13 @@ private:
             SmGui::Text("Status:");
             SmGui::SameLine();
             SmGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), _this->connectedStr.c_str());
+
+            if (_this->running) {
+                char buf[128];
+                rfspace::UDPStats stats = _this->client->getUDPStats();
+                sprintf(buf, "Packets lost: %llu, reordered: %llu", (unsigned long long)stats.lost, (unsigned long long)stats.reordered);
+                SmGui::Text(buf);
+            }
         }
         else {
             SmGui::Text("Status:");
@@ -316,6 +327,7 @@ private:
 
     dsp::stream<dsp::complex_t> stream;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
 
     rfspace::RFspaceClient client;
 };
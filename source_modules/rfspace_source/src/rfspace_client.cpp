@@ -1,7 +1,9 @@
 #include <rfspace_client.h>
 #include <volk/volk.h>
+#include <dsp/convert/int_to_complex.h>
 #include <cstring>
 #include <utils/flog.h>
+#include <algorithm>
 
 using namespace std::chrono_literals;
 
@@ -14,7 +16,7 @@ namespace rfspace {
         // Allocate buffers
         rbuffer = new uint8_t[RFSPACE_MAX_SIZE];
         sbuffer = new uint8_t[RFSPACE_MAX_SIZE];
-        ubuffer = new uint8_t[RFSPACE_MAX_SIZE];
+        ubuffer = new uint8_t[RFSPACE_UDP_BATCH * RFSPACE_MAX_SIZE];
 
         // Clear write stop of stream just in case
         output->clearWriteStop();
@@ -24,7 +26,7 @@ namespace rfspace {
 
         // Start readers
         client->readAsync(sizeof(tcpHeader), (uint8_t*)&tcpHeader, tcpHandler, this);
-        udpClient->readAsync(RFSPACE_MAX_SIZE, ubuffer, udpHandler, this);
+        udpThread = std::thread(&RFspaceClientClass::udpWorker, this);
 
         // Get device ID and wait for response
         getControlItem(RFSPACE_CTRL_ITEM_PROD_ID, NULL, 0);
@@ -134,9 +136,13 @@ namespace rfspace {
 
     void RFspaceClientClass::setSampleRate(uint32_t sampleRate) {
         setControlItemWithChanID(RFSPACE_CTRL_ITEM_IQ_SAMP_RATE, 0, &sampleRate, sizeof(sampleRate));
+
+        // Size the output blocks for the latency target
+        blockSize = std::clamp<int>(((int64_t)sampleRate * RFSPACE_UDP_BLOCK_LATENCY_MS) / 1000, 1, STREAM_BUFFER_SIZE / 2);
     }
 
     void RFspaceClientClass::start(SampleFormat sampleFormat, SampleDepth sampleDepth) {
+        this->sampleDepth = sampleDepth;
         uint8_t args[4] = { (uint8_t)sampleFormat, (uint8_t)RFSPACE_STATE_RUN, (uint8_t)sampleDepth, 0 };
         setControlItem(RFSPACE_CTRL_ITEM_STATE, args, sizeof(args));
     }
@@ -153,6 +159,7 @@ namespace rfspace {
         if (heartBeatThread.joinable()) { heartBeatThread.join(); }
         client->close();
         udpClient->close();
+        if (udpThread.joinable()) { udpThread.join(); }
         output->clearWriteStop();
     }
 
@@ -160,6 +167,14 @@ namespace rfspace {
         return client->isOpen();
     }
 
+    UDPStats RFspaceClientClass::getUDPStats() {
+        UDPStats stats;
+        stats.packets = packets;
+        stats.lost = lost;
+        stats.reordered = reordered;
+        return stats;
+    }
+
     void RFspaceClientClass::tcpHandler(int count, uint8_t* buf, void* ctx) {
         RFspaceClientClass* _this = (RFspaceClientClass*)ctx;
         uint8_t type = _this->tcpHeader >> 13;
@@ -187,21 +202,83 @@ namespace rfspace {
         _this->client->readAsync(sizeof(_this->tcpHeader), (uint8_t*)&_this->tcpHeader, tcpHandler, _this);
     }
 
-    void RFspaceClientClass::udpHandler(int count, uint8_t* buf, void* ctx) {
-        RFspaceClientClass* _this = (RFspaceClientClass*)ctx;
-        uint16_t hdr = (uint16_t)buf[0] | ((uint16_t)buf[1] << 8);
-        uint8_t type = hdr >> 13;
-        uint16_t size = hdr & 0b1111111111111;
-
-        if (type == RFSPACE_MSG_TYPE_T2H_DATA_ITEM_0) {
-            int16_t* samples = (int16_t*)&buf[4];
-            int sampCount = (size - 4) / (2 * sizeof(int16_t));
-            volk_16i_s32f_convert_32f((float*)_this->output->writeBuf, samples, 32768.0f, sampCount * 2);
-            _this->output->swap(sampCount);
+    void RFspaceClientClass::udpWorker() {
+        int lens[RFSPACE_UDP_BATCH];
+        int filled = 0;
+        int concealed = 0;      // Silence in the current block, reported as a gap rather than as delivered
+        while (true) {
+            // Receive all datagrams that are queued, or wait for one
+            int count = udpClient->readMulti(RFSPACE_MAX_SIZE, ubuffer, lens, RFSPACE_UDP_BATCH);
+            if (count < 0) { return; }
+
+            for (int p = 0; p < count; p++) {
+                uint8_t* buf = &ubuffer[p * RFSPACE_MAX_SIZE];
+                if (lens[p] < 4) { continue; }
+                uint16_t hdr = (uint16_t)buf[0] | ((uint16_t)buf[1] << 8);
+                uint8_t type = hdr >> 13;
+                uint16_t size = hdr & 0b1111111111111;
+                if (type != RFSPACE_MSG_TYPE_T2H_DATA_ITEM_0 || size > lens[p]) { continue; }
+
+                // Samples are converted straight from the receive buffer into the stream
+                bool is24 = (sampleDepth == RFSPACE_SAMP_FORMAT_24BIT);
+                int sampCount = (size - 4) / (is24 ? 6 : 4);
+                if (filled + sampCount * (RFSPACE_MAX_CONCEAL_PACKETS + 1) > STREAM_BUFFER_SIZE) {
+                    if (health) { health->delivered(filled - concealed); }
+                    if (!output->swap(filled)) { return; }
+                    filled = 0;
+                    concealed = 0;
+                }
+
+                // Keep the timing of the stream by replacing lost packets with silence
+                uint64_t lostBefore = lost;
+                int missing = checkSequence((uint16_t)buf[2] | ((uint16_t)buf[3] << 8));
+                if (missing < 0) { continue; }
+                if (health && lost != lostBefore) { health->gap((lost - lostBefore) * sampCount); }
+                if (missing) {
+                    memset(&output->writeBuf[filled], 0, missing * sampCount * sizeof(dsp::complex_t));
+                    filled += missing * sampCount;
+                    concealed += missing * sampCount;
+                }
+
+                if (is24) {
+                    dsp::convert::int_to_complex::s24(&buf[4], &output->writeBuf[filled], sampCount);
+                }
+                else {
+                    dsp::convert::int_to_complex::s16((int16_t*)&buf[4], &output->writeBuf[filled], sampCount);
+                }
+                filled += sampCount;
+            }
+
+            // Send the data once enough has been accumulated
+            if (filled >= blockSize) {
+                if (health) { health->delivered(filled - concealed); }
+                if (!output->swap(filled)) { return; }
+                filled = 0;
+                concealed = 0;
+            }
         }
+    }
 
-        // Restart an async read
-        _this->udpClient->readAsync(RFSPACE_MAX_SIZE, _this->ubuffer, udpHandler, _this);
+    int RFspaceClientClass::checkSequence(uint16_t seq) {
+        packets++;
+
+        // The sequence restarts at zero with the stream and skips zero when wrapping
+        if (!seqValid || !seq) {
+            seqValid = true;
+            lastSeq = seq;
+            return 0;
+        }
+        uint16_t expected = (lastSeq == 0xFFFF) ? 1 : (lastSeq + 1);
+        int diff = (int16_t)(seq - expected);
+        if (diff > 0 && seq < expected) { diff--; }
+        if (diff < 0) {
+            // Late packet, its slot was already filled
+            reordered++;
+            return -1;
+        }
+        lastSeq = seq;
+        lost += diff;
+        return std::min<int>(diff, RFSPACE_MAX_CONCEAL_PACKETS);
     }
 
     void RFspaceClientClass::heartBeatWorker() {
@@ -2,6 +2,7 @@
 #include <utils/networking.h>
 #include <dsp/stream.h>
 #include <dsp/types.h>
+#include <signal_path/source_health.h>
 #include <atomic>
 #include <queue>
 
@@ -9,6 +10,11 @@
 #define RFSPACE_HEARTBEAT_INTERVAL_MS   1000
 #define RFSPACE_TIMEOUT_MS              3000
 
+// UDP data path
+#define RFSPACE_UDP_BATCH               32
+#define RFSPACE_UDP_BLOCK_LATENCY_MS    20
+#define RFSPACE_MAX_CONCEAL_PACKETS     64
+
 namespace rfspace {
     enum H2TMessageType {
         RFSPACE_MSG_TYPE_H2T_SET_CTRL_ITEM,
@@ -96,6 +102,12 @@ namespace rfspace {
         RFSPACE_CTRL_ITEM_ERROR_LOG     = 0x0410
     };
 
+    struct UDPStats {
+        uint64_t packets;
+        uint64_t lost;
+        uint64_t reordered;
+    };
+
     class RFspaceClientClass {
     public:
         RFspaceClientClass(net::Conn conn, net::Conn udpConn, dsp::stream<dsp::complex_t>* out);
@@ -120,11 +132,17 @@ namespace rfspace {
         void close();
         bool isOpen();
 
+        UDPStats getUDPStats();
+
         DeviceID deviceId;
 
+        // Optional delivery counters of the source
+        SourceHealth* health = NULL;
+
     private:
         static void tcpHandler(int count, uint8_t* buf, void* ctx);
-        static void udpHandler(int count, uint8_t* buf, void* ctx);
+        void udpWorker();
+        int checkSequence(uint16_t seq);
         void heartBeatWorker();
 
         net::Conn client;
@@ -133,12 +151,21 @@ namespace rfspace {
         dsp::stream<dsp::complex_t>* output;
 
         uint16_t tcpHeader;
-        uint16_t udpHeader;
 
         uint8_t* rbuffer = NULL;
         uint8_t* sbuffer = NULL;
         uint8_t* ubuffer = NULL;
 
+        // UDP data path
+        std::thread udpThread;
+        std::atomic<SampleDepth> sampleDepth = RFSPACE_SAMP_FORMAT_16BIT;
+        std::atomic<int> blockSize = 1;
+        bool seqValid = false;
+        uint16_t lastSeq = 0;
+        std::atomic<uint64_t> packets = 0;
+        std::atomic<uint64_t> lost = 0;
+        std::atomic<uint64_t> reordered = 0;
+
         std::thread heartBeatThread;
         std::mutex heartBeatMtx;
         std::condition_variable heartBeatCnd;
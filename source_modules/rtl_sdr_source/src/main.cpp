@@ -7,6 +7,7 @@
 #include <config.h>
 #include <gui/smgui.h>
 #include <rtl-sdr.h>
+#include <dsp/convert/int_to_complex.h>
 
 #ifdef __ANDROID__
 #include <android_backend.h>
@@ -71,6 +72,8 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.stream8 = &stream8;
+        handler.health = &health;
 
         strcpy(dbTxt, "--");
 
@@ -316,6 +319,7 @@ private:
 
         _this->workerThread = std::thread(&RTLSDRSourceModule::worker, _this);
 
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         flog::info("RTLSDRSourceModule '{0}': Start!", _this->name);
     }
@@ -324,10 +328,13 @@ private:
         RTLSDRSourceModule* _this = (RTLSDRSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         _this->stream.stopWriter();
+        _this->stream8.stopWriter();
         rtlsdr_cancel_async(_this->openDev);
         if (_this->workerThread.joinable()) { _this->workerThread.join(); }
         _this->stream.clearWriteStop();
+        _this->stream8.clearWriteStop();
         rtlsdr_close(_this->openDev);
         flog::info("RTLSDRSourceModule '{0}': Stop!", _this->name);
     }
@@ -522,11 +529,19 @@ private:
     static void asyncHandler(unsigned char* buf, uint32_t len, void* ctx) {
         RTLSDRSourceModule* _this = (RTLSDRSourceModule*)ctx;
         int sampCount = len / 2;
-        for (int i = 0; i < sampCount; i++) {
-            _this->stream.writeBuf[i].re = (float)(buf[i * 2] - 127) / 128.0f;
-            _this->stream.writeBuf[i].im = (float)(buf[(i * 2) + 1] - 127) / 128.0f;
+        _this->health.delivered(sampCount);
+
+        // The ADC is offset binary centered on 127.5, removing 127 or 128 leaves the same half LSB of DC.
+        // 128 is used since it's what turns the samples into int8, the DC blocker removes the rest.
+        if (_this->handler.nativeOutput) {
+            int8_t* out = (int8_t*)_this->stream8.writeBuf;
+            for (uint32_t i = 0; i < len; i++) { out[i] = (int8_t)(buf[i] ^ 0x80); }
+            if (!_this->stream8.swap(sampCount)) { return; }
+        }
+        else {
+            dsp::convert::int_to_complex::u8(buf, _this->stream.writeBuf, sampCount);
+            if (!_this->stream.swap(sampCount)) { return; }
         }
-        if (!_this->stream.swap(sampCount)) { return; }
     }
 
     void updateGainTxt() {
@@ -537,8 +552,10 @@ private:
     rtlsdr_dev_t* openDev;
     bool enabled = true;
     dsp::stream<dsp::complex_t> stream;
+    dsp::stream<dsp::complex8_t> stream8;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     double freq;
     std::string selectedDevName = "";
@@ -90,6 +90,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
         sigpath::sourceManager.registerSource("RTL-TCP", &handler);
     }
 
@@ -129,8 +130,9 @@ private:
         if (_this->running) { return; }
         
         // Connect to the server
+        _this->health.start(_this->sampleRate);
         try {
-            _this->client = rtltcp::connect(&_this->stream, _this->ip, _this->port);
+            _this->client = rtltcp::connect(&_this->stream, _this->ip, _this->port, &_this->health);
         }
         catch (std::exception e) {
             flog::error("Could connect to RTL-TCP server: {0}", e.what());
@@ -162,6 +164,7 @@ private:
         if (!_this->running) { return; }
         _this->client->close();
         _this->running = false;
+        _this->health.stop();
         flog::info("RTLTCPSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -288,6 +291,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     std::thread workerThread;
     std::shared_ptr<rtltcp::Client> client;
     bool running = false;
@@ -1,9 +1,11 @@
 #include "rtl_tcp_client.h"
+#include <dsp/convert/int_to_complex.h>
 
 namespace rtltcp {
-    Client::Client(std::shared_ptr<net::Socket> sock, dsp::stream<dsp::complex_t>* stream) {
+    Client::Client(std::shared_ptr<net::Socket> sock, dsp::stream<dsp::complex_t>* stream, SourceHealth* health) {
         this->sock = sock;
         this->stream = stream;
+        this->health = health;
 
         // Start worker
         workerThread = std::thread(&Client::worker, this);
@@ -82,20 +84,18 @@ namespace rtltcp {
 
             // Convert to complex float
             int scount = count/2;
-            for (int i = 0; i < scount; i++) {
-                stream->writeBuf[i].re = ((double)buffer[i * 2] - 128.0) / 128.0;
-                stream->writeBuf[i].im = ((double)buffer[(i * 2) + 1] - 128.0) / 128.0;
-            }
+            dsp::convert::int_to_complex::u8(buffer, stream->writeBuf, scount);
 
             // Swap buffer
+            if (health) { health->delivered(scount); }
             if (!stream->swap(scount)) { break; }
         }
 
         dsp::buffer::free(buffer);
     }
 
-    std::shared_ptr<Client> connect(dsp::stream<dsp::complex_t>* stream, std::string host, int port) {
+    std::shared_ptr<Client> connect(dsp::stream<dsp::complex_t>* stream, std::string host, int port, SourceHealth* health) {
         auto sock = net::connect(host, port);
-        return std::make_shared<Client>(sock, stream);
+        return std::make_shared<Client>(sock, stream, health);
     }
 }
\ No newline at end of file
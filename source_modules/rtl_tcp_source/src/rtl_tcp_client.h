@@ -2,6 +2,7 @@
 #include <utils/net.h>
 #include <dsp/stream.h>
 #include <dsp/types.h>
+#include <signal_path/source_health.h>
 #include <thread>
 
 namespace rtltcp {
@@ -14,7 +15,7 @@ namespace rtltcp {
 
     class Client {
     public:
-        Client(std::shared_ptr<net::Socket> sock, dsp::stream<dsp::complex_t>* stream);
+        Client(std::shared_ptr<net::Socket> sock, dsp::stream<dsp::complex_t>* stream, SourceHealth* health = NULL);
         ~Client();
 
         bool isOpen();
@@ -38,8 +39,9 @@ namespace rtltcp {
         std::shared_ptr<net::Socket> sock;
         std::thread workerThread;
         dsp::stream<dsp::complex_t>* stream;
+        SourceHealth* health;
         int bufferSize = 2400000 / 200;
     };
 
-    std::shared_ptr<Client> connect(dsp::stream<dsp::complex_t>* stream, std::string host, int port = 1234);
+    std::shared_ptr<Client> connect(dsp::stream<dsp::complex_t>* stream, std::string host, int port = 1234, SourceHealth* health = NULL);
 }
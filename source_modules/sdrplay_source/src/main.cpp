@@ -152,6 +152,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         refresh();
 
@@ -651,6 +652,7 @@ private:
         sdrplay_api_Update(_this->openDev.dev, _this->openDev.tuner, sdrplay_api_Update_Tuner_Gr, sdrplay_api_Update_Ext1_None);
         sdrplay_api_Update(_this->openDev.dev, _this->openDev.tuner, sdrplay_api_Update_Ctrl_Agc, sdrplay_api_Update_Ext1_None);
 
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         flog::info("SDRPlaySourceModule '{0}': Start!", _this->name);
     }
@@ -659,6 +661,7 @@ private:
         SDRPlaySourceModule* _this = (SDRPlaySourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         _this->stream.stopWriter();
 
         // Release device after stopping
@@ -1113,6 +1116,7 @@ private:
         SDRPlaySourceModule* _this = (SDRPlaySourceModule*)cbContext;
         // TODO: Optimise using volk and math
         if (!_this->running) { return; }
+        _this->health.delivered(numSamples);
         for (int i = 0; i < numSamples; i++) {
             int id = _this->bufferIndex++;
             _this->stream.writeBuf[id].re = (float)xi[i] / 32768.0f;
@@ -1135,6 +1139,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     double freq;
     bool initOk = false;
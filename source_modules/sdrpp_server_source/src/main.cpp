@@ -1,4 +1,5 @@
 #include "sdrpp_server_client.h"
+#include "sdrpp_server_source_interface.h"
 #include <imgui.h>
 #include <utils/flog.h>
 #include <module.h>
@@ -36,6 +37,27 @@ public:
         sampleTypeList.define("Int16", dsp::compression::PCM_TYPE_I16);
         sampleTypeList.define("Float32", dsp::compression::PCM_TYPE_F32);
         sampleTypeId = sampleTypeList.valueId(dsp::compression::PCM_TYPE_I16);
+        compressionList.define("none", "None", server::COMPRESSION_MODE_NONE);
+        compressionList.define("zstd", "Zstd", server::COMPRESSION_MODE_ZSTD);
+        compressionList.define("adaptive", "Adaptive", server::COMPRESSION_MODE_ADAPTIVE);
+        compressionId = compressionList.valueId(server::COMPRESSION_MODE_NONE);
+        udpBitrateList.define("unlimited", "Unlimited", 0);
+        udpBitrateList.define("1M", "1 Mbit/s", 1000000);
+        udpBitrateList.define("2M", "2 Mbit/s", 2000000);
+        udpBitrateList.define("5M", "5 Mbit/s", 5000000);
+        udpBitrateList.define("10M", "10 Mbit/s", 10000000);
+        udpBitrateList.define("20M", "20 Mbit/s", 20000000);
+        udpBitrateList.define("50M", "50 Mbit/s", 50000000);
+        udpBitrateList.define("100M", "100 Mbit/s", 100000000);
+        udpBitrateId = udpBitrateList.valueId(0);
+
+        jitterList.define("off", "Off", 0);
+        jitterList.define("20ms", "20 ms", 20);
+        jitterList.define("50ms", "50 ms", 50);
+        jitterList.define("100ms", "100 ms", 100);
+        jitterList.define("200ms", "200 ms", 200);
+        jitterList.define("500ms", "500 ms", 500);
+        jitterId = jitterList.valueId(0);
 
         handler.ctx = this;
         handler.selectHandler = menuSelected;
@@ -45,6 +67,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         // Load config
         config.acquire();
@@ -54,11 +77,13 @@ public:
         config.release();
 
         sigpath::sourceManager.registerSource("SDR++ Server", &handler);
+        core::modComManager.registerInterface("sdrpp_server_source", name, moduleInterfaceHandler, this);
     }
 
     ~SDRPPServerSourceModule() {
         stop(this);
         sigpath::sourceManager.unregisterSource("SDR++ Server");
+        core::modComManager.unregisterInterface(name);
     }
 
     void postInit() {}
@@ -117,6 +142,7 @@ private:
 
         // Set configuration
         _this->client->setFrequency(_this->freq);
+        _this->health.start(_this->client->getSampleRate());
         _this->client->start();
 
         _this->running = true;
@@ -130,6 +156,7 @@ private:
         if (_this->client) { _this->client->stop(); }
 
         _this->running = false;
+        _this->health.stop();
         flog::info("SDRPPServerSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -190,19 +217,66 @@ private:
                 config.release(true);
             }
             
-            if (ImGui::Checkbox("Compression", &_this->compression)) {
-                _this->client->setCompression(_this->compression);
+            ImGui::LeftLabel("Compression");
+            ImGui::FillWidth();
+            if (ImGui::Combo("##sdrpp_srv_source_compression", &_this->compressionId, _this->compressionList.txt)) {
+                _this->client->setCompression(_this->compressionList[_this->compressionId]);
+
+                // Save config
+                config.acquire();
+                config.conf["servers"][_this->devConfName]["compressionMode"] = _this->compressionList.key(_this->compressionId);
+                config.release(true);
+            }
+
+            if (ImGui::Checkbox("Full IQ", &_this->fullIQ)) {
+                _this->client->setFullIQ(_this->fullIQ);
+
+                // Save config
+                config.acquire();
+                config.conf["servers"][_this->devConfName]["fullIQ"] = _this->fullIQ;
+                config.release(true);
+            }
+
+            ImGui::LeftLabel("Jitter buffer");
+            ImGui::FillWidth();
+            if (ImGui::Combo("##sdrpp_srv_source_jitter", &_this->jitterId, _this->jitterList.txt)) {
+                _this->client->setJitterBuffer(_this->jitterList[_this->jitterId]);
+
+                // Save config
+                config.acquire();
+                config.conf["servers"][_this->devConfName]["jitterBuffer"] = _this->jitterList.key(_this->jitterId);
+                config.release(true);
+            }
+
+            if (ImGui::Checkbox("UDP data channel", &_this->udp)) {
+                _this->client->setUDP(_this->udp, _this->udpBitrateList[_this->udpBitrateId]);
 
                 // Save config
                 config.acquire();
-                config.conf["servers"][_this->devConfName]["compression"] = _this->compression;
+                config.conf["servers"][_this->devConfName]["udp"] = _this->udp;
                 config.release(true);
             }
 
-            bool dummy = true;
-            style::beginDisabled();
-            ImGui::Checkbox("Full IQ", &dummy);
-            style::endDisabled();
+            if (_this->udp) {
+                ImGui::LeftLabel("UDP pacing");
+                ImGui::FillWidth();
+                if (ImGui::Combo("##sdrpp_srv_source_udp_bitrate", &_this->udpBitrateId, _this->udpBitrateList.txt)) {
+                    _this->client->setUDP(true, _this->udpBitrateList[_this->udpBitrateId]);
+
+                    // Save config
+                    config.acquire();
+                    config.conf["servers"][_this->devConfName]["udpBitrate"] = _this->udpBitrateList.key(_this->udpBitrateId);
+                    config.release(true);
+                }
+
+                server::UDPStats stats = _this->client->getUDPStats();
+                ImGui::Text("UDP lost: %llu datagrams, %llu packets", (unsigned long long)stats.datagramsLost, (unsigned long long)stats.packetsLost);
+                ImGui::Text("UDP reordered: %llu, concealed: %llu samples", (unsigned long long)stats.datagramsReordered, (unsigned long long)stats.samplesConcealed);
+            }
+
+            server::RxStats rxStats = _this->client->getRxStats();
+            ImGui::Text("Queue: %d (max %d), buffered: %.1f ms", rxStats.queueDepth, rxStats.maxQueueDepth, rxStats.bufferedMs);
+            ImGui::Text("Stalls: %llu, decompression: %.3f ms/block", (unsigned long long)rxStats.stalls, rxStats.decompressTimeMs);
 
             // Calculate datarate
             _this->frametimeCounter += ImGui::GetIO().DeltaTime;
@@ -229,8 +303,10 @@ private:
 
     void tryConnect() {
         try {
+            std::lock_guard<std::mutex> lck(clientMtx);
             if (client) { client.reset(); }
             client = server::connect(hostname, port, &stream);
+            if (client) { client->health = &health; }
             deviceInit();
         }
         catch (std::exception e) {
@@ -251,13 +327,65 @@ private:
             std::string key = config.conf["servers"][devConfName]["sampleType"];
             if (sampleTypeList.keyExists(key)) { sampleTypeId = sampleTypeList.keyId(key); }
         }
-        if (config.conf["servers"][devConfName].contains("compression")) {
-            compression = config.conf["servers"][devConfName]["compression"];
+        compressionId = compressionList.valueId(server::COMPRESSION_MODE_NONE);
+        if (config.conf["servers"][devConfName].contains("compressionMode")) {
+            std::string key = config.conf["servers"][devConfName]["compressionMode"];
+            if (compressionList.keyExists(key)) { compressionId = compressionList.keyId(key); }
+        }
+        else if (config.conf["servers"][devConfName].contains("compression")) {
+            // Older configs only had an on/off setting
+            bool compression = config.conf["servers"][devConfName]["compression"];
+            if (compression) { compressionId = compressionList.valueId(server::COMPRESSION_MODE_ZSTD); }
+        }
+        fullIQ = true;
+        if (config.conf["servers"][devConfName].contains("fullIQ")) {
+            fullIQ = config.conf["servers"][devConfName]["fullIQ"];
+        }
+        udp = false;
+        if (config.conf["servers"][devConfName].contains("udp")) {
+            udp = config.conf["servers"][devConfName]["udp"];
+        }
+        udpBitrateId = udpBitrateList.valueId(0);
+        if (config.conf["servers"][devConfName].contains("udpBitrate")) {
+            std::string key = config.conf["servers"][devConfName]["udpBitrate"];
+            if (udpBitrateList.keyExists(key)) { udpBitrateId = udpBitrateList.keyId(key); }
+        }
+        jitterId = jitterList.valueId(0);
+        if (config.conf["servers"][devConfName].contains("jitterBuffer")) {
+            std::string key = config.conf["servers"][devConfName]["jitterBuffer"];
+            if (jitterList.keyExists(key)) { jitterId = jitterList.keyId(key); }
         }
 
         // Set settings
         client->setSampleType(sampleTypeList[sampleTypeId]);
-        client->setCompression(compression);
+        client->setCompression(compressionList[compressionId]);
+        client->setFullIQ(fullIQ);
+        if (udp) { client->setUDP(true, udpBitrateList[udpBitrateId]); }
+        client->setJitterBuffer(jitterList[jitterId]);
+    }
+
+    static void moduleInterfaceHandler(int code, void* in, void* out, void* ctx) {
+        SDRPPServerSourceModule* _this = (SDRPPServerSourceModule*)ctx;
+
+        // Keep a reference instead of holding the lock, the commands wait for the server to answer
+        server::Client client;
+        {
+            std::lock_guard<std::mutex> lck(_this->clientMtx);
+            client = _this->client;
+        }
+        bool connected = (client && client->isOpen());
+        if (code == SDRPP_SERVER_SOURCE_IFACE_CMD_ADD_VFO && in) {
+            SDRPPServerVFO* vfo = (SDRPPServerVFO*)in;
+            vfo->id = (connected && vfo->out) ? client->addVFO(vfo->offset, vfo->bandwidth, vfo->sampleRate, vfo->out) : -1;
+        }
+        else if (code == SDRPP_SERVER_SOURCE_IFACE_CMD_SET_VFO_PARAMS && in) {
+            SDRPPServerVFO* vfo = (SDRPPServerVFO*)in;
+            bool ok = connected && client->setVFOParams(vfo->id, vfo->offset, vfo->bandwidth, vfo->sampleRate);
+            if (out) { *(bool*)out = ok; }
+        }
+        else if (code == SDRPP_SERVER_SOURCE_IFACE_CMD_REMOVE_VFO && in) {
+            if (client) { client->removeVFO(*(int*)in); }
+        }
     }
 
     std::string name;
@@ -276,11 +404,21 @@ private:
 
     dsp::stream<dsp::complex_t> stream;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
 
     OptionList<std::string, dsp::compression::PCMType> sampleTypeList;
     int sampleTypeId;
-    bool compression = false;
-
+    OptionList<std::string, server::CompressionMode> compressionList;
+    int compressionId;
+    bool fullIQ = true;
+    bool udp = false;
+    OptionList<std::string, uint32_t> udpBitrateList;
+    int udpBitrateId;
+    OptionList<std::string, int> jitterList;
+    int jitterId;
+
+    // Held when replacing the client, it's also used by other modules through the interface
+    std::mutex clientMtx;
     server::Client client;
 };
 
@@ -7,8 +7,9 @@
 using namespace std::chrono_literals;
 
 namespace server {
-    ClientClass::ClientClass(net::Conn conn, dsp::stream<dsp::complex_t>* out) {
+    ClientClass::ClientClass(net::Conn conn, std::string host, dsp::stream<dsp::complex_t>* out) {
         client = std::move(conn);
+        this->host = host;
         output = out;
 
         // Allocate buffers
@@ -33,9 +34,12 @@ namespace server {
         decompIn.setBufferSize((sizeof(dsp::complex_t) * STREAM_BUFFER_SIZE) + 8);
         decompIn.clearWriteStop();
         decomp.init(&decompIn);
-        link.init(&decomp.out, output);
+        sink.init(&decomp.out, dHandler, this);
         decomp.start();
-        link.start();
+        sink.start();
+
+        // Start the receive pipeline
+        rxThread = std::thread(&ClientClass::rxWorker, this);
 
         // Start readers
         client->readAsync(sizeof(PacketHeader), rbuffer, tcpHandler, this);
@@ -48,7 +52,10 @@ namespace server {
 
     ClientClass::~ClientClass() {
         close();
+        vfos.clear();
         ZSTD_freeDCtx(dctx);
+        for (auto& blk : rxPool) { delete blk; }
+        for (auto& blk : rxQueue) { delete blk; }
         delete[] rbuffer;
         delete[] sbuffer;
     }
@@ -63,6 +70,8 @@ namespace server {
         }
 
         if (!diffId.empty()) {
+            std::lock_guard<std::recursive_mutex> clck(cmdMtx);
+
             // Save ID
             SmGui::DrawListElem elemId;
             elemId.type = SmGui::DRAW_LIST_ELEM_TYPE_STRING;
@@ -98,9 +107,10 @@ namespace server {
 
     void ClientClass::setFrequency(double freq) {
         if (!client || !client->isOpen()) { return; }
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
         *(double*)s_cmd_data = freq;
-        sendCommand(COMMAND_SET_FREQUENCY, sizeof(double));
         auto waiter = awaitCommandAck(COMMAND_SET_FREQUENCY);
+        sendCommand(COMMAND_SET_FREQUENCY, sizeof(double));
         waiter->await(PROTOCOL_TIMEOUT_MS);
         waiter->handled();
     }
@@ -110,31 +120,205 @@ namespace server {
     }
 
     void ClientClass::setSampleType(dsp::compression::PCMType type) {
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
         s_cmd_data[0] = type;
         sendCommand(COMMAND_SET_SAMPLE_TYPE, 1);
     }
 
-    void ClientClass::setCompression(bool enabled) {
-         s_cmd_data[0] = enabled;
+    void ClientClass::setCompression(CompressionMode mode) {
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+        s_cmd_data[0] = mode;
         sendCommand(COMMAND_SET_COMPRESSION, 1);
     }
 
+    void ClientClass::setFullIQ(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+        s_cmd_data[0] = enabled;
+        sendCommand(COMMAND_SET_FULL_IQ, 1);
+    }
+
+    bool ClientClass::setUDP(bool enabled, uint32_t bitrate) {
+        if (!client || !client->isOpen()) { return false; }
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+
+        // Tear down the current channel, the server goes back to TCP until it hears from the new one
+        closeUDP();
+
+        UDPParams* params = (UDPParams*)s_cmd_data;
+        params->enabled = enabled;
+        params->bitrate = bitrate;
+        auto waiter = awaitCommandAck(COMMAND_SET_UDP);
+        sendCommand(COMMAND_SET_UDP, sizeof(UDPParams));
+        UDPInfo info = {};
+        bool ok = false;
+        if (waiter->await(PROTOCOL_TIMEOUT_MS)) {
+            info = *(UDPInfo*)r_cmd_data;
+            ok = (info.error == ERROR_NONE);
+            if (!ok) { flog::error("Server refused to open a UDP data channel"); }
+        }
+        else {
+            flog::error("Timeout out after requesting a UDP data channel");
+        }
+        waiter->handled();
+        if (!ok || !enabled) { return ok; }
+
+        // Open the local end, data keeps coming over TCP until the server receives our hello
+        try {
+            udpConn = net::openUDP("0.0.0.0", 0, host, info.port, true);
+        }
+        catch (const std::exception& e) {
+            flog::error("Could not open the UDP data channel: {0}", e.what());
+            return false;
+        }
+
+        // Reset reassembly state and start the workers
+        udpPackets.clear();
+        udpSynced = false;
+        expectedTimestamps.clear();
+        udpToken = info.token;
+        udpStop = false;
+        udpThread = std::thread(&ClientClass::udpWorker, this);
+        udpHelloThread = std::thread(&ClientClass::udpHelloWorker, this);
+        return true;
+    }
+
+    UDPStats ClientClass::getUDPStats() {
+        UDPStats stats;
+        stats.datagrams = udpDatagrams;
+        stats.datagramsLost = udpDatagramsLost;
+        stats.datagramsReordered = udpDatagramsReordered;
+        stats.packetsLost = udpPacketsLost;
+        stats.samplesConcealed = udpSamplesConcealed;
+        return stats;
+    }
+
+    void ClientClass::setJitterBuffer(int ms) {
+        jitterMs = ms;
+        rxCnd.notify_all();
+    }
+
+    RxStats ClientClass::getRxStats() {
+        RxStats stats;
+        std::lock_guard<std::mutex> lck(rxMtx);
+        stats.queueDepth = rxQueue.size();
+        stats.maxQueueDepth = rxMaxQueueDepth;
+        stats.bufferedMs = getBufferedMs();
+        stats.stalls = rxStalls;
+        uint64_t blocks = decompressedBlocks;
+        stats.decompressTimeMs = blocks ? ((double)decompressTimeNs / (double)blocks) / 1e6 : 0.0;
+        return stats;
+    }
+
+    int ClientClass::addVFO(double offset, double bandwidth, double sampleRate, dsp::stream<dsp::complex_t>* out) {
+        if (!client || !client->isOpen()) { return -1; }
+
+        // Create the local decompression chain before the server starts sending data
+        std::shared_ptr<RemoteVFO> vfo = std::make_shared<RemoteVFO>();
+        vfo->decompIn.setBufferSize((sizeof(dsp::complex_t) * STREAM_BUFFER_SIZE) + 8);
+        vfo->decomp.init(&vfo->decompIn);
+        vfo->link.init(&vfo->decomp.out, out);
+        vfo->decomp.start();
+        vfo->link.start();
+
+        uint32_t id;
+        {
+            std::lock_guard<std::mutex> lck(vfoMtx);
+            id = nextVFOId++;
+            vfos[id] = vfo;
+        }
+
+        // Ask the server to create the channel
+        bool ok;
+        {
+            std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+            VFOParams* params = (VFOParams*)s_cmd_data;
+            params->id = id;
+            params->offset = offset;
+            params->bandwidth = bandwidth;
+            params->sampleRate = sampleRate;
+            ok = sendVFOCommand(COMMAND_ADD_VFO, sizeof(VFOParams));
+        }
+        if (!ok) {
+            {
+                std::lock_guard<std::mutex> lck(vfoMtx);
+                vfos.erase(id);
+            }
+            stopVFO(vfo.get());
+            return -1;
+        }
+
+        return id;
+    }
+
+    bool ClientClass::setVFOParams(int id, double offset, double bandwidth, double sampleRate) {
+        if (!client || !client->isOpen()) { return false; }
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+        VFOParams* params = (VFOParams*)s_cmd_data;
+        params->id = id;
+        params->offset = offset;
+        params->bandwidth = bandwidth;
+        params->sampleRate = sampleRate;
+        return sendVFOCommand(COMMAND_SET_VFO_PARAMS, sizeof(VFOParams));
+    }
+
+    void ClientClass::removeVFO(int id) {
+        if (client && client->isOpen()) {
+            std::lock_guard<std::recursive_mutex> lck(cmdMtx);
+            *(uint32_t*)s_cmd_data = id;
+            sendVFOCommand(COMMAND_REMOVE_VFO, sizeof(uint32_t));
+        }
+
+        // Stop the local chain, it's freed once the receive worker is done with it
+        std::shared_ptr<RemoteVFO> vfo;
+        {
+            std::lock_guard<std::mutex> lck(vfoMtx);
+            auto it = vfos.find(id);
+            if (it == vfos.end()) { return; }
+            vfo = it->second;
+            vfos.erase(it);
+        }
+        stopVFO(vfo.get());
+    }
+
+    std::shared_ptr<RemoteVFO> ClientClass::getVFO(uint32_t id) {
+        std::lock_guard<std::mutex> lck(vfoMtx);
+        auto it = vfos.find(id);
+        return (it != vfos.end()) ? it->second : nullptr;
+    }
+
+    void ClientClass::stopVFO(RemoteVFO* vfo) {
+        // Release a writer waiting to swap before stopping the blocks reading from the streams
+        vfo->decompIn.stopWriter();
+        vfo->decomp.stop();
+        vfo->link.stop();
+    }
+
     void ClientClass::start() {
         if (!client || !client->isOpen()) { return; }
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
         sendCommand(COMMAND_START, 0);
         getUI();
     }
 
     void ClientClass::stop() {
         if (!client || !client->isOpen()) { return; }
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
         sendCommand(COMMAND_STOP, 0);
         getUI();
     }
 
     void ClientClass::close() {
         decomp.stop();
-        link.stop();
+        output->stopWriter();
+        sink.stop();
+        output->clearWriteStop();
         decompIn.stopWriter();
+        {
+            std::lock_guard<std::mutex> lck(vfoMtx);
+            for (auto& [id, vfo] : vfos) { stopVFO(vfo.get()); }
+        }
+        stopRxWorker();
+        closeUDP();
         client->close();
         decompIn.clearWriteStop();
     }
@@ -169,42 +353,36 @@ namespace server {
                 flog::error("Asked to disconnect by the server");
                 _this->serverBusy = true;
 
-                // Cancel waiters
+                // Cancel waiters, outside of the lock since they block until the waiting thread is done
                 std::vector<PacketWaiter*> toBeRemoved;
-                for (auto& [waiter, cmd] : _this->commandAckWaiters) {
-                    waiter->cancel();
-                    toBeRemoved.push_back(waiter);
+                {
+                    std::lock_guard<std::mutex> lck(_this->waitersMtx);
+                    for (auto& [waiter, cmd] : _this->commandAckWaiters) { toBeRemoved.push_back(waiter); }
+                    _this->commandAckWaiters.clear();
                 }
-
-                // Remove handled waiters
                 for (auto& waiter : toBeRemoved) {
-                    _this->commandAckWaiters.erase(waiter);
+                    waiter->cancel();
                     delete waiter;
                 }
             }
         }
         else if (_this->r_pkt_hdr->type == PACKET_TYPE_COMMAND_ACK) {
-            // Notify waiters
+            // Take the waiters of this command, then notify them outside of the lock since they block until handled
             std::vector<PacketWaiter*> toBeRemoved;
-            for (auto& [waiter, cmd] : _this->commandAckWaiters) {
-                if (cmd != _this->r_cmd_hdr->cmd) { continue; }
-                waiter->notify();
-                toBeRemoved.push_back(waiter);
+            {
+                std::lock_guard<std::mutex> lck(_this->waitersMtx);
+                for (auto& [waiter, cmd] : _this->commandAckWaiters) {
+                    if (cmd == _this->r_cmd_hdr->cmd) { toBeRemoved.push_back(waiter); }
+                }
+                for (auto& waiter : toBeRemoved) { _this->commandAckWaiters.erase(waiter); }
             }
-
-            // Remove handled waiters
             for (auto& waiter : toBeRemoved) {
-                _this->commandAckWaiters.erase(waiter);
+                waiter->notify();
                 delete waiter;
             }
         }
-        else if (_this->r_pkt_hdr->type == PACKET_TYPE_BASEBAND) {
-            memcpy(_this->decompIn.writeBuf, &buf[sizeof(PacketHeader)], _this->r_pkt_hdr->size - sizeof(PacketHeader));
-            _this->decompIn.swap(_this->r_pkt_hdr->size - sizeof(PacketHeader));
-        }
-        else if (_this->r_pkt_hdr->type == PACKET_TYPE_BASEBAND_COMPRESSED) {
-            size_t outCount = ZSTD_decompressDCtx(_this->dctx, _this->decompIn.writeBuf, STREAM_BUFFER_SIZE, _this->r_pkt_data, _this->r_pkt_hdr->size - sizeof(PacketHeader));
-            if (outCount) { _this->decompIn.swap(outCount); };
+        else if (_this->r_pkt_hdr->type == PACKET_TYPE_BASEBAND || _this->r_pkt_hdr->type == PACKET_TYPE_BASEBAND_COMPRESSED || _this->r_pkt_hdr->type == PACKET_TYPE_VFO) {
+            _this->queueDataPacket(_this->r_pkt_hdr);
         }
         else if (_this->r_pkt_hdr->type == PACKET_TYPE_ERROR) {
             flog::error("SDR++ Server Error: {0}", buf[sizeof(PacketHeader)]);
@@ -218,6 +396,7 @@ namespace server {
     }
 
     int ClientClass::getUI() {
+        std::lock_guard<std::recursive_mutex> lck(cmdMtx);
         auto waiter = awaitCommandAck(COMMAND_GET_UI);
         sendCommand(COMMAND_GET_UI, 0);
         if (waiter->await(PROTOCOL_TIMEOUT_MS)) {
@@ -233,6 +412,355 @@ namespace server {
         return 0;
     }
 
+    bool ClientClass::sendVFOCommand(Command cmd, int len) {
+        auto waiter = awaitCommandAck(cmd);
+        sendCommand(cmd, len);
+        bool ok = false;
+        if (waiter->await(PROTOCOL_TIMEOUT_MS)) {
+            ok = (r_cmd_data[0] == ERROR_NONE);
+            if (!ok) { flog::error("Server refused VFO command {0}: error {1}", (int)cmd, (int)r_cmd_data[0]); }
+        }
+        else {
+            flog::error("Timeout out after sending VFO command");
+        }
+        waiter->handled();
+        return ok;
+    }
+
+    void ClientClass::handleDataPacket(PacketHeader* hdr, uint8_t* data) {
+        int len = hdr->size - sizeof(PacketHeader);
+        if (hdr->type == PACKET_TYPE_BASEBAND) {
+            memcpy(decompIn.writeBuf, data, len);
+            swapBaseband(len, false);
+        }
+        else if (hdr->type == PACKET_TYPE_BASEBAND_COMPRESSED) {
+            auto start = std::chrono::steady_clock::now();
+            size_t outCount = ZSTD_decompressDCtx(dctx, decompIn.writeBuf, (sizeof(dsp::complex_t) * STREAM_BUFFER_SIZE) + 8, data, len);
+            decompressTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            decompressedBlocks++;
+            if (outCount && !ZSTD_isError(outCount)) {
+                // Used to estimate how many samples the following compressed packets hold
+                int count = dsp::compression::SampleStreamDecompressor::getSampleCount(outCount, decompIn.writeBuf);
+                if (count) { rxBytesPerSample = (double)(outCount - 8) / (double)count; }
+                swapBaseband(outCount, false);
+            }
+        }
+        else if (hdr->type == PACKET_TYPE_VFO) {
+            handleVFOPacket(data, len);
+        }
+    }
+
+    void ClientClass::swapBaseband(int size, bool concealed) {
+        // The decompressor doesn't output anything for blocks without samples, don't count them
+        if (!dsp::compression::SampleStreamDecompressor::getSampleCount(size, decompIn.writeBuf)) { return; }
+        if (concealed) {
+            std::lock_guard<std::mutex> lck(concealedMtx);
+            concealedBlocks.push_back(basebandBlocksIn);
+        }
+        basebandBlocksIn++;
+        decompIn.swap(size);
+    }
+
+    void ClientClass::handleVFOPacket(uint8_t* data, int len) {
+        if (len < sizeof(VFOHeader)) { return; }
+        VFOHeader* vhdr = (VFOHeader*)data;
+        data += sizeof(VFOHeader);
+        len -= sizeof(VFOHeader);
+
+        // Don't hold the lock while swapping, the reader may be stalled
+        std::shared_ptr<RemoteVFO> vfo = getVFO(vhdr->id);
+        if (!vfo) { return; }
+
+        if (vhdr->compressed) {
+            auto start = std::chrono::steady_clock::now();
+            size_t outCount = ZSTD_decompressDCtx(dctx, vfo->decompIn.writeBuf, (sizeof(dsp::complex_t) * STREAM_BUFFER_SIZE) + 8, data, len);
+            decompressTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            decompressedBlocks++;
+            if (outCount && !ZSTD_isError(outCount)) { vfo->decompIn.swap(outCount); };
+        }
+        else {
+            memcpy(vfo->decompIn.writeBuf, data, len);
+            vfo->decompIn.swap(len);
+        }
+    }
+
+    void ClientClass::queueDataPacket(PacketHeader* hdr) {
+        RxBlock* blk = getFreeBlock();
+        if (!blk) { return; }
+        blk->silence = false;
+        blk->data.assign((uint8_t*)hdr, (uint8_t*)hdr + hdr->size);
+        blk->samples = getPacketSamples(hdr);
+        queueBlock(blk);
+    }
+
+    uint64_t ClientClass::getPacketSamples(PacketHeader* hdr) {
+        uint8_t* data = (uint8_t*)hdr + sizeof(PacketHeader);
+        int len = hdr->size - sizeof(PacketHeader);
+        if (hdr->type == PACKET_TYPE_BASEBAND) {
+            return dsp::compression::SampleStreamDecompressor::getSampleCount(len, data);
+        }
+        else if (hdr->type == PACKET_TYPE_BASEBAND_COMPRESSED) {
+            // The sample type is only known after decompression, assume it's the same as the last block's
+            unsigned long long size = ZSTD_getFrameContentSize(data, len);
+            double bps = rxBytesPerSample;
+            if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR || size <= 8 || bps <= 0.0) { return 0; }
+            return (double)(size - 8) / bps;
+        }
+        return 0;
+    }
+
+    double ClientClass::getBufferedMs() {
+        // Must be called with the rx mutex held. Without baseband, only VFOs, fall back to the age of the oldest packet.
+        if (rxQueue.empty()) { return 0.0; }
+        if (rxQueuedSamples) { return (double)rxQueuedSamples * 1000.0 / currentSampleRate; }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rxQueue.front()->arrival).count();
+    }
+
+    void ClientClass::queueSilence(int64_t streamId, uint64_t count) {
+        RxBlock* blk = getFreeBlock();
+        if (!blk) { return; }
+        blk->silence = true;
+        blk->streamId = streamId;
+        blk->silenceCount = count;
+        blk->data.clear();
+        blk->samples = (streamId < 0) ? count : 0;
+        queueBlock(blk);
+    }
+
+    RxBlock* ClientClass::getFreeBlock() {
+        // Block the reader while the queue is full, over TCP this pushes back on the server
+        std::unique_lock<std::mutex> lck(rxMtx);
+        rxSpaceCnd.wait(lck, [this]() { return rxQueuedBytes < RX_QUEUE_MAX_BYTES || rxStop; });
+        if (rxStop) { return NULL; }
+        if (rxPool.empty()) { return new RxBlock; }
+        RxBlock* blk = rxPool.back();
+        rxPool.pop_back();
+        return blk;
+    }
+
+    void ClientClass::queueBlock(RxBlock* blk) {
+        {
+            std::lock_guard<std::mutex> lck(rxMtx);
+            blk->arrival = std::chrono::steady_clock::now();
+            rxQueue.push_back(blk);
+            rxQueuedBytes += blk->data.size();
+            rxQueuedSamples += blk->samples;
+            rxMaxQueueDepth = std::max<int>(rxMaxQueueDepth, rxQueue.size());
+        }
+        rxCnd.notify_all();
+    }
+
+    void ClientClass::stopRxWorker() {
+        {
+            std::lock_guard<std::mutex> lck(rxMtx);
+            rxStop = true;
+        }
+        rxCnd.notify_all();
+        rxSpaceCnd.notify_all();
+        if (rxThread.joinable()) { rxThread.join(); }
+    }
+
+    void ClientClass::rxWorker() {
+        // Start out buffering like after a stall
+        bool refill = true;
+        std::unique_lock<std::mutex> lck(rxMtx);
+        while (true) {
+            // Wait for data, going without any for longer than the jitter buffer counts as a stall
+            auto waitStart = std::chrono::steady_clock::now();
+            rxCnd.wait(lck, [this]() { return !rxQueue.empty() || rxStop; });
+            if (rxStop) { return; }
+            int jitter = jitterMs;
+            if (jitter && !refill && std::chrono::steady_clock::now() - waitStart > std::chrono::milliseconds(jitter)) {
+                rxStalls++;
+                refill = true;
+            }
+
+            // Hold the data back until the target duration is buffered, or the queue is full
+            while (jitter && refill) {
+                if (getBufferedMs() >= jitter || rxQueuedBytes >= RX_QUEUE_MAX_BYTES) { break; }
+                if (rxQueuedSamples) {
+                    rxCnd.wait(lck);
+                }
+                else {
+                    rxCnd.wait_until(lck, rxQueue.front()->arrival + std::chrono::milliseconds(jitter));
+                }
+                if (rxStop) { return; }
+                jitter = jitterMs;
+            }
+            refill = false;
+
+            RxBlock* blk = rxQueue.front();
+            rxQueue.pop_front();
+            rxQueuedBytes -= blk->data.size();
+            rxQueuedSamples -= blk->samples;
+            lck.unlock();
+            rxSpaceCnd.notify_all();
+
+            // Decompress and hand to the DSP
+            if (blk->silence) {
+                conceal(blk->streamId, blk->silenceCount);
+            }
+            else {
+                handleDataPacket((PacketHeader*)blk->data.data(), &blk->data[sizeof(PacketHeader)]);
+            }
+
+            lck.lock();
+            rxPool.push_back(blk);
+        }
+    }
+
+    void ClientClass::closeUDP() {
+        {
+            std::lock_guard<std::mutex> lck(udpHelloMtx);
+            udpStop = true;
+        }
+        udpHelloCnd.notify_all();
+        if (udpConn) { udpConn->close(); }
+        if (udpThread.joinable()) { udpThread.join(); }
+        if (udpHelloThread.joinable()) { udpHelloThread.join(); }
+        udpConn.reset();
+    }
+
+    void ClientClass::udpWorker() {
+        std::vector<uint8_t> buf(SERVER_UDP_DATAGRAM_SIZE);
+        while (true) {
+            struct sockaddr_in addr;
+            int len = udpConn->readFrom(buf.size(), buf.data(), &addr);
+            if (len < 0 || udpStop) { return; }
+            handleDatagram(buf.data(), len);
+        }
+    }
+
+    void ClientClass::udpHelloWorker() {
+        // Keep saying hello, this lets the server find us and keeps NAT mappings open
+        UDPHello hello;
+        hello.type = UDP_PACKET_TYPE_HELLO;
+        hello.token = udpToken;
+        std::unique_lock<std::mutex> lck(udpHelloMtx);
+        while (!udpStop) {
+            udpConn->write(sizeof(UDPHello), (uint8_t*)&hello);
+            udpHelloCnd.wait_for(lck, std::chrono::milliseconds(SERVER_UDP_HELLO_INTERVAL_MS), [this]() { return udpStop.load(); });
+        }
+    }
+
+    void ClientClass::handleDatagram(uint8_t* buf, int len) {
+        // Validate the datagram
+        if (len < sizeof(UDPHeader)) { return; }
+        UDPHeader* hdr = (UDPHeader*)buf;
+        int payloadSize = len - sizeof(UDPHeader);
+        if (hdr->type != UDP_PACKET_TYPE_DATA || !hdr->fragmentCount || hdr->fragment >= hdr->fragmentCount) { return; }
+        if ((size_t)hdr->fragmentCount * SERVER_UDP_MAX_PAYLOAD > SERVER_MAX_PACKET_SIZE) { return; }
+        bool last = (hdr->fragment == hdr->fragmentCount - 1);
+        if (payloadSize > SERVER_UDP_MAX_PAYLOAD || (!last && payloadSize != SERVER_UDP_MAX_PAYLOAD)) { return; }
+        bytes += len;
+        udpDatagrams++;
+
+        // Track datagram loss and reordering, a late datagram was first counted as lost
+        if (!udpSynced) {
+            udpSynced = true;
+            udpLastSeq = hdr->seq - 1;
+            udpNextPacketSeq = hdr->packetSeq;
+        }
+        int32_t seqDiff = (int32_t)(hdr->seq - udpLastSeq);
+        if (seqDiff > 0) {
+            udpDatagramsLost += seqDiff - 1;
+            udpLastSeq = hdr->seq;
+        }
+        else {
+            udpDatagramsReordered++;
+            if (udpDatagramsLost) { udpDatagramsLost--; }
+        }
+
+        // Ignore fragments of packets that were already delivered or given up on
+        if ((int32_t)(hdr->packetSeq - udpNextPacketSeq) < 0) { return; }
+
+        // Store the fragment
+        UDPReassembly& pkt = udpPackets[hdr->packetSeq];
+        if (pkt.received.empty()) {
+            pkt.received.resize(hdr->fragmentCount, false);
+            pkt.data.resize(hdr->fragmentCount * SERVER_UDP_MAX_PAYLOAD);
+            pkt.timestamp = hdr->timestamp;
+            pkt.sampleCount = hdr->sampleCount;
+        }
+        if (pkt.received.size() != hdr->fragmentCount || pkt.received[hdr->fragment]) { return; }
+        memcpy(&pkt.data[hdr->fragment * SERVER_UDP_MAX_PAYLOAD], &buf[sizeof(UDPHeader)], payloadSize);
+        pkt.received[hdr->fragment] = true;
+        pkt.receivedCount++;
+        if (last) { pkt.size = hdr->fragment * SERVER_UDP_MAX_PAYLOAD + payloadSize; }
+
+        deliverUDPPackets(hdr->packetSeq);
+    }
+
+    void ClientClass::deliverUDPPackets(uint32_t newestSeq) {
+        // Deliver complete packets in order
+        while (!udpPackets.empty()) {
+            auto it = udpPackets.find(udpNextPacketSeq);
+            bool complete = (it != udpPackets.end() && it->second.receivedCount == it->second.received.size());
+            if (!complete) {
+                // Give the missing fragments some time to show up before declaring the packet lost
+                if ((int32_t)(newestSeq - udpNextPacketSeq) < UDP_REORDER_WINDOW) { return; }
+                if (it != udpPackets.end()) { udpPackets.erase(it); }
+                udpPacketsLost++;
+                udpNextPacketSeq++;
+                continue;
+            }
+            deliverUDPPacket(it->second);
+            udpPackets.erase(it);
+            udpNextPacketSeq++;
+        }
+    }
+
+    void ClientClass::deliverUDPPacket(UDPReassembly& pkt) {
+        PacketHeader* hdr = (PacketHeader*)pkt.data.data();
+        if (pkt.size < sizeof(PacketHeader) || hdr->size != pkt.size) { return; }
+
+        // Find out which stream the packet belongs to
+        int64_t streamId = -1;
+        if (hdr->type == PACKET_TYPE_VFO) {
+            if (pkt.size < sizeof(PacketHeader) + sizeof(VFOHeader)) { return; }
+            streamId = ((VFOHeader*)&pkt.data[sizeof(PacketHeader)])->id;
+        }
+        else if (hdr->type != PACKET_TYPE_BASEBAND && hdr->type != PACKET_TYPE_BASEBAND_COMPRESSED) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lck(dataMtx);
+
+        // Fill whatever the stream is missing with silence and drop data that arrived too late
+        auto it = expectedTimestamps.find(streamId);
+        if (it != expectedTimestamps.end()) {
+            int64_t gap = (int64_t)(pkt.timestamp - it->second);
+            if (gap < 0) { return; }
+            if (gap > 0) { queueSilence(streamId, gap); }
+        }
+        expectedTimestamps[streamId] = pkt.timestamp + pkt.sampleCount;
+
+        queueDataPacket(hdr);
+    }
+
+    // Returns the size of the silent block written to the buffer
+    int writeSilence(uint8_t* buf, int count) {
+        *(uint16_t*)&buf[0] = 0;
+        *(uint16_t*)&buf[2] = dsp::compression::PCM_TYPE_F32;
+        *(float*)&buf[4] = 0;
+        memset(&buf[8], 0, count * sizeof(dsp::complex_t));
+        return 8 + (count * sizeof(dsp::complex_t));
+    }
+
+    void ClientClass::conceal(int64_t streamId, uint64_t count) {
+        // Anything longer than a buffer is an outage more than packet loss, don't try to fill all of it
+        int fillCount = std::min<uint64_t>(count, STREAM_BUFFER_SIZE);
+        udpSamplesConcealed += fillCount;
+
+        if (streamId < 0) {
+            if (health) { health->gap(count); }
+            swapBaseband(writeSilence(decompIn.writeBuf, fillCount), true);
+            return;
+        }
+        std::shared_ptr<RemoteVFO> vfo = getVFO(streamId);
+        if (vfo) { vfo->decompIn.swap(writeSilence(vfo->decompIn.writeBuf, fillCount)); }
+    }
+
     void ClientClass::sendPacket(PacketType type, int len) {
         s_pkt_hdr->type = type;
         s_pkt_hdr->size = sizeof(PacketHeader) + len;
@@ -251,19 +779,35 @@ namespace server {
 
     PacketWaiter* ClientClass::awaitCommandAck(Command cmd) {
         PacketWaiter* waiter = new PacketWaiter;
+        std::lock_guard<std::mutex> lck(waitersMtx);
         commandAckWaiters[waiter] = cmd;
         return waiter;
     }
 
     void ClientClass::dHandler(dsp::complex_t *data, int count, void *ctx) {
         ClientClass* _this = (ClientClass*)ctx;
+
+        // Blocks come out of the decompressor in the order they went in
+        bool concealed = false;
+        {
+            std::lock_guard<std::mutex> lck(_this->concealedMtx);
+            auto& blocks = _this->concealedBlocks;
+            while (!blocks.empty() && blocks.front() < _this->basebandBlocksOut) { blocks.pop_front(); }
+            if (!blocks.empty() && blocks.front() == _this->basebandBlocksOut) {
+                concealed = true;
+                blocks.pop_front();
+            }
+        }
+        _this->basebandBlocksOut++;
+
         memcpy(_this->output->writeBuf, data, count * sizeof(dsp::complex_t));
+        if (_this->health && !concealed) { _this->health->delivered(count); }
         _this->output->swap(count);
     }
 
     Client connect(std::string host, uint16_t port, dsp::stream<dsp::complex_t>* out) {
         net::Conn conn = net::connect(host, port);
         if (!conn) { return NULL; }
-        return Client(new ClientClass(std::move(conn), out));
+        return Client(new ClientClass(std::move(conn), host, out));
     }
 }
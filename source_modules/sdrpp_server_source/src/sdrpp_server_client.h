@@ -2,15 +2,20 @@
 #include <utils/networking.h>
 #include <dsp/stream.h>
 #include <dsp/types.h>
+#include <signal_path/source_health.h>
 #include <atomic>
 #include <queue>
+#include <deque>
+#include <chrono>
 #include <server_protocol.h>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <vector>
 #include <dsp/compression/sample_stream_decompressor.h>
 #include <dsp/sink.h>
 #include <dsp/routing/stream_link.h>
+#include <dsp/sink/handler_sink.h>
 #include <zstd.h>
 
 #define RFSPACE_MAX_SIZE                8192
@@ -19,6 +24,12 @@
 
 #define PROTOCOL_TIMEOUT_MS             10000
 
+// Number of packets to wait for missing fragments before declaring a UDP packet lost
+#define UDP_REORDER_WINDOW              8
+
+// Maximum amount of received data waiting for decompression, readers block beyond that
+#define RX_QUEUE_MAX_BYTES              (64 * 1024 * 1024)
+
 namespace server {
     class PacketWaiter {
     public:
@@ -75,9 +86,49 @@ namespace server {
         std::mutex handledMtx;
     };
 
+    struct RemoteVFO {
+        dsp::stream<uint8_t> decompIn;
+        dsp::compression::SampleStreamDecompressor decomp;
+        dsp::routing::StreamLink<dsp::complex_t> link;
+    };
+
+    struct UDPReassembly {
+        std::vector<uint8_t> data;
+        std::vector<bool> received;
+        int receivedCount = 0;
+        int size = 0;
+        uint64_t timestamp;
+        uint32_t sampleCount;
+    };
+
+    struct UDPStats {
+        uint64_t datagrams;
+        uint64_t datagramsLost;
+        uint64_t datagramsReordered;
+        uint64_t packetsLost;
+        uint64_t samplesConcealed;
+    };
+
+    struct RxBlock {
+        bool silence;
+        int64_t streamId;
+        uint64_t silenceCount;
+        std::vector<uint8_t> data;
+        uint64_t samples;       // Baseband samples carried, estimated for compressed packets
+        std::chrono::steady_clock::time_point arrival;
+    };
+
+    struct RxStats {
+        int queueDepth;
+        int maxQueueDepth;
+        double bufferedMs;
+        uint64_t stalls;
+        double decompressTimeMs;
+    };
+
     class ClientClass {
     public:
-        ClientClass(net::Conn conn, dsp::stream<dsp::complex_t>* out);
+        ClientClass(net::Conn conn, std::string host, dsp::stream<dsp::complex_t>* out);
         ~ClientClass();
 
         void showMenu();
@@ -86,7 +137,18 @@ namespace server {
         double getSampleRate();
         
         void setSampleType(dsp::compression::PCMType type);
-        void setCompression(bool enabled);
+        void setCompression(CompressionMode mode);
+        void setFullIQ(bool enabled);
+        bool setUDP(bool enabled, uint32_t bitrate = 0);
+        UDPStats getUDPStats();
+
+        // After a stall, data is held back until this much has arrived, 0 to disable
+        void setJitterBuffer(int ms);
+        RxStats getRxStats();
+
+        int addVFO(double offset, double bandwidth, double sampleRate, dsp::stream<dsp::complex_t>* out);
+        bool setVFOParams(int id, double offset, double bandwidth, double sampleRate);
+        void removeVFO(int id);
 
         void start();
         void stop();
@@ -97,10 +159,36 @@ namespace server {
         int bytes = 0;
         bool serverBusy = false;
 
+        // Optional delivery counters of the baseband stream
+        SourceHealth* health = NULL;
+
     private:
         static void tcpHandler(int count, uint8_t* buf, void* ctx);
 
         int getUI();
+        bool sendVFOCommand(Command cmd, int len);
+        void handleDataPacket(PacketHeader* hdr, uint8_t* data);
+        void handleVFOPacket(uint8_t* data, int len);
+        void swapBaseband(int size, bool concealed);
+        std::shared_ptr<RemoteVFO> getVFO(uint32_t id);
+        static void stopVFO(RemoteVFO* vfo);
+
+        void queueDataPacket(PacketHeader* hdr);
+        void queueSilence(int64_t streamId, uint64_t count);
+        void queueBlock(RxBlock* blk);
+        RxBlock* getFreeBlock();
+        uint64_t getPacketSamples(PacketHeader* hdr);
+        double getBufferedMs();
+        void stopRxWorker();
+        void rxWorker();
+
+        void closeUDP();
+        void udpWorker();
+        void udpHelloWorker();
+        void handleDatagram(uint8_t* buf, int len);
+        void deliverUDPPackets(uint32_t newestSeq);
+        void deliverUDPPacket(UDPReassembly& pkt);
+        void conceal(int64_t streamId, uint64_t count);
 
         void sendPacket(PacketType type, int len);
         void sendCommand(Command cmd, int len);
@@ -109,16 +197,27 @@ namespace server {
         PacketWaiter* awaitCommandAck(Command cmd);
         void commandAckHandled(PacketWaiter* waiter);
         std::map<PacketWaiter*, Command> commandAckWaiters;
+        std::mutex waitersMtx;
+
+        // Held while a command is built in the send buffer, sent and acknowledged, commands come from several threads
+        std::recursive_mutex cmdMtx;
 
         static void dHandler(dsp::complex_t *data, int count, void *ctx);
 
         net::Conn client;
+        std::string host;
 
         dsp::stream<uint8_t> decompIn;
         dsp::compression::SampleStreamDecompressor decomp;
-        dsp::routing::StreamLink<dsp::complex_t> link;
+        dsp::sink::Handler<dsp::complex_t> sink;
         dsp::stream<dsp::complex_t>* output;
 
+        // Baseband blocks given to the decompressor, concealed ones are reported as gaps and not as delivered samples
+        uint64_t basebandBlocksIn = 0;
+        uint64_t basebandBlocksOut = 0;
+        std::deque<uint64_t> concealedBlocks;
+        std::mutex concealedMtx;
+
         uint8_t* rbuffer = NULL;
         uint8_t* sbuffer = NULL;
 
@@ -136,11 +235,57 @@ namespace server {
         std::mutex dlMtx;
 
         ZSTD_DCtx* dctx;
+        std::mutex dataMtx;
+
+        // Shared so that a packet being written to a VFO keeps it alive while it gets removed
+        std::map<uint32_t, std::shared_ptr<RemoteVFO>> vfos;
+        std::mutex vfoMtx;
+        uint32_t nextVFOId = 0;
+
+        std::atomic<double> currentSampleRate = 1000000.0;
+
+        // Receive pipeline, readers queue packets and the worker decompresses them and feeds the DSP
+        std::deque<RxBlock*> rxQueue;
+        std::vector<RxBlock*> rxPool;
+        std::mutex rxMtx;
+        std::condition_variable rxCnd;
+        std::condition_variable rxSpaceCnd;
+        bool rxStop = false;
+        std::thread rxThread;
+        std::atomic<int> jitterMs = 0;
+        uint64_t rxQueuedBytes = 0;
+        uint64_t rxQueuedSamples = 0;
+        std::atomic<double> rxBytesPerSample = 0.0;    // Of the last decompressed baseband block
+        int rxMaxQueueDepth = 0;
+        std::atomic<uint64_t> rxStalls = 0;
+        std::atomic<uint64_t> decompressTimeNs = 0;
+        std::atomic<uint64_t> decompressedBlocks = 0;
+
+        // UDP data channel
+        net::Conn udpConn;
+        std::thread udpThread;
+        std::thread udpHelloThread;
+        std::mutex udpHelloMtx;
+        std::condition_variable udpHelloCnd;
+        std::atomic<bool> udpStop = false;
+        uint32_t udpToken = 0;
+
+        // UDP reassembly and loss concealment state, only touched by the UDP worker
+        std::map<uint32_t, UDPReassembly> udpPackets;
+        bool udpSynced = false;
+        uint32_t udpLastSeq = 0;
+        uint32_t udpNextPacketSeq = 0;
+        std::map<int64_t, uint64_t> expectedTimestamps;
 
-        double currentSampleRate = 1000000.0;
+        std::atomic<uint64_t> udpDatagrams = 0;
+        std::atomic<uint64_t> udpDatagramsLost = 0;
+        std::atomic<uint64_t> udpDatagramsReordered = 0;
+        std::atomic<uint64_t> udpPacketsLost = 0;
+        std::atomic<uint64_t> udpSamplesConcealed = 0;
     };
 
-    typedef std::unique_ptr<ClientClass> Client;
+    // Shared so that a command sent through the module interface keeps the client alive without holding its lock
+    typedef std::shared_ptr<ClientClass> Client;
 
     Client connect(std::string host, uint16_t port, dsp::stream<dsp::complex_t>* out);
 }
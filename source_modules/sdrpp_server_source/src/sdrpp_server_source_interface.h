@@ -0,0 +1,19 @@
+#pragma once
+#include <dsp/stream.h>
+#include <dsp/types.h>
+
+enum {
+    SDRPP_SERVER_SOURCE_IFACE_CMD_ADD_VFO,
+    SDRPP_SERVER_SOURCE_IFACE_CMD_SET_VFO_PARAMS,
+    SDRPP_SERVER_SOURCE_IFACE_CMD_REMOVE_VFO
+};
+
+// Channel extracted on the server and streamed alongside the baseband. Channels belong
+// to the current connection, they stop delivering samples once it is closed.
+struct SDRPPServerVFO {
+    int id;                                 // Set by ADD_VFO (-1 on failure), given to the other commands
+    double offset;                          // From the center frequency, in Hz
+    double bandwidth;
+    double sampleRate;
+    dsp::stream<dsp::complex_t>* out;       // Only used by ADD_VFO
+};
@@ -49,6 +49,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
         sigpath::sourceManager.registerSource("SoapySDR", &handler);
     }
 
@@ -334,6 +335,7 @@ private:
 
         _this->devStream = _this->dev->setupStream(SOAPY_SDR_RX, "CF32");
         _this->dev->activateStream(_this->devStream);
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         _this->workerThread = std::thread(_worker, _this);
         flog::info("SoapyModule '{0}': Start!", _this->name);
@@ -343,6 +345,7 @@ private:
         SoapyModule* _this = (SoapyModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         _this->dev->deactivateStream(_this->devStream);
         _this->dev->closeStream(_this->devStream);
         _this->stream.stopWriter();
@@ -484,9 +487,11 @@ private:
 
         while (_this->running) {
             int res = _this->dev->readStream(_this->devStream, (void**)&_this->stream.writeBuf, blockSize, flags, timeMs);
+            if (res == SOAPY_SDR_OVERFLOW) { _this->health.gap(); }
             if (res < 1) {
                 continue;
             }
+            _this->health.delivered(res);
             if (!_this->stream.swap(res)) { return; }
         }
     }
@@ -496,6 +501,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     SoapySDR::Stream* devStream;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     SoapySDR::KwargsList devList;
     SoapySDR::Kwargs devArgs;
     SoapySDR::Device* dev;
@@ -38,6 +38,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         sigpath::sourceManager.registerSource("Spectran HTTP", &handler);
     }
@@ -82,6 +83,7 @@ private:
         if (_this->running && connected) { return; }
 
         // TODO: Start
+        _this->health.start(_this->sampleRate);
         _this->client->streaming(true);
 
         // TODO: Set options
@@ -94,6 +96,7 @@ private:
         SpectranHTTPSourceModule* _this = (SpectranHTTPSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         
         // TODO: Implement stop
         _this->client->streaming(false);
@@ -166,6 +169,7 @@ private:
             client = std::make_shared<SpectranHTTPClient>(hostname, port, &stream);
             onFreqChangedId = client->onCenterFrequencyChanged.bind(&SpectranHTTPSourceModule::onFreqChanged, this);
             onSamplerateChangedId = client->onSamplerateChanged.bind(&SpectranHTTPSourceModule::onSamplerateChanged, this);
+            client->health = &health;
             client->startWorker();
         }
         catch (std::runtime_error e) {
@@ -181,6 +185,8 @@ private:
     }
 
     void onSamplerateChanged(double newSr) {
+        sampleRate = newSr;
+        health.setExpectedRate(newSr);
         core::setInputSampleRate(newSr);
     }
 
@@ -188,6 +194,7 @@ private:
     bool enabled = true;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
 
     std::shared_ptr<SpectranHTTPClient> client;
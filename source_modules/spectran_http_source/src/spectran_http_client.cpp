@@ -141,6 +141,7 @@ void SpectranHTTPClient::worker() {
 
         // Swap to stream
         if (streamingEnabled) {
+            if (health) { health->delivered(sampCount); }
             if (!stream->swap(sampCount)) { return; }
         }
         
@@ -1,6 +1,7 @@
 #pragma once
 #include <dsp/stream.h>
 #include <dsp/types.h>
+#include <signal_path/source_health.h>
 #include <string>
 #include <thread>
 #include <utils/proto/http.h>
@@ -21,6 +22,9 @@ public:
     NewEvent<uint64_t> onCenterFrequencyChanged;
     NewEvent<uint64_t> onSamplerateChanged;
 
+    // Optional delivery counters of the source, must be set before starting the worker
+    SourceHealth* health = NULL;
+
 private:
     void worker();
 
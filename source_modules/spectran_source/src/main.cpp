@@ -59,6 +59,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         refresh();
 
@@ -287,6 +288,7 @@ private:
 
         _this->workerThread = std::thread(&SpectranSourceModule::worker, _this);
 
+        _this->health.start(_this->samplerate.effective);
         _this->running = true;
         flog::info("SpectranSourceModule '{0}': Start!", _this->name);
     }
@@ -295,6 +297,7 @@ private:
         SpectranSourceModule* _this = (SpectranSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         
         _this->stream.stopWriter();
         AARTSAAPI_StopDevice(&_this->dev);
@@ -417,6 +420,7 @@ private:
 
             // Write data
             memcpy(stream.writeBuf, pkt.fp32, pkt.num * sizeof(dsp::complex_t));
+            health.delivered(pkt.num);
             if (!stream.swap(pkt.num)) {
                 AARTSAAPI_ConsumePackets(&dev, 0, 1);
                 break;
@@ -487,6 +491,7 @@ private:
     bool enabled = true;
     dsp::stream<dsp::complex_t> stream;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     double freq;
     
@@ -64,6 +64,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         strcpy(hostname, host.c_str());
 
@@ -134,6 +135,7 @@ private:
         _this->client->setSetting(SPYSERVER_SETTING_STREAMING_MODE, SPYSERVER_STREAM_MODE_IQ_ONLY);
         _this->client->setSetting(SPYSERVER_SETTING_GAIN, _this->gain);
         _this->client->setSetting(SPYSERVER_SETTING_IQ_DIGITAL_GAIN, _this->client->computeDigitalGain(srvBits, _this->gain, _this->srId + _this->client->devInfo.MinimumIQDecimation));
+        _this->health.start(_this->sampleRate);
         _this->client->startStream();
 
         _this->running = true;
@@ -147,6 +149,7 @@ private:
         _this->client->stopStream();
 
         _this->running = false;
+        _this->health.stop();
         flog::info("SpyServerSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -244,6 +247,7 @@ private:
         try {
             if (client) { client.reset(); }
             client = spyserver::connect(hostname, port, &stream);
+            if (client) { client->health = &health; }
 
             if (!client->waitForDevInfo(3000)) {
                 flog::error("SpyServer didn't respond with device information");
@@ -308,6 +312,7 @@ private:
 
     dsp::stream<dsp::complex_t> stream;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
 
     spyserver::SpyServerClient client;
 };
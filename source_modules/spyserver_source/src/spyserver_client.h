@@ -3,6 +3,7 @@
 #include <spyserver_protocol.h>
 #include <dsp/stream.h>
 #include <dsp/types.h>
+#include <signal_path/source_health.h>
 
 namespace spyserver {
     class SpyServerClientClass {
@@ -24,6 +25,9 @@ namespace spyserver {
 
         SpyServerDeviceInfo devInfo;
 
+        // Optional delivery counters of the source
+        SourceHealth* health = NULL;
+
     private:
         void sendCommand(uint32_t command, void* data, int len);
         void sendHandshake(std::string appName);
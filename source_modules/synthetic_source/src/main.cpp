@@ -0,0 +1,361 @@
+#include <utils/flog.h>
+#include <module.h>
+#include <gui/gui.h>
+#include <gui/smgui.h>
+#include <signal_path/signal_path.h>
+#include <core.h>
+#include <config.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "scene.h"
+
+#define CONCAT(a, b) ((std::string(a) + b).c_str())
+
+SDRPP_MOD_INFO{
+    /* Name:            */ "synthetic_source",
+    /* Description:     */ "Synthetic signal source module for SDR++",
+    /* Author:          */ "Ryzerth",
+    /* Version:         */ 0, 1, 0,
+    /* Max instances    */ 1
+};
+
+ConfigManager config;
+
+const char* carrierTypesTxt = "AM\0FM\0PSK\0GFSK\0Sweep\0Burst\0";
+const char* carrierTypeNames[] = { "AM", "FM", "PSK", "GFSK", "Sweep", "Burst" };
+const char* carrierRateLabels[] = { "Tone (Hz)", "Tone (Hz)", "Symbol rate", "Symbol rate", "Sweeps/s", "Bursts/s" };
+const char* carrierParamLabels[] = { "Depth (%)", "Deviation (Hz)", "Order", "Deviation (Hz)", "Span (Hz)", "Length (ms)" };
+
+class SyntheticSourceModule : public ModuleManager::Instance {
+public:
+    SyntheticSourceModule(std::string name) {
+        this->name = name;
+
+        config.acquire();
+        if (config.conf.contains("sampleRate")) {
+            sampleRate = config.conf["sampleRate"];
+        }
+        if (config.conf.contains("seed")) {
+            seed = config.conf["seed"];
+        }
+        if (config.conf.contains("noiseLevel")) {
+            noiseLevel = config.conf["noiseLevel"];
+        }
+        if (config.conf.contains("unthrottled")) {
+            unthrottled = config.conf["unthrottled"];
+        }
+        if (config.conf.contains("carriers")) {
+            for (auto const& c : config.conf["carriers"]) {
+                synthetic::CarrierConfig carrier;
+                carrier.type = std::clamp<int>(c["type"], synthetic::CARRIER_AM, synthetic::CARRIER_BURST);
+                carrier.offset = c["offset"];
+                carrier.level = c["level"];
+                carrier.rate = c["rate"];
+                carrier.param = c["param"];
+                carriers.push_back(carrier);
+            }
+        }
+        config.release();
+        refreshCarrierList();
+
+        handler.ctx = this;
+        handler.selectHandler = menuSelected;
+        handler.deselectHandler = menuDeselected;
+        handler.menuHandler = menuHandler;
+        handler.startHandler = start;
+        handler.stopHandler = stop;
+        handler.tuneHandler = tune;
+        handler.stream = &stream;
+        sigpath::sourceManager.registerSource("Synthetic", &handler);
+    }
+
+    ~SyntheticSourceModule() {
+        stop(this);
+        sigpath::sourceManager.unregisterSource("Synthetic");
+    }
+
+    void postInit() {}
+
+    void enable() {
+        enabled = true;
+    }
+
+    void disable() {
+        enabled = false;
+    }
+
+    bool isEnabled() {
+        return enabled;
+    }
+
+private:
+    static void menuSelected(void* ctx) {
+        SyntheticSourceModule* _this = (SyntheticSourceModule*)ctx;
+        core::setInputSampleRate(_this->sampleRate);
+        flog::info("SyntheticSourceModule '{0}': Menu Select!", _this->name);
+    }
+
+    static void menuDeselected(void* ctx) {
+        SyntheticSourceModule* _this = (SyntheticSourceModule*)ctx;
+        flog::info("SyntheticSourceModule '{0}': Menu Deselect!", _this->name);
+    }
+
+    static void start(void* ctx) {
+        SyntheticSourceModule* _this = (SyntheticSourceModule*)ctx;
+        if (_this->running) { return; }
+
+        // Always start from a fresh scene so that every run produces the same samples
+        _this->rebuildScene();
+        _this->outputRate = 0;
+        _this->running = true;
+        _this->workerThread = std::thread(worker, _this);
+        flog::info("SyntheticSourceModule '{0}': Start!", _this->name);
+    }
+
+    static void stop(void* ctx) {
+        SyntheticSourceModule* _this = (SyntheticSourceModule*)ctx;
+        if (!_this->running) { return; }
+        _this->stream.stopWriter();
+        _this->workerThread.join();
+        _this->stream.clearWriteStop();
+        _this->running = false;
+        flog::info("SyntheticSourceModule '{0}': Stop!", _this->name);
+    }
+
+    static void tune(double freq, void* ctx) {
+        // The scene is defined relative to the center frequency, so there's nothing to retune
+        SyntheticSourceModule* _this = (SyntheticSourceModule*)ctx;
+        flog::info("SyntheticSourceModule '{0}': Tune: {1}!", _this->name, freq);
+    }
+
+    static void menuHandler(void* ctx) {
+        SyntheticSourceModule* _this = (SyntheticSourceModule*)ctx;
+
+        if (_this->running) { SmGui::BeginDisabled(); }
+        SmGui::LeftLabel("Samplerate");
+        SmGui::FillWidth();
+        if (SmGui::InputInt(CONCAT("##_synthetic_sr_", _this->name), &_this->sampleRate, 0)) {
+            _this->sampleRate = std::clamp<int>(_this->sampleRate, 1000, 1000000000);
+            core::setInputSampleRate(_this->sampleRate);
+            config.acquire();
+            config.conf["sampleRate"] = _this->sampleRate;
+            config.release(true);
+        }
+
+        SmGui::LeftLabel("Seed");
+        SmGui::FillWidth();
+        if (SmGui::InputInt(CONCAT("##_synthetic_seed_", _this->name), &_this->seed)) {
+            config.acquire();
+            config.conf["seed"] = _this->seed;
+            config.release(true);
+        }
+        if (_this->running) { SmGui::EndDisabled(); }
+
+        SmGui::LeftLabel("Noise (dB)");
+        SmGui::FillWidth();
+        float noiseLevel = _this->noiseLevel;
+        if (SmGui::SliderFloat(CONCAT("##_synthetic_noise_", _this->name), &noiseLevel, -150.0f, 0.0f, SmGui::FMT_STR_FLOAT_ONE_DECIMAL)) {
+            std::lock_guard<std::mutex> lck(_this->sceneMtx);
+            _this->noiseLevel = noiseLevel;
+            _this->sceneChanged();
+        }
+
+        bool unthrottled = _this->unthrottled;
+        if (SmGui::Checkbox(CONCAT("Unthrottled##_synthetic_unthrottled_", _this->name), &unthrottled)) {
+            _this->unthrottled = unthrottled;
+            config.acquire();
+            config.conf["unthrottled"] = unthrottled;
+            config.release(true);
+        }
+
+        // Carrier list, the selected one is edited below
+        SmGui::LeftLabel("Carrier");
+        SmGui::FillWidth();
+        SmGui::Combo(CONCAT("##_synthetic_carrier_", _this->name), &_this->carrierId, _this->carrierListTxt.c_str());
+        if (SmGui::Button(CONCAT("Add##_synthetic_add_", _this->name))) {
+            std::lock_guard<std::mutex> lck(_this->sceneMtx);
+            _this->carriers.push_back(synthetic::CarrierConfig());
+            _this->carrierId = _this->carriers.size() - 1;
+            _this->sceneChanged();
+        }
+        SmGui::SameLine();
+        if (SmGui::Button(CONCAT("Remove##_synthetic_rem_", _this->name)) && _this->carrierId < _this->carriers.size()) {
+            std::lock_guard<std::mutex> lck(_this->sceneMtx);
+            _this->carriers.erase(_this->carriers.begin() + _this->carrierId);
+            _this->carrierId = std::max<int>(0, _this->carrierId - 1);
+            _this->sceneChanged();
+        }
+
+        if (_this->carrierId < _this->carriers.size()) {
+            synthetic::CarrierConfig c = _this->carriers[_this->carrierId];
+            bool changed = false;
+
+            SmGui::LeftLabel("Type");
+            SmGui::FillWidth();
+            changed |= SmGui::Combo(CONCAT("##_synthetic_type_", _this->name), &c.type, carrierTypesTxt);
+
+            SmGui::LeftLabel("Offset (Hz)");
+            SmGui::FillWidth();
+            changed |= SmGui::InputInt(CONCAT("##_synthetic_offset_", _this->name), &c.offset, 0);
+
+            SmGui::LeftLabel("Level (dB)");
+            SmGui::FillWidth();
+            changed |= SmGui::SliderFloat(CONCAT("##_synthetic_level_", _this->name), &c.level, -150.0f, 0.0f, SmGui::FMT_STR_FLOAT_ONE_DECIMAL);
+
+            SmGui::LeftLabel(carrierRateLabels[c.type]);
+            SmGui::FillWidth();
+            changed |= SmGui::InputInt(CONCAT("##_synthetic_rate_", _this->name), &c.rate, 0);
+
+            SmGui::LeftLabel(carrierParamLabels[c.type]);
+            SmGui::FillWidth();
+            changed |= SmGui::InputInt(CONCAT("##_synthetic_param_", _this->name), &c.param, 0);
+
+            if (changed) {
+                // Keep the carrier inside the band, only a sweep can go down
+                int nyquist = _this->sampleRate / 2;
+                c.offset = std::clamp<int>(c.offset, -nyquist, nyquist);
+                c.rate = std::clamp<int>(c.rate, (c.type == synthetic::CARRIER_SWEEP) ? -nyquist : 1, nyquist);
+                c.param = std::max<int>(c.param, 0);
+
+                std::lock_guard<std::mutex> lck(_this->sceneMtx);
+                _this->carriers[_this->carrierId] = c;
+                _this->sceneChanged();
+            }
+        }
+
+        if (_this->running) {
+            char buf[128];
+            sprintf(buf, "Output: %.2f MS/s", _this->outputRate / 1e6);
+            SmGui::Text(buf);
+        }
+    }
+
+    // Save the scene and have the worker pick it up, sceneMtx must be held
+    void sceneChanged() {
+        refreshCarrierList();
+        sceneDirty = true;
+
+        config.acquire();
+        config.conf["noiseLevel"] = noiseLevel;
+        config.conf["carriers"] = json::array();
+        for (auto const& c : carriers) {
+            json carrier;
+            carrier["type"] = c.type;
+            carrier["offset"] = c.offset;
+            carrier["level"] = c.level;
+            carrier["rate"] = c.rate;
+            carrier["param"] = c.param;
+            config.conf["carriers"].push_back(carrier);
+        }
+        config.release(true);
+    }
+
+    void refreshCarrierList() {
+        carrierListTxt.clear();
+        for (auto const& c : carriers) {
+            char buf[128];
+            sprintf(buf, "%s %+.3f MHz", carrierTypeNames[c.type], c.offset / 1e6);
+            carrierListTxt += buf;
+            carrierListTxt += '\0';
+        }
+        carrierId = std::clamp<int>(carrierId, 0, std::max<int>(0, carriers.size() - 1));
+    }
+
+    void rebuildScene() {
+        std::lock_guard<std::mutex> lck(sceneMtx);
+        scene = std::make_unique<synthetic::Scene>(sampleRate, seed, noiseLevel, carriers);
+        sceneDirty = false;
+    }
+
+    static void worker(void* ctx) {
+        SyntheticSourceModule* _this = (SyntheticSourceModule*)ctx;
+        double sampleRate = _this->sampleRate;
+        int blockSize = std::clamp<int>(sampleRate / 200.0, 1, SYNTHETIC_MAX_BLOCK);
+        auto nextTime = std::chrono::steady_clock::now();
+        auto rateTime = nextTime;
+        uint64_t rateCount = 0;
+
+        while (true) {
+            if (_this->sceneDirty) { _this->rebuildScene(); }
+            _this->scene->generate(_this->stream.writeBuf, blockSize);
+            if (!_this->stream.swap(blockSize)) { break; }
+
+            // Measure the actual output rate, mostly useful when unthrottled
+            auto now = std::chrono::steady_clock::now();
+            rateCount += blockSize;
+            double elapsed = std::chrono::duration<double>(now - rateTime).count();
+            if (elapsed >= 1.0) {
+                _this->outputRate = rateCount / elapsed;
+                rateCount = 0;
+                rateTime = now;
+            }
+
+            if (_this->unthrottled) {
+                nextTime = now;
+                continue;
+            }
+
+            // Don't try to catch up after falling behind by a lot, eg. when the DSP was blocked
+            nextTime += std::chrono::nanoseconds((int64_t)((double)blockSize * 1e9 / sampleRate));
+            if (now - nextTime > std::chrono::milliseconds(100)) { nextTime = now; }
+            std::this_thread::sleep_until(nextTime);
+        }
+    }
+
+    std::string name;
+    bool enabled = true;
+    dsp::stream<dsp::complex_t> stream;
+    SourceManager::SourceHandler handler;
+    bool running = false;
+    std::thread workerThread;
+
+    int sampleRate = 2400000;
+    int seed = 1;
+    float noiseLevel = -60.0f;
+    std::atomic<bool> unthrottled = false;
+    std::atomic<double> outputRate = 0;
+
+    std::vector<synthetic::CarrierConfig> carriers;
+    std::string carrierListTxt;
+    int carrierId = 0;
+
+    std::mutex sceneMtx;
+    std::unique_ptr<synthetic::Scene> scene;
+    std::atomic<bool> sceneDirty = false;
+};
+
+MOD_EXPORT void _INIT_() {
+    json def = json({});
+    def["sampleRate"] = 2400000;
+    def["seed"] = 1;
+    def["noiseLevel"] = -60.0f;
+    def["unthrottled"] = false;
+
+    // Default scene with one of each kind of carrier
+    def["carriers"] = json::array();
+    def["carriers"].push_back({ { "type", synthetic::CARRIER_FM }, { "offset", -600000 }, { "level", -30.0f }, { "rate", 1000 }, { "param", 75000 } });
+    def["carriers"].push_back({ { "type", synthetic::CARRIER_AM }, { "offset", -250000 }, { "level", -40.0f }, { "rate", 800 }, { "param", 50 } });
+    def["carriers"].push_back({ { "type", synthetic::CARRIER_PSK }, { "offset", 150000 }, { "level", -35.0f }, { "rate", 50000 }, { "param", 4 } });
+    def["carriers"].push_back({ { "type", synthetic::CARRIER_GFSK }, { "offset", 400000 }, { "level", -35.0f }, { "rate", 9600 }, { "param", 2400 } });
+    def["carriers"].push_back({ { "type", synthetic::CARRIER_SWEEP }, { "offset", 800000 }, { "level", -45.0f }, { "rate", 2 }, { "param", 200000 } });
+    def["carriers"].push_back({ { "type", synthetic::CARRIER_BURST }, { "offset", -950000 }, { "level", -30.0f }, { "rate", 5 }, { "param", 20 } });
+
+    config.setPath(core::args["root"].s() + "/synthetic_source_config.json");
+    config.load(def);
+    config.enableAutoSave();
+}
+
+MOD_EXPORT ModuleManager::Instance* _CREATE_INSTANCE_(std::string name) {
+    return new SyntheticSourceModule(name);
+}
+
+MOD_EXPORT void _DELETE_INSTANCE_(ModuleManager::Instance* instance) {
+    delete (SyntheticSourceModule*)instance;
+}
+
+MOD_EXPORT void _END_() {
+    config.disableAutoSave();
+    config.save();
+}
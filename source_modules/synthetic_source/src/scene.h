@@ -0,0 +1,302 @@
+#pragma once
+#include <dsp/types.h>
+#include <dsp/mod/gfsk.h>
+#include <dsp/mod/psk.h>
+#include <dsp/mod/quadrature.h>
+#include <dsp/channel/frequency_xlator.h>
+#include <dsp/math/phasor.h>
+#include <dsp/math/hz_to_rads.h>
+#include <dsp/math/normalize_phase.h>
+#include <dsp/math/constants.h>
+#include <memory>
+#include <random>
+#include <vector>
+#include <string>
+#include <math.h>
+
+// Number of samples in the precomputed noise table, must be a power of two
+#define SYNTHETIC_NOISE_TABLE_SIZE  (1 << 20)
+
+// Largest block the scene is asked to generate at once
+#define SYNTHETIC_MAX_BLOCK         (STREAM_BUFFER_SIZE / 4)
+
+/*
+    Deterministic signal scene for testing without hardware. Everything random is drawn from
+    std::mt19937 seeded with the scene seed, which is fully specified by the standard,
+    so a given seed and configuration always produce the same samples.
+*/
+
+namespace synthetic {
+    enum CarrierType {
+        CARRIER_AM,
+        CARRIER_FM,
+        CARRIER_PSK,
+        CARRIER_GFSK,
+        CARRIER_SWEEP,
+        CARRIER_BURST
+    };
+
+    struct CarrierConfig {
+        int type = CARRIER_FM;
+        int offset = 0;     // Hz from the center frequency
+        float level = -20;  // dBFS
+        int rate = 1000;    // Modulating tone (AM/FM), symbol rate (PSK/GFSK), sweeps per second (sweep) or bursts per second (burst) in Hz
+        int param = 0;      // Modulation depth in percent (AM), deviation in Hz (FM/GFSK), constellation order (PSK), span in Hz (sweep) or burst length in ms (burst)
+    };
+
+    inline float dbToAmplitude(float db) {
+        return powf(10.0f, db / 20.0f);
+    }
+
+    class Carrier {
+    public:
+        virtual ~Carrier() {}
+
+        // Add count samples of the carrier to out
+        virtual void generate(dsp::complex_t* out, int count) = 0;
+    };
+
+    // Tone modulated AM or FM, the modulator works at baseband and is moved to the offset afterwards
+    class AnalogCarrier : public Carrier {
+    public:
+        AnalogCarrier(const CarrierConfig& cfg, double samplerate) {
+            am = (cfg.type == CARRIER_AM);
+            depth = std::clamp<double>(cfg.param / 100.0, 0.0, 1.0);
+            amp = dbToAmplitude(cfg.level);
+            toneDelta = dsp::math::hzToRads(cfg.rate, samplerate);
+            mod.init(NULL, cfg.param, samplerate);
+            mod.out.free();
+            xlator.init(NULL, cfg.offset, samplerate);
+            xlator.out.free();
+            audio.resize(SYNTHETIC_MAX_BLOCK);
+            buf.resize(SYNTHETIC_MAX_BLOCK);
+        }
+
+        void generate(dsp::complex_t* out, int count) {
+            for (int i = 0; i < count; i++) {
+                audio[i] = sinf(tonePhase);
+                tonePhase = dsp::math::normalizePhase(tonePhase + toneDelta);
+            }
+
+            if (am) {
+                for (int i = 0; i < count; i++) {
+                    buf[i] = { amp * (1.0f + depth * audio[i]), 0.0f };
+                }
+            }
+            else {
+                mod.process(count, audio.data(), buf.data());
+                for (int i = 0; i < count; i++) { buf[i] = buf[i] * amp; }
+            }
+
+            xlator.process(count, buf.data(), buf.data());
+            for (int i = 0; i < count; i++) { out[i] += buf[i]; }
+        }
+
+    private:
+        bool am;
+        float depth;
+        float amp;
+        float tonePhase = 0;
+        float toneDelta;
+        dsp::mod::Quadrature mod;
+        dsp::channel::FrequencyXlator xlator;
+        std::vector<float> audio;
+        std::vector<dsp::complex_t> buf;
+    };
+
+    // Random symbols, PSK through the RRC interpolator or GFSK through the GFSK modulator.
+    // The symbol rate is rounded to an integer number of samples per symbol to keep the resampler small.
+    class DigitalCarrier : public Carrier {
+    public:
+        DigitalCarrier(const CarrierConfig& cfg, double samplerate, uint32_t seed) : rng(seed) {
+            gfsk = (cfg.type == CARRIER_GFSK);
+            amp = dbToAmplitude(cfg.level);
+            sps = std::max<int>(2, round(samplerate / std::max<int>(cfg.rate, 1)));
+            double symbolrate = samplerate / (double)sps;
+
+            // Only the ratio matters to the modulators, normalizing to one symbol per second keeps the rates integer
+            if (gfsk) {
+                gfskMod.init(NULL, 1.0, sps, 0.5, 31, (double)cfg.param / symbolrate);
+                gfskMod.out.free();
+            }
+            else {
+                order = std::clamp<int>(cfg.param, 2, 16);
+                pskMod.init(NULL, 1.0, sps, 0.35, 31);
+                pskMod.out.free();
+
+                // The RRC taps are scaled down by the samples per symbol, bring the pulses back to unit amplitude
+                amp *= sps;
+            }
+            xlator.init(NULL, cfg.offset, samplerate);
+            xlator.out.free();
+
+            symbolsPerChunk = std::max<int>(1, SYNTHETIC_MAX_BLOCK / sps);
+            fsymbols.resize(symbolsPerChunk);
+            csymbols.resize(symbolsPerChunk);
+            pending.resize((symbolsPerChunk + 1) * sps + SYNTHETIC_MAX_BLOCK);
+        }
+
+        void generate(dsp::complex_t* out, int count) {
+            // Modulate whole chunks of symbols until there's enough, the rest is kept for the next call
+            while (pendingCount < count) {
+                int n = std::min<int>(symbolsPerChunk, (count - pendingCount + sps - 1) / sps);
+                dsp::complex_t* dst = &pending[pendingCount];
+                if (gfsk) {
+                    for (int i = 0; i < n; i++) { fsymbols[i] = (rng() & 1) ? 1.0f : -1.0f; }
+                    pendingCount += gfskMod.process(n, fsymbols.data(), dst);
+                }
+                else {
+                    for (int i = 0; i < n; i++) { csymbols[i] = dsp::math::phasor(2.0f * FL_M_PI * (float)(rng() % order) / (float)order); }
+                    pendingCount += pskMod.process(n, csymbols.data(), dst);
+                }
+            }
+
+            xlator.process(count, pending.data(), pending.data());
+            for (int i = 0; i < count; i++) { out[i] += (pending[i] * amp); }
+            pendingCount -= count;
+            memmove(pending.data(), &pending[count], pendingCount * sizeof(dsp::complex_t));
+        }
+
+    private:
+        bool gfsk;
+        float amp;
+        int sps;
+        int order = 4;
+        int symbolsPerChunk;
+        std::mt19937 rng;
+        dsp::mod::GFSK gfskMod;
+        dsp::mod::PSK pskMod;
+        dsp::channel::FrequencyXlator xlator;
+        std::vector<float> fsymbols;
+        std::vector<dsp::complex_t> csymbols;
+        std::vector<dsp::complex_t> pending;
+        int pendingCount = 0;
+    };
+
+    // Tone going linearly across the span, rate times per second, downwards if the rate is negative
+    class SweepCarrier : public Carrier {
+    public:
+        SweepCarrier(const CarrierConfig& cfg, double samplerate) {
+            amp = dbToAmplitude(cfg.level);
+            startFreq = dsp::math::hzToRads((double)cfg.offset - (double)cfg.param / 2.0, samplerate);
+            span = dsp::math::hzToRads(cfg.param, samplerate);
+            sweepDelta = (double)cfg.rate / samplerate;
+        }
+
+        void generate(dsp::complex_t* out, int count) {
+            for (int i = 0; i < count; i++) {
+                out[i] += (dsp::math::phasor(phase) * amp);
+                phase = dsp::math::normalizePhase(phase + startFreq + span * sweepPos);
+                sweepPos += sweepDelta;
+                if (sweepPos >= 1.0 || sweepPos < 0.0) { sweepPos -= floor(sweepPos); }
+            }
+        }
+
+    private:
+        float amp;
+        double startFreq;
+        double span;
+        double sweepDelta;
+        double sweepPos = 0;
+        float phase = 0;
+    };
+
+    // Tone keyed on and off, the spacing of the bursts is jittered randomly by up to a quarter of the period
+    class BurstCarrier : public Carrier {
+    public:
+        BurstCarrier(const CarrierConfig& cfg, double samplerate, uint32_t seed) : rng(seed) {
+            amp = dbToAmplitude(cfg.level);
+            delta = dsp::math::hzToRads(cfg.offset, samplerate);
+            period = std::max<int64_t>(2, samplerate / std::max<int>(cfg.rate, 1));
+            length = std::clamp<int64_t>(cfg.param * samplerate / 1000.0, 1, period / 2);
+            nextBurst = rng() % (period / 2 + 1);
+        }
+
+        void generate(dsp::complex_t* out, int count) {
+            for (int i = 0; i < count; i++) {
+                if (pos >= nextBurst && pos < nextBurst + length) {
+                    out[i] += (dsp::math::phasor(phase) * amp);
+                }
+                else if (pos >= nextBurst + length) {
+                    nextBurst += period + (rng() % (period / 2 + 1)) - (period / 4);
+                }
+                phase = dsp::math::normalizePhase(phase + delta);
+                pos++;
+            }
+        }
+
+    private:
+        std::mt19937 rng;
+        float amp;
+        float delta;
+        float phase = 0;
+        int64_t period;
+        int64_t length;
+        int64_t pos = 0;
+        int64_t nextBurst;
+    };
+
+    class Scene {
+    public:
+        Scene(double samplerate, uint32_t seed, float noiseLevel, const std::vector<CarrierConfig>& carriers) : rng(seed) {
+            // Gaussian noise, generated once with Box-Muller and then read from a random place every block
+            noiseAmp = dbToAmplitude(noiseLevel) / sqrtf(2.0f);
+            if (noiseLevel > -200.0f) {
+                noise.resize(SYNTHETIC_NOISE_TABLE_SIZE);
+                for (auto& n : noise) {
+                    double u1 = ((double)rng() + 1.0) / 4294967296.0;
+                    double u2 = (double)rng() / 4294967296.0;
+                    double r = sqrt(-2.0 * log(u1));
+                    n = { (float)(r * cos(2.0 * M_PI * u2)) * noiseAmp, (float)(r * sin(2.0 * M_PI * u2)) * noiseAmp };
+                }
+            }
+
+            // Each carrier gets its own generator so that adding one doesn't change the others
+            for (int i = 0; i < carriers.size(); i++) {
+                const CarrierConfig& cfg = carriers[i];
+                uint32_t carrierSeed = seed + 1000003 * (i + 1);
+                switch (cfg.type) {
+                case CARRIER_AM:
+                case CARRIER_FM:
+                    this->carriers.push_back(std::make_unique<AnalogCarrier>(cfg, samplerate));
+                    break;
+                case CARRIER_PSK:
+                case CARRIER_GFSK:
+                    this->carriers.push_back(std::make_unique<DigitalCarrier>(cfg, samplerate, carrierSeed));
+                    break;
+                case CARRIER_SWEEP:
+                    this->carriers.push_back(std::make_unique<SweepCarrier>(cfg, samplerate));
+                    break;
+                case CARRIER_BURST:
+                    this->carriers.push_back(std::make_unique<BurstCarrier>(cfg, samplerate, carrierSeed));
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+
+        // Generate count samples, count must not be larger than SYNTHETIC_MAX_BLOCK
+        void generate(dsp::complex_t* out, int count) {
+            if (noise.empty()) {
+                memset(out, 0, count * sizeof(dsp::complex_t));
+            }
+            else {
+                int offset = rng() & (SYNTHETIC_NOISE_TABLE_SIZE - 1);
+                for (int i = 0; i < count; i++) {
+                    out[i] = noise[(offset + i) & (SYNTHETIC_NOISE_TABLE_SIZE - 1)];
+                }
+            }
+
+            for (auto& carrier : carriers) {
+                carrier->generate(out, count);
+            }
+        }
+
+    private:
+        std::mt19937 rng;
+        float noiseAmp;
+        std::vector<dsp::complex_t> noise;
+        std::vector<std::unique_ptr<Carrier>> carriers;
+    };
+}
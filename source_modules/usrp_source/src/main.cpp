@@ -39,6 +39,7 @@ public:
         handler.stopHandler = stop;
         handler.tuneHandler = tune;
         handler.stream = &stream;
+        handler.health = &health;
 
         sigpath::sourceManager.registerSource("USRP", &handler);
     }
@@ -293,6 +294,7 @@ private:
         _this->stream.clearWriteStop();
         _this->workerThread = std::thread(&USRPSourceModule::worker, _this);
 
+        _this->health.start(_this->sampleRate);
         _this->running = true;
         flog::info("USRPSourceModule '{0}': Start!", _this->name);
     }
@@ -301,6 +303,7 @@ private:
         USRPSourceModule* _this = (USRPSourceModule*)ctx;
         if (!_this->running) { return; }
         _this->running = false;
+        _this->health.stop();
         
         _this->stream.stopWriter();
         _this->streamer->issue_stream_cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
@@ -452,10 +455,9 @@ private:
             uhd::rx_streamer::buffs_type buffers(ptr, 1);
             int len = streamer->recv(stream.writeBuf, bufferSize, meta, 1.0);
             if (len < 0) { break; }
-            if (len != bufferSize) {
-                printf("%d\n", len);
-            }
+            if (meta.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW) { health.gap(); }
             if (len) {
+                health.delivered(len);
                 if (!stream.swap(len)) { break; }
             }
         }
@@ -466,6 +468,7 @@ private:
     dsp::stream<dsp::complex_t> stream;
     double sampleRate;
     SourceManager::SourceHandler handler;
+    SourceHealth health;
     bool running = false;
     double freq;
     int devId = 0;